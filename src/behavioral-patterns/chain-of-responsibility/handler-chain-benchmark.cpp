@@ -0,0 +1,220 @@
+/**
+* @file handler-chain-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Chain of Responsibility benchmark
+*
+* Sends requests through a chain of handlers of four different classes,
+* each accepting a single request type, with a skewed mix where most
+* requests are meant for the last handlers of the configured chain.
+* Compares the textbook linked list of virtual handlers, scattered over the
+* heap, with the flattened HandlerChain, per request and in batches, before
+* and after reordering.
+*
+* Build:
+* g++ -std=c++20 -O2 handler-chain-benchmark.cpp -o handler-chain-benchmark
+* ./handler-chain-benchmark [handlers] [requests] [rounds]
+*
+*/
+
+#include "handler-chain.h"
+#include "../../benchmark.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+
+struct Request
+{
+    uint32_t m_type;
+    uint32_t m_payload;
+    uint64_t m_result;
+};
+
+
+/**
+ * Textbook handler, a linked list of virtual objects.
+ */
+class Handler
+{
+    public:
+        virtual ~Handler() = default;
+
+        void SetNext(Handler* next)
+        {
+            m_next = next;
+        }
+
+        bool Handle(Request& request)
+        {
+            if (TryHandle(request))
+            {
+                return true;
+            }
+            return m_next != nullptr && m_next->Handle(request);
+        }
+
+    protected:
+        virtual bool TryHandle(Request& request) = 0;
+
+    private:
+        Handler* m_next = nullptr;
+};
+
+/**
+ * Handlers accepting a single request type, four different operations so
+ * the chain is made of several classes as in real code.
+ */
+template <uint32_t Operation>
+uint64_t Apply(uint32_t type, uint32_t payload)
+{
+    switch (Operation)
+    {
+        case 0: return payload * (type + 1);
+        case 1: return payload + type;
+        case 2: return payload ^ (type << 8);
+        default: return static_cast<uint64_t>(payload) << (type & 15);
+    }
+}
+
+template <uint32_t Operation>
+class TypeHandler : public Handler
+{
+    public:
+        explicit TypeHandler(uint32_t type) :
+            m_type(type) {}
+
+    protected:
+        bool TryHandle(Request& request) override
+        {
+            if (request.m_type != m_type)
+            {
+                return false;
+            }
+            request.m_result = Apply<Operation>(m_type, request.m_payload);
+            return true;
+        }
+
+    private:
+        uint32_t m_type;
+};
+
+template <uint32_t Operation>
+std::unique_ptr<Handler> MakeHandler(uint32_t type)
+{
+    return std::make_unique<TypeHandler<Operation> >(type);
+}
+
+template <uint32_t Operation>
+void AddHandler(HandlerChain<Request>& chain, uint32_t type)
+{
+    chain.Add("type " + std::to_string(type), [type](Request& request)
+    {
+        if (request.m_type != type)
+        {
+            return false;
+        }
+        request.m_result = Apply<Operation>(type, request.m_payload);
+        return true;
+    });
+}
+
+
+int main(int argc, char* argv[])
+{
+    const uint32_t handlerCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16;
+    const size_t requestCount = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1 << 16;
+    const size_t rounds = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 200;
+
+    // 80% of the requests go to the last quarter of the handlers
+    std::mt19937 random(42);
+    std::vector<Request> requests(requestCount);
+    for (Request& request : requests)
+    {
+        uint32_t hotFirst = handlerCount - (handlerCount + 3) / 4;
+        request.m_type = (random() % 10 < 8) ? hotFirst + random() % (handlerCount - hotFirst) : random() % handlerCount;
+        request.m_payload = random() & 0xffff;
+    }
+
+    // Linked handlers, interleaved with other allocations as in a long running process
+    std::vector<std::unique_ptr<Handler> > linked;
+    std::vector<std::unique_ptr<char[]> > noise;
+    HandlerChain<Request> chain;
+    for (uint32_t type = 0; type < handlerCount; type++)
+    {
+        switch (type % 4)
+        {
+            case 0: linked.push_back(MakeHandler<0>(type)); AddHandler<0>(chain, type); break;
+            case 1: linked.push_back(MakeHandler<1>(type)); AddHandler<1>(chain, type); break;
+            case 2: linked.push_back(MakeHandler<2>(type)); AddHandler<2>(chain, type); break;
+            default: linked.push_back(MakeHandler<3>(type)); AddHandler<3>(chain, type); break;
+        }
+        noise.push_back(std::make_unique<char[]>(1024 + random() % 4096));
+        if (type > 0)
+        {
+            linked[type - 1]->SetNext(linked[type].get());
+        }
+    }
+    chain.Add("fallback", [](Request&) { return true; }, true);
+
+    const size_t operations = requestCount * rounds;
+    std::cout << "Handlers: " << handlerCount << ", requests: " << requestCount << ", rounds: " << rounds << "\n";
+
+    auto checksum = [&]()
+    {
+        uint64_t sum = 0;
+        for (const Request& request : requests)
+        {
+            sum += request.m_result;
+        }
+        return sum;
+    };
+
+    Measure("  linked virtual   ", operations, [&]()
+    {
+        for (size_t round = 0; round < rounds; round++)
+            for (Request& request : requests)
+                linked.front()->Handle(request);
+        return checksum();
+    }, "request");
+
+    Measure("  flat             ", operations, [&]()
+    {
+        for (size_t round = 0; round < rounds; round++)
+            for (Request& request : requests)
+                chain.Handle(request);
+        return checksum();
+    }, "request");
+
+    Measure("  flat batch       ", operations, [&]()
+    {
+        for (size_t round = 0; round < rounds; round++)
+            chain.Handle(std::span<Request>(requests));
+        return checksum();
+    }, "request");
+
+    chain.ReorderByHits();
+    chain.ResetCounters();
+
+    Measure("  reordered batch  ", operations, [&]()
+    {
+        for (size_t round = 0; round < rounds; round++)
+            chain.Handle(std::span<Request>(requests));
+        return checksum();
+    }, "request");
+
+    std::cout << "\nOrder after reordering:";
+    for (const HandlerChain<Request>::HandlerInfo& info : chain.Handlers())
+    {
+        std::cout << " " << info.m_name << (info.m_pinned ? " (pinned)" : "") << ",";
+    }
+    std::cout << "\n";
+    return 0;
+}
@@ -0,0 +1,329 @@
+/**
+* @file handler-chain.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Chain of Responsibility behavioral pattern
+*
+* The Problem:
+*
+* A request should be handled by the first of several handlers willing to
+* accept it, without the sender knowing which one. The textbook chain is a
+* linked list of handler objects, each holding a pointer to the next one.
+* Every request hops through heap objects scattered in memory, with a
+* dependent load and a virtual call per hop, and the order of the chain is
+* fixed by whoever configured it, not by which handlers are actually hot.
+*
+* Solution:
+*
+* Flatten the configured chain into one contiguous array of entries, each
+* holding a plain function pointer and the handler state. Small, trivially
+* copyable handlers, such as lambdas capturing a few values, are stored
+* inside the entry itself. Walking the chain is a linear scan over a few
+* cache lines, the address of the next handler never depends on a load.
+* Batches are processed handler by handler, which keeps the indirect call
+* target constant and predictable.
+*
+* Handle() stops at the first handler that accepts the request. Every
+* entry counts the requests it accepted, ReorderByHits() moves the hot
+* handlers to the front so that the common requests are decided in the
+* first few entries.
+*
+* Usage:
+*
+* HandlerChain<Request> chain;
+* chain.Add("auth", [](Request& request) { return request.m_type == Type::Auth && ...; });
+* chain.Add("fallback", [](Request& request) { ...; return true; });
+*
+* chain.Handle(request);
+* chain.Handle(std::span<Request>(requests));
+* chain.ReorderByHits();
+*
+* Notes:
+*
+* Reordering changes which handler sees a request first. It is only
+* correct when the handlers accept disjoint sets of requests, handlers
+* marked with pinned = true, typically a catch-all at the end, keep their
+* position.
+*
+*/
+
+#ifndef __HANDLER_CHAIN_H_
+#define __HANDLER_CHAIN_H_
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Flattened handler chain
+ */
+template <class Request>
+class HandlerChain
+{
+
+    public:
+
+        static constexpr size_t NotHandled = std::numeric_limits<size_t>::max();
+
+        /**
+         * Handler statistics
+         */
+        struct HandlerInfo
+        {
+            std::string m_name;
+            uint64_t m_hits;
+            bool m_pinned;
+        };
+
+        HandlerChain() = default;
+
+        ~HandlerChain()
+        {
+            for (Entry& entry : m_entries)
+            {
+                if (entry.m_destroy != nullptr)
+                {
+                    entry.m_destroy(entry.m_state);
+                }
+            }
+        }
+
+        // Entries own their handlers
+        HandlerChain(HandlerChain const&) = delete;
+        HandlerChain& operator=(HandlerChain const&) = delete;
+
+        /**
+         * Append a handler, any callable returning true when it accepted
+         * the request. Handlers are tried in the order they were added.
+         */
+        template <class F>
+        void Add(std::string name, F&& handler, bool pinned = false)
+        {
+            using Callable = std::decay_t<F>;
+
+            Entry entry;
+            if constexpr (sizeof(Callable) <= InlineSize && alignof(Callable) <= alignof(void*)
+                && std::is_trivially_copyable_v<Callable> && std::is_trivially_destructible_v<Callable>)
+            {
+                new (entry.m_state) Callable(std::forward<F>(handler));
+                entry.m_handle = [](void* state, Request& request) -> bool
+                {
+                    return (*std::launder(reinterpret_cast<Callable*>(state)))(request);
+                };
+            }
+            else
+            {
+                *reinterpret_cast<Callable**>(entry.m_state) = new Callable(std::forward<F>(handler));
+                entry.m_handle = [](void* state, Request& request) -> bool
+                {
+                    return (**reinterpret_cast<Callable**>(state))(request);
+                };
+                entry.m_destroy = [](void* state)
+                {
+                    delete *reinterpret_cast<Callable**>(state);
+                };
+            }
+
+            m_entries.push_back(entry);
+            m_info.push_back(Info{std::move(name), pinned});
+        }
+
+        /**
+         * Pass the request along the chain.
+         * Returns the position of the handler that accepted it or NotHandled.
+         */
+        size_t Handle(Request& request)
+        {
+            Entry* entries = m_entries.data();
+            const size_t count = m_entries.size();
+
+            for (size_t i = 0; i < count; i++)
+            {
+                if (entries[i].m_handle(entries[i].m_state, request))
+                {
+                    entries[i].m_hits++;
+                    return i;
+                }
+            }
+
+            m_unhandled++;
+            return NotHandled;
+        }
+
+        /**
+         * Pass a batch of requests along the chain.
+         * The batch is processed handler by handler, each handler is
+         * offered all requests still unhandled, so the indirect call in the
+         * inner loop always has the same target. Every request still meets
+         * the handlers in chain order, but handlers see the requests of the
+         * batch interleaved differently than with one Handle() per request.
+         * Returns the number of requests some handler accepted.
+         */
+        size_t Handle(std::span<Request> requests)
+        {
+            size_t handled = 0;
+
+            // Blocks small enough to stay in the L1 cache across all handlers
+            for (size_t begin = 0; begin < requests.size(); begin += BlockSize)
+            {
+                handled += HandleBlock(requests.subspan(begin, std::min(BlockSize, requests.size() - begin)));
+            }
+
+            m_unhandled += requests.size() - handled;
+            return handled;
+        }
+
+        /**
+         * Move the handlers with the most hits to the front.
+         * Pinned handlers keep their positions, the others are stably
+         * sorted by their hit counters within the slots between them.
+         */
+        void ReorderByHits()
+        {
+            std::vector<size_t> order(m_entries.size());
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                order[i] = i;
+            }
+
+            // Sort each run of unpinned handlers separately
+            size_t begin = 0;
+            while (begin < order.size())
+            {
+                if (m_info[begin].m_pinned)
+                {
+                    begin++;
+                    continue;
+                }
+
+                size_t end = begin;
+                while (end < order.size() && !m_info[end].m_pinned)
+                {
+                    end++;
+                }
+
+                std::stable_sort(order.begin() + begin, order.begin() + end, [this](size_t a, size_t b)
+                {
+                    return m_entries[a].m_hits > m_entries[b].m_hits;
+                });
+                begin = end;
+            }
+
+            std::vector<Entry> entries;
+            std::vector<Info> info;
+            entries.reserve(order.size());
+            info.reserve(order.size());
+            for (size_t index : order)
+            {
+                entries.push_back(m_entries[index]);
+                info.push_back(std::move(m_info[index]));
+            }
+            m_entries.swap(entries);
+            m_info.swap(info);
+        }
+
+        void ResetCounters()
+        {
+            for (Entry& entry : m_entries)
+            {
+                entry.m_hits = 0;
+            }
+            m_unhandled = 0;
+        }
+
+        // Handlers in their current order
+        std::vector<HandlerInfo> Handlers() const
+        {
+            std::vector<HandlerInfo> handlers;
+            handlers.reserve(m_entries.size());
+            for (size_t i = 0; i < m_entries.size(); i++)
+            {
+                handlers.push_back(HandlerInfo{m_info[i].m_name, m_entries[i].m_hits, m_info[i].m_pinned});
+            }
+            return handlers;
+        }
+
+        uint64_t UnhandledCount() const
+        {
+            return m_unhandled;
+        }
+
+        size_t Size() const
+        {
+            return m_entries.size();
+        }
+
+    private:
+
+        static constexpr size_t InlineSize = 16;
+        static constexpr size_t BlockSize = 256;
+
+        /**
+         * Hot part of a handler, trivially copyable and 40 bytes.
+         */
+        struct Entry
+        {
+            bool (*m_handle)(void*, Request&) = nullptr;
+            alignas(void*) unsigned char m_state[InlineSize];
+            uint64_t m_hits = 0;
+            void (*m_destroy)(void*) = nullptr;
+        };
+
+        /**
+         * Cold part, only used for configuration and reporting.
+         */
+        struct Info
+        {
+            std::string m_name;
+            bool m_pinned;
+        };
+
+        size_t HandleBlock(std::span<Request> requests)
+        {
+            uint32_t pendingIndices[BlockSize];
+            for (size_t i = 0; i < requests.size(); i++)
+            {
+                pendingIndices[i] = static_cast<uint32_t>(i);
+            }
+
+            size_t pending = requests.size();
+            for (Entry& entry : m_entries)
+            {
+                if (pending == 0)
+                {
+                    break;
+                }
+
+                // Compact the requests the handler declined to the front
+                size_t declined = 0;
+                for (size_t i = 0; i < pending; i++)
+                {
+                    uint32_t index = pendingIndices[i];
+                    pendingIndices[declined] = index;
+                    declined += !entry.m_handle(entry.m_state, requests[index]);
+                }
+
+                entry.m_hits += pending - declined;
+                pending = declined;
+            }
+
+            return requests.size() - pending;
+        }
+
+        std::vector<Entry> m_entries;
+        std::vector<Info> m_info;
+        uint64_t m_unhandled = 0;
+};
+
+
+#endif //__HANDLER_CHAIN_H_
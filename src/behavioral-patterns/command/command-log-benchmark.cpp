@@ -0,0 +1,226 @@
+/**
+* @file command-log-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Command log benchmark
+*
+* Executes and undoes a stream of account commands, once as heap allocated
+* polymorphic command objects and once appended to a CommandLog, then saves
+* the log, maps it back and replays it into fresh accounts which must end
+* in the same state. Finally replays damaged logs, a type id beyond the
+* registry, a payload size not matching its type and a truncated record,
+* each must be rejected before any handler reads the payload.
+*
+* Build:
+* g++ -std=c++20 -O2 command-log-benchmark.cpp -o command-log-benchmark
+* ./command-log-benchmark [commands] [path]
+*
+*/
+
+#include "command-log.h"
+#include "../../benchmark.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+struct Accounts
+{
+    std::vector<int64_t> m_balances = std::vector<int64_t>(1024, 0);
+
+    int64_t Checksum() const
+    {
+        int64_t checksum = 0;
+        for (size_t i = 0; i < m_balances.size(); i++)
+        {
+            checksum += m_balances[i] * static_cast<int64_t>(i + 1);
+        }
+        return checksum;
+    }
+};
+
+struct Deposit
+{
+    static const uint16_t Id = 1;
+    uint32_t m_account;
+    int64_t m_amount;
+    void Execute(Accounts& accounts) const { accounts.m_balances[m_account] += m_amount; }
+    void Undo(Accounts& accounts) const { accounts.m_balances[m_account] -= m_amount; }
+};
+
+struct Transfer
+{
+    static const uint16_t Id = 2;
+    uint32_t m_from;
+    uint32_t m_to;
+    int64_t m_amount;
+    void Execute(Accounts& accounts) const { accounts.m_balances[m_from] -= m_amount; accounts.m_balances[m_to] += m_amount; }
+    void Undo(Accounts& accounts) const { accounts.m_balances[m_from] += m_amount; accounts.m_balances[m_to] -= m_amount; }
+};
+
+
+/**
+ * Classic command objects
+ */
+class AccountCommand
+{
+    public:
+        virtual ~AccountCommand() = default;
+        virtual void Execute(Accounts& accounts) const = 0;
+        virtual void Undo(Accounts& accounts) const = 0;
+};
+
+template <class Command>
+class HeapCommand : public AccountCommand
+{
+    public:
+        explicit HeapCommand(const Command& command) :
+            m_command(command) {}
+
+        void Execute(Accounts& accounts) const override
+        {
+            m_command.Execute(accounts);
+        }
+
+        void Undo(Accounts& accounts) const override
+        {
+            m_command.Undo(accounts);
+        }
+
+    private:
+        Command m_command;
+};
+
+
+/**
+ * Replay raw records, true if the registry rejected them.
+ */
+bool Rejected(const std::string& name, const CommandRegistry<Accounts>& registry, const std::vector<std::byte>& bytes)
+{
+    Accounts accounts;
+    try
+    {
+        CommandLogView(bytes.data(), bytes.size()).Replay(registry, accounts);
+    }
+    catch (const std::runtime_error& error)
+    {
+        std::cout << "  " << name << ": rejected, " << error.what() << "\n";
+        return true;
+    }
+    std::cout << "  " << name << ": accepted\n";
+    return false;
+}
+
+std::vector<std::byte> Record(uint16_t type, uint32_t size, size_t bytes)
+{
+    std::vector<std::byte> record(sizeof(CommandRecordHeader) + bytes);
+    CommandRecordHeader header{type, 0, size};
+    std::memcpy(record.data(), &header, sizeof(header));
+    return record;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 20;
+    const std::string path = argc > 2 ? argv[2] : "/tmp/command-log-benchmark.log";
+    std::cout << "Commands: " << count << "\n";
+
+    std::mt19937 random(42);
+    std::vector<Deposit> deposits(count);
+    std::vector<Transfer> transfers(count);
+    std::vector<bool> isTransfer(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        isTransfer[i] = random() % 2 == 0;
+        deposits[i] = {static_cast<uint32_t>(random() % 1024), static_cast<int64_t>(random() % 1000)};
+        transfers[i] = {static_cast<uint32_t>(random() % 1024), static_cast<uint32_t>(random() % 1024), static_cast<int64_t>(random() % 1000)};
+    }
+
+    Accounts heapAccounts;
+    std::vector<std::unique_ptr<AccountCommand> > heap;
+    Measure("  heap objects, create and execute ", count, [&]()
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (isTransfer[i])
+            {
+                heap.push_back(std::make_unique<HeapCommand<Transfer> >(transfers[i]));
+            }
+            else
+            {
+                heap.push_back(std::make_unique<HeapCommand<Deposit> >(deposits[i]));
+            }
+            heap.back()->Execute(heapAccounts);
+        }
+        return heapAccounts.Checksum();
+    }, "command");
+
+    CommandRegistry<Accounts> registry;
+    registry.Register<Deposit>();
+    registry.Register<Transfer>();
+    Accounts logAccounts;
+    CommandLog log;
+    Measure("  command log, append and execute  ", count, [&]()
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (isTransfer[i])
+            {
+                log.Append(transfers[i]);
+            }
+            else
+            {
+                log.Append(deposits[i]);
+            }
+        }
+        log.ExecutePending(registry, logAccounts);
+        return logAccounts.Checksum();
+    }, "command");
+
+    Measure("  heap objects, undo half          ", count / 2, [&]()
+    {
+        for (size_t i = 0; i < count / 2; i++)
+        {
+            heap[count - 1 - i]->Undo(heapAccounts);
+        }
+        heap.resize(count - count / 2);
+        return heapAccounts.Checksum();
+    }, "command");
+    Measure("  command log, undo half           ", count / 2, [&]()
+    {
+        log.Undo(registry, logAccounts, count / 2);
+        return logAccounts.Checksum();
+    }, "command");
+
+    log.Save(path);
+    Accounts replayed;
+    Measure("  map and replay                   ", log.ExecutedCount(), [&]()
+    {
+        MappedCommandLog mapped(path);
+        mapped.View().Replay(registry, replayed);
+        return replayed.Checksum();
+    }, "command");
+    const bool same = replayed.Checksum() == logAccounts.Checksum() && logAccounts.Checksum() == heapAccounts.Checksum();
+    std::cout << "  replayed state matches: " << (same ? "yes" : "no") << ", log " << log.ByteSize() / (1 << 20) << " MB\n";
+    std::remove(path.c_str());
+
+    // Damaged logs
+    bool rejected = true;
+    rejected = Rejected("type beyond the registry", registry, Record(1000, 16, 16)) && rejected;
+    rejected = Rejected("unregistered type       ", registry, Record(7, 16, 16)) && rejected;
+    rejected = Rejected("payload size too small  ", registry, Record(Transfer::Id, 4, 8)) && rejected;
+    std::vector<std::byte> truncated = Record(Deposit::Id, sizeof(Deposit), sizeof(Deposit));
+    truncated.resize(truncated.size() - 4);
+    rejected = Rejected("truncated payload       ", registry, truncated) && rejected;
+    return same && rejected ? 0 : 1;
+}
@@ -0,0 +1,512 @@
+/**
+* @file command-log.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Command behavioral pattern with a replayable command log
+*
+* The Problem:
+*
+* The Command pattern turns a request into an object, so it can be queued,
+* logged, undone and replayed. The usual implementation allocates every
+* command on the heap as a polymorphic object, each one costs an allocation
+* and a virtual call, the objects are scattered in memory and they cannot be
+* written to disk without a separate serialisation layer.
+*
+* Solution:
+*
+* Commands are small trivially copyable records with a numeric type id.
+* They are appended one after another to a contiguous byte buffer, each
+* preceded by a small header. Execution walks the buffer and dispatches on
+* the type id through a jump table of function pointers registered once per
+* command type, so there is no per-object vtable and no allocation.
+*
+* Because the records are plain bytes the whole log can be written to a file
+* as is and mapped back into memory with mmap for replay, without parsing
+* or copying.
+*
+* Usage:
+*
+* struct Deposit
+* {
+*     static const uint16_t Id = 1;
+*     int64_t m_amount;
+*     void Execute(Account& account) const { account.m_balance += m_amount; }
+*     void Undo(Account& account) const { account.m_balance -= m_amount; }
+* };
+*
+* CommandRegistry<Account> registry;
+* registry.Register<Deposit>();
+*
+* CommandLog log;
+* log.Append(Deposit{100});
+* log.ExecutePending(registry, account);
+* log.Undo(registry, account, 1);
+* log.Save("account.log");
+*
+* MappedCommandLog mapped("account.log");
+* mapped.View().Replay(registry, fresh);
+*
+* Notes:
+*
+* The file stores records in host byte order and is meant to be replayed on
+* the machine architecture which wrote it. MappedCommandLog uses POSIX mmap.
+* Records of an unknown type or with a payload size not matching their type
+* throw std::runtime_error instead of being executed.
+*
+*/
+
+#ifndef __COMMAND_LOG_H_
+#define __COMMAND_LOG_H_
+
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/**
+ * Header preceding every record in the log.
+ * Payloads start at an 8 byte boundary.
+ */
+struct CommandRecordHeader
+{
+    uint16_t m_type;
+    uint16_t m_reserved;
+    // Payload size in bytes, without padding
+    uint32_t m_size;
+};
+
+static_assert(sizeof(CommandRecordHeader) == 8, "Record header must be 8 bytes");
+
+/**
+ * Header at the start of a saved log file.
+ */
+struct CommandFileHeader
+{
+    char m_magic[4];
+    uint32_t m_version;
+    uint64_t m_recordCount;
+    uint64_t m_byteSize;
+};
+
+// Round up to the record alignment
+inline size_t CommandRecordAlign(size_t size)
+{
+    return (size + 7) & ~size_t(7);
+}
+
+
+/**
+ * Command Registry
+ * Jump table from command type id to its execute and undo functions.
+ */
+template <class Receiver>
+class CommandRegistry
+{
+
+    public:
+
+        using Handler = void (*)(Receiver&, const void*);
+
+        // Largest type id plus one
+        static const size_t MaxTypes = 256;
+
+        CommandRegistry()
+        {
+            m_execute.fill(nullptr);
+            m_undo.fill(nullptr);
+            m_sizes.fill(0);
+        }
+
+        /**
+         * Register a command type.
+         * The type must be trivially copyable and provide a static Id,
+         * Execute(Receiver&) const and optionally Undo(Receiver&) const.
+         */
+        template <class Command>
+        void Register()
+        {
+            static_assert(std::is_trivially_copyable_v<Command>, "Commands must be trivially copyable");
+            static_assert(Command::Id < MaxTypes, "Command id out of range");
+
+            m_sizes[Command::Id] = sizeof(Command);
+            m_execute[Command::Id] = [](Receiver& receiver, const void* payload)
+            {
+                Command command;
+                std::memcpy(&command, payload, sizeof(Command));
+                command.Execute(receiver);
+            };
+
+            if constexpr (HasUndo<Command>::value)
+            {
+                m_undo[Command::Id] = [](Receiver& receiver, const void* payload)
+                {
+                    Command command;
+                    std::memcpy(&command, payload, sizeof(Command));
+                    command.Undo(receiver);
+                };
+            }
+        }
+
+        /**
+         * Run the record, its type and payload size are checked first as a
+         * log read from a file cannot be trusted.
+         */
+        void Execute(Receiver& receiver, const CommandRecordHeader& header, const void* payload) const
+        {
+            Handler handler = Lookup(m_execute, header);
+            if (handler == nullptr)
+            {
+                throw std::runtime_error("Unregistered command type " + std::to_string(header.m_type));
+            }
+            handler(receiver, payload);
+        }
+
+        void Undo(Receiver& receiver, const CommandRecordHeader& header, const void* payload) const
+        {
+            Handler handler = Lookup(m_undo, header);
+            if (handler == nullptr)
+            {
+                throw std::runtime_error("Command type " + std::to_string(header.m_type) + " cannot be undone");
+            }
+            handler(receiver, payload);
+        }
+
+    private:
+
+        template <class Command, class = void>
+        struct HasUndo : std::false_type {};
+
+        template <class Command>
+        struct HasUndo<Command, std::void_t<decltype(std::declval<const Command&>().Undo(std::declval<Receiver&>()))> >
+            : std::true_type {};
+
+        Handler Lookup(const std::array<Handler, MaxTypes>& table, const CommandRecordHeader& header) const
+        {
+            if (header.m_type >= MaxTypes || m_execute[header.m_type] == nullptr)
+            {
+                throw std::runtime_error("Unregistered command type " + std::to_string(header.m_type));
+            }
+            if (header.m_size != m_sizes[header.m_type])
+            {
+                throw std::runtime_error("Command type " + std::to_string(header.m_type) + " has payload size "
+                    + std::to_string(header.m_size) + ", expected " + std::to_string(m_sizes[header.m_type]));
+            }
+            return table[header.m_type];
+        }
+
+        std::array<Handler, MaxTypes> m_execute;
+        std::array<Handler, MaxTypes> m_undo;
+
+        // Payload size of every registered type
+        std::array<uint32_t, MaxTypes> m_sizes;
+};
+
+
+/**
+ * Read-only view over encoded records, owned by a CommandLog or a mapped file.
+ */
+class CommandLogView
+{
+
+    public:
+
+        CommandLogView(const std::byte* data, size_t size) :
+            m_data(data), m_size(size) {}
+
+        /**
+         * Call func(header, payload) for every record in order.
+         */
+        template <class F>
+        void ForEach(F&& func) const
+        {
+            size_t offset = 0;
+            while (offset < m_size)
+            {
+                if (m_size - offset < sizeof(CommandRecordHeader))
+                {
+                    throw std::runtime_error("Truncated command record");
+                }
+
+                CommandRecordHeader header;
+                std::memcpy(&header, m_data + offset, sizeof(header));
+                offset += sizeof(header);
+
+                if (m_size - offset < header.m_size)
+                {
+                    throw std::runtime_error("Truncated command payload");
+                }
+
+                func(header, m_data + offset);
+                offset += CommandRecordAlign(header.m_size);
+            }
+        }
+
+        /**
+         * Execute all records against the receiver, e.g. to rebuild its state.
+         */
+        template <class Receiver>
+        void Replay(const CommandRegistry<Receiver>& registry, Receiver& receiver) const
+        {
+            ForEach([&](const CommandRecordHeader& header, const std::byte* payload)
+            {
+                registry.Execute(receiver, header, payload);
+            });
+        }
+
+        const std::byte* Data() const
+        {
+            return m_data;
+        }
+
+        size_t Size() const
+        {
+            return m_size;
+        }
+
+    private:
+
+        const std::byte* m_data;
+        size_t m_size;
+};
+
+
+/**
+ * Command Log
+ * Append-only buffer of command records with an execution cursor.
+ * Records before the cursor have been executed, records after it are
+ * either undone or pending. Undo moves the cursor back, Redo forward again,
+ * appending discards the undone records.
+ */
+class CommandLog
+{
+
+    public:
+
+        CommandLog() = default;
+
+        /**
+         * Append a command record, it is not executed yet.
+         */
+        template <class Command>
+        void Append(const Command& command)
+        {
+            static_assert(std::is_trivially_copyable_v<Command>, "Commands must be trivially copyable");
+
+            // Appending after an undo drops the undone records
+            if (m_executed < m_undoneEnd)
+            {
+                m_buffer.resize(m_offsets[m_executed]);
+                m_offsets.resize(m_executed);
+                m_undoneEnd = m_executed;
+            }
+
+            const size_t offset = m_buffer.size();
+            CommandRecordHeader header{Command::Id, 0, static_cast<uint32_t>(sizeof(Command))};
+            m_buffer.resize(offset + sizeof(header) + CommandRecordAlign(sizeof(Command)));
+            std::memcpy(m_buffer.data() + offset, &header, sizeof(header));
+            std::memcpy(m_buffer.data() + offset + sizeof(header), &command, sizeof(Command));
+            m_offsets.push_back(offset);
+        }
+
+        /**
+         * Execute all pending records in one pass.
+         * Returns the number of executed records.
+         */
+        template <class Receiver>
+        size_t ExecutePending(const CommandRegistry<Receiver>& registry, Receiver& receiver)
+        {
+            const size_t first = m_executed;
+            while (m_executed < m_offsets.size())
+            {
+                const std::byte* record = m_buffer.data() + m_offsets[m_executed];
+                CommandRecordHeader header;
+                std::memcpy(&header, record, sizeof(header));
+                registry.Execute(receiver, header, record + sizeof(header));
+                m_executed++;
+            }
+            m_undoneEnd = m_executed;
+            return m_executed - first;
+        }
+
+        /**
+         * Undo up to count executed records, newest first.
+         * Returns the number of undone records.
+         */
+        template <class Receiver>
+        size_t Undo(const CommandRegistry<Receiver>& registry, Receiver& receiver, size_t count)
+        {
+            size_t undone = 0;
+            while (undone < count && m_executed > 0)
+            {
+                const std::byte* record = m_buffer.data() + m_offsets[m_executed - 1];
+                CommandRecordHeader header;
+                std::memcpy(&header, record, sizeof(header));
+                registry.Undo(receiver, header, record + sizeof(header));
+                m_executed--;
+                undone++;
+            }
+            return undone;
+        }
+
+        /**
+         * Execute undone records again, oldest first.
+         */
+        template <class Receiver>
+        size_t Redo(const CommandRegistry<Receiver>& registry, Receiver& receiver, size_t count)
+        {
+            size_t redone = 0;
+            while (redone < count && m_executed < m_undoneEnd)
+            {
+                const std::byte* record = m_buffer.data() + m_offsets[m_executed];
+                CommandRecordHeader header;
+                std::memcpy(&header, record, sizeof(header));
+                registry.Execute(receiver, header, record + sizeof(header));
+                m_executed++;
+                redone++;
+            }
+            return redone;
+        }
+
+        /**
+         * Write the executed records to a file which MappedCommandLog can map.
+         */
+        void Save(const std::string& path) const
+        {
+            const size_t byteSize = (m_executed < m_offsets.size()) ? m_offsets[m_executed] : m_buffer.size();
+
+            CommandFileHeader header{{'C', 'M', 'D', 'L'}, FileVersion, m_executed, byteSize};
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                throw std::runtime_error("Unable to open " + path);
+            }
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(m_buffer.data()), static_cast<std::streamsize>(byteSize));
+            if (!file)
+            {
+                throw std::runtime_error("Unable to write " + path);
+            }
+        }
+
+        // View over all records, executed and pending
+        CommandLogView View() const
+        {
+            return CommandLogView(m_buffer.data(), m_buffer.size());
+        }
+
+        size_t RecordCount() const
+        {
+            return m_offsets.size();
+        }
+
+        size_t ExecutedCount() const
+        {
+            return m_executed;
+        }
+
+        size_t ByteSize() const
+        {
+            return m_buffer.size();
+        }
+
+        static const uint32_t FileVersion = 1;
+
+    private:
+
+        // Encoded records
+        std::vector<std::byte> m_buffer;
+
+        // Start of every record, allows undo to walk backwards
+        std::vector<size_t> m_offsets;
+
+        // Number of executed records
+        size_t m_executed = 0;
+
+        // End of the records which were executed and then undone
+        size_t m_undoneEnd = 0;
+};
+
+
+/**
+ * Mapped Command Log
+ * Maps a saved log file read-only into memory, RAII over the mapping.
+ */
+class MappedCommandLog
+{
+
+    public:
+
+        explicit MappedCommandLog(const std::string& path)
+        {
+            const int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Unable to open " + path);
+            }
+
+            struct stat info;
+            if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(CommandFileHeader))
+            {
+                close(fd);
+                throw std::runtime_error("Invalid command log " + path);
+            }
+
+            m_size = static_cast<size_t>(info.st_size);
+            m_mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (m_mapping == MAP_FAILED)
+            {
+                throw std::runtime_error("Unable to map " + path);
+            }
+
+            std::memcpy(&m_header, m_mapping, sizeof(m_header));
+            if (std::memcmp(m_header.m_magic, "CMDL", 4) != 0 || m_header.m_version != CommandLog::FileVersion
+                || m_header.m_byteSize > m_size - sizeof(CommandFileHeader))
+            {
+                munmap(m_mapping, m_size);
+                throw std::runtime_error("Invalid command log " + path);
+            }
+        }
+
+        ~MappedCommandLog()
+        {
+            munmap(m_mapping, m_size);
+        }
+
+        // Delete copy constructor and copy-assignment
+        MappedCommandLog(MappedCommandLog const&) = delete;
+        MappedCommandLog& operator=(MappedCommandLog const&) = delete;
+
+        // Records in the file, read directly from the mapping
+        CommandLogView View() const
+        {
+            return CommandLogView(static_cast<const std::byte*>(m_mapping) + sizeof(CommandFileHeader), m_header.m_byteSize);
+        }
+
+        uint64_t RecordCount() const
+        {
+            return m_header.m_recordCount;
+        }
+
+    private:
+
+        void* m_mapping = nullptr;
+        size_t m_size = 0;
+        CommandFileHeader m_header;
+};
+
+
+#endif //__COMMAND_LOG_H_
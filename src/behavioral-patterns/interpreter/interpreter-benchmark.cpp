@@ -0,0 +1,112 @@
+/**
+* @file interpreter-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Interpreter benchmark
+*
+* Evaluates a rule expression over many rows of input three ways, walking
+* the expression tree, running the compiled bytecode row by row and
+* running it in batch mode over columns, and checks all three agree.
+*
+* Build:
+* g++ -std=c++20 -O3 -march=native interpreter-benchmark.cpp -o interpreter-benchmark
+* g++ -std=c++20 -O3 -march=native -DINTERPRETER_NO_COMPUTED_GOTO interpreter-benchmark.cpp -o interpreter-benchmark-switch
+* ./interpreter-benchmark [rows] [rounds]
+*
+*/
+
+#include "interpreter.h"
+#include "../../benchmark.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+int main(int argc, char* argv[])
+{
+    const size_t rows = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 20;
+    const size_t rounds = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10;
+
+    using namespace ExpressionBuilder;
+
+    // Variables: 0 price, 1 quantity, 2 region, 3 discount
+    // select(price * quantity * (1 - discount) > 100 * 2.5 && region != 3,
+    //        max(price * quantity - 10 / 4, 0), min(price, 50) + quantity)
+    ExpressionPtr rule = Select(
+        And(Greater(Multiply(Multiply(Variable(0), Variable(1)), Subtract(Constant(1), Variable(3))),
+                    Multiply(Constant(100), Constant(2.5))),
+            NotEqual(Variable(2), Constant(3))),
+        Max(Subtract(Multiply(Variable(0), Variable(1)), Divide(Constant(10), Constant(4))), Constant(0)),
+        Add(Min(Variable(0), Constant(50)), Variable(1)));
+
+    BytecodeProgram program = CompileExpression(*rule);
+
+    std::cout << "Rows: " << rows << ", rounds: " << rounds
+              << ", instructions: " << program.InstructionCount()
+              << ", registers: " << program.RegisterCount()
+              << ", dispatch: " << (INTERPRETER_COMPUTED_GOTO ? "computed goto" : "switch") << "\n";
+
+    // Row and column layouts of the same input
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> price(1.0, 100.0);
+    std::vector<double> rowData(rows * 4);
+    std::vector<double> columns[4];
+    for (std::vector<double>& column : columns)
+    {
+        column.resize(rows);
+    }
+    for (size_t row = 0; row < rows; row++)
+    {
+        double values[4] = {price(random), double(random() % 20), double(random() % 5), (random() % 30) / 100.0};
+        for (size_t i = 0; i < 4; i++)
+        {
+            rowData[row * 4 + i] = values[i];
+            columns[i][row] = values[i];
+        }
+    }
+    const double* columnPointers[4] = {columns[0].data(), columns[1].data(), columns[2].data(), columns[3].data()};
+
+    std::vector<double> treeResults(rows), bytecodeResults(rows), batchResults(rows);
+
+    Measure("  tree walk ", rows * rounds, [&]()
+    {
+        double sum = 0;
+        for (size_t round = 0; round < rounds; round++)
+            for (size_t row = 0; row < rows; row++)
+                sum += treeResults[row] = rule->Interpret(&rowData[row * 4]);
+        return sum;
+    }, "row");
+
+    Measure("  bytecode  ", rows * rounds, [&]()
+    {
+        double sum = 0;
+        for (size_t round = 0; round < rounds; round++)
+            for (size_t row = 0; row < rows; row++)
+                sum += bytecodeResults[row] = program.Evaluate(&rowData[row * 4]);
+        return sum;
+    }, "row");
+
+    Measure("  batch     ", rows * rounds, [&]()
+    {
+        double sum = 0;
+        for (size_t round = 0; round < rounds; round++)
+        {
+            program.EvaluateBatch(columnPointers, rows, batchResults.data());
+            sum += batchResults[round % rows];
+        }
+        return sum;
+    }, "row");
+
+    size_t mismatches = 0;
+    for (size_t row = 0; row < rows; row++)
+    {
+        mismatches += treeResults[row] != bytecodeResults[row] || treeResults[row] != batchResults[row];
+    }
+    std::cout << "Mismatches: " << mismatches << "\n";
+    return mismatches == 0 ? 0 : 1;
+}
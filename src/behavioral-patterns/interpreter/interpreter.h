@@ -0,0 +1,724 @@
+/**
+* @file interpreter.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Interpreter behavioral pattern, compiled to bytecode
+*
+* The Problem:
+*
+* The Interpreter pattern represents a sentence of a small language as a
+* tree of expression objects, each node interprets itself by recursively
+* interpreting its children. Evaluating a rule this way costs a virtual
+* call and a pointer chase per node, on every evaluation, and the tree is
+* scattered across the heap.
+*
+* Solution:
+*
+* Keep the expression tree as the representation built by the parser and
+* used for diagnostics, but compile it once into bytecode for a register
+* machine:
+*
+*   * Constant folding - subtrees without variables are evaluated at
+*     compile time, the bytecode only contains work depending on input.
+*
+*   * Register bytecode - every instruction names its operand registers
+*     directly, there is no operand stack to push to and pop from. The
+*     program is a contiguous array of 8-byte instructions.
+*
+*   * Computed goto - the virtual machine jumps straight from one handler
+*     to the next through a table of label addresses, giving each handler
+*     its own indirect branch for the predictor. Compilers without the
+*     labels-as-values extension, or with INTERPRETER_NO_COMPUTED_GOTO
+*     defined, use a switch.
+*
+*   * Batch mode - EvaluateBatch() runs a program over columns of input,
+*     one instruction at a time over a block of rows. The dispatch cost is
+*     paid once per block and every handler is a simple loop over arrays,
+*     which the compiler vectorizes.
+*
+* Usage:
+*
+* using namespace ExpressionBuilder;
+*
+* // price * quantity > 100 && region == 3
+* ExpressionPtr rule = And(Greater(Multiply(Variable(0), Variable(1)), Constant(100)),
+*                          Equal(Variable(2), Constant(3)));
+*
+* double slow = rule->Interpret(variables);
+* BytecodeProgram program = CompileExpression(*rule);
+* double fast = program.Evaluate(variables);
+*
+* Notes:
+*
+* All values are doubles, comparisons and logical operators yield 1 or 0.
+* Both operands of And and Or are always evaluated, expressions have no
+* side effects.
+*
+*/
+
+#ifndef __INTERPRETER_H_
+#define __INTERPRETER_H_
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(INTERPRETER_NO_COMPUTED_GOTO)
+#define INTERPRETER_COMPUTED_GOTO 1
+#else
+#define INTERPRETER_COMPUTED_GOTO 0
+#endif
+
+// Tells the vectorizer that a loop carries no dependency between iterations
+#if defined(__clang__)
+#define INTERPRETER_NO_LOOP_DEPENDENCY _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define INTERPRETER_NO_LOOP_DEPENDENCY _Pragma("GCC ivdep")
+#else
+#define INTERPRETER_NO_LOOP_DEPENDENCY
+#endif
+
+
+/**
+ * Instruction set of the register machine
+ */
+enum class Opcode : uint8_t
+{
+    LoadConstant,   // r[dst] = constants[index]
+    LoadVariable,   // r[dst] = variables[index]
+    Add,            // r[dst] = r[a] + r[b]
+    Subtract,
+    Multiply,
+    Divide,
+    Minimum,
+    Maximum,
+    Less,           // r[dst] = r[a] < r[b] ? 1 : 0
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Equal,
+    NotEqual,
+    And,            // r[dst] = r[a] != 0 && r[b] != 0 ? 1 : 0
+    Or,
+    Negate,         // r[dst] = -r[a]
+    Not,            // r[dst] = r[a] == 0 ? 1 : 0
+    Select,         // r[dst] = r[a] != 0 ? r[b] : r[c]
+    Return,         // result = r[a]
+    Count
+};
+
+/**
+ * 8-byte instruction, constant and variable indices are held in m_index.
+ */
+struct Instruction
+{
+    Opcode m_opcode;
+    uint8_t m_dst;
+    uint8_t m_a;
+    uint8_t m_b;
+    uint8_t m_c;
+    uint8_t m_reserved;
+    uint16_t m_index;
+};
+
+static_assert(sizeof(Instruction) == 8, "Instructions must stay 8 bytes");
+
+
+inline double ApplyBinary(Opcode opcode, double a, double b)
+{
+    switch (opcode)
+    {
+        case Opcode::Add: return a + b;
+        case Opcode::Subtract: return a - b;
+        case Opcode::Multiply: return a * b;
+        case Opcode::Divide: return a / b;
+        case Opcode::Minimum: return std::min(a, b);
+        case Opcode::Maximum: return std::max(a, b);
+        case Opcode::Less: return a < b ? 1.0 : 0.0;
+        case Opcode::LessEqual: return a <= b ? 1.0 : 0.0;
+        case Opcode::Greater: return a > b ? 1.0 : 0.0;
+        case Opcode::GreaterEqual: return a >= b ? 1.0 : 0.0;
+        case Opcode::Equal: return a == b ? 1.0 : 0.0;
+        case Opcode::NotEqual: return a != b ? 1.0 : 0.0;
+        case Opcode::And: return (a != 0.0 && b != 0.0) ? 1.0 : 0.0;
+        case Opcode::Or: return (a != 0.0 || b != 0.0) ? 1.0 : 0.0;
+        default: throw std::invalid_argument("Not a binary opcode");
+    }
+}
+
+inline double ApplyUnary(Opcode opcode, double a)
+{
+    switch (opcode)
+    {
+        case Opcode::Negate: return -a;
+        case Opcode::Not: return a == 0.0 ? 1.0 : 0.0;
+        default: throw std::invalid_argument("Not a unary opcode");
+    }
+}
+
+
+class BytecodeProgram;
+class ExpressionCompiler;
+
+
+/**
+ * Abstract expression
+ * The classic interpreter, every node evaluates itself recursively.
+ */
+class Expression
+{
+    public:
+        virtual ~Expression() = default;
+
+        virtual double Interpret(const double* variables) const = 0;
+
+    protected:
+        friend class ExpressionCompiler;
+
+        /**
+         * Result of compiling a subtree, a constant if it could be folded,
+         * otherwise the register holding its value.
+         */
+        struct Operand
+        {
+            bool m_constant;
+            double m_value;
+            uint8_t m_register;
+        };
+
+        virtual Operand Compile(ExpressionCompiler& compiler) const = 0;
+};
+
+using ExpressionPtr = std::unique_ptr<Expression>;
+
+
+/**
+ * Builds the bytecode, hands out registers in stack order.
+ */
+class ExpressionCompiler
+{
+    public:
+
+        using Operand = Expression::Operand;
+
+        static const size_t MaxRegisters = 256;
+
+        Operand Compile(const Expression& expression)
+        {
+            return expression.Compile(*this);
+        }
+
+        static Operand Folded(double value)
+        {
+            return Operand{true, value, 0};
+        }
+
+        // Place an operand in a register, emitting a constant load if needed
+        uint8_t Materialize(const Operand& operand)
+        {
+            if (!operand.m_constant)
+            {
+                return operand.m_register;
+            }
+
+            uint8_t dst = Acquire();
+            Emit(Instruction{Opcode::LoadConstant, dst, 0, 0, 0, 0, AddConstant(operand.m_value)});
+            return dst;
+        }
+
+        Operand LoadVariable(uint16_t index)
+        {
+            uint8_t dst = Acquire();
+            Emit(Instruction{Opcode::LoadVariable, dst, 0, 0, 0, 0, index});
+            m_variableCount = std::max<size_t>(m_variableCount, size_t(index) + 1);
+            return Operand{false, 0.0, dst};
+        }
+
+        /**
+         * Emit an operation over operands already placed in registers.
+         * The result reuses the lowest operand register.
+         */
+        Operand EmitOperation(Opcode opcode, uint8_t a, uint8_t b = 0, uint8_t c = 0, size_t operandCount = 2)
+        {
+            // The operands are the topmost registers, release from the top
+            uint8_t operands[3] = {a, b, c};
+            for (size_t i = 1; i < operandCount; i++)
+            {
+                for (size_t j = i; j > 0 && operands[j - 1] < operands[j]; j--)
+                {
+                    std::swap(operands[j - 1], operands[j]);
+                }
+            }
+            for (size_t i = 0; i < operandCount; i++)
+            {
+                Release(operands[i]);
+            }
+
+            uint8_t dst = Acquire();
+            Emit(Instruction{opcode, dst, a, b, c, 0, 0});
+            return Operand{false, 0.0, dst};
+        }
+
+        BytecodeProgram Finish(const Operand& result);
+
+    private:
+
+        uint8_t Acquire()
+        {
+            if (m_next >= MaxRegisters)
+            {
+                throw std::length_error("Expression needs too many registers");
+            }
+            m_registerCount = std::max(m_registerCount, m_next + 1);
+            return static_cast<uint8_t>(m_next++);
+        }
+
+        void Release(uint8_t reg)
+        {
+            if (reg + size_t(1) == m_next)
+            {
+                m_next--;
+            }
+        }
+
+        uint16_t AddConstant(double value)
+        {
+            for (size_t i = 0; i < m_constants.size(); i++)
+            {
+                if (m_constants[i] == value && std::signbit(m_constants[i]) == std::signbit(value))
+                {
+                    return static_cast<uint16_t>(i);
+                }
+            }
+            if (m_constants.size() > UINT16_MAX)
+            {
+                throw std::length_error("Too many constants");
+            }
+            m_constants.push_back(value);
+            return static_cast<uint16_t>(m_constants.size() - 1);
+        }
+
+        void Emit(const Instruction& instruction)
+        {
+            m_code.push_back(instruction);
+        }
+
+        std::vector<Instruction> m_code;
+        std::vector<double> m_constants;
+        size_t m_next = 0;
+        size_t m_registerCount = 0;
+        size_t m_variableCount = 0;
+};
+
+
+/**
+ * Compiled expression, immutable and safe to share between threads.
+ */
+class BytecodeProgram
+{
+
+    public:
+
+        // Rows per block in batch mode
+        static constexpr size_t BlockSize = 256;
+
+        /**
+         * Evaluate for a single set of variables.
+         */
+        double Evaluate(const double* variables) const
+        {
+            double registers[ExpressionCompiler::MaxRegisters];
+            const double* constants = m_constants.data();
+            const Instruction* ip = m_code.data();
+
+#if INTERPRETER_COMPUTED_GOTO
+
+            // Labels as values are a GNU extension, keep -Wpedantic builds quiet
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+            // Same order as Opcode
+            static const void* const labels[] =
+            {
+                &&LoadConstant, &&LoadVariable, &&Add, &&Subtract, &&Multiply, &&Divide, &&Minimum, &&Maximum,
+                &&Less, &&LessEqual, &&Greater, &&GreaterEqual, &&Equal, &&NotEqual, &&And, &&Or,
+                &&Negate, &&Not, &&Select, &&Return
+            };
+            static_assert(sizeof(labels) / sizeof(labels[0]) == static_cast<size_t>(Opcode::Count), "Missing label");
+
+#define INTERPRETER_CASE(name) name:
+#define INTERPRETER_NEXT() goto *labels[static_cast<size_t>((++ip)->m_opcode)]
+
+            goto *labels[static_cast<size_t>(ip->m_opcode)];
+#else
+
+#define INTERPRETER_CASE(name) case Opcode::name:
+#define INTERPRETER_NEXT() ip++; continue
+
+            while (true)
+            {
+                switch (ip->m_opcode)
+                {
+#endif
+                    INTERPRETER_CASE(LoadConstant) registers[ip->m_dst] = constants[ip->m_index]; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(LoadVariable) registers[ip->m_dst] = variables[ip->m_index]; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Add) registers[ip->m_dst] = registers[ip->m_a] + registers[ip->m_b]; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Subtract) registers[ip->m_dst] = registers[ip->m_a] - registers[ip->m_b]; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Multiply) registers[ip->m_dst] = registers[ip->m_a] * registers[ip->m_b]; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Divide) registers[ip->m_dst] = registers[ip->m_a] / registers[ip->m_b]; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Minimum) registers[ip->m_dst] = std::min(registers[ip->m_a], registers[ip->m_b]); INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Maximum) registers[ip->m_dst] = std::max(registers[ip->m_a], registers[ip->m_b]); INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Less) registers[ip->m_dst] = registers[ip->m_a] < registers[ip->m_b] ? 1.0 : 0.0; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(LessEqual) registers[ip->m_dst] = registers[ip->m_a] <= registers[ip->m_b] ? 1.0 : 0.0; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Greater) registers[ip->m_dst] = registers[ip->m_a] > registers[ip->m_b] ? 1.0 : 0.0; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(GreaterEqual) registers[ip->m_dst] = registers[ip->m_a] >= registers[ip->m_b] ? 1.0 : 0.0; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Equal) registers[ip->m_dst] = registers[ip->m_a] == registers[ip->m_b] ? 1.0 : 0.0; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(NotEqual) registers[ip->m_dst] = registers[ip->m_a] != registers[ip->m_b] ? 1.0 : 0.0; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(And) registers[ip->m_dst] = (registers[ip->m_a] != 0.0) & (registers[ip->m_b] != 0.0) ? 1.0 : 0.0; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Or) registers[ip->m_dst] = (registers[ip->m_a] != 0.0) | (registers[ip->m_b] != 0.0) ? 1.0 : 0.0; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Negate) registers[ip->m_dst] = -registers[ip->m_a]; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Not) registers[ip->m_dst] = registers[ip->m_a] == 0.0 ? 1.0 : 0.0; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Select) registers[ip->m_dst] = registers[ip->m_a] != 0.0 ? registers[ip->m_b] : registers[ip->m_c]; INTERPRETER_NEXT();
+                    INTERPRETER_CASE(Return) return registers[ip->m_a];
+#if !INTERPRETER_COMPUTED_GOTO
+                    default:
+                        return 0.0;
+                }
+            }
+#endif
+
+#if INTERPRETER_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+#undef INTERPRETER_CASE
+#undef INTERPRETER_NEXT
+        }
+
+        /**
+         * Evaluate over columns of input, out[row] for every row.
+         * columns[i] points to the values of variable i for all rows.
+         */
+        void EvaluateBatch(const double* const* columns, size_t rows, double* out) const
+        {
+            std::vector<double> registers(std::max<size_t>(m_registerCount, 1) * BlockSize);
+
+            for (size_t begin = 0; begin < rows; begin += BlockSize)
+            {
+                const size_t count = std::min(BlockSize, rows - begin);
+                EvaluateBlock(columns, begin, count, registers.data(), out + begin);
+            }
+        }
+
+        size_t InstructionCount() const
+        {
+            return m_code.size();
+        }
+
+        size_t RegisterCount() const
+        {
+            return m_registerCount;
+        }
+
+        size_t VariableCount() const
+        {
+            return m_variableCount;
+        }
+
+        const std::vector<Instruction>& Code() const
+        {
+            return m_code;
+        }
+
+    private:
+
+        friend class ExpressionCompiler;
+
+        BytecodeProgram(std::vector<Instruction> code, std::vector<double> constants, size_t registerCount, size_t variableCount) :
+            m_code(std::move(code)), m_constants(std::move(constants)),
+            m_registerCount(registerCount), m_variableCount(variableCount) {}
+
+        /**
+         * One instruction at a time over the whole block. Every case is a
+         * simple loop over arrays the compiler vectorizes.
+         */
+        void EvaluateBlock(const double* const* columns, size_t begin, size_t count, double* registers, double* out) const
+        {
+            auto reg = [registers](uint8_t index) { return registers + size_t(index) * BlockSize; };
+
+            for (const Instruction& instruction : m_code)
+            {
+                double* dst = reg(instruction.m_dst);
+                const double* a = reg(instruction.m_a);
+                const double* b = reg(instruction.m_b);
+                const double* c = reg(instruction.m_c);
+
+                switch (instruction.m_opcode)
+                {
+                    case Opcode::LoadConstant:
+                    {
+                        const double value = m_constants[instruction.m_index];
+                        std::fill(dst, dst + count, value);
+                        break;
+                    }
+                    case Opcode::LoadVariable:
+                        std::copy(columns[instruction.m_index] + begin, columns[instruction.m_index] + begin + count, dst);
+                        break;
+                    case Opcode::Add: Lanes(dst, a, b, count, [](double x, double y) { return x + y; }); break;
+                    case Opcode::Subtract: Lanes(dst, a, b, count, [](double x, double y) { return x - y; }); break;
+                    case Opcode::Multiply: Lanes(dst, a, b, count, [](double x, double y) { return x * y; }); break;
+                    case Opcode::Divide: Lanes(dst, a, b, count, [](double x, double y) { return x / y; }); break;
+                    case Opcode::Minimum: Lanes(dst, a, b, count, [](double x, double y) { return y < x ? y : x; }); break;
+                    case Opcode::Maximum: Lanes(dst, a, b, count, [](double x, double y) { return x < y ? y : x; }); break;
+                    case Opcode::Less: Lanes(dst, a, b, count, [](double x, double y) { return x < y ? 1.0 : 0.0; }); break;
+                    case Opcode::LessEqual: Lanes(dst, a, b, count, [](double x, double y) { return x <= y ? 1.0 : 0.0; }); break;
+                    case Opcode::Greater: Lanes(dst, a, b, count, [](double x, double y) { return x > y ? 1.0 : 0.0; }); break;
+                    case Opcode::GreaterEqual: Lanes(dst, a, b, count, [](double x, double y) { return x >= y ? 1.0 : 0.0; }); break;
+                    case Opcode::Equal: Lanes(dst, a, b, count, [](double x, double y) { return x == y ? 1.0 : 0.0; }); break;
+                    case Opcode::NotEqual: Lanes(dst, a, b, count, [](double x, double y) { return x != y ? 1.0 : 0.0; }); break;
+                    case Opcode::And: Lanes(dst, a, b, count, [](double x, double y) { return (x != 0.0) & (y != 0.0) ? 1.0 : 0.0; }); break;
+                    case Opcode::Or: Lanes(dst, a, b, count, [](double x, double y) { return (x != 0.0) | (y != 0.0) ? 1.0 : 0.0; }); break;
+                    case Opcode::Negate: Lanes(dst, a, a, count, [](double x, double) { return -x; }); break;
+                    case Opcode::Not: Lanes(dst, a, a, count, [](double x, double) { return x == 0.0 ? 1.0 : 0.0; }); break;
+                    case Opcode::Select:
+                        INTERPRETER_NO_LOOP_DEPENDENCY
+                        for (size_t i = 0; i < count; i++)
+                        {
+                            dst[i] = a[i] != 0.0 ? b[i] : c[i];
+                        }
+                        break;
+                    case Opcode::Return:
+                        std::copy(a, a + count, out);
+                        return;
+                    default:
+                        return;
+                }
+            }
+        }
+
+        /**
+         * The destination register may be one of the operands. Every lane
+         * only reads and writes its own row, so there is no dependency
+         * between iterations and the loop can be vectorized regardless.
+         */
+        template <class F>
+        static void Lanes(double* dst, const double* a, const double* b, size_t count, F operation)
+        {
+            INTERPRETER_NO_LOOP_DEPENDENCY
+            for (size_t i = 0; i < count; i++)
+            {
+                dst[i] = operation(a[i], b[i]);
+            }
+        }
+
+        std::vector<Instruction> m_code;
+        std::vector<double> m_constants;
+        size_t m_registerCount;
+        size_t m_variableCount;
+};
+
+
+inline BytecodeProgram ExpressionCompiler::Finish(const Operand& result)
+{
+    uint8_t reg = Materialize(result);
+    Emit(Instruction{Opcode::Return, 0, reg, 0, 0, 0, 0});
+    return BytecodeProgram(std::move(m_code), std::move(m_constants), m_registerCount, m_variableCount);
+}
+
+
+/**
+ * Terminal expressions
+ */
+class ConstantExpression : public Expression
+{
+    public:
+        explicit ConstantExpression(double value) :
+            m_value(value) {}
+
+        double Interpret(const double*) const override
+        {
+            return m_value;
+        }
+
+    protected:
+        Operand Compile(ExpressionCompiler&) const override
+        {
+            return ExpressionCompiler::Folded(m_value);
+        }
+
+    private:
+        double m_value;
+};
+
+class VariableExpression : public Expression
+{
+    public:
+        explicit VariableExpression(uint16_t index) :
+            m_index(index) {}
+
+        double Interpret(const double* variables) const override
+        {
+            return variables[m_index];
+        }
+
+    protected:
+        Operand Compile(ExpressionCompiler& compiler) const override
+        {
+            return compiler.LoadVariable(m_index);
+        }
+
+    private:
+        uint16_t m_index;
+};
+
+
+/**
+ * Nonterminal expressions
+ */
+class UnaryExpression : public Expression
+{
+    public:
+        UnaryExpression(Opcode opcode, ExpressionPtr operand) :
+            m_opcode(opcode), m_operand(std::move(operand)) {}
+
+        double Interpret(const double* variables) const override
+        {
+            return ApplyUnary(m_opcode, m_operand->Interpret(variables));
+        }
+
+    protected:
+        Operand Compile(ExpressionCompiler& compiler) const override
+        {
+            Operand operand = compiler.Compile(*m_operand);
+            if (operand.m_constant)
+            {
+                return ExpressionCompiler::Folded(ApplyUnary(m_opcode, operand.m_value));
+            }
+            return compiler.EmitOperation(m_opcode, operand.m_register, 0, 0, 1);
+        }
+
+    private:
+        Opcode m_opcode;
+        ExpressionPtr m_operand;
+};
+
+class BinaryExpression : public Expression
+{
+    public:
+        BinaryExpression(Opcode opcode, ExpressionPtr left, ExpressionPtr right) :
+            m_opcode(opcode), m_left(std::move(left)), m_right(std::move(right)) {}
+
+        double Interpret(const double* variables) const override
+        {
+            return ApplyBinary(m_opcode, m_left->Interpret(variables), m_right->Interpret(variables));
+        }
+
+    protected:
+        Operand Compile(ExpressionCompiler& compiler) const override
+        {
+            Operand left = compiler.Compile(*m_left);
+            Operand right = compiler.Compile(*m_right);
+            if (left.m_constant && right.m_constant)
+            {
+                return ExpressionCompiler::Folded(ApplyBinary(m_opcode, left.m_value, right.m_value));
+            }
+
+            // Registers are handed out in stack order, load the constants last
+            uint8_t a = compiler.Materialize(left);
+            uint8_t b = compiler.Materialize(right);
+            return compiler.EmitOperation(m_opcode, a, b);
+        }
+
+    private:
+        Opcode m_opcode;
+        ExpressionPtr m_left;
+        ExpressionPtr m_right;
+};
+
+class SelectExpression : public Expression
+{
+    public:
+        SelectExpression(ExpressionPtr condition, ExpressionPtr whenTrue, ExpressionPtr whenFalse) :
+            m_condition(std::move(condition)), m_true(std::move(whenTrue)), m_false(std::move(whenFalse)) {}
+
+        double Interpret(const double* variables) const override
+        {
+            return m_condition->Interpret(variables) != 0.0 ? m_true->Interpret(variables) : m_false->Interpret(variables);
+        }
+
+    protected:
+        Operand Compile(ExpressionCompiler& compiler) const override
+        {
+            Operand condition = compiler.Compile(*m_condition);
+
+            // A constant condition selects one branch at compile time
+            if (condition.m_constant)
+            {
+                return compiler.Compile(condition.m_value != 0.0 ? *m_true : *m_false);
+            }
+
+            Operand whenTrue = compiler.Compile(*m_true);
+            Operand whenFalse = compiler.Compile(*m_false);
+            uint8_t b = compiler.Materialize(whenTrue);
+            uint8_t c = compiler.Materialize(whenFalse);
+            return compiler.EmitOperation(Opcode::Select, condition.m_register, b, c, 3);
+        }
+
+    private:
+        ExpressionPtr m_condition;
+        ExpressionPtr m_true;
+        ExpressionPtr m_false;
+};
+
+
+/**
+ * Compile an expression tree into bytecode.
+ */
+inline BytecodeProgram CompileExpression(const Expression& expression)
+{
+    ExpressionCompiler compiler;
+    return compiler.Finish(compiler.Compile(expression));
+}
+
+
+/**
+ * Builder functions, named after the operators they build and kept out of
+ * the global namespace
+ */
+namespace ExpressionBuilder
+{
+    inline ExpressionPtr Constant(double value) { return std::make_unique<ConstantExpression>(value); }
+    inline ExpressionPtr Variable(uint16_t index) { return std::make_unique<VariableExpression>(index); }
+
+    inline ExpressionPtr Add(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::Add, std::move(a), std::move(b)); }
+    inline ExpressionPtr Subtract(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::Subtract, std::move(a), std::move(b)); }
+    inline ExpressionPtr Multiply(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::Multiply, std::move(a), std::move(b)); }
+    inline ExpressionPtr Divide(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::Divide, std::move(a), std::move(b)); }
+    inline ExpressionPtr Min(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::Minimum, std::move(a), std::move(b)); }
+    inline ExpressionPtr Max(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::Maximum, std::move(a), std::move(b)); }
+    inline ExpressionPtr Less(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::Less, std::move(a), std::move(b)); }
+    inline ExpressionPtr LessEqual(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::LessEqual, std::move(a), std::move(b)); }
+    inline ExpressionPtr Greater(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::Greater, std::move(a), std::move(b)); }
+    inline ExpressionPtr GreaterEqual(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::GreaterEqual, std::move(a), std::move(b)); }
+    inline ExpressionPtr Equal(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::Equal, std::move(a), std::move(b)); }
+    inline ExpressionPtr NotEqual(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::NotEqual, std::move(a), std::move(b)); }
+    inline ExpressionPtr And(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::And, std::move(a), std::move(b)); }
+    inline ExpressionPtr Or(ExpressionPtr a, ExpressionPtr b) { return std::make_unique<BinaryExpression>(Opcode::Or, std::move(a), std::move(b)); }
+    inline ExpressionPtr Negate(ExpressionPtr a) { return std::make_unique<UnaryExpression>(Opcode::Negate, std::move(a)); }
+    inline ExpressionPtr Not(ExpressionPtr a) { return std::make_unique<UnaryExpression>(Opcode::Not, std::move(a)); }
+
+    inline ExpressionPtr Select(ExpressionPtr condition, ExpressionPtr whenTrue, ExpressionPtr whenFalse)
+    {
+        return std::make_unique<SelectExpression>(std::move(condition), std::move(whenTrue), std::move(whenFalse));
+    }
+
+}
+
+#endif //__INTERPRETER_H_
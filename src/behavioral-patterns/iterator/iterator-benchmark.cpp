@@ -0,0 +1,161 @@
+/**
+* @file iterator-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Iterator benchmark
+*
+* Steps objects allocated one by one, as a pool hands them out, in an order
+* unrelated to their addresses. Compares a plain loop over the pointers with
+* IndirectRange at a few prefetch distances, then compares a sequential and
+* a parallel walk over the same objects stored contiguously in arena blocks,
+* and the cost of a parallel walk over a range of a few hundred objects.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread iterator-benchmark.cpp -o iterator-benchmark
+* ./iterator-benchmark [objects] [rounds]
+*
+*/
+
+#include "iterator.h"
+#include "../../benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct Particle
+{
+    double m_position[3];
+    double m_velocity[3];
+    double m_mass;
+    double m_charge;
+};
+
+
+// Moves the particle a step and returns its kinetic energy
+double Step(Particle& particle)
+{
+    double* p = particle.m_position;
+    double* v = particle.m_velocity;
+    double energy = 0;
+    for (size_t axis = 0; axis < 3; axis++)
+    {
+        v[axis] += particle.m_charge * 1e-3 - v[axis] * 1e-4;
+        p[axis] += v[axis] * 1e-2;
+        energy += v[axis] * v[axis];
+    }
+    return 0.5 * particle.m_mass * energy;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 21;
+    const size_t rounds = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 5;
+    const size_t operations = count * rounds;
+
+    std::cout << "Objects: " << count << ", rounds: " << rounds
+              << ", threads: " << std::thread::hardware_concurrency() << "\n";
+
+    // Pooled objects, visited in an order unrelated to their addresses
+    std::mt19937 random(42);
+    std::vector<std::unique_ptr<Particle> > pool;
+    pool.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        pool.push_back(std::make_unique<Particle>(Particle{{0, 0, 0}, {double(i % 7), 1, 2}, 1.0 + i % 3, double(i % 5)}));
+    }
+    std::shuffle(pool.begin(), pool.end(), random);
+
+    Measure("  pointer loop       ", operations, [&]()
+    {
+        double sum = 0;
+        for (size_t round = 0; round < rounds; round++)
+            for (std::unique_ptr<Particle>& particle : pool)
+                sum += Step(*particle);
+        return sum;
+    }, "object");
+
+    for (size_t distance : {4, 16, 64})
+    {
+        Measure("  indirect, ahead " + std::to_string(distance) + std::string(distance < 10 ? "  " : " "), operations, [&]()
+        {
+            double sum = 0;
+            for (size_t round = 0; round < rounds; round++)
+                for (Particle& particle : IndirectRange<std::unique_ptr<Particle> >(pool, distance))
+                    sum += Step(particle);
+            return sum;
+        }, "object");
+    }
+
+    // The same objects in arena blocks of 64k
+    std::vector<std::vector<Particle> > blocks;
+    std::vector<std::span<Particle> > segments;
+    for (size_t first = 0; first < count; first += 65536)
+    {
+        blocks.emplace_back();
+        for (size_t i = first; i < std::min(count, first + 65536); i++)
+        {
+            blocks.back().push_back(*pool[i]);
+        }
+        segments.push_back(blocks.back());
+    }
+    SegmentedRange<Particle> arena(segments);
+
+    Measure("  arena chunks       ", operations, [&]()
+    {
+        double sum = 0;
+        for (size_t round = 0; round < rounds; round++)
+            for (std::span<Particle> chunk : arena)
+                for (Particle& particle : chunk)
+                    sum += Step(particle);
+        return sum;
+    }, "object");
+
+    Measure("  arena parallel     ", operations, [&]()
+    {
+        std::atomic<double> sum = 0;
+        for (size_t round = 0; round < rounds; round++)
+        {
+            ParallelForEach(arena, [&](std::span<Particle> chunk)
+            {
+                double partial = 0;
+                for (Particle& particle : chunk)
+                    partial += Step(particle);
+                sum.fetch_add(partial, std::memory_order_relaxed);
+            });
+        }
+        return sum.load();
+    }, "object");
+
+    // Cost of a call, pieces too small for the split to pay off
+    const size_t calls = 10000;
+    std::span<Particle> small = segments.front().first(std::min<size_t>(256, segments.front().size()));
+    Measure("  parallel, 256 each ", calls * small.size(), [&]()
+    {
+        std::atomic<double> sum = 0;
+        for (size_t call = 0; call < calls; call++)
+        {
+            ParallelForEach(ChunkedRange<Particle>(small, 16), [&](std::span<Particle> chunk)
+            {
+                double partial = 0;
+                for (Particle& particle : chunk)
+                    partial += Step(particle);
+                sum.fetch_add(partial, std::memory_order_relaxed);
+            });
+        }
+        return sum.load();
+    }, "object");
+
+    return 0;
+}
@@ -0,0 +1,543 @@
+/**
+* @file iterator.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Iterator behavioral pattern, chunked and prefetching
+*
+* The Problem:
+*
+* The textbook iterator hands out one element at a time through Next() and
+* Current(), hiding how the elements are stored. For pooled objects and
+* arena products that is a pointer per element: every step is a dependent
+* load to a random address the hardware prefetcher cannot predict, the
+* loop body cannot be vectorized and there is no way to hand half of the
+* walk to another thread.
+*
+* Solution:
+*
+* Iterators that expose the shape of the storage instead of hiding it:
+*
+*   * ChunkedRange - contiguous storage yielded as spans of a fixed number
+*     of elements, the loop body works on a whole chunk at a time.
+*
+*   * SegmentedRange - storage made of several blocks, as an arena grows,
+*     yielded as spans that never cross a block boundary.
+*
+*   * IndirectRange - objects held through pointers, as handed out by a
+*     pool. Stepping to an element issues a software prefetch for the
+*     object a configurable distance ahead, so the loads overlap instead
+*     of serializing.
+*
+* All three model SplittableRange, they know their size and can be cut in
+* two halves without touching the elements. ParallelForEach() splits a
+* range recursively into tasks of a ForkJoinPool, the one passed in or the
+* process wide ForkJoinPool::Global(), no threads are started per call.
+*
+* Usage:
+*
+* std::vector<Particle*> particles = ...;
+* for (Particle& particle : IndirectRange<Particle*>(particles, 16))
+* {
+*     particle.Update();
+* }
+*
+* ParallelForEach(ChunkedRange<float>(samples), [](std::span<float> chunk)
+* {
+*     for (float& sample : chunk) sample *= 0.5f;
+* });
+*
+* Notes:
+*
+* The ranges are views, the storage must outlive them and must not change
+* size while a range is in use. The prefetch distance is a trade off, too
+* short and the object is not in cache yet when it is reached, too long
+* and it has been evicted again, 8 to 32 elements is typical. Contiguous
+* chunks are not prefetched, the hardware prefetcher handles sequential
+* access better than software can.
+*
+* References:
+* https://en.wikipedia.org/wiki/Iterator_pattern
+* https://oneapi-src.github.io/oneTBB/main/tbb_userguide/Splittable_Ranges.html
+*
+*/
+
+#ifndef __ITERATOR_H_
+#define __ITERATOR_H_
+
+
+#include "../../concurrency-patterns/fork-join.h"
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <utility>
+#include <vector>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ITERATOR_PREFETCH(address) __builtin_prefetch(address)
+#elif defined(_MSC_VER)
+#include <xmmintrin.h>
+#define ITERATOR_PREFETCH(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#else
+#define ITERATOR_PREFETCH(address) ((void)(address))
+#endif
+
+
+/**
+ * Range which can report its size and be cut in two halves, each of
+ * which can be iterated independently.
+ */
+template <class R>
+concept SplittableRange = std::ranges::range<const R> && std::copy_constructible<R> && requires(const R& range)
+{
+    { range.Size() } -> std::convertible_to<size_t>;
+    { range.Split() } -> std::same_as<std::pair<R, R> >;
+};
+
+
+/**
+ * Number of elements per chunk when none is given, about 16 KB.
+ */
+template <class T>
+constexpr size_t DefaultChunkSize()
+{
+    return std::max<size_t>(1, 16384 / sizeof(T));
+}
+
+
+/**
+ * Contiguous storage iterated in spans of at most ChunkSize() elements.
+ */
+template <class T>
+class ChunkedRange
+{
+    public:
+        class Iterator
+        {
+            public:
+                using value_type = std::span<T>;
+                using difference_type = std::ptrdiff_t;
+
+                Iterator() = default;
+
+                Iterator(T* position, T* end, size_t chunkSize) :
+                    m_position(position), m_end(end), m_chunkSize(chunkSize) {}
+
+                std::span<T> operator*() const
+                {
+                    return std::span<T>(m_position, Step());
+                }
+
+                Iterator& operator++()
+                {
+                    m_position += Step();
+                    return *this;
+                }
+
+                Iterator operator++(int)
+                {
+                    Iterator previous = *this;
+                    ++*this;
+                    return previous;
+                }
+
+                bool operator==(const Iterator& other) const
+                {
+                    return m_position == other.m_position;
+                }
+
+            private:
+                size_t Step() const
+                {
+                    return std::min<size_t>(m_chunkSize, m_end - m_position);
+                }
+
+                T* m_position = nullptr;
+                T* m_end = nullptr;
+                size_t m_chunkSize = 1;
+        };
+
+        explicit ChunkedRange(std::span<T> data, size_t chunkSize = DefaultChunkSize<T>()) :
+            m_data(data), m_chunkSize(std::max<size_t>(1, chunkSize)) {}
+
+        Iterator begin() const
+        {
+            return Iterator(m_data.data(), m_data.data() + m_data.size(), m_chunkSize);
+        }
+
+        Iterator end() const
+        {
+            T* end = m_data.data() + m_data.size();
+            return Iterator(end, end, m_chunkSize);
+        }
+
+        /**
+         * Number of elements, not chunks
+         */
+        size_t Size() const
+        {
+            return m_data.size();
+        }
+
+        size_t ChunkSize() const
+        {
+            return m_chunkSize;
+        }
+
+        /**
+         * Cuts the range in two on a chunk boundary, the second half is
+         * empty when the range is a single chunk.
+         */
+        std::pair<ChunkedRange, ChunkedRange> Split() const
+        {
+            size_t chunks = (m_data.size() + m_chunkSize - 1) / m_chunkSize;
+            size_t middle = std::min(m_data.size(), (chunks + 1) / 2 * m_chunkSize);
+            return {ChunkedRange(m_data.first(middle), m_chunkSize),
+                    ChunkedRange(m_data.subspan(middle), m_chunkSize)};
+        }
+
+    private:
+        std::span<T> m_data;
+        size_t m_chunkSize;
+};
+
+
+/**
+ * Storage made of several contiguous blocks, iterated in spans which never
+ * cross a block boundary and hold at most ChunkSize() elements. The range
+ * covers the elements from a (block, offset) position up to another.
+ */
+template <class T>
+class SegmentedRange
+{
+    public:
+        class Iterator
+        {
+            public:
+                using value_type = std::span<T>;
+                using difference_type = std::ptrdiff_t;
+
+                Iterator() = default;
+
+                Iterator(const SegmentedRange& range, size_t segment, size_t offset) :
+                    m_segments(range.m_segments.data()),
+                    m_segment(segment),
+                    m_offset(offset),
+                    m_endSegment(range.m_endSegment),
+                    m_endOffset(range.m_endOffset),
+                    m_chunkSize(range.m_chunkSize)
+                {
+                    SkipEmpty();
+                }
+
+                std::span<T> operator*() const
+                {
+                    return m_segments[m_segment].subspan(m_offset, Step());
+                }
+
+                Iterator& operator++()
+                {
+                    m_offset += Step();
+                    SkipEmpty();
+                    return *this;
+                }
+
+                Iterator operator++(int)
+                {
+                    Iterator previous = *this;
+                    ++*this;
+                    return previous;
+                }
+
+                bool operator==(const Iterator& other) const
+                {
+                    return m_segment == other.m_segment && m_offset == other.m_offset;
+                }
+
+            private:
+                size_t Limit() const
+                {
+                    return m_segment == m_endSegment ? m_endOffset : m_segments[m_segment].size();
+                }
+
+                size_t Step() const
+                {
+                    return std::min(m_chunkSize, Limit() - m_offset);
+                }
+
+                // Moves past exhausted blocks, stopping at the end position
+                void SkipEmpty()
+                {
+                    while (m_segment < m_endSegment && m_offset == m_segments[m_segment].size())
+                    {
+                        m_segment++;
+                        m_offset = 0;
+                    }
+                }
+
+                const std::span<T>* m_segments = nullptr;
+                size_t m_segment = 0;
+                size_t m_offset = 0;
+                size_t m_endSegment = 0;
+                size_t m_endOffset = 0;
+                size_t m_chunkSize = 1;
+        };
+
+        /**
+         * All elements of all blocks
+         */
+        explicit SegmentedRange(std::span<const std::span<T> > segments, size_t chunkSize = DefaultChunkSize<T>()) :
+            SegmentedRange(segments, 0, 0, segments.size(), 0, chunkSize) {}
+
+        SegmentedRange(std::span<const std::span<T> > segments, size_t beginSegment, size_t beginOffset,
+                       size_t endSegment, size_t endOffset, size_t chunkSize = DefaultChunkSize<T>()) :
+            m_segments(segments),
+            m_beginSegment(beginSegment),
+            m_beginOffset(beginOffset),
+            m_endSegment(endSegment),
+            m_endOffset(endOffset),
+            m_chunkSize(std::max<size_t>(1, chunkSize)) {}
+
+        Iterator begin() const
+        {
+            return Iterator(*this, m_beginSegment, m_beginOffset);
+        }
+
+        Iterator end() const
+        {
+            return Iterator(*this, m_endSegment, m_endOffset);
+        }
+
+        /**
+         * Number of elements, walks the blocks
+         */
+        size_t Size() const
+        {
+            size_t size = 0;
+            for (size_t segment = m_beginSegment; segment < m_endSegment; segment++)
+            {
+                size += m_segments[segment].size();
+            }
+            return size + m_endOffset - m_beginOffset;
+        }
+
+        size_t ChunkSize() const
+        {
+            return m_chunkSize;
+        }
+
+        /**
+         * Cuts the range in two halves of about the same number of elements,
+         * within a block when needed.
+         */
+        std::pair<SegmentedRange, SegmentedRange> Split() const
+        {
+            size_t remaining = Size() / 2;
+            size_t segment = m_beginSegment;
+            size_t offset = m_beginOffset;
+            while (segment < m_endSegment && m_segments[segment].size() - offset <= remaining)
+            {
+                remaining -= m_segments[segment].size() - offset;
+                segment++;
+                offset = 0;
+            }
+            offset += remaining;
+
+            return {SegmentedRange(m_segments, m_beginSegment, m_beginOffset, segment, offset, m_chunkSize),
+                    SegmentedRange(m_segments, segment, offset, m_endSegment, m_endOffset, m_chunkSize)};
+        }
+
+    private:
+        std::span<const std::span<T> > m_segments;
+        size_t m_beginSegment;
+        size_t m_beginOffset;
+        size_t m_endSegment;
+        size_t m_endOffset;
+        size_t m_chunkSize;
+};
+
+
+/**
+ * Objects held through pointers, raw or smart. Iterating yields the
+ * objects themselves and prefetches the object Distance() elements ahead.
+ */
+template <class Pointer>
+class IndirectRange
+{
+    public:
+        using Reference = decltype(*std::declval<const Pointer&>());
+
+        static constexpr size_t DefaultDistance = 16;
+
+        class Iterator
+        {
+            public:
+                using value_type = std::remove_cvref_t<Reference>;
+                using difference_type = std::ptrdiff_t;
+
+                Iterator() = default;
+
+                Iterator(const Pointer* position, const Pointer* end, size_t distance) :
+                    m_position(position), m_end(end), m_distance(distance) {}
+
+                Reference operator*() const
+                {
+                    return **m_position;
+                }
+
+                Iterator& operator++()
+                {
+                    m_position++;
+                    if (static_cast<size_t>(m_end - m_position) > m_distance)
+                    {
+                        ITERATOR_PREFETCH(std::to_address(m_position[m_distance]));
+                    }
+                    return *this;
+                }
+
+                Iterator operator++(int)
+                {
+                    Iterator previous = *this;
+                    ++*this;
+                    return previous;
+                }
+
+                bool operator==(const Iterator& other) const
+                {
+                    return m_position == other.m_position;
+                }
+
+            private:
+                const Pointer* m_position = nullptr;
+                const Pointer* m_end = nullptr;
+                size_t m_distance = 0;
+        };
+
+        explicit IndirectRange(std::span<const Pointer> pointers, size_t distance = DefaultDistance) :
+            m_pointers(pointers), m_distance(distance) {}
+
+        /**
+         * Prefetches the first Distance() objects, iteration keeps the
+         * window moving from there.
+         */
+        Iterator begin() const
+        {
+            size_t warm = std::min(m_distance, m_pointers.size());
+            for (size_t i = 0; i < warm; i++)
+            {
+                ITERATOR_PREFETCH(std::to_address(m_pointers[i]));
+            }
+            return Iterator(m_pointers.data(), m_pointers.data() + m_pointers.size(), m_distance);
+        }
+
+        Iterator end() const
+        {
+            const Pointer* end = m_pointers.data() + m_pointers.size();
+            return Iterator(end, end, m_distance);
+        }
+
+        size_t Size() const
+        {
+            return m_pointers.size();
+        }
+
+        size_t Distance() const
+        {
+            return m_distance;
+        }
+
+        std::pair<IndirectRange, IndirectRange> Split() const
+        {
+            size_t middle = m_pointers.size() / 2;
+            return {IndirectRange(m_pointers.first(middle), m_distance),
+                    IndirectRange(m_pointers.subspan(middle), m_distance)};
+        }
+
+    private:
+        std::span<const Pointer> m_pointers;
+        size_t m_distance;
+};
+
+
+namespace IteratorDetail
+{
+    /**
+     * Halve the range until depth is used up or the pieces reach grain
+     * elements, the second half of every split is left for other workers
+     * to steal. A failed piece stops pieces which have not started yet.
+     */
+    template <SplittableRange R, class F>
+    void ForEachSplit(ForkJoinPool& pool, const R& range, F& function, size_t grain, size_t depth, std::atomic<bool>& failed)
+    {
+        if (failed.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        if (depth > 0 && range.Size() > grain)
+        {
+            std::pair<R, R> halves = range.Split();
+            if (halves.first.Size() != 0 && halves.second.Size() != 0)
+            {
+                ParallelInvoke(pool,
+                    [&]() { ForEachSplit(pool, halves.first, function, grain, depth - 1, failed); },
+                    [&]() { ForEachSplit(pool, halves.second, function, grain, depth - 1, failed); });
+                return;
+            }
+        }
+
+        try
+        {
+            for (auto&& element : range)
+            {
+                function(element);
+            }
+        }
+        catch (...)
+        {
+            failed.store(true, std::memory_order_relaxed);
+            throw;
+        }
+    }
+}
+
+/**
+ * Calls function for every element of the range, which for chunked ranges
+ * is a span, as tasks of the pool. The range is split recursively until
+ * there are a few pieces per worker or the pieces are no larger than grain
+ * elements. The function must be safe to call concurrently, the first
+ * exception it throws is rethrown once all started pieces have finished.
+ */
+template <SplittableRange R, class F>
+void ParallelForEach(ForkJoinPool& pool, const R& range, F&& function, size_t grain = 1)
+{
+    size_t depth = 0;
+    while ((size_t(1) << depth) < pool.ThreadCount() * 4)
+    {
+        depth++;
+    }
+
+    std::atomic<bool> failed{false};
+    pool.Invoke([&]()
+    {
+        IteratorDetail::ForEachSplit(pool, range, function, grain, depth, failed);
+    });
+}
+
+/**
+ * Same as above on the process wide pool.
+ */
+template <SplittableRange R, class F>
+void ParallelForEach(const R& range, F&& function, size_t grain = 1)
+{
+    ParallelForEach(ForkJoinPool::Global(), range, std::forward<F>(function), grain);
+}
+
+#endif // __ITERATOR_H_
@@ -0,0 +1,238 @@
+/**
+* @file mediator-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Mediator benchmark
+*
+* Colleagues pass tokens to each other, each token hops a fixed number of
+* times, a configurable share of the hops going to a colleague of the same
+* shard. Compares the classic mediator, one locked queue served by a pool
+* of threads, with ShardedMediator for an increasing number of threads and
+* reports the messages delivered per second.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread mediator-benchmark.cpp -o mediator-benchmark
+* ./mediator-benchmark [max threads] [local percent] [tokens] [hops]
+*
+*/
+
+#include "sharded-mediator.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+struct Token
+{
+    uint32_t m_hops;
+    uint32_t m_seed;
+};
+
+
+/**
+ * Classic mediator, a single locked queue and routing table.
+ */
+class LockedMediator
+{
+    public:
+        using Handler = std::function<void(LockedMediator&, ColleagueId, const Token&)>;
+
+        void Register(ColleagueId id, Handler handler)
+        {
+            m_colleagues[id] = std::move(handler);
+        }
+
+        void Start(size_t threads)
+        {
+            for (size_t i = 0; i < threads; i++)
+            {
+                m_workers.emplace_back([this]() { WorkerLoop(); });
+            }
+        }
+
+        void Send(ColleagueId from, ColleagueId to, const Token& token)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queue.push_back({from, to, token});
+                m_pending++;
+            }
+            m_signal.notify_one();
+        }
+
+        void Flush()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_idle.wait(lock, [this]() { return m_pending == 0; });
+        }
+
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_signal.notify_all();
+            for (std::thread& worker : m_workers)
+            {
+                worker.join();
+            }
+        }
+
+    private:
+        struct Envelope
+        {
+            ColleagueId m_from;
+            ColleagueId m_to;
+            Token m_token;
+        };
+
+        void WorkerLoop()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            for (;;)
+            {
+                m_signal.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+                if (m_queue.empty())
+                {
+                    return;
+                }
+                Envelope envelope = m_queue.front();
+                m_queue.pop_front();
+                Handler& handler = m_colleagues[envelope.m_to];
+                lock.unlock();
+
+                handler(*this, envelope.m_from, envelope.m_token);
+
+                lock.lock();
+                if (--m_pending == 0)
+                {
+                    m_idle.notify_all();
+                }
+            }
+        }
+
+        std::unordered_map<ColleagueId, Handler> m_colleagues;
+        std::deque<Envelope> m_queue;
+        std::mutex m_mutex;
+        std::condition_variable m_signal;
+        std::condition_variable m_idle;
+        std::vector<std::thread> m_workers;
+        size_t m_pending = 0;
+        bool m_stop = false;
+};
+
+
+/**
+ * Next holder of a token, a colleague of the same shard localPercent of
+ * the time, any colleague otherwise.
+ */
+ColleagueId NextColleague(ColleagueId id, Token& token, uint32_t colleagues, uint32_t shards, uint32_t localPercent)
+{
+    token.m_seed = token.m_seed * 1664525u + 1013904223u;
+    ColleagueId next = (token.m_seed >> 8) % colleagues;
+    if ((token.m_seed >> 24) % 100 < localPercent)
+    {
+        next = next - next % shards + id % shards;
+        if (next >= colleagues)
+        {
+            next = id;
+        }
+    }
+    return next;
+}
+
+// Busy work done by a colleague for every message
+uint32_t Work(uint32_t seed)
+{
+    for (int i = 0; i < 16; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+    }
+    return seed;
+}
+
+
+template <class Mediator, class Setup>
+double MessagesPerSecond(Mediator& mediator, Setup&& start, uint32_t colleagues, uint32_t tokens, uint32_t hops)
+{
+    auto begin = std::chrono::steady_clock::now();
+    start();
+    for (uint32_t i = 0; i < tokens; i++)
+    {
+        mediator.Send(0, i % colleagues, Token{hops, i});
+    }
+    mediator.Flush();
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    return tokens * (hops + 1.0) / seconds;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const uint32_t maxThreads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : std::max(4u, std::thread::hardware_concurrency());
+    const uint32_t localPercent = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 50;
+    const uint32_t tokens = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 4096;
+    const uint32_t hops = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 500;
+    const uint32_t colleagues = 1024;
+
+    std::cout << "Colleagues: " << colleagues << ", tokens: " << tokens << ", hops: " << hops
+              << ", local: " << localPercent << "%, cores: " << std::thread::hardware_concurrency() << "\n";
+
+    for (uint32_t threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        double locked = 0;
+        {
+            LockedMediator mediator;
+            for (ColleagueId id = 0; id < colleagues; id++)
+            {
+                mediator.Register(id, [=](LockedMediator& mediator, ColleagueId, const Token& token)
+                {
+                    Token next = {token.m_hops - 1, Work(token.m_seed)};
+                    if (token.m_hops > 0)
+                    {
+                        mediator.Send(id, NextColleague(id, next, colleagues, threads, localPercent), next);
+                    }
+                });
+            }
+            locked = MessagesPerSecond(mediator, [&]() { mediator.Start(threads); }, colleagues, tokens, hops);
+            mediator.Stop();
+        }
+
+        double sharded = 0;
+        MediatorStats stats;
+        {
+            ShardedMediator<Token> mediator(threads, 1 << 14);
+            for (ColleagueId id = 0; id < colleagues; id++)
+            {
+                mediator.Register(id, [=](ShardedMediator<Token>& mediator, ColleagueId, const Token& token)
+                {
+                    Token next = {token.m_hops - 1, Work(token.m_seed)};
+                    if (token.m_hops > 0)
+                    {
+                        mediator.Send(id, NextColleague(id, next, colleagues, threads, localPercent), next);
+                    }
+                });
+            }
+            sharded = MessagesPerSecond(mediator, [&]() { mediator.Start(); }, colleagues, tokens, hops);
+            stats = mediator.Stats();
+        }
+
+        std::cout << "  " << threads << " thread(s): locked " << (locked / 1e6) << " M msg/s, sharded "
+                  << (sharded / 1e6) << " M msg/s (local " << stats.m_local << ", queued " << stats.m_queued << ")\n";
+    }
+    return 0;
+}
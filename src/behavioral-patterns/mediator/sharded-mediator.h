@@ -0,0 +1,500 @@
+/**
+* @file sharded-mediator.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Mediator behavioral pattern, sharded
+*
+* The Problem:
+*
+* Colleagues talk to each other only through the mediator, which knows who
+* is who and forwards every message. A mediator shared by many threads
+* guards its routing table and its queue with one lock, every message from
+* every thread passes through the same cache line and the mediator becomes
+* the point where all the threads wait for each other.
+*
+* Solution:
+*
+* Split the mediator into shards, colleague id modulo the number of shards
+* picks the shard. Each shard owns:
+*
+*   * A routing table of its own colleagues, written only before Start()
+*     and read only by the shard, so lookups need no synchronisation.
+*
+*   * A bounded lock-free queue, many producers and a single consumer,
+*     holding the messages sent to its colleagues from other threads.
+*
+*   * A worker thread, the only one ever calling the handlers of the
+*     shard's colleagues, so a colleague needs no locking of its own.
+*
+* A colleague sending to another colleague of the same shard is already on
+* the right thread, the message is delivered by a direct call and never
+* touches a queue. Messages between shards cost one compare-and-swap on the
+* target queue, threads only contend when they target the same shard.
+*
+* Usage:
+*
+* ShardedMediator<Order> mediator(4);
+* mediator.Register(Exchange, [](ShardedMediator<Order>& mediator, ColleagueId from, const Order& order)
+* {
+*     mediator.Send(Exchange, from, Fill(order));
+* });
+* mediator.Register(Trader, ...);
+* mediator.Start();
+* mediator.Send(Trader, Exchange, order);
+* mediator.Flush();
+*
+* Notes:
+*
+* Local delivery is synchronous, a handler sending to a colleague of its
+* own shard runs that colleague's handler before Send() returns. Messages
+* from one sender to one shard arrive in the order sent. A sender finding
+* the target queue full waits for space, a worker waiting this way keeps
+* handling its own queue meanwhile so two full shards cannot deadlock.
+*
+* Messages must be default constructible and copy assignable. Colleague ids
+* should be dense, each shard's table is indexed by id / shard count.
+*
+* References:
+* https://en.wikipedia.org/wiki/Mediator_pattern
+* https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+*
+*/
+
+#ifndef __SHARDED_MEDIATOR_H_
+#define __SHARDED_MEDIATOR_H_
+
+
+#include "../../concurrency-patterns/spinlock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+using ColleagueId = uint32_t;
+
+/**
+ * Snapshot of the counters of all shards
+ */
+struct MediatorStats
+{
+    // Delivered by a direct call on the sending shard
+    uint64_t m_local = 0;
+
+    // Delivered through a shard queue
+    uint64_t m_queued = 0;
+
+    // Sent to an id without a registered colleague
+    uint64_t m_undeliverable = 0;
+
+    // Times a sender found the target queue full
+    uint64_t m_fullWaits = 0;
+};
+
+
+template <class Message>
+class ShardedMediator
+{
+    public:
+        using Handler = std::function<void(ShardedMediator&, ColleagueId, const Message&)>;
+
+        /**
+         * Constructor
+         * The queue capacity is per shard and rounded up to a power of two.
+         */
+        explicit ShardedMediator(size_t shardCount = std::thread::hardware_concurrency(), size_t queueCapacity = 4096)
+        {
+            shardCount = std::max<size_t>(1, shardCount);
+            size_t capacity = 2;
+            while (capacity < queueCapacity)
+            {
+                capacity *= 2;
+            }
+
+            m_shards.reserve(shardCount);
+            for (size_t i = 0; i < shardCount; i++)
+            {
+                m_shards.emplace_back(new Shard(capacity));
+            }
+        }
+
+        /**
+         * Destructor
+         * Delivers the pending messages and stops the workers.
+         */
+        ~ShardedMediator()
+        {
+            Stop();
+        }
+
+        // Delete copy constructor and copy-assignment
+        ShardedMediator(ShardedMediator const&) = delete;
+        ShardedMediator& operator=(ShardedMediator const&) = delete;
+
+        /**
+         * Add a colleague, only allowed before Start().
+         */
+        void Register(ColleagueId id, Handler handler)
+        {
+            if (m_started)
+            {
+                throw std::logic_error("Colleagues must be registered before the mediator is started");
+            }
+            if (!handler)
+            {
+                throw std::invalid_argument("Colleague handler must not be empty");
+            }
+
+            std::vector<Handler>& colleagues = m_shards[ShardOf(id)]->m_colleagues;
+            size_t slot = id / m_shards.size();
+            if (slot >= colleagues.size())
+            {
+                colleagues.resize(slot + 1);
+            }
+            if (colleagues[slot])
+            {
+                throw std::invalid_argument("Colleague id is already registered");
+            }
+            colleagues[slot] = std::move(handler);
+        }
+
+        /**
+         * Start one worker per shard.
+         */
+        void Start()
+        {
+            if (m_started)
+            {
+                return;
+            }
+            m_started = true;
+            m_stop.store(false);
+            for (size_t i = 0; i < m_shards.size(); i++)
+            {
+                m_shards[i]->m_worker = std::thread(&ShardedMediator::WorkerLoop, this, i);
+            }
+        }
+
+        /**
+         * Route a message, from any thread. Delivered directly when called
+         * by the worker of the target's shard, queued otherwise.
+         */
+        void Send(ColleagueId from, ColleagueId to, const Message& message)
+        {
+            const size_t target = ShardOf(to);
+            Shard& shard = *m_shards[target];
+
+            if (t_current.m_mediator == this && t_current.m_shard == target)
+            {
+                Increment(shard.m_local);
+                Deliver(shard, from, to, message);
+                return;
+            }
+
+            if (!shard.TryPush(from, to, message))
+            {
+                shard.m_fullWaits.fetch_add(1, std::memory_order_relaxed);
+                do
+                {
+                    // Keep our own queue moving, whoever fills the target may be waiting on us
+                    if (t_current.m_mediator != this || Drain(*m_shards[t_current.m_shard], 1) == 0)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+                while (!shard.TryPush(from, to, message));
+            }
+
+            // Wake the worker up if it went to sleep before seeing the message
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (shard.m_sleeping.load(std::memory_order_relaxed) != 0)
+            {
+                shard.m_sleeping.store(0, std::memory_order_relaxed);
+                shard.m_sleeping.notify_one();
+            }
+        }
+
+        /**
+         * Wait until every message sent before the call, and every message
+         * sent while handling those, has been delivered. Must not be called
+         * from a handler.
+         */
+        void Flush() const
+        {
+            if (!m_started)
+            {
+                return;
+            }
+
+            // A single idle pass is not enough, it may read a shard before a
+            // handler still running on a later shard sends to it. Two idle
+            // passes in a row with nothing pushed in between leave no
+            // handler which could have sent unseen.
+            bool previousIdle = false;
+            uint64_t previousPushed = 0;
+            for (;;)
+            {
+                uint64_t pushed = 0;
+                bool idle = true;
+                for (const std::unique_ptr<Shard>& shard : m_shards)
+                {
+                    uint64_t tail = shard->m_tail.load(std::memory_order_acquire);
+                    idle = idle && shard->m_processed.load(std::memory_order_acquire) == tail;
+                    pushed += tail;
+                }
+
+                if (idle && previousIdle && pushed == previousPushed)
+                {
+                    return;
+                }
+                previousIdle = idle;
+                previousPushed = pushed;
+                std::this_thread::yield();
+            }
+        }
+
+        /**
+         * Deliver the pending messages and join the workers. Colleagues
+         * stay registered, the mediator can be started again.
+         */
+        void Stop()
+        {
+            if (!m_started)
+            {
+                return;
+            }
+
+            Flush();
+            m_stop.store(true);
+            for (std::unique_ptr<Shard>& shard : m_shards)
+            {
+                shard->m_sleeping.store(0);
+                shard->m_sleeping.notify_one();
+            }
+            for (std::unique_ptr<Shard>& shard : m_shards)
+            {
+                shard->m_worker.join();
+            }
+            m_started = false;
+        }
+
+        size_t ShardCount() const
+        {
+            return m_shards.size();
+        }
+
+        size_t ShardOf(ColleagueId id) const
+        {
+            return id % m_shards.size();
+        }
+
+        MediatorStats Stats() const
+        {
+            MediatorStats stats;
+            for (const std::unique_ptr<Shard>& shard : m_shards)
+            {
+                stats.m_local += shard->m_local.load(std::memory_order_relaxed);
+                stats.m_queued += shard->m_queued.load(std::memory_order_relaxed);
+                stats.m_undeliverable += shard->m_undeliverable.load(std::memory_order_relaxed);
+                stats.m_fullWaits += shard->m_fullWaits.load(std::memory_order_relaxed);
+            }
+            return stats;
+        }
+
+    private:
+
+        // Messages handled per pass over the queue before checking for stop
+        static constexpr size_t BatchSize = 64;
+
+        // Empty polls before a worker goes to sleep
+        static constexpr size_t SpinLimit = 256;
+
+        struct Slot
+        {
+            std::atomic<uint64_t> m_sequence{0};
+            ColleagueId m_from = 0;
+            ColleagueId m_to = 0;
+            Message m_message{};
+        };
+
+        /**
+         * Routing table, bounded queue and worker of one shard. The queue
+         * follows Dmitry Vyukov's bounded queue, every slot carries the
+         * sequence number telling whether it is free or holds a message.
+         */
+        struct alignas(64) Shard
+        {
+            explicit Shard(size_t capacity) :
+                m_slots(new Slot[capacity]), m_mask(capacity - 1)
+            {
+                for (size_t i = 0; i < capacity; i++)
+                {
+                    m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            // Any thread
+            bool TryPush(ColleagueId from, ColleagueId to, const Message& message)
+            {
+                uint64_t position = m_tail.load(std::memory_order_relaxed);
+                for (;;)
+                {
+                    Slot& slot = m_slots[position & m_mask];
+                    uint64_t sequence = slot.m_sequence.load(std::memory_order_acquire);
+                    int64_t difference = static_cast<int64_t>(sequence - position);
+                    if (difference == 0)
+                    {
+                        if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                        {
+                            slot.m_from = from;
+                            slot.m_to = to;
+                            slot.m_message = message;
+                            slot.m_sequence.store(position + 1, std::memory_order_release);
+                            return true;
+                        }
+                    }
+                    else if (difference < 0)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        position = m_tail.load(std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            // Worker only
+            bool Empty() const
+            {
+                return m_slots[m_head & m_mask].m_sequence.load(std::memory_order_acquire) != m_head + 1;
+            }
+
+            std::unique_ptr<Slot[]> m_slots;
+            const uint64_t m_mask;
+
+            // Written by Register() before Start(), read only by the worker afterwards
+            std::vector<Handler> m_colleagues;
+            std::thread m_worker;
+
+            // Producers
+            alignas(64) std::atomic<uint64_t> m_tail{0};
+            std::atomic<uint64_t> m_fullWaits{0};
+
+            // Consumer, m_processed trails m_head until the handler has returned
+            alignas(64) uint64_t m_head = 0;
+            std::atomic<uint64_t> m_processed{0};
+            std::atomic<uint32_t> m_sleeping{0};
+            std::atomic<uint64_t> m_local{0};
+            std::atomic<uint64_t> m_queued{0};
+            std::atomic<uint64_t> m_undeliverable{0};
+        };
+
+        /**
+         * Shard served by the calling thread
+         */
+        struct CurrentShard
+        {
+            const ShardedMediator* m_mediator = nullptr;
+            size_t m_shard = 0;
+        };
+
+        static inline thread_local CurrentShard t_current;
+
+        // Counter with a single writer, no read-modify-write needed
+        static void Increment(std::atomic<uint64_t>& counter)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        void Deliver(Shard& shard, ColleagueId from, ColleagueId to, const Message& message)
+        {
+            size_t slot = to / m_shards.size();
+            if (slot < shard.m_colleagues.size() && shard.m_colleagues[slot])
+            {
+                shard.m_colleagues[slot](*this, from, message);
+            }
+            else
+            {
+                Increment(shard.m_undeliverable);
+            }
+        }
+
+        /**
+         * Handle up to limit queued messages, returns the number handled.
+         * The message is copied out and the slot released before the
+         * handler runs, a handler may send to its own shard.
+         */
+        size_t Drain(Shard& shard, size_t limit)
+        {
+            size_t handled = 0;
+            while (handled < limit && !shard.Empty())
+            {
+                Slot& slot = shard.m_slots[shard.m_head & shard.m_mask];
+                ColleagueId from = slot.m_from;
+                ColleagueId to = slot.m_to;
+                Message message = slot.m_message;
+                slot.m_sequence.store(shard.m_head + shard.m_mask + 1, std::memory_order_release);
+                shard.m_head++;
+
+                Increment(shard.m_queued);
+                Deliver(shard, from, to, message);
+                shard.m_processed.store(shard.m_processed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+                handled++;
+            }
+            return handled;
+        }
+
+        void WorkerLoop(size_t index)
+        {
+            Shard& shard = *m_shards[index];
+            t_current.m_mediator = this;
+            t_current.m_shard = index;
+
+            size_t idle = 0;
+            for (;;)
+            {
+                if (Drain(shard, BatchSize) != 0)
+                {
+                    idle = 0;
+                    continue;
+                }
+                if (m_stop.load(std::memory_order_acquire))
+                {
+                    break;
+                }
+                if (++idle < SpinLimit)
+                {
+                    CpuRelax();
+                    continue;
+                }
+
+                // Announce the sleep, then check once more for messages sent meanwhile
+                shard.m_sleeping.store(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (shard.Empty() && !m_stop.load(std::memory_order_relaxed))
+                {
+                    shard.m_sleeping.wait(1, std::memory_order_relaxed);
+                }
+                shard.m_sleeping.store(0, std::memory_order_relaxed);
+                idle = 0;
+            }
+
+            t_current = CurrentShard();
+        }
+
+        std::vector<std::unique_ptr<Shard> > m_shards;
+        std::atomic<bool> m_stop{false};
+        bool m_started = false;
+};
+
+
+#endif // __SHARDED_MEDIATOR_H_
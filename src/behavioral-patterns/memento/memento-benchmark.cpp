@@ -0,0 +1,175 @@
+/**
+* @file memento-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Memento benchmark
+*
+* Applies a number of small random writes to a large state, takes a snapshot
+* after every step and occasionally rolls back a few steps. Compares the
+* classic memento copying the whole state with PagedState, which saves only
+* the pages written since the previous snapshot, and reports the time per
+* snapshot and per restore.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread memento-benchmark.cpp -o memento-benchmark
+* ./memento-benchmark [state MB] [writes per step] [steps]
+*
+*/
+
+#include "paged-memento.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+/**
+ * Classic originator, the memento is a full copy of the state.
+ */
+class FullCopyState
+{
+    public:
+        explicit FullCopyState(size_t size) :
+            m_state(size) {}
+
+        void Write(size_t offset, const void* data, size_t size)
+        {
+            std::memcpy(m_state.data() + offset, data, size);
+        }
+
+        std::vector<std::byte> Snapshot() const
+        {
+            return m_state;
+        }
+
+        void Restore(const std::vector<std::byte>& memento)
+        {
+            m_state = memento;
+        }
+
+        const std::byte* Data() const
+        {
+            return m_state.data();
+        }
+
+    private:
+        std::vector<std::byte> m_state;
+};
+
+
+struct Timings
+{
+    double m_snapshot = 0;
+    double m_restore = 0;
+    size_t m_snapshots = 0;
+    size_t m_restores = 0;
+};
+
+template <class F>
+double Seconds(F&& function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+void Report(const char* name, const Timings& timings)
+{
+    std::cout << name << ": snapshot " << (timings.m_snapshot * 1e6 / timings.m_snapshots) << " us"
+              << ", restore " << (timings.m_restore * 1e6 / timings.m_restores) << " us\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t stateSize = (argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64) << 20;
+    const size_t writesPerStep = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 32;
+    const size_t steps = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 200;
+
+    // Keep the last few snapshots, roll back three steps every tenth step
+    const size_t kept = 8;
+
+    std::cout << "State: " << (stateSize >> 20) << " MB, writes per step: " << writesPerStep << ", steps: " << steps << "\n";
+
+    // The same sequence of writes for both implementations
+    std::mt19937_64 random(42);
+    std::vector<size_t> offsets(steps * writesPerStep);
+    for (size_t& offset : offsets)
+    {
+        offset = random() % (stateSize - sizeof(uint64_t));
+    }
+
+    Timings full;
+    {
+        FullCopyState state(stateSize);
+        std::deque<std::vector<std::byte> > mementos;
+        for (size_t step = 0; step < steps; step++)
+        {
+            for (size_t i = 0; i < writesPerStep; i++)
+            {
+                uint64_t value = step * writesPerStep + i;
+                state.Write(offsets[step * writesPerStep + i], &value, sizeof(value));
+            }
+
+            full.m_snapshot += Seconds([&]() { mementos.push_back(state.Snapshot()); });
+            full.m_snapshots++;
+            if (mementos.size() > kept)
+            {
+                mementos.pop_front();
+            }
+
+            if (step % 10 == 9 && mementos.size() > 3)
+            {
+                full.m_restore += Seconds([&]() { state.Restore(mementos[mementos.size() - 4]); });
+                full.m_restores++;
+                mementos.resize(mementos.size() - 3);
+            }
+        }
+    }
+    Report("  full copy", full);
+
+    Timings paged;
+    {
+        PagedState<> state(stateSize, 64 * 1024);
+        state.StartBackgroundCompaction();
+
+        std::deque<PagedState<>::SnapshotId> snapshots;
+        for (size_t step = 0; step < steps; step++)
+        {
+            for (size_t i = 0; i < writesPerStep; i++)
+            {
+                uint64_t value = step * writesPerStep + i;
+                state.Write(offsets[step * writesPerStep + i], &value, sizeof(value));
+            }
+
+            paged.m_snapshot += Seconds([&]() { snapshots.push_back(state.Snapshot()); });
+            paged.m_snapshots++;
+            if (snapshots.size() > kept)
+            {
+                state.Release(snapshots.front());
+                snapshots.pop_front();
+            }
+
+            if (step % 10 == 9 && snapshots.size() > 3)
+            {
+                paged.m_restore += Seconds([&]() { state.Restore(snapshots[snapshots.size() - 4]); });
+                paged.m_restores++;
+                snapshots.resize(snapshots.size() - 3);
+            }
+        }
+
+        MementoStats stats = state.Stats();
+        Report("  paged    ", paged);
+        std::cout << "  deltas held " << stats.m_deltas << " of " << stats.m_capacity
+                  << ", compacted " << stats.m_compacted << ", evicted " << stats.m_evicted << "\n";
+    }
+
+    return 0;
+}
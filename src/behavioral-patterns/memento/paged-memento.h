@@ -0,0 +1,491 @@
+/**
+* @file paged-memento.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Memento behavioral pattern, incremental
+*
+* The Problem:
+*
+* A memento captures the internal state of an object so that the object can
+* be restored to it later, without exposing the state to the caretaker
+* holding the memento. Copying the whole state into every memento makes
+* snapshots and restores cost O(state size), however little has changed,
+* which rules out frequent snapshots of large objects.
+*
+* Solution:
+*
+* PagedState holds the state of the originator in one buffer split into
+* pages and tracks which pages have been written since the last snapshot.
+* The first write to a page after a snapshot saves the old contents of the
+* page (a copy-on-write pre-image) into a delta log, later writes to the
+* same page are free.
+*
+*   * Snapshot() only closes the current epoch, it clears the dirty bits of
+*     the pages written since the previous snapshot. O(dirty pages).
+*
+*   * Restore(id) copies back the pre-images saved since snapshot id, from
+*     the newest to the oldest. O(pages changed since the snapshot).
+*
+* The delta log is a fixed pool of page sized slots with a compact array of
+* slot indices in order of capture, so deltas never allocate and removing
+* one never moves page data. Once snapshots are released some pre-images
+* can no longer be needed by any remaining snapshot, Compact() frees them,
+* either on demand or periodically on a background thread. When the pool
+* is full and compaction frees nothing the oldest deltas are evicted and
+* the snapshots depending on them become unrestorable.
+*
+* Usage:
+*
+* PagedState<> state(64 << 20, 4096);
+* state.Edit<Account>(offset).m_balance += 10;
+* PagedState<>::SnapshotId id = state.Snapshot();
+* ...
+* state.Restore(id);
+* state.Release(id);
+*
+* Notes:
+*
+* Writes must go through Modify(), Edit() or Write(), which mark the pages
+* dirty. Trapping writes with mprotect() and a signal handler would make
+* this transparent, at the cost of a fault per page and process wide
+* signal handling. PageSize is a template parameter, small pages such as
+* 64 bytes give field level granularity for states with scattered writes.
+*
+* Accessing the state is not thread safe, only the compaction may run
+* concurrently with the owner of the state.
+*
+*/
+
+#ifndef __PAGED_MEMENTO_H_
+#define __PAGED_MEMENTO_H_
+
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Delta log statistics
+ */
+struct MementoStats
+{
+    size_t m_snapshots = 0;
+    size_t m_deltas = 0;
+    size_t m_capacity = 0;
+    uint64_t m_compacted = 0;
+    uint64_t m_evicted = 0;
+};
+
+
+/**
+ * Paged state with incremental snapshots
+ */
+template <size_t PageSize = 4096>
+class PagedState
+{
+
+    static_assert(PageSize >= 8 && (PageSize & (PageSize - 1)) == 0, "Page size must be a power of two");
+
+    public:
+
+        using SnapshotId = uint64_t;
+
+        // Never returned by Snapshot()
+        static const SnapshotId InvalidSnapshot = 0;
+
+        /**
+         * Constructor
+         * size - size of the state in bytes, zero initialised
+         * deltaCapacity - maximum number of page pre-images held
+         */
+        PagedState(size_t size, size_t deltaCapacity) :
+            m_size(size),
+            m_pageCount((size + PageSize - 1) / PageSize),
+            m_data(new PageBlock[m_pageCount]()),
+            m_dirtyBits((m_pageCount + 63) / 64, 0),
+            m_capacity(deltaCapacity),
+            m_deltaData(new PageBlock[deltaCapacity]),
+            m_deltaHeaders(deltaCapacity)
+        {
+            if (size == 0 || deltaCapacity == 0 || deltaCapacity > UINT32_MAX)
+            {
+                throw std::invalid_argument("Invalid state size or delta capacity");
+            }
+
+            m_freeSlots.reserve(deltaCapacity);
+            for (size_t i = deltaCapacity; i-- > 0; )
+            {
+                m_freeSlots.push_back(static_cast<uint32_t>(i));
+            }
+            m_order.reserve(deltaCapacity);
+        }
+
+        ~PagedState()
+        {
+            StopBackgroundCompaction();
+        }
+
+        PagedState(PagedState const&) = delete;
+        PagedState& operator=(PagedState const&) = delete;
+
+        size_t Size() const
+        {
+            return m_size;
+        }
+
+        const std::byte* Data() const
+        {
+            return reinterpret_cast<const std::byte*>(m_data.get());
+        }
+
+        template <class T>
+        const T& Read(size_t offset) const
+        {
+            return *reinterpret_cast<const T*>(Data() + offset);
+        }
+
+        /**
+         * Writable view of [offset, offset + size).
+         * Marks the pages dirty, the first write to a page since the last
+         * snapshot saves its pre-image.
+         */
+        std::byte* Modify(size_t offset, size_t size)
+        {
+            if (offset + size > m_size)
+            {
+                throw std::out_of_range("Modify outside of the state");
+            }
+
+            if (size > 0)
+            {
+                const size_t last = (offset + size - 1) / PageSize;
+                for (size_t page = offset / PageSize; page <= last; page++)
+                {
+                    uint64_t& word = m_dirtyBits[page / 64];
+                    const uint64_t bit = uint64_t(1) << (page % 64);
+                    if ((word & bit) == 0)
+                    {
+                        word |= bit;
+                        MarkDirty(page);
+                    }
+                }
+            }
+            return reinterpret_cast<std::byte*>(m_data.get()) + offset;
+        }
+
+        template <class T>
+        T& Edit(size_t offset)
+        {
+            return *reinterpret_cast<T*>(Modify(offset, sizeof(T)));
+        }
+
+        void Write(size_t offset, const void* data, size_t size)
+        {
+            std::memcpy(Modify(offset, size), data, size);
+        }
+
+        /**
+         * Capture the current state.
+         * Costs O(pages written since the previous snapshot).
+         */
+        SnapshotId Snapshot()
+        {
+            ClearDirty();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_currentTag = ++m_lastSnapshot;
+            m_retained.push_back(m_currentTag);
+            return m_currentTag;
+        }
+
+        /**
+         * Return the state to the given snapshot.
+         * Snapshots taken after it are discarded, the snapshot itself stays
+         * valid. Returns false if it was released or evicted.
+         */
+        bool Restore(SnapshotId id)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (!std::binary_search(m_retained.begin(), m_retained.end(), id))
+            {
+                return false;
+            }
+
+            // Newest first, the oldest pre-image of every page wins
+            while (!m_order.empty() && m_deltaHeaders[m_order.back()].m_tag >= id)
+            {
+                const uint32_t slot = m_order.back();
+                std::memcpy(m_data[m_deltaHeaders[slot].m_page].m_bytes, m_deltaData[slot].m_bytes, PageSize);
+                m_freeSlots.push_back(slot);
+                m_order.pop_back();
+            }
+
+            m_retained.erase(std::upper_bound(m_retained.begin(), m_retained.end(), id), m_retained.end());
+            m_currentTag = id;
+
+            // Pages restored match the snapshot, the next write captures them again
+            ClearDirty();
+            return true;
+        }
+
+        /**
+         * The caretaker no longer needs the snapshot.
+         * Its deltas are freed by the next compaction.
+         */
+        void Release(SnapshotId id)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                std::vector<SnapshotId>::iterator found = std::lower_bound(m_retained.begin(), m_retained.end(), id);
+                if (found == m_retained.end() || *found != id)
+                {
+                    return;
+                }
+                m_retained.erase(found);
+                m_compactionWanted = true;
+            }
+            m_compactionSignal.notify_one();
+        }
+
+        bool IsRestorable(SnapshotId id) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return std::binary_search(m_retained.begin(), m_retained.end(), id);
+        }
+
+        /**
+         * Free every pre-image no remaining snapshot can need.
+         * Only headers are inspected, no page data is moved.
+         */
+        void Compact()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            CompactLocked();
+        }
+
+        /**
+         * Compact on a background thread, after every Release() and at
+         * least once per interval.
+         */
+        void StartBackgroundCompaction(std::chrono::milliseconds interval = std::chrono::milliseconds(100))
+        {
+            if (m_compactor.joinable())
+            {
+                return;
+            }
+
+            m_stop = false;
+            m_compactor = std::thread([this, interval]()
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while (!m_stop)
+                {
+                    m_compactionSignal.wait_for(lock, interval, [this]() { return m_stop || m_compactionWanted; });
+                    if (!m_stop)
+                    {
+                        CompactLocked();
+                    }
+                }
+            });
+        }
+
+        void StopBackgroundCompaction()
+        {
+            if (!m_compactor.joinable())
+            {
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_compactionSignal.notify_one();
+            m_compactor.join();
+        }
+
+        MementoStats Stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            MementoStats stats;
+            stats.m_snapshots = m_retained.size();
+            stats.m_deltas = m_order.size();
+            stats.m_capacity = m_capacity;
+            stats.m_compacted = m_compacted;
+            stats.m_evicted = m_evicted;
+            return stats;
+        }
+
+        size_t DirtyPageCount() const
+        {
+            return m_dirtyPages.size();
+        }
+
+    private:
+
+        struct alignas(PageSize < 64 ? PageSize : 64) PageBlock
+        {
+            std::byte m_bytes[PageSize];
+        };
+
+        static_assert(sizeof(PageBlock) == PageSize, "Pages must be contiguous");
+
+        /**
+         * Pre-image of one page, taken in the epoch following snapshot m_tag.
+         */
+        struct DeltaHeader
+        {
+            SnapshotId m_tag;
+            uint32_t m_page;
+        };
+
+        void MarkDirty(size_t page)
+        {
+            m_dirtyPages.push_back(static_cast<uint32_t>(page));
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            // Without a snapshot nobody needs the old contents
+            if (m_retained.empty())
+            {
+                return;
+            }
+
+            if (m_freeSlots.empty())
+            {
+                CompactLocked();
+                if (m_freeSlots.empty())
+                {
+                    EvictOldest();
+                }
+            }
+
+            const uint32_t slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+            std::memcpy(m_deltaData[slot].m_bytes, m_data[page].m_bytes, PageSize);
+            m_deltaHeaders[slot] = DeltaHeader{m_currentTag, static_cast<uint32_t>(page)};
+            m_order.push_back(slot);
+        }
+
+        void ClearDirty()
+        {
+            for (uint32_t page : m_dirtyPages)
+            {
+                m_dirtyBits[page / 64] &= ~(uint64_t(1) << (page % 64));
+            }
+            m_dirtyPages.clear();
+        }
+
+        /**
+         * A pre-image is needed if some retained snapshot lies after the
+         * previous pre-image of the same page and not after this one,
+         * restoring to that snapshot ends with this pre-image.
+         */
+        void CompactLocked()
+        {
+            m_compactionWanted = false;
+
+            if (m_lastTags.size() != m_pageCount)
+            {
+                m_lastTags.assign(m_pageCount, NoTag);
+            }
+
+            const size_t freeBefore = m_freeSlots.size();
+            size_t kept = 0;
+            for (size_t i = 0; i < m_order.size(); i++)
+            {
+                const uint32_t slot = m_order[i];
+                const DeltaHeader& header = m_deltaHeaders[slot];
+
+                const SnapshotId previous = m_lastTags[header.m_page];
+                m_lastTags[header.m_page] = header.m_tag;
+
+                // First retained snapshot after the previous pre-image
+                std::vector<SnapshotId>::const_iterator next = previous == NoTag
+                    ? m_retained.begin()
+                    : std::upper_bound(m_retained.begin(), m_retained.end(), previous);
+
+                if (next != m_retained.end() && *next <= header.m_tag)
+                {
+                    m_order[kept++] = slot;
+                }
+                else
+                {
+                    m_freeSlots.push_back(slot);
+                    m_compacted++;
+                }
+            }
+
+            m_order.resize(kept);
+
+            // Reset only the pages touched
+            for (uint32_t slot : m_order)
+            {
+                m_lastTags[m_deltaHeaders[slot].m_page] = NoTag;
+            }
+            for (size_t i = freeBefore; i < m_freeSlots.size(); i++)
+            {
+                m_lastTags[m_deltaHeaders[m_freeSlots[i]].m_page] = NoTag;
+            }
+        }
+
+        /**
+         * Drop the oldest pre-image, every snapshot which could need it is
+         * no longer restorable.
+         */
+        void EvictOldest()
+        {
+            const uint32_t slot = m_order.front();
+            const SnapshotId tag = m_deltaHeaders[slot].m_tag;
+
+            m_order.erase(m_order.begin());
+            m_freeSlots.push_back(slot);
+            m_evicted++;
+
+            m_retained.erase(m_retained.begin(), std::upper_bound(m_retained.begin(), m_retained.end(), tag));
+        }
+
+        static constexpr SnapshotId NoTag = ~SnapshotId(0);
+
+        // The state, owned by a single thread
+        const size_t m_size;
+        const size_t m_pageCount;
+        std::unique_ptr<PageBlock[]> m_data;
+        std::vector<uint64_t> m_dirtyBits;
+        std::vector<uint32_t> m_dirtyPages;
+
+        // Delta log, guarded by m_mutex
+        mutable std::mutex m_mutex;
+        const size_t m_capacity;
+        std::unique_ptr<PageBlock[]> m_deltaData;
+        std::vector<DeltaHeader> m_deltaHeaders;
+        std::vector<uint32_t> m_freeSlots;
+        std::vector<uint32_t> m_order;
+        std::vector<SnapshotId> m_retained;
+        std::vector<SnapshotId> m_lastTags;
+        SnapshotId m_lastSnapshot = 0;
+        SnapshotId m_currentTag = 0;
+        uint64_t m_compacted = 0;
+        uint64_t m_evicted = 0;
+
+        // Background compaction
+        std::condition_variable m_compactionSignal;
+        bool m_compactionWanted = false;
+        bool m_stop = false;
+        std::thread m_compactor;
+};
+
+
+#endif //__PAGED_MEMENTO_H_
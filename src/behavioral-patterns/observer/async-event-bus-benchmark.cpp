@@ -0,0 +1,224 @@
+/**
+* @file async-event-bus-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Asynchronous event bus benchmark
+*
+* First a slow and a fast subscriber share a single worker while events
+* keep arriving, the deliveries of both are read before flushing, a queue
+* which is never empty must not keep the worker to itself. Then publishers
+* feed subscribers using each overflow policy, reporting the publish cost
+* and the counters of every subscriber once flushed. Every event accepted
+* must be delivered, dropped or coalesced, the lag after Flush() is zero.
+* In between a publisher waits on a full Block queue while a callback
+* unsubscribes another subscriber, both must complete.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread async-event-bus-benchmark.cpp -o async-event-bus-benchmark
+* ./async-event-bus-benchmark [workers] [publisher threads] [events per publisher]
+*
+*/
+
+#include "async-event-bus.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct PriceEvent
+{
+    uint64_t m_instrument = 0;
+    uint64_t m_price = 0;
+};
+
+// Keep the callback busy without sleeping, like real work would
+void Spin(std::chrono::microseconds duration)
+{
+    const auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end)
+    {
+    }
+}
+
+void Print(const std::string& name, const AsyncSubscriberMetrics& metrics)
+{
+    std::cout << "    " << name << " enqueued " << metrics.m_enqueued << ", delivered " << metrics.m_delivered
+              << ", dropped " << metrics.m_dropped << ", coalesced " << metrics.m_coalesced
+              << ", max depth " << metrics.m_maxDepth << ", lag " << metrics.Lag() << "\n";
+}
+
+
+/**
+ * One worker, a subscriber needing 20 us per event and one needing none.
+ */
+bool Fairness()
+{
+    std::cout << "Fairness, one worker\n";
+    AsyncEventBus<PriceEvent> bus(1);
+    std::atomic<uint64_t> slow{0};
+    std::atomic<uint64_t> fast{0};
+    auto slowId = bus.Subscribe([&](const PriceEvent&) { Spin(std::chrono::microseconds(20)); slow++; });
+    auto fastId = bus.Subscribe([&](const PriceEvent&) { fast++; });
+
+    const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+    uint64_t published = 0;
+    while (std::chrono::steady_clock::now() < end)
+    {
+        bus.Publish(PriceEvent{published % 16, published});
+        published++;
+        if (published % 64 == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+    const uint64_t slowSeen = slow.load();
+    const uint64_t fastSeen = fast.load();
+    std::cout << "    published " << published << ", before flush slow " << slowSeen << ", fast " << fastSeen << "\n";
+
+    bus.Flush();
+    Print("slow", bus.Metrics(slowId));
+    Print("fast", bus.Metrics(fastId));
+    // Each queue gets a batch per turn, the fast one must not fall far behind
+    return 2 * fastSeen >= slowSeen && bus.Metrics(slowId).Lag() == 0 && bus.Metrics(fastId).Lag() == 0;
+}
+
+
+/**
+ * A full Block queue with a slow callback while another callback
+ * unsubscribes, the waiting publisher must not hold up the unsubscribe.
+ */
+bool BlockAndUnsubscribe()
+{
+    std::cout << "Block while a callback unsubscribes, one worker\n";
+    AsyncEventBus<PriceEvent> bus(1);
+    AsyncSubscriberOptions<PriceEvent> blocking;
+    blocking.m_capacity = 1;
+    blocking.m_policy = OverflowPolicy::Block;
+
+    std::atomic<uint64_t> victimSeen{0};
+    auto slowId = bus.Subscribe([&](const PriceEvent&) { Spin(std::chrono::microseconds(200)); }, blocking);
+    auto victimId = bus.Subscribe([&](const PriceEvent&) { victimSeen++; });
+    std::atomic<bool> unsubscribed{false};
+    bus.Subscribe([&](const PriceEvent&)
+    {
+        if (!unsubscribed.exchange(true))
+        {
+            bus.Unsubscribe(victimId);
+        }
+    });
+
+    const uint64_t events = 200;
+    std::atomic<bool> done{false};
+    std::thread publisher([&]()
+    {
+        for (uint64_t i = 0; i < events; i++)
+        {
+            bus.Publish(PriceEvent{i, i});
+        }
+        done = true;
+    });
+
+    // A deadlocked publisher never returns, give up instead of hanging
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!done && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (!done)
+    {
+        std::cout << "    publisher still blocked after 10 s" << std::endl;
+        std::_Exit(1);
+    }
+    publisher.join();
+    bus.Flush();
+
+    const AsyncSubscriberMetrics slow = bus.Metrics(slowId);
+    Print("slow", slow);
+    std::cout << "    unsubscribed subscriber saw " << victimSeen.load() << " events\n";
+    return slow.m_delivered == events && slow.Lag() == 0;
+}
+
+
+/**
+ * Publishers against one subscriber per overflow policy.
+ */
+bool Policies(size_t workers, size_t publishers, size_t events)
+{
+    std::cout << "Policies, " << workers << " workers, " << publishers << " publishers\n";
+    AsyncEventBus<PriceEvent> bus(workers);
+    std::atomic<uint64_t> checksum{0};
+
+    AsyncSubscriberOptions<PriceEvent> dropping;
+    dropping.m_capacity = 256;
+    AsyncSubscriberOptions<PriceEvent> blocking;
+    blocking.m_capacity = 256;
+    blocking.m_policy = OverflowPolicy::Block;
+    AsyncSubscriberOptions<PriceEvent> coalescing;
+    coalescing.m_capacity = 256;
+    coalescing.m_policy = OverflowPolicy::CoalesceByKey;
+    coalescing.m_key = [](const PriceEvent& event) { return event.m_instrument; };
+
+    auto work = [&](const PriceEvent& event)
+    {
+        Spin(std::chrono::microseconds(1));
+        checksum.fetch_add(event.m_price, std::memory_order_relaxed);
+    };
+    auto dropId = bus.Subscribe(work, dropping);
+    auto blockId = bus.Subscribe(work, blocking);
+    auto coalesceId = bus.Subscribe(work, coalescing);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < publishers; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            for (size_t i = 0; i < events; i++)
+            {
+                bus.Publish(PriceEvent{i % 64, t * events + i});
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    const auto published = std::chrono::steady_clock::now();
+    bus.Flush();
+    const auto flushed = std::chrono::steady_clock::now();
+
+    const double total = static_cast<double>(publishers * events);
+    std::cout << "    publish " << std::chrono::duration<double, std::nano>(published - start).count() / total
+              << " ns/event, until flushed " << std::chrono::duration<double, std::nano>(flushed - start).count() / total
+              << " ns/event (checksum " << checksum.load() << ")\n";
+
+    const AsyncSubscriberMetrics drop = bus.Metrics(dropId);
+    const AsyncSubscriberMetrics block = bus.Metrics(blockId);
+    const AsyncSubscriberMetrics coalesce = bus.Metrics(coalesceId);
+    Print("DropOldest   ", drop);
+    Print("Block        ", block);
+    Print("CoalesceByKey", coalesce);
+    return drop.Lag() == 0 && coalesce.Lag() == 0 && block.m_delivered == publishers * events;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t workers = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2;
+    const size_t publishers = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2;
+    const size_t events = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 100000;
+
+    const bool fair = Fairness();
+    const bool blocking = BlockAndUnsubscribe();
+    const bool consistent = Policies(workers, publishers, events);
+    std::cout << "fair: " << (fair ? "yes" : "no") << ", block with unsubscribe: " << (blocking ? "yes" : "no")
+              << ", counters consistent: " << (consistent ? "yes" : "no") << "\n";
+    return fair && blocking && consistent ? 0 : 1;
+}
@@ -0,0 +1,602 @@
+/**
+* @file async-event-bus.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Asynchronous Observer
+*
+* The Problem:
+*
+* A synchronous observer runs every callback on the publishing thread, the
+* publisher is only as fast as the slowest subscriber.
+*
+* Solution:
+*
+* Decouple the two sides with a bounded queue per subscriber. Publishing
+* copies the event into each subscriber's queue and returns. A pool of
+* workers drains the queues in batches and invokes the callbacks, a queue
+* is drained by at most one worker at a time so every subscriber still
+* observes events in publish order.
+*
+* What happens when a subscriber falls behind and its queue is full is
+* chosen per subscriber:
+*
+*   * DropOldest - the oldest pending event is discarded, the publisher
+*     never waits.
+*
+*   * Block - the publisher waits for space, for subscribers which must not
+*     lose events.
+*
+*   * CoalesceByKey - a pending event with the same key is replaced by the
+*     newer one, e.g. only the latest price of an instrument matters. If the
+*     queue is full of distinct keys the oldest event is dropped.
+*
+* Every subscriber keeps counters of enqueued, delivered, dropped and
+* coalesced events, the difference is its lag.
+*
+* Usage:
+*
+* AsyncEventBus<Event> bus(2);
+* AsyncSubscriberOptions<Event> options;
+* options.m_policy = OverflowPolicy::CoalesceByKey;
+* options.m_key = [](const Event& event){ return event.m_instrument; };
+* bus.Subscribe([](const Event& event){ ... }, options);
+* bus.Publish(event);
+*
+* Notes:
+*
+* Built on top of EventBus, every subscriber is a synchronous subscriber
+* which only enqueues. The queue is a bounded ring buffer. Its producer
+* side is serialised by a Spinlock held for a handful of instructions, which
+* allows several publishers and lets the consumer take a whole batch at once.
+*
+* Events must be default constructible and copy assignable. A publisher
+* blocked on a full queue must not be one of the bus workers. It waits
+* after the dispatch over the subscribers has finished, outside of the
+* epoch guard, so Unsubscribe() from a callback and reclamation in the
+* shared EpochDomain keep making progress meanwhile.
+*
+*/
+
+#ifndef __ASYNC_EVENT_BUS_H_
+#define __ASYNC_EVENT_BUS_H_
+
+
+#include "observer.h"
+#include "../../concurrency-patterns/fork-join.h"
+#include "../../concurrency-patterns/spinlock.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+enum class OverflowPolicy
+{
+    DropOldest,
+    Block,
+    CoalesceByKey
+};
+
+/**
+ * Per subscriber configuration
+ */
+template <class Event>
+struct AsyncSubscriberOptions
+{
+    // Maximum number of pending events
+    size_t m_capacity = 1024;
+
+    OverflowPolicy m_policy = OverflowPolicy::DropOldest;
+
+    // Coalescing key, required by OverflowPolicy::CoalesceByKey
+    std::function<uint64_t(const Event&)> m_key;
+};
+
+/**
+ * Snapshot of the counters of a single subscriber
+ */
+struct AsyncSubscriberMetrics
+{
+    uint64_t m_enqueued = 0;
+    uint64_t m_delivered = 0;
+    uint64_t m_dropped = 0;
+    uint64_t m_coalesced = 0;
+    uint64_t m_failed = 0;
+    uint64_t m_maxDepth = 0;
+
+    // Events accepted but not yet handled
+    uint64_t Lag() const
+    {
+        return m_enqueued - m_delivered - m_dropped - m_coalesced - m_failed;
+    }
+};
+
+
+/**
+ * Bounded event queue of a single subscriber.
+ */
+template <class Event>
+class AsyncSubscriberQueue
+{
+
+    public:
+
+        AsyncSubscriberQueue(std::function<void(const Event&)> callback, const AsyncSubscriberOptions<Event>& options) :
+            m_callback(std::move(callback)),
+            m_options(options),
+            m_ring(options.m_capacity)
+        {
+            if (options.m_capacity == 0)
+            {
+                throw std::invalid_argument("Queue capacity must not be zero");
+            }
+            if (options.m_policy == OverflowPolicy::CoalesceByKey)
+            {
+                if (!options.m_key)
+                {
+                    throw std::invalid_argument("Coalescing requires a key function");
+                }
+
+                // Open addressing table, at most half full
+                size_t slots = 2;
+                while (slots < 2 * options.m_capacity)
+                {
+                    slots *= 2;
+                }
+                m_keys.resize(slots);
+            }
+            m_batch.reserve(BatchSize);
+        }
+
+        // Maximum number of events handed to the callback per drain
+        static const size_t BatchSize = 64;
+
+        /**
+         * Producer side, apply the overflow policy and store the event.
+         * A full queue under the Block policy is left untouched and false
+         * returned, the caller retries with Push() once it may wait.
+         */
+        bool TryPush(const Event& event)
+        {
+            return Push(event, false);
+        }
+
+        /**
+         * Producer side, waits for space under the Block policy.
+         */
+        void Push(const Event& event)
+        {
+            Push(event, true);
+        }
+
+        /**
+         * Consumer side, move up to BatchSize events into the batch buffer
+         * and invoke the callback for each of them outside of the lock.
+         * Returns false if the queue was empty.
+         */
+        bool DrainBatch()
+        {
+            m_batch.clear();
+            {
+                std::lock_guard<Spinlock> lock(m_lock);
+                while (m_head != m_tail && m_batch.size() < BatchSize)
+                {
+                    const uint64_t sequence = m_head++;
+                    Event& event = m_ring[sequence % m_ring.size()];
+                    if (m_options.m_policy == OverflowPolicy::CoalesceByKey)
+                    {
+                        EraseKey(m_options.m_key(event), sequence);
+                    }
+                    m_batch.push_back(std::move(event));
+                }
+            }
+
+            if (m_batch.empty())
+            {
+                return false;
+            }
+
+            // Wake publishers waiting for space
+            m_popSignal.fetch_add(1, std::memory_order_release);
+            if (m_blockedProducers.load() > 0)
+            {
+                m_popSignal.notify_all();
+            }
+
+            for (const Event& event : m_batch)
+            {
+                try
+                {
+                    m_callback(event);
+                    m_delivered.fetch_add(1, std::memory_order_relaxed);
+                }
+                catch (...)
+                {
+                    m_failed.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            return true;
+        }
+
+        bool Empty()
+        {
+            std::lock_guard<Spinlock> lock(m_lock);
+            return m_head == m_tail;
+        }
+
+        AsyncSubscriberMetrics Metrics() const
+        {
+            AsyncSubscriberMetrics metrics;
+            metrics.m_delivered = m_delivered.load();
+            metrics.m_dropped = m_dropped.load();
+            metrics.m_coalesced = m_coalesced.load();
+            metrics.m_failed = m_failed.load();
+            metrics.m_maxDepth = m_maxDepth.load();
+            metrics.m_enqueued = m_enqueued.load();
+            return metrics;
+        }
+
+        // Set while a worker owns the consumer side
+        std::atomic<bool> m_scheduled{false};
+
+    private:
+
+        struct KeySlot
+        {
+            uint64_t m_key = 0;
+            uint64_t m_sequence = 0;
+            bool m_used = false;
+        };
+
+        bool Push(const Event& event, bool wait)
+        {
+            std::unique_lock<Spinlock> lock(m_lock);
+
+            // Replace a pending event with the same key
+            if (m_options.m_policy == OverflowPolicy::CoalesceByKey)
+            {
+                const uint64_t key = m_options.m_key(event);
+                KeySlot* slot = FindKey(key);
+                if (slot != nullptr)
+                {
+                    m_ring[slot->m_sequence % m_ring.size()] = event;
+                    m_enqueued.fetch_add(1, std::memory_order_relaxed);
+                    m_coalesced.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+
+            if (m_tail - m_head == m_ring.size())
+            {
+                if (m_options.m_policy == OverflowPolicy::Block)
+                {
+                    if (!wait)
+                    {
+                        return false;
+                    }
+
+                    // Wait for the consumer to make room
+                    while (m_tail - m_head == m_ring.size())
+                    {
+                        const uint32_t popped = m_popSignal.load(std::memory_order_acquire);
+                        m_blockedProducers.fetch_add(1);
+                        lock.unlock();
+                        m_popSignal.wait(popped, std::memory_order_acquire);
+                        m_blockedProducers.fetch_sub(1);
+                        lock.lock();
+                    }
+                }
+                else
+                {
+                    DropOldest();
+                }
+            }
+
+            m_enqueued.fetch_add(1, std::memory_order_relaxed);
+            const uint64_t sequence = m_tail++;
+            m_ring[sequence % m_ring.size()] = event;
+            if (m_options.m_policy == OverflowPolicy::CoalesceByKey)
+            {
+                InsertKey(m_options.m_key(event), sequence);
+            }
+
+            const uint64_t depth = m_tail - m_head;
+            if (depth > m_maxDepth.load(std::memory_order_relaxed))
+            {
+                m_maxDepth.store(depth, std::memory_order_relaxed);
+            }
+            return true;
+        }
+
+        void DropOldest()
+        {
+            const uint64_t sequence = m_head++;
+            if (m_options.m_policy == OverflowPolicy::CoalesceByKey)
+            {
+                EraseKey(m_options.m_key(m_ring[sequence % m_ring.size()]), sequence);
+            }
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        size_t HashSlot(uint64_t key) const
+        {
+            // Fibonacci hashing spreads sequential keys
+            return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & (m_keys.size() - 1);
+        }
+
+        KeySlot* FindKey(uint64_t key)
+        {
+            for (size_t i = HashSlot(key); m_keys[i].m_used; i = (i + 1) & (m_keys.size() - 1))
+            {
+                if (m_keys[i].m_key == key)
+                {
+                    return &m_keys[i];
+                }
+            }
+            return nullptr;
+        }
+
+        void InsertKey(uint64_t key, uint64_t sequence)
+        {
+            size_t i = HashSlot(key);
+            while (m_keys[i].m_used)
+            {
+                i = (i + 1) & (m_keys.size() - 1);
+            }
+            m_keys[i].m_key = key;
+            m_keys[i].m_sequence = sequence;
+            m_keys[i].m_used = true;
+        }
+
+        /**
+         * Remove the key if it still refers to the given event.
+         * Uses backward shift deletion, no tombstones are needed.
+         */
+        void EraseKey(uint64_t key, uint64_t sequence)
+        {
+            KeySlot* slot = FindKey(key);
+            if (slot == nullptr || slot->m_sequence != sequence)
+            {
+                return;
+            }
+
+            const size_t mask = m_keys.size() - 1;
+            size_t hole = static_cast<size_t>(slot - m_keys.data());
+            size_t next = (hole + 1) & mask;
+            while (m_keys[next].m_used)
+            {
+                // Move the entry into the hole unless its home lies between
+                const size_t home = HashSlot(m_keys[next].m_key);
+                if (((next - home) & mask) >= ((next - hole) & mask))
+                {
+                    m_keys[hole] = m_keys[next];
+                    hole = next;
+                }
+                next = (next + 1) & mask;
+            }
+            m_keys[hole].m_used = false;
+        }
+
+        std::function<void(const Event&)> m_callback;
+        AsyncSubscriberOptions<Event> m_options;
+
+        // Ring buffer indexed by sequence number, guarded by m_lock
+        Spinlock m_lock;
+        std::vector<Event> m_ring;
+        uint64_t m_head = 0;
+        uint64_t m_tail = 0;
+        std::vector<KeySlot> m_keys;
+
+        // Only used by the single active consumer
+        std::vector<Event> m_batch;
+
+        // Blocked publishers
+        std::atomic<uint32_t> m_popSignal{0};
+        std::atomic<uint32_t> m_blockedProducers{0};
+
+        // Metrics
+        std::atomic<uint64_t> m_enqueued{0};
+        std::atomic<uint64_t> m_delivered{0};
+        std::atomic<uint64_t> m_dropped{0};
+        std::atomic<uint64_t> m_coalesced{0};
+        std::atomic<uint64_t> m_failed{0};
+        std::atomic<uint64_t> m_maxDepth{0};
+};
+
+
+/**
+ * Asynchronous event bus
+ */
+template <class Event>
+class AsyncEventBus
+{
+
+    public:
+
+        using SubscriberId = typename EventBus<Event>::SubscriberId;
+        using Queue = AsyncSubscriberQueue<Event>;
+
+        /**
+         * Constructor
+         * Starts the workers draining the subscriber queues.
+         */
+        explicit AsyncEventBus(size_t workerCount = 1) :
+            m_pool(workerCount) {}
+
+        /**
+         * Destructor
+         * Delivers all pending events before stopping the workers.
+         */
+        ~AsyncEventBus()
+        {
+            Flush();
+        }
+
+        // Delete copy constructor and copy-assignment
+        AsyncEventBus(AsyncEventBus const&) = delete;
+        AsyncEventBus& operator=(AsyncEventBus const&) = delete;
+
+        template <class F>
+        SubscriberId Subscribe(F&& callback, const AsyncSubscriberOptions<Event>& options = AsyncSubscriberOptions<Event>())
+        {
+            std::shared_ptr<Queue> queue = std::make_shared<Queue>(std::forward<F>(callback), options);
+
+            // The synchronous subscriber only enqueues, a full Block queue is
+            // left to Publish() to wait for outside of the dispatch
+            const SubscriberId id = m_bus.Subscribe([this, queue](const Event& event)
+            {
+                if (!queue->TryPush(event))
+                {
+                    Blocked().push_back(queue);
+                }
+                Schedule(queue);
+            });
+
+            std::lock_guard<std::mutex> lock(m_queuesMutex);
+            m_queues[id] = queue;
+            return id;
+        }
+
+        /**
+         * Remove a subscriber, events still pending for it are discarded.
+         */
+        bool Unsubscribe(SubscriberId id)
+        {
+            if (!m_bus.Unsubscribe(id))
+            {
+                return false;
+            }
+
+            std::lock_guard<std::mutex> lock(m_queuesMutex);
+            m_queues.erase(id);
+            return true;
+        }
+
+        /**
+         * Copy the event into the queue of every subscriber.
+         * Waits for space in full Block queues only after the dispatch has
+         * left its epoch guard, a waiting publisher must neither stall
+         * reclamation nor an Unsubscribe() called from a callback.
+         */
+        void Publish(const Event& event)
+        {
+            std::vector<std::shared_ptr<Queue> >& blocked = Blocked();
+            blocked.clear();
+            m_bus.Publish(event);
+
+            for (std::shared_ptr<Queue>& queue : blocked)
+            {
+                queue->Push(event);
+                Schedule(queue);
+            }
+            blocked.clear();
+        }
+
+        /**
+         * Counters of a single subscriber.
+         */
+        AsyncSubscriberMetrics Metrics(SubscriberId id)
+        {
+            std::lock_guard<std::mutex> lock(m_queuesMutex);
+            auto it = m_queues.find(id);
+            if (it == m_queues.end())
+            {
+                throw std::invalid_argument("Unknown subscriber");
+            }
+            return it->second->Metrics();
+        }
+
+        /**
+         * Block until every event published so far has been handled.
+         * Must not be called from a subscriber callback.
+         */
+        void Flush()
+        {
+            std::vector<std::shared_ptr<Queue> > queues;
+            {
+                std::lock_guard<std::mutex> lock(m_queuesMutex);
+                for (std::pair<const SubscriberId, std::shared_ptr<Queue> >& entry : m_queues)
+                {
+                    queues.push_back(entry.second);
+                }
+            }
+
+            for (std::shared_ptr<Queue>& queue : queues)
+            {
+                while (!queue->Empty() || queue->m_scheduled.load())
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+
+        /**
+         * Full Block queues met by the dispatch of the calling thread.
+         */
+        static std::vector<std::shared_ptr<Queue> >& Blocked()
+        {
+            thread_local std::vector<std::shared_ptr<Queue> > blocked;
+            return blocked;
+        }
+
+        /**
+         * Hand the queue to a worker unless one already owns it.
+         */
+        void Schedule(const std::shared_ptr<Queue>& queue, bool requeue = false)
+        {
+            if (!queue->m_scheduled.exchange(true))
+            {
+                auto task = [this, queue]
+                {
+                    Drain(queue);
+                };
+                if (requeue)
+                {
+                    m_pool.PostShared(std::move(task));
+                }
+                else
+                {
+                    m_pool.Post(std::move(task));
+                }
+            }
+        }
+
+        /**
+         * Worker task, deliver one batch and reschedule if more is pending.
+         * The queue goes to the back of the shared queue instead of looping,
+         * so queues already waiting take their turn first.
+         */
+        void Drain(const std::shared_ptr<Queue>& queue)
+        {
+            queue->DrainBatch();
+
+            // Release ownership, then re-check to not miss a concurrent push
+            queue->m_scheduled.store(false);
+            if (!queue->Empty())
+            {
+                Schedule(queue, true);
+            }
+        }
+
+        EventBus<Event> m_bus;
+
+        std::mutex m_queuesMutex;
+        std::unordered_map<SubscriberId, std::shared_ptr<Queue> > m_queues;
+
+        // Declared last, workers stop before the queues are destroyed
+        ForkJoinPool m_pool;
+};
+
+
+#endif //__ASYNC_EVENT_BUS_H_
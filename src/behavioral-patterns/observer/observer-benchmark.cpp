@@ -0,0 +1,160 @@
+/**
+* @file observer-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Observer benchmark
+*
+* Publishes events from several threads to many subscribers, once through
+* the copy-on-write EventBus and once through the textbook observer made of
+* a std::vector of std::function behind a std::mutex. A background thread
+* keeps subscribing and unsubscribing during the run.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread observer-benchmark.cpp -o observer-benchmark
+* ./observer-benchmark [publisher threads] [subscribers] [events per publisher]
+*
+*/
+
+#include "observer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct PriceEvent
+{
+    uint64_t m_instrument;
+    uint64_t m_price;
+};
+
+// Work done by every subscriber, kept per thread to avoid shared writes
+static thread_local uint64_t t_checksum = 0;
+
+void OnPrice(const PriceEvent& event)
+{
+    t_checksum += event.m_price;
+}
+
+
+/**
+ * Textbook observer, a vector of callbacks behind a mutex.
+ */
+class MutexEventBus
+{
+    public:
+        using SubscriberId = uint64_t;
+
+        SubscriberId Subscribe(std::function<void(const PriceEvent&)> callback)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_subscribers.emplace_back(++m_lastId, std::move(callback));
+            return m_lastId;
+        }
+
+        bool Unsubscribe(SubscriberId id)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (size_t i = 0; i < m_subscribers.size(); i++)
+            {
+                if (m_subscribers[i].first == id)
+                {
+                    m_subscribers.erase(m_subscribers.begin() + i);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void Publish(const PriceEvent& event)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (std::pair<SubscriberId, std::function<void(const PriceEvent&)> >& subscriber : m_subscribers)
+            {
+                subscriber.second(event);
+            }
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::vector<std::pair<SubscriberId, std::function<void(const PriceEvent&)> > > m_subscribers;
+        SubscriberId m_lastId = 0;
+};
+
+
+template <class Bus>
+void Run(const std::string& name, size_t publisherCount, size_t subscriberCount, size_t eventCount)
+{
+    Bus bus;
+    for (size_t i = 0; i < subscriberCount; i++)
+    {
+        bus.Subscribe(&OnPrice);
+    }
+
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> churn{0};
+
+    // Subscription churn during publishing
+    std::thread churner([&]
+    {
+        while (!done.load())
+        {
+            typename Bus::SubscriberId id = bus.Subscribe(&OnPrice);
+            bus.Unsubscribe(id);
+            churn.fetch_add(1, std::memory_order_relaxed);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> publishers;
+    for (size_t p = 0; p < publisherCount; p++)
+    {
+        publishers.emplace_back([&, p]
+        {
+            for (size_t i = 0; i < eventCount; i++)
+            {
+                bus.Publish(PriceEvent{p, i});
+            }
+        });
+    }
+
+    for (std::thread& publisher : publishers)
+    {
+        publisher.join();
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    done.store(true);
+    churner.join();
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    const double events = static_cast<double>(publisherCount * eventCount);
+    std::cout << name << "\n";
+    std::cout << "    events/s:        " << events / seconds / 1e6 << " M\n";
+    std::cout << "    deliveries/s:    " << events * subscriberCount / seconds / 1e6 << " M\n";
+    std::cout << "    churn ops:       " << churn.load() << "\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t publisherCount = (argc > 1) ? std::stoul(argv[1]) : 4;
+    const size_t subscriberCount = (argc > 2) ? std::stoul(argv[2]) : 16;
+    const size_t eventCount = (argc > 3) ? std::stoul(argv[3]) : 1000000;
+
+    std::cout << "Publishers: " << publisherCount << ", subscribers: " << subscriberCount
+        << ", events per publisher: " << eventCount << "\n\n";
+
+    Run<EventBus<PriceEvent> >("Copy-on-write EventBus", publisherCount, subscriberCount, eventCount);
+    Run<MutexEventBus>("Mutex and vector observer", publisherCount, subscriberCount, eventCount);
+    return 0;
+}
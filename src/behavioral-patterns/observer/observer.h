@@ -0,0 +1,278 @@
+/**
+* @file observer.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Observer behavioral pattern
+*
+* The Problem:
+*
+* An object (the subject) has to notify an open ended set of other objects
+* (the observers) about its events, without depending on their types.
+*
+* The textbook implementation keeps a vector of observers behind a mutex.
+* Every publish takes the lock, so publishers serialise with each other and
+* stall whenever somebody subscribes or unsubscribes.
+*
+* Solution:
+*
+* Observers register with the subject through a common interface and the
+* subject iterates over all registered observers on each event.
+*
+* The EventBus below stores its subscribers in an immutable array. Adding or
+* removing a subscriber copies the array and atomically swaps the pointer
+* (copy-on-write), the old array is retired through epoch-based reclamation
+* once no publisher can still be reading it. Publishing is an epoch guard,
+* one atomic load and a loop over the array, it never takes a lock, never
+* waits for other threads and never allocates.
+*
+* Subscribers may be added or removed at any time, including from inside a
+* callback. A dispatch already in progress keeps using the array it started
+* with, removed subscribers are skipped.
+*
+* Usage:
+*
+* EventBus<Event> bus;
+* auto id = bus.Subscribe([](const Event& event){ ... });
+* bus.Publish(Event{...});
+* bus.Unsubscribe(id);
+*
+* Notes:
+*
+* Subscribing and unsubscribing copy the array and are meant to be rare
+* compared to publishing.
+*
+*/
+
+#ifndef __OBSERVER_H_
+#define __OBSERVER_H_
+
+
+#include "../../concurrency-patterns/epoch-reclamation.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Observer interface
+ * Classic base class for objects interested in events of a subject.
+ */
+template <class Event>
+class Observer
+{
+    public:
+        virtual ~Observer() = default;
+        virtual void OnNotify(const Event& event) = 0;
+};
+
+
+/**
+ * Event Bus (subject)
+ */
+template <class Event>
+class EventBus
+{
+
+    public:
+
+        using SubscriberId = uint64_t;
+
+        /**
+         * Constructor
+         * The epoch domain must outlive every thread publishing on the bus.
+         */
+        explicit EventBus(EpochDomain& domain = EpochDomain::Global()) :
+            m_domain(domain), m_list(new SubscriberList()) {}
+
+        /**
+         * Destructor
+         * No thread may publish concurrently with the destruction.
+         */
+        ~EventBus()
+        {
+            SubscriberList* list = m_list.load();
+            for (Subscriber* subscriber : list->m_subscribers)
+            {
+                delete subscriber;
+            }
+            delete list;
+        }
+
+        // Delete copy constructor and copy-assignment
+        EventBus(EventBus const&) = delete;
+        EventBus& operator=(EventBus const&) = delete;
+
+        /**
+         * Register any callable accepting const Event&.
+         */
+        template <class F, class = std::enable_if_t<!std::is_convertible_v<F, Observer<Event>*> > >
+        SubscriberId Subscribe(F&& callback)
+        {
+            using Callable = std::decay_t<F>;
+
+            Subscriber* subscriber = new Subscriber();
+            subscriber->m_context = new Callable(std::forward<F>(callback));
+            subscriber->m_invoke = [](void* context, const Event& event)
+            {
+                (*static_cast<Callable*>(context))(event);
+            };
+            subscriber->m_destroy = [](void* context)
+            {
+                delete static_cast<Callable*>(context);
+            };
+            return Add(subscriber);
+        }
+
+        /**
+         * Register an observer object, the bus does not take ownership.
+         */
+        SubscriberId Subscribe(Observer<Event>* observer)
+        {
+            Subscriber* subscriber = new Subscriber();
+            subscriber->m_context = observer;
+            subscriber->m_invoke = [](void* context, const Event& event)
+            {
+                static_cast<Observer<Event>*>(context)->OnNotify(event);
+            };
+            return Add(subscriber);
+        }
+
+        /**
+         * Remove a subscriber.
+         * When called outside of a callback the function waits until no
+         * publisher can still be invoking the subscriber, so any state it
+         * references may be released afterwards. From inside a callback it
+         * returns immediately and the subscriber misses all further events.
+         * Returns false if the id is unknown.
+         */
+        bool Unsubscribe(SubscriberId id)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_writerMutex);
+
+                SubscriberList* current = m_list.load(std::memory_order_relaxed);
+                SubscriberList* updated = new SubscriberList();
+                updated->m_subscribers.reserve(current->m_subscribers.size());
+
+                Subscriber* removed = nullptr;
+                for (Subscriber* subscriber : current->m_subscribers)
+                {
+                    if (subscriber->m_id == id)
+                    {
+                        removed = subscriber;
+                    }
+                    else
+                    {
+                        updated->m_subscribers.push_back(subscriber);
+                    }
+                }
+
+                if (removed == nullptr)
+                {
+                    delete updated;
+                    return false;
+                }
+
+                // Dispatches in flight skip it from now on
+                removed->m_active.store(false, std::memory_order_release);
+
+                m_list.store(updated, std::memory_order_release);
+                m_domain.Retire(current);
+                m_domain.Retire(removed);
+            }
+
+            // Wait for publishers which may still be inside the callback
+            if (!m_domain.InGuard())
+            {
+                m_domain.Synchronize();
+            }
+            return true;
+        }
+
+        /**
+         * Deliver the event to every subscriber on the calling thread.
+         * Wait-free with respect to other publishers and subscribers.
+         */
+        void Publish(const Event& event)
+        {
+            EpochGuard guard(m_domain);
+            const SubscriberList* list = m_list.load(std::memory_order_acquire);
+
+            for (Subscriber* subscriber : list->m_subscribers)
+            {
+                if (subscriber->m_active.load(std::memory_order_acquire))
+                {
+                    subscriber->m_invoke(subscriber->m_context, event);
+                }
+            }
+        }
+
+        size_t SubscriberCount() const
+        {
+            EpochGuard guard(m_domain);
+            return m_list.load(std::memory_order_acquire)->m_subscribers.size();
+        }
+
+    private:
+
+        /**
+         * Registered callback, freed once no dispatch can reference it.
+         */
+        struct Subscriber
+        {
+            ~Subscriber()
+            {
+                if (m_destroy != nullptr)
+                {
+                    m_destroy(m_context);
+                }
+            }
+
+            SubscriberId m_id = 0;
+            std::atomic<bool> m_active{true};
+            void* m_context = nullptr;
+            void (*m_invoke)(void*, const Event&) = nullptr;
+            void (*m_destroy)(void*) = nullptr;
+        };
+
+        /**
+         * Immutable snapshot of all subscribers.
+         */
+        struct SubscriberList
+        {
+            std::vector<Subscriber*> m_subscribers;
+        };
+
+        SubscriberId Add(Subscriber* subscriber)
+        {
+            std::lock_guard<std::mutex> lock(m_writerMutex);
+
+            subscriber->m_id = ++m_lastId;
+
+            // Copy, extend and publish the new snapshot
+            SubscriberList* current = m_list.load(std::memory_order_relaxed);
+            SubscriberList* updated = new SubscriberList();
+            updated->m_subscribers = current->m_subscribers;
+            updated->m_subscribers.push_back(subscriber);
+
+            m_list.store(updated, std::memory_order_release);
+            m_domain.Retire(current);
+            return subscriber->m_id;
+        }
+
+        EpochDomain& m_domain;
+        std::atomic<SubscriberList*> m_list;
+
+        // Serialises subscribe and unsubscribe, never taken by Publish()
+        std::mutex m_writerMutex;
+        SubscriberId m_lastId = 0;
+};
+
+
+#endif //__OBSERVER_H_
@@ -0,0 +1,331 @@
+/**
+* @file state-machine-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* State machine benchmark
+*
+* A connection with four states driven by a random stream of five events,
+* with guards and actions counting bytes and retries. The same machine is
+* written three times, as the classic State pattern allocating a new state
+* object on every transition and calling it through a virtual interface,
+* as a hand written switch, and as a StateMachine over a transition table.
+* All three must end with the same counters and in the same state.
+*
+* Build:
+* g++ -std=c++20 -O2 -DNDEBUG state-machine-benchmark.cpp -o state-machine-benchmark
+* ./state-machine-benchmark [events]
+*
+*/
+
+#include "state-machine.h"
+#include "../../benchmark.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+struct Connection
+{
+    uint64_t m_bytes = 0;
+    uint32_t m_retries = 0;
+    uint32_t m_opened = 0;
+    static const uint32_t MaxRetries = 3;
+
+    uint64_t Checksum(size_t state) const
+    {
+        return m_bytes * 31 + m_retries * 7 + m_opened * 3 + state;
+    }
+};
+
+// Events, named for the tracer of debug builds
+struct Connect { static constexpr const char* Name = "Connect"; };
+struct Ack { static constexpr const char* Name = "Ack"; };
+struct Data { static constexpr const char* Name = "Data"; uint32_t m_size; };
+struct Close { static constexpr const char* Name = "Close"; };
+struct Timeout { static constexpr const char* Name = "Timeout"; };
+
+enum EventCode : uint8_t
+{
+    ConnectCode,
+    AckCode,
+    DataCode,
+    CloseCode,
+    TimeoutCode
+};
+
+// States, the numbering is shared by every implementation
+struct Idle { static constexpr const char* Name = "Idle"; };
+struct Connecting { static constexpr const char* Name = "Connecting"; };
+struct Open { static constexpr const char* Name = "Open"; };
+struct Closing { static constexpr const char* Name = "Closing"; };
+
+
+/**
+ * Table driven
+ */
+struct CountOpen
+{
+    void operator()(Connection& connection, const Ack&) const
+    {
+        connection.m_opened++;
+        connection.m_retries = 0;
+    }
+};
+
+struct CountBytes
+{
+    void operator()(Connection& connection, const Data& data) const
+    {
+        connection.m_bytes += data.m_size;
+    }
+};
+
+struct CountRetry
+{
+    void operator()(Connection& connection, const Timeout&) const
+    {
+        connection.m_retries++;
+    }
+};
+
+struct CanRetry
+{
+    bool operator()(const Connection& connection, const Timeout&) const
+    {
+        return connection.m_retries < Connection::MaxRetries;
+    }
+};
+
+using ConnectionTable = TransitionTable<
+    Transition<Idle,       Connect, Connecting>,
+    Transition<Connecting, Ack,     Open,       CountOpen>,
+    Transition<Connecting, Timeout, Connecting, CountRetry, CanRetry>,
+    Transition<Connecting, Timeout, Idle>,
+    Transition<Open,       Data,    Open,       CountBytes>,
+    Transition<Open,       Close,   Closing>,
+    Transition<Open,       Timeout, Closing>,
+    Transition<Closing,    Ack,     Idle>,
+    Transition<Closing,    Timeout, Idle> >;
+
+using ConnectionMachine = StateMachine<ConnectionTable, Connection, StateStreamTracer>;
+
+
+/**
+ * Hand written switch
+ */
+class SwitchMachine
+{
+    public:
+        void Process(Connection& connection, EventCode event, uint32_t size)
+        {
+            switch (m_state)
+            {
+                case 0:
+                    if (event == ConnectCode)
+                    {
+                        m_state = 1;
+                    }
+                    break;
+                case 1:
+                    if (event == AckCode)
+                    {
+                        connection.m_opened++;
+                        connection.m_retries = 0;
+                        m_state = 2;
+                    }
+                    else if (event == TimeoutCode)
+                    {
+                        if (connection.m_retries < Connection::MaxRetries)
+                        {
+                            connection.m_retries++;
+                        }
+                        else
+                        {
+                            m_state = 0;
+                        }
+                    }
+                    break;
+                case 2:
+                    if (event == DataCode)
+                    {
+                        connection.m_bytes += size;
+                    }
+                    else if (event == CloseCode || event == TimeoutCode)
+                    {
+                        m_state = 3;
+                    }
+                    break;
+                case 3:
+                    if (event == AckCode || event == TimeoutCode)
+                    {
+                        m_state = 0;
+                    }
+                    break;
+            }
+        }
+
+        size_t CurrentIndex() const
+        {
+            return m_state;
+        }
+
+    private:
+        uint8_t m_state = 0;
+};
+
+
+/**
+ * Classic State pattern, a new state object per transition
+ */
+class ConnectionState
+{
+    public:
+        virtual ~ConnectionState() = default;
+        virtual std::unique_ptr<ConnectionState> Handle(Connection& connection, EventCode event, uint32_t size) = 0;
+        virtual size_t Index() const = 0;
+};
+
+class IdleState : public ConnectionState
+{
+    public:
+        std::unique_ptr<ConnectionState> Handle(Connection& connection, EventCode event, uint32_t size) override;
+        size_t Index() const override { return 0; }
+};
+
+class ConnectingState : public ConnectionState
+{
+    public:
+        std::unique_ptr<ConnectionState> Handle(Connection& connection, EventCode event, uint32_t size) override;
+        size_t Index() const override { return 1; }
+};
+
+class OpenState : public ConnectionState
+{
+    public:
+        std::unique_ptr<ConnectionState> Handle(Connection& connection, EventCode event, uint32_t size) override;
+        size_t Index() const override { return 2; }
+};
+
+class ClosingState : public ConnectionState
+{
+    public:
+        std::unique_ptr<ConnectionState> Handle(Connection& connection, EventCode event, uint32_t size) override;
+        size_t Index() const override { return 3; }
+};
+
+std::unique_ptr<ConnectionState> IdleState::Handle(Connection&, EventCode event, uint32_t)
+{
+    return event == ConnectCode ? std::make_unique<ConnectingState>() : nullptr;
+}
+
+std::unique_ptr<ConnectionState> ConnectingState::Handle(Connection& connection, EventCode event, uint32_t)
+{
+    if (event == AckCode)
+    {
+        connection.m_opened++;
+        connection.m_retries = 0;
+        return std::make_unique<OpenState>();
+    }
+    if (event == TimeoutCode)
+    {
+        if (connection.m_retries < Connection::MaxRetries)
+        {
+            connection.m_retries++;
+            return std::make_unique<ConnectingState>();
+        }
+        return std::make_unique<IdleState>();
+    }
+    return nullptr;
+}
+
+std::unique_ptr<ConnectionState> OpenState::Handle(Connection& connection, EventCode event, uint32_t size)
+{
+    if (event == DataCode)
+    {
+        connection.m_bytes += size;
+        return std::make_unique<OpenState>();
+    }
+    if (event == CloseCode || event == TimeoutCode)
+    {
+        return std::make_unique<ClosingState>();
+    }
+    return nullptr;
+}
+
+std::unique_ptr<ConnectionState> ClosingState::Handle(Connection&, EventCode event, uint32_t)
+{
+    return event == AckCode || event == TimeoutCode ? std::make_unique<IdleState>() : nullptr;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000000;
+    std::cout << "Events: " << count << ", tracing: " << (StateStreamTracer::Enabled ? "on" : "off") << "\n";
+
+    // Weighted towards data so connections spend time open
+    std::mt19937 random(42);
+    std::vector<EventCode> events(count);
+    std::vector<uint32_t> sizes(count);
+    const EventCode weights[] = {ConnectCode, ConnectCode, AckCode, AckCode, DataCode, DataCode, DataCode, DataCode, CloseCode, TimeoutCode};
+    for (size_t i = 0; i < count; i++)
+    {
+        events[i] = weights[random() % 10];
+        sizes[i] = random() % 1500;
+    }
+
+    uint64_t results[3];
+    Measure("  virtual state objects", count, [&]()
+    {
+        Connection connection;
+        std::unique_ptr<ConnectionState> state = std::make_unique<IdleState>();
+        for (size_t i = 0; i < count; i++)
+        {
+            std::unique_ptr<ConnectionState> next = state->Handle(connection, events[i], sizes[i]);
+            if (next != nullptr)
+            {
+                state = std::move(next);
+            }
+        }
+        return results[0] = connection.Checksum(state->Index());
+    }, "event");
+
+    Measure("  hand written switch  ", count, [&]()
+    {
+        Connection connection;
+        SwitchMachine machine;
+        for (size_t i = 0; i < count; i++)
+        {
+            machine.Process(connection, events[i], sizes[i]);
+        }
+        return results[1] = connection.Checksum(machine.CurrentIndex());
+    }, "event");
+
+    Measure("  transition table     ", count, [&]()
+    {
+        Connection connection;
+        ConnectionMachine machine;
+        for (size_t i = 0; i < count; i++)
+        {
+            switch (events[i])
+            {
+                case ConnectCode: machine.Process(connection, Connect{}); break;
+                case AckCode: machine.Process(connection, Ack{}); break;
+                case DataCode: machine.Process(connection, Data{sizes[i]}); break;
+                case CloseCode: machine.Process(connection, Close{}); break;
+                case TimeoutCode: machine.Process(connection, Timeout{}); break;
+            }
+        }
+        return results[2] = connection.Checksum(machine.CurrentIndex());
+    }, "event");
+
+    const bool same = results[0] == results[1] && results[1] == results[2];
+    std::cout << "  same result: " << (same ? "yes" : "no") << ", table machine size " << sizeof(ConnectionMachine) << " byte\n";
+    return same ? 0 : 1;
+}
@@ -0,0 +1,306 @@
+/**
+* @file state-machine.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* State behavioral pattern, table driven
+*
+* The Problem:
+*
+* An object changes its behaviour depending on its internal state. The
+* classic State pattern gives each state its own class behind a common
+* interface and swaps the state object on every transition, which costs an
+* allocation per transition and a virtual call per event, and spreads the
+* transitions across many classes.
+*
+* Solution:
+*
+* Describe the machine as a transition table, rows of
+*
+*   Transition<From, Event, To, Action, Guard>
+*
+* in a single place. States and events are types, actions and guards are
+* stateless function objects. The table is evaluated entirely at compile
+* time, the machine only stores the index of the current state. Processing
+* an event expands into a chain of comparisons over the rows handling that
+* event, which the compiler turns into a switch or a jump table, and
+* actions and guards are inlined.
+*
+* Usage:
+*
+* struct Locked {}; struct Unlocked {};
+* struct Coin {}; struct Push {};
+*
+* struct CountCoin { void operator()(Turnstile& t, const Coin&) const { t.m_coins++; } };
+*
+* using Table = TransitionTable<
+*     Transition<Locked,   Coin, Unlocked, CountCoin>,
+*     Transition<Unlocked, Push, Locked>,
+*     Transition<Unlocked, Coin, Unlocked, CountCoin> >;
+*
+* StateMachine<Table, Turnstile> machine;
+* machine.Process(turnstile, Coin{});
+* machine.Is<Unlocked>();
+*
+* The initial state is the From state of the first row.
+*
+* Notes:
+*
+* Transition tracing is provided by the tracer parameter. StateStreamTracer
+* prints every transition in debug builds and is compiled out entirely when
+* NDEBUG is defined, NullStateTracer never traces.
+*
+* References:
+* https://boost-ext.github.io/sml/
+*
+*/
+
+#ifndef __STATE_MACHINE_H_
+#define __STATE_MACHINE_H_
+
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+
+
+/**
+ * Default action, does nothing.
+ */
+struct NoAction
+{
+    template <class Context, class Event>
+    void operator()(Context&, const Event&) const {}
+};
+
+/**
+ * Default guard, always allows the transition.
+ */
+struct NoGuard
+{
+    template <class Context, class Event>
+    bool operator()(const Context&, const Event&) const
+    {
+        return true;
+    }
+};
+
+/**
+ * Row of a transition table.
+ * On Event in state From, if Guard allows it, run Action and enter To.
+ */
+template <class From, class Event, class To, class Action = NoAction, class Guard = NoGuard>
+struct Transition
+{
+    using FromState = From;
+    using EventType = Event;
+    using ToState = To;
+    using ActionType = Action;
+    using GuardType = Guard;
+};
+
+/**
+ * List of transitions describing the machine.
+ */
+template <class... Rows>
+struct TransitionTable
+{
+    static_assert(sizeof...(Rows) > 0, "Transition table must not be empty");
+    using RowTuple = std::tuple<Rows...>;
+};
+
+
+/**
+ * Tracer which never traces.
+ */
+struct NullStateTracer
+{
+    static const bool Enabled = false;
+
+    template <class From, class Event, class To>
+    static void OnTransition() {}
+};
+
+/**
+ * Tracer printing transitions to std::clog, compiled out in release builds.
+ * States and events may provide static constexpr const char* Name.
+ */
+struct StateStreamTracer
+{
+#ifdef NDEBUG
+    static const bool Enabled = false;
+#else
+    static const bool Enabled = true;
+#endif
+
+    template <class From, class Event, class To>
+    static void OnTransition()
+    {
+        std::clog << "[state] " << NameOf<From>() << " --" << NameOf<Event>() << "--> " << NameOf<To>() << "\n";
+    }
+
+    template <class T, class = void>
+    struct HasName : std::false_type {};
+
+    template <class T>
+    struct HasName<T, std::void_t<decltype(T::Name)> > : std::true_type {};
+
+    template <class T>
+    static const char* NameOf()
+    {
+        if constexpr (HasName<T>::value)
+        {
+            return T::Name;
+        }
+        else
+        {
+            return typeid(T).name();
+        }
+    }
+};
+
+
+/**
+ * Compile time helpers over the transition table
+ */
+namespace StateMachineDetail
+{
+    // Append T to a tuple of types unless it is already present
+    template <class Tuple, class T>
+    struct AppendUnique;
+
+    template <class... Ts, class T>
+    struct AppendUnique<std::tuple<Ts...>, T>
+    {
+        using Type = std::conditional_t<(std::is_same_v<T, Ts> || ...), std::tuple<Ts...>, std::tuple<Ts..., T> >;
+    };
+
+    // All distinct states in order of first appearance
+    template <class Accumulated, class... Rows>
+    struct CollectStates
+    {
+        using Type = Accumulated;
+    };
+
+    template <class Accumulated, class Row, class... Rows>
+    struct CollectStates<Accumulated, Row, Rows...>
+    {
+        using WithFrom = typename AppendUnique<Accumulated, typename Row::FromState>::Type;
+        using WithTo = typename AppendUnique<WithFrom, typename Row::ToState>::Type;
+        using Type = typename CollectStates<WithTo, Rows...>::Type;
+    };
+
+    // Index of T in a tuple of types
+    template <class T, class Tuple>
+    struct IndexOf;
+
+    template <class T, class... Ts>
+    struct IndexOf<T, std::tuple<T, Ts...> >
+    {
+        static const size_t Value = 0;
+    };
+
+    template <class T, class U, class... Ts>
+    struct IndexOf<T, std::tuple<U, Ts...> >
+    {
+        static const size_t Value = 1 + IndexOf<T, std::tuple<Ts...> >::Value;
+    };
+
+    template <class T>
+    struct IndexOf<T, std::tuple<> >
+    {
+        static_assert(sizeof(T) == 0, "State is not part of the transition table");
+        static const size_t Value = 0;
+    };
+}
+
+
+/**
+ * State Machine
+ * Stores only the index of the current state.
+ */
+template <class Table, class Context, class Tracer = NullStateTracer>
+class StateMachine;
+
+template <class... Rows, class Context, class Tracer>
+class StateMachine<TransitionTable<Rows...>, Context, Tracer>
+{
+
+    public:
+
+        // All states of the machine, the first one is the initial state
+        using States = typename StateMachineDetail::CollectStates<std::tuple<>, Rows...>::Type;
+
+        static const size_t StateCount = std::tuple_size_v<States>;
+
+        static_assert(StateCount <= 256, "Too many states");
+
+        /**
+         * Dispatch the event.
+         * Returns false if no transition handles the event in the current
+         * state or every guard rejected it, the state is then unchanged.
+         */
+        template <class Event>
+        bool Process(Context& context, const Event& event)
+        {
+            // Only rows for this event take part, the first matching row wins
+            return (TryRow<Rows>(context, event) || ...);
+        }
+
+        // Whether the machine is currently in the given state
+        template <class State>
+        bool Is() const
+        {
+            return m_state == StateMachineDetail::IndexOf<State, States>::Value;
+        }
+
+        // Index of the current state within States
+        size_t CurrentIndex() const
+        {
+            return m_state;
+        }
+
+        // Return to the initial state
+        void Reset()
+        {
+            m_state = 0;
+        }
+
+    private:
+
+        template <class Row, class Event>
+        bool TryRow(Context& context, const Event& event)
+        {
+            if constexpr (std::is_same_v<typename Row::EventType, Event>)
+            {
+                constexpr uint8_t from = StateMachineDetail::IndexOf<typename Row::FromState, States>::Value;
+                constexpr uint8_t to = StateMachineDetail::IndexOf<typename Row::ToState, States>::Value;
+
+                if (m_state != from || !typename Row::GuardType()(static_cast<const Context&>(context), event))
+                {
+                    return false;
+                }
+
+                typename Row::ActionType()(context, event);
+                m_state = to;
+
+                if constexpr (Tracer::Enabled)
+                {
+                    Tracer::template OnTransition<typename Row::FromState, Event, typename Row::ToState>();
+                }
+                return true;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        uint8_t m_state = 0;
+};
+
+
+#endif //__STATE_MACHINE_H_
@@ -0,0 +1,476 @@
+/**
+* @file cpu-dispatch.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Strategy selected by the host CPU
+*
+* The Problem:
+*
+* Numeric kernels compiled for the baseline instruction set leave most of
+* a modern CPU unused, while kernels compiled for AVX2 or AVX-512 crash on
+* hosts without them. Shipping one binary per instruction set is rarely an
+* option.
+*
+* Solution:
+*
+* Compile every kernel several times inside the same binary, each version
+* with a target attribute enabling one instruction set, and pick the best
+* version the CPU supports once at startup. The choice is a strategy
+* stored in a function pointer, every call afterwards is one indirect call
+* with no feature checks.
+*
+*   CpuDispatch<Function> keeps one implementation per CpuLevel and selects
+*   the highest level which is both implemented and supported.
+*
+* CpuDotProduct(), CpuAxpy() and CpuSum() below are kernels built on it,
+* prefixed since every header including this one sees them. Setting the
+* environment variable CPU_DISPATCH_LEVEL to generic, sse2, avx2 or avx512
+* caps the selected level, which is useful for testing and benchmarking
+* the lower tiers on a capable host.
+*
+* Notes:
+*
+* GCC also offers __attribute__((target_clones)) which generates the
+* versions and the resolver automatically, but it needs ifunc support
+* from the loader and gives no control over the selection.
+*
+* References:
+* https://gcc.gnu.org/onlinedocs/gcc/Function-Multiversioning.html
+*
+*/
+
+#ifndef __CPU_DISPATCH_H_
+#define __CPU_DISPATCH_H_
+
+
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_DISPATCH_X86 1
+#include <immintrin.h>
+#else
+#define CPU_DISPATCH_X86 0
+#endif
+
+
+/**
+ * Instruction set tiers, ordered from the most portable.
+ */
+enum class CpuLevel
+{
+    Generic = 0,
+    Sse2,
+    Avx2,
+    Avx512,
+    Count
+};
+
+inline const char* CpuLevelName(CpuLevel level)
+{
+    switch (level)
+    {
+        case CpuLevel::Generic: return "generic";
+        case CpuLevel::Sse2: return "sse2";
+        case CpuLevel::Avx2: return "avx2";
+        case CpuLevel::Avx512: return "avx512";
+        default: return "unknown";
+    }
+}
+
+
+/**
+ * Highest level supported by the host, capped by CPU_DISPATCH_LEVEL.
+ * Detected once, cpuid is not cheap.
+ */
+inline CpuLevel DetectCpuLevel()
+{
+    static const CpuLevel level = []()
+    {
+        CpuLevel detected = CpuLevel::Generic;
+#if CPU_DISPATCH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2"))
+        {
+            detected = CpuLevel::Sse2;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            detected = CpuLevel::Avx2;
+        }
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            detected = CpuLevel::Avx512;
+        }
+#endif
+        // Optional cap, never raises the level above what the CPU supports
+        if (const char* cap = std::getenv("CPU_DISPATCH_LEVEL"))
+        {
+            for (int i = 0; i < static_cast<int>(CpuLevel::Count); i++)
+            {
+                if (std::strcmp(cap, CpuLevelName(static_cast<CpuLevel>(i))) == 0 && i < static_cast<int>(detected))
+                {
+                    detected = static_cast<CpuLevel>(i);
+                }
+            }
+        }
+        return detected;
+    }();
+    return level;
+}
+
+
+/**
+ * Set of implementations of one kernel, one per level.
+ * Levels without an implementation are left null, the generic one is
+ * mandatory.
+ */
+template <class Function>
+class CpuDispatch
+{
+    public:
+
+        explicit CpuDispatch(Function generic)
+        {
+            m_implementations.fill(nullptr);
+            m_implementations[static_cast<size_t>(CpuLevel::Generic)] = generic;
+        }
+
+        CpuDispatch& Add(CpuLevel level, Function implementation)
+        {
+            m_implementations[static_cast<size_t>(level)] = implementation;
+            return *this;
+        }
+
+        /**
+         * Best implementation for the given level.
+         */
+        Function Select(CpuLevel level = DetectCpuLevel()) const
+        {
+            for (size_t i = static_cast<size_t>(level) + 1; i-- > 0; )
+            {
+                if (m_implementations[i] != nullptr)
+                {
+                    return m_implementations[i];
+                }
+            }
+            return m_implementations[0];
+        }
+
+        /**
+         * Level of the implementation Select() returns.
+         */
+        CpuLevel SelectedLevel(CpuLevel level = DetectCpuLevel()) const
+        {
+            for (size_t i = static_cast<size_t>(level) + 1; i-- > 0; )
+            {
+                if (m_implementations[i] != nullptr)
+                {
+                    return static_cast<CpuLevel>(i);
+                }
+            }
+            return CpuLevel::Generic;
+        }
+
+    private:
+
+        std::array<Function, static_cast<size_t>(CpuLevel::Count)> m_implementations;
+};
+
+
+/**
+ * Kernel implementations
+ */
+namespace CpuKernels
+{
+    using DotProductFunction = float (*)(const float*, const float*, size_t);
+    using AxpyFunction = void (*)(float, const float*, float*, size_t);
+    using SumFunction = float (*)(const float*, size_t);
+
+    inline float DotProductGeneric(const float* a, const float* b, size_t count)
+    {
+        float result = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            result += a[i] * b[i];
+        }
+        return result;
+    }
+
+    inline void AxpyGeneric(float alpha, const float* x, float* y, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            y[i] += alpha * x[i];
+        }
+    }
+
+    inline float SumGeneric(const float* values, size_t count)
+    {
+        float result = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            result += values[i];
+        }
+        return result;
+    }
+
+#if CPU_DISPATCH_X86
+
+    __attribute__((target("sse2")))
+    inline float HorizontalSum128(__m128 v)
+    {
+        __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 sums = _mm_add_ps(v, shuffled);
+        shuffled = _mm_movehl_ps(shuffled, sums);
+        return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+    }
+
+    __attribute__((target("sse2")))
+    inline float DotProductSse2(const float* a, const float* b, size_t count)
+    {
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        float result = HorizontalSum128(_mm_add_ps(sum0, sum1));
+        for (; i < count; i++)
+        {
+            result += a[i] * b[i];
+        }
+        return result;
+    }
+
+    __attribute__((target("sse2")))
+    inline void AxpySse2(float alpha, const float* x, float* y, size_t count)
+    {
+        const __m128 factor = _mm_set1_ps(alpha);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(factor, _mm_loadu_ps(x + i))));
+        }
+        for (; i < count; i++)
+        {
+            y[i] += alpha * x[i];
+        }
+    }
+
+    __attribute__((target("sse2")))
+    inline float SumSse2(const float* values, size_t count)
+    {
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            sum0 = _mm_add_ps(sum0, _mm_loadu_ps(values + i));
+            sum1 = _mm_add_ps(sum1, _mm_loadu_ps(values + i + 4));
+        }
+        float result = HorizontalSum128(_mm_add_ps(sum0, sum1));
+        for (; i < count; i++)
+        {
+            result += values[i];
+        }
+        return result;
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline float HorizontalSum256(__m256 v)
+    {
+        return HorizontalSum128(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline float DotProductAvx2(const float* a, const float* b, size_t count)
+    {
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+            sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+        }
+        float result = HorizontalSum256(_mm256_add_ps(sum0, sum1));
+        for (; i < count; i++)
+        {
+            result += a[i] * b[i];
+        }
+        return result;
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void AxpyAvx2(float alpha, const float* x, float* y, size_t count)
+    {
+        const __m256 factor = _mm256_set1_ps(alpha);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_ps(y + i, _mm256_fmadd_ps(factor, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+        }
+        for (; i < count; i++)
+        {
+            y[i] += alpha * x[i];
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline float SumAvx2(const float* values, size_t count)
+    {
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            sum0 = _mm256_add_ps(sum0, _mm256_loadu_ps(values + i));
+            sum1 = _mm256_add_ps(sum1, _mm256_loadu_ps(values + i + 8));
+        }
+        float result = HorizontalSum256(_mm256_add_ps(sum0, sum1));
+        for (; i < count; i++)
+        {
+            result += values[i];
+        }
+        return result;
+    }
+
+    // _mm512_reduce_add_ps trips -Wuninitialized inside GCC 12 headers
+    __attribute__((target("avx512f")))
+    inline float HorizontalSum512(__m512 v)
+    {
+        alignas(64) float lanes[16];
+        _mm512_store_ps(lanes, v);
+
+        float result = 0.0f;
+        for (float lane : lanes)
+        {
+            result += lane;
+        }
+        return result;
+    }
+
+    __attribute__((target("avx512f")))
+    inline float DotProductAvx512(const float* a, const float* b, size_t count)
+    {
+        __m512 sum0 = _mm512_setzero_ps();
+        __m512 sum1 = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+        {
+            sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum0);
+            sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), sum1);
+        }
+        // Masked tail, no scalar loop needed
+        for (; i < count; i += 16)
+        {
+            size_t remaining = count - i < 16 ? count - i : 16;
+            __mmask16 mask = static_cast<__mmask16>((1u << remaining) - 1);
+            sum0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), sum0);
+        }
+        return HorizontalSum512(_mm512_add_ps(sum0, sum1));
+    }
+
+    __attribute__((target("avx512f")))
+    inline void AxpyAvx512(float alpha, const float* x, float* y, size_t count)
+    {
+        const __m512 factor = _mm512_set1_ps(alpha);
+        for (size_t i = 0; i < count; i += 16)
+        {
+            size_t remaining = count - i < 16 ? count - i : 16;
+            __mmask16 mask = static_cast<__mmask16>((1u << remaining) - 1);
+            __m512 result = _mm512_fmadd_ps(factor, _mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, y + i));
+            _mm512_mask_storeu_ps(y + i, mask, result);
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    inline float SumAvx512(const float* values, size_t count)
+    {
+        __m512 sum0 = _mm512_setzero_ps();
+        __m512 sum1 = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+        {
+            sum0 = _mm512_add_ps(sum0, _mm512_loadu_ps(values + i));
+            sum1 = _mm512_add_ps(sum1, _mm512_loadu_ps(values + i + 16));
+        }
+        for (; i < count; i += 16)
+        {
+            size_t remaining = count - i < 16 ? count - i : 16;
+            __mmask16 mask = static_cast<__mmask16>((1u << remaining) - 1);
+            sum0 = _mm512_add_ps(sum0, _mm512_maskz_loadu_ps(mask, values + i));
+        }
+        return HorizontalSum512(_mm512_add_ps(sum0, sum1));
+    }
+
+#endif
+
+    inline const CpuDispatch<DotProductFunction>& DotProductTable()
+    {
+        static const CpuDispatch<DotProductFunction> table = CpuDispatch<DotProductFunction>(&DotProductGeneric)
+#if CPU_DISPATCH_X86
+            .Add(CpuLevel::Sse2, &DotProductSse2)
+            .Add(CpuLevel::Avx2, &DotProductAvx2)
+            .Add(CpuLevel::Avx512, &DotProductAvx512)
+#endif
+            ;
+        return table;
+    }
+
+    inline const CpuDispatch<AxpyFunction>& AxpyTable()
+    {
+        static const CpuDispatch<AxpyFunction> table = CpuDispatch<AxpyFunction>(&AxpyGeneric)
+#if CPU_DISPATCH_X86
+            .Add(CpuLevel::Sse2, &AxpySse2)
+            .Add(CpuLevel::Avx2, &AxpyAvx2)
+            .Add(CpuLevel::Avx512, &AxpyAvx512)
+#endif
+            ;
+        return table;
+    }
+
+    inline const CpuDispatch<SumFunction>& SumTable()
+    {
+        static const CpuDispatch<SumFunction> table = CpuDispatch<SumFunction>(&SumGeneric)
+#if CPU_DISPATCH_X86
+            .Add(CpuLevel::Sse2, &SumSse2)
+            .Add(CpuLevel::Avx2, &SumAvx2)
+            .Add(CpuLevel::Avx512, &SumAvx512)
+#endif
+            ;
+        return table;
+    }
+}
+
+
+/**
+ * Dispatched kernels, the implementation is resolved on the first call.
+ */
+inline float CpuDotProduct(const float* a, const float* b, size_t count)
+{
+    static const CpuKernels::DotProductFunction function = CpuKernels::DotProductTable().Select();
+    return function(a, b, count);
+}
+
+// y += alpha * x
+inline void CpuAxpy(float alpha, const float* x, float* y, size_t count)
+{
+    static const CpuKernels::AxpyFunction function = CpuKernels::AxpyTable().Select();
+    function(alpha, x, y, count);
+}
+
+inline float CpuSum(const float* values, size_t count)
+{
+    static const CpuKernels::SumFunction function = CpuKernels::SumTable().Select();
+    return function(values, count);
+}
+
+
+#endif //__CPU_DISPATCH_H_
@@ -0,0 +1,194 @@
+/**
+* @file strategy-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Strategy benchmark
+*
+* Part one applies a small strategy to every element of an array through
+* a virtual base class, std::function, Strategy and PolicyContext.
+*
+* Part two runs the CPU dispatched kernels at every level the host
+* supports and verifies they agree with the generic implementation.
+*
+* Build:
+* g++ -std=c++20 -O2 strategy-benchmark.cpp -o strategy-benchmark
+* ./strategy-benchmark [elements] [rounds]
+*
+*/
+
+#include "strategy.h"
+#include "cpu-dispatch.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+/**
+ * Textbook strategy through an abstract base class.
+ */
+class ScaleStrategy
+{
+    public:
+        virtual ~ScaleStrategy() = default;
+        virtual uint64_t Apply(uint64_t value) const = 0;
+};
+
+class MultiplyAdd : public ScaleStrategy
+{
+    public:
+        MultiplyAdd(uint64_t factor, uint64_t offset) :
+            m_factor(factor), m_offset(offset) {}
+
+        uint64_t Apply(uint64_t value) const override
+        {
+            return value * m_factor + m_offset;
+        }
+
+    private:
+        uint64_t m_factor;
+        uint64_t m_offset;
+};
+
+struct MultiplyAddPolicy
+{
+    uint64_t m_factor = 3;
+    uint64_t m_offset = 7;
+
+    uint64_t operator()(uint64_t value) const
+    {
+        return value * m_factor + m_offset;
+    }
+};
+
+
+template <class F>
+double Measure(F&& function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+template <class F>
+void RunStrategy(const std::string& name, const std::vector<uint64_t>& values, size_t rounds, F&& apply)
+{
+    uint64_t checksum = 0;
+    double seconds = Measure([&]()
+    {
+        for (size_t round = 0; round < rounds; round++)
+        {
+            for (uint64_t value : values)
+            {
+                checksum += apply(value);
+            }
+        }
+    });
+
+    std::cout << name << ": " << (seconds * 1e9 / (values.size() * rounds)) << " ns/element (checksum " << checksum << ")\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t elements = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 20;
+    const size_t rounds = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 50;
+
+    std::mt19937 random(42);
+    std::vector<uint64_t> values(elements);
+    for (uint64_t& value : values)
+    {
+        value = random();
+    }
+
+    std::cout << "Elements: " << elements << ", rounds: " << rounds << "\n\nStrategy binding\n";
+
+    // Opaque to the optimiser, as a strategy chosen from configuration would be
+    std::unique_ptr<ScaleStrategy> object = std::make_unique<MultiplyAdd>(3, 7);
+    const ScaleStrategy* virtualStrategy = object.get();
+    RunStrategy("  virtual       ", values, rounds, [&](uint64_t value) { return virtualStrategy->Apply(value); });
+
+    uint64_t factor = 3, offset = 7;
+    std::function<uint64_t(uint64_t)> function = [factor, offset](uint64_t value) { return value * factor + offset; };
+    RunStrategy("  std::function ", values, rounds, [&](uint64_t value) { return function(value); });
+
+    Strategy<uint64_t(uint64_t)> strategy = [factor, offset](uint64_t value) { return value * factor + offset; };
+    RunStrategy("  Strategy      ", values, rounds, [&](uint64_t value) { return strategy(value); });
+    std::cout << "    stored inline: " << (strategy.IsInline() ? "yes" : "no") << "\n";
+
+    PolicyContext<MultiplyAddPolicy> policy;
+    RunStrategy("  PolicyContext ", values, rounds, [&](uint64_t value) { return policy(value); });
+
+    // Kernels at every level up to the detected one
+    std::vector<float> a(elements), b(elements), y(elements);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    for (size_t i = 0; i < elements; i++)
+    {
+        a[i] = distribution(random);
+        b[i] = distribution(random);
+    }
+
+    const CpuLevel hostLevel = DetectCpuLevel();
+    std::cout << "\nCPU dispatch, host level " << CpuLevelName(hostLevel) << "\n";
+
+    const float reference = CpuKernels::DotProductGeneric(a.data(), b.data(), elements);
+    for (int level = 0; level <= static_cast<int>(hostLevel); level++)
+    {
+        CpuLevel cpuLevel = static_cast<CpuLevel>(level);
+        CpuKernels::DotProductFunction dot = CpuKernels::DotProductTable().Select(cpuLevel);
+        CpuKernels::AxpyFunction axpy = CpuKernels::AxpyTable().Select(cpuLevel);
+        CpuKernels::SumFunction sum = CpuKernels::SumTable().Select(cpuLevel);
+
+        float result = 0.0f;
+        double dotSeconds = Measure([&]()
+        {
+            for (size_t round = 0; round < rounds; round++)
+            {
+                result += dot(a.data(), b.data(), elements);
+            }
+        });
+
+        double axpySeconds = Measure([&]()
+        {
+            for (size_t round = 0; round < rounds; round++)
+            {
+                axpy(0.5f, a.data(), y.data(), elements);
+            }
+        });
+
+        float total = 0.0f;
+        double sumSeconds = Measure([&]()
+        {
+            for (size_t round = 0; round < rounds; round++)
+            {
+                total += sum(y.data(), elements);
+            }
+        });
+
+        // Summation order differs between levels, allow a relative error
+        float single = dot(a.data(), b.data(), elements);
+        bool matches = std::fabs(single - reference) <= 1e-3f * (1.0f + std::fabs(reference));
+
+        const double gigaElements = static_cast<double>(elements) * rounds / 1e9;
+        std::cout << "  " << CpuLevelName(cpuLevel)
+                  << ": dot " << gigaElements / dotSeconds << " G/s"
+                  << ", axpy " << gigaElements / axpySeconds << " G/s"
+                  << ", sum " << gigaElements / sumSeconds << " G/s"
+                  << (matches ? "" : " MISMATCH") << " (checksum " << result + total << ")\n";
+    }
+
+    const float dispatched = CpuDotProduct(a.data(), b.data(), elements);
+    const bool dispatchedMatches = std::fabs(dispatched - reference) <= 1e-3f * (1.0f + std::fabs(reference));
+    std::cout << "\nCpuDotProduct() resolved to " << CpuLevelName(CpuKernels::DotProductTable().SelectedLevel())
+              << (dispatchedMatches ? "" : " MISMATCH") << "\n";
+    return 0;
+}
@@ -0,0 +1,310 @@
+/**
+* @file strategy.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Strategy behavioral pattern
+*
+* The Problem:
+*
+* A family of interchangeable algorithms should be selectable without the
+* code using them knowing which one runs. The textbook solution holds the
+* strategy through a pointer to an abstract base class, which costs a heap
+* allocation per strategy object and an indirect call the compiler cannot
+* inline on every use, even when the strategy is known at compile time.
+*
+* Solution:
+*
+* Choose the cheapest binding the use case allows.
+*
+*   * Compile time - PolicyContext<Policy>, the strategy is a template
+*     parameter stored by value. Calls are direct and inlined, there is no
+*     overhead over writing the algorithm in place.
+*
+*   * Run time - Strategy<R(Args...)>, a type-erased strategy holding any
+*     callable. Callables up to InlineSize bytes live inside the object, so
+*     typical lambdas and function objects never allocate, and a call is a
+*     single indirect call through a function pointer. MoveOnlyStrategy
+*     also accepts callables which cannot be copied, e.g. ones owning a
+*     Promise, and is itself only movable.
+*
+*   * Per host - see cpu-dispatch.h, the implementation is selected once at
+*     startup from the instruction sets the CPU supports.
+*
+* Usage:
+*
+* struct Ascending { bool operator()(int a, int b) const { return a < b; } };
+* PolicyContext<Ascending> context;
+* context(1, 2);
+*
+* Strategy<int(int, int)> strategy = [](int a, int b) { return a + b; };
+* strategy(1, 2);
+*
+*/
+
+#ifndef __STRATEGY_H_
+#define __STRATEGY_H_
+
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+/**
+ * Policy Context
+ * Holds the strategy by value, empty policies take no space.
+ */
+template <class Policy>
+class PolicyContext : private Policy
+{
+    public:
+
+        PolicyContext() = default;
+
+        explicit PolicyContext(Policy policy) :
+            Policy(std::move(policy)) {}
+
+        template <class... Args>
+        decltype(auto) operator()(Args&&... args)
+        {
+            return static_cast<Policy&>(*this)(std::forward<Args>(args)...);
+        }
+
+        template <class... Args>
+        decltype(auto) operator()(Args&&... args) const
+        {
+            return static_cast<const Policy&>(*this)(std::forward<Args>(args)...);
+        }
+
+        Policy& GetPolicy()
+        {
+            return *this;
+        }
+
+        const Policy& GetPolicy() const
+        {
+            return *this;
+        }
+};
+
+
+/**
+ * Type-erased strategy with small buffer storage
+ * Movable, and copyable unless Copyable is false, which in turn admits
+ * callables that are only movable. An empty strategy throws
+ * std::bad_function_call when invoked.
+ */
+template <class Signature, size_t InlineSize = 32, bool Copyable = true>
+class Strategy;
+
+template <class Signature, size_t InlineSize = 32>
+using MoveOnlyStrategy = Strategy<Signature, InlineSize, false>;
+
+template <class R, class... Args, size_t InlineSize, bool Copyable>
+class Strategy<R(Args...), InlineSize, Copyable>
+{
+
+    public:
+
+        Strategy() = default;
+
+        template <class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Strategy>
+                                                 && std::is_invocable_r_v<R, std::decay_t<F>&, Args...>
+                                                 && (!Copyable || std::is_copy_constructible_v<std::decay_t<F> >)> >
+        Strategy(F&& func)
+        {
+            using Callable = std::decay_t<F>;
+
+            if constexpr (IsInline<Callable>())
+            {
+                new (m_buffer) Callable(std::forward<F>(func));
+                m_invoke = &InlineInvoke<Callable>;
+                m_manage = &InlineManage<Callable>;
+            }
+            else
+            {
+                *reinterpret_cast<Callable**>(m_buffer) = new Callable(std::forward<F>(func));
+                m_invoke = &HeapInvoke<Callable>;
+                m_manage = &HeapManage<Callable>;
+            }
+        }
+
+        Strategy(Strategy const& other) requires Copyable
+        {
+            CopyFrom(other);
+        }
+
+        Strategy(Strategy&& other) noexcept
+        {
+            MoveFrom(other);
+        }
+
+        Strategy& operator=(Strategy const& other) requires Copyable
+        {
+            if (this != &other)
+            {
+                Strategy copy(other);
+                Reset();
+                MoveFrom(copy);
+            }
+            return *this;
+        }
+
+        Strategy& operator=(Strategy&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Reset();
+                MoveFrom(other);
+            }
+            return *this;
+        }
+
+        ~Strategy()
+        {
+            Reset();
+        }
+
+        explicit operator bool() const
+        {
+            return m_invoke != nullptr;
+        }
+
+        R operator()(Args... args) const
+        {
+            if (m_invoke == nullptr)
+            {
+                throw std::bad_function_call();
+            }
+            return m_invoke(m_buffer, std::forward<Args>(args)...);
+        }
+
+        // Whether the callable is stored in the inline buffer
+        bool IsInline() const
+        {
+            return m_manage != nullptr && m_manage(Operation::QueryInline, nullptr, nullptr);
+        }
+
+    private:
+
+        enum class Operation
+        {
+            Copy,
+            Move,
+            Destroy,
+            QueryInline
+        };
+
+        template <class Callable>
+        static constexpr bool IsInline()
+        {
+            return sizeof(Callable) <= InlineSize && alignof(Callable) <= alignof(std::max_align_t)
+                && std::is_nothrow_move_constructible_v<Callable>;
+        }
+
+        template <class Callable>
+        static R InlineInvoke(const void* self, Args&&... args)
+        {
+            Callable* callable = const_cast<Callable*>(static_cast<const Callable*>(self));
+            return (*callable)(std::forward<Args>(args)...);
+        }
+
+        template <class Callable>
+        static R HeapInvoke(const void* self, Args&&... args)
+        {
+            Callable* callable = *static_cast<Callable* const*>(self);
+            return (*callable)(std::forward<Args>(args)...);
+        }
+
+        template <class Callable>
+        static bool InlineManage(Operation operation, void* self, const void* other)
+        {
+            switch (operation)
+            {
+                case Operation::Copy:
+                    if constexpr (Copyable)
+                    {
+                        new (self) Callable(*static_cast<const Callable*>(other));
+                    }
+                    break;
+                case Operation::Move:
+                {
+                    Callable* source = const_cast<Callable*>(static_cast<const Callable*>(other));
+                    new (self) Callable(std::move(*source));
+                    source->~Callable();
+                    break;
+                }
+                case Operation::Destroy:
+                    static_cast<Callable*>(self)->~Callable();
+                    break;
+                case Operation::QueryInline:
+                    return true;
+            }
+            return false;
+        }
+
+        template <class Callable>
+        static bool HeapManage(Operation operation, void* self, const void* other)
+        {
+            switch (operation)
+            {
+                case Operation::Copy:
+                    if constexpr (Copyable)
+                    {
+                        *static_cast<Callable**>(self) = new Callable(**static_cast<Callable* const*>(other));
+                    }
+                    break;
+                case Operation::Move:
+                    *static_cast<Callable**>(self) = *static_cast<Callable* const*>(other);
+                    break;
+                case Operation::Destroy:
+                    delete *static_cast<Callable**>(self);
+                    break;
+                case Operation::QueryInline:
+                    return false;
+            }
+            return false;
+        }
+
+        void CopyFrom(Strategy const& other) requires Copyable
+        {
+            if (other.m_manage != nullptr)
+            {
+                other.m_manage(Operation::Copy, m_buffer, other.m_buffer);
+                m_invoke = other.m_invoke;
+                m_manage = other.m_manage;
+            }
+        }
+
+        void MoveFrom(Strategy& other)
+        {
+            if (other.m_manage != nullptr)
+            {
+                other.m_manage(Operation::Move, m_buffer, other.m_buffer);
+                m_invoke = other.m_invoke;
+                m_manage = other.m_manage;
+                other.m_invoke = nullptr;
+                other.m_manage = nullptr;
+            }
+        }
+
+        void Reset()
+        {
+            if (m_manage != nullptr)
+            {
+                m_manage(Operation::Destroy, m_buffer, nullptr);
+                m_invoke = nullptr;
+                m_manage = nullptr;
+            }
+        }
+
+        alignas(std::max_align_t) unsigned char m_buffer[InlineSize < sizeof(void*) ? sizeof(void*) : InlineSize];
+        R (*m_invoke)(const void*, Args&&...) = nullptr;
+        bool (*m_manage)(Operation, void*, const void*) = nullptr;
+};
+
+
+#endif //__STRATEGY_H_
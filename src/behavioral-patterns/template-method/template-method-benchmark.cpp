@@ -0,0 +1,212 @@
+/**
+* @file template-method-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Template Method benchmark
+*
+* Runs two algorithms over an array of samples, one clamping accepted
+* samples and one scaling them with a gain read once per batch from shared
+* settings guarded by a mutex. Compares the classic skeleton calling
+* virtual hooks for every item, the subclass chosen at run time so the
+* calls stay indirect, with the static TemplateMethod per item and in
+* batches.
+*
+* Build:
+* g++ -std=c++20 -O2 template-method-benchmark.cpp -o template-method-benchmark
+* ./template-method-benchmark [samples] [rounds]
+*
+*/
+
+#include "template-method.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+
+struct Sample
+{
+    float m_value;
+    uint32_t m_flags;
+};
+
+/**
+ * Settings shared with other threads
+ */
+struct Settings
+{
+    float Gain()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_gain;
+    }
+
+    std::mutex m_mutex;
+    float m_gain = 1;
+};
+
+
+/**
+ * Classic skeleton, every step a virtual hook with an empty default.
+ */
+class VirtualAlgorithm
+{
+    public:
+        virtual ~VirtualAlgorithm() = default;
+
+        bool Run(Sample& sample)
+        {
+            BeginBatch(1);
+            bool accepted = Accept(sample);
+            if (accepted)
+            {
+                Prepare(sample);
+                Process(sample);
+                Finish(sample);
+            }
+            EndBatch(accepted ? 1 : 0);
+            return accepted;
+        }
+
+    protected:
+        virtual void BeginBatch(size_t) {}
+        virtual bool Accept(const Sample&) { return true; }
+        virtual void Prepare(Sample&) {}
+        virtual void Process(Sample& sample) = 0;
+        virtual void Finish(Sample&) {}
+        virtual void EndBatch(size_t) {}
+};
+
+class VirtualClamp : public VirtualAlgorithm
+{
+    protected:
+        bool Accept(const Sample& sample) override { return sample.m_flags % 8 != 0; }
+        void Process(Sample& sample) override { sample.m_value = std::clamp(sample.m_value, -1.0f, 1.0f); }
+};
+
+class VirtualScale : public VirtualAlgorithm
+{
+    public:
+        explicit VirtualScale(Settings& settings) :
+            m_settings(settings) {}
+
+    protected:
+        void BeginBatch(size_t) override { m_gain = m_settings.Gain(); }
+        void Process(Sample& sample) override { sample.m_value *= m_gain; }
+
+    private:
+        Settings& m_settings;
+        float m_gain = 1;
+};
+
+
+/**
+ * The same algorithms on the static skeleton.
+ */
+class Clamp : public TemplateMethod<Clamp, Sample>
+{
+    public:
+        bool Accept(const Sample& sample) { return sample.m_flags % 8 != 0; }
+        void Process(Sample& sample) { sample.m_value = std::clamp(sample.m_value, -1.0f, 1.0f); }
+};
+
+class Scale : public TemplateMethod<Scale, Sample>
+{
+    public:
+        explicit Scale(Settings& settings) :
+            m_settings(settings) {}
+
+        void BeginBatch(size_t) { m_gain = m_settings.Gain(); }
+        void Process(Sample& sample) { sample.m_value *= m_gain; }
+
+    private:
+        Settings& m_settings;
+        float m_gain = 1;
+};
+
+static_assert(!Scale::HasHook<Hook::Accept>() && Scale::HasHook<Hook::BeginBatch>());
+
+
+template <class F>
+void Measure(const std::string& name, size_t operations, const std::vector<Sample>& samples, F&& function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto end = std::chrono::steady_clock::now();
+
+    double checksum = 0;
+    for (const Sample& sample : samples)
+    {
+        checksum += sample.m_value;
+    }
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << name << ": " << (seconds * 1e9 / operations) << " ns/item (checksum " << checksum << ")\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 16;
+    const size_t rounds = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000;
+    const size_t operations = count * rounds * 2;
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> value(-2.0f, 2.0f);
+    std::vector<Sample> original(count);
+    for (Sample& sample : original)
+    {
+        sample = {value(random), static_cast<uint32_t>(random())};
+    }
+
+    // Gain of one so repeated scaling stays finite
+    Settings settings;
+    std::cout << "Samples: " << count << ", rounds: " << rounds << "\n";
+
+    std::vector<Sample> samples = original;
+    std::vector<std::unique_ptr<VirtualAlgorithm> > algorithms;
+    algorithms.push_back(std::make_unique<VirtualClamp>());
+    algorithms.push_back(std::make_unique<VirtualScale>(settings));
+    Measure("  virtual hooks    ", operations, samples, [&]()
+    {
+        for (size_t round = 0; round < rounds; round++)
+            for (const std::unique_ptr<VirtualAlgorithm>& algorithm : algorithms)
+                for (Sample& sample : samples)
+                    algorithm->Run(sample);
+    });
+
+    samples = original;
+    Clamp clamp;
+    Scale scale(settings);
+    Measure("  static per item  ", operations, samples, [&]()
+    {
+        for (size_t round = 0; round < rounds; round++)
+        {
+            for (Sample& sample : samples)
+                clamp.Run(sample);
+            for (Sample& sample : samples)
+                scale.Run(sample);
+        }
+    });
+
+    samples = original;
+    Measure("  static batch     ", operations, samples, [&]()
+    {
+        for (size_t round = 0; round < rounds; round++)
+        {
+            clamp.RunMany(samples);
+            scale.RunMany(samples);
+        }
+    });
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+/**
+* @file template-method.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Template Method behavioral pattern, static
+*
+* The Problem:
+*
+* A base class fixes the skeleton of an algorithm and subclasses fill in
+* the steps by overriding virtual hooks, most of them optional with an
+* empty default. Run over many items the skeleton costs an indirect call
+* per hook per item, including every hook the subclass never overrode,
+* and none of the steps can be inlined into the loop.
+*
+* Solution:
+*
+* Bind the subclass at compile time through the curiously recurring
+* template pattern. The base checks for each optional hook whether the
+* subclass declares it, a hook which is not declared is not called at all,
+* not even as an empty inline function, and the hooks which are declared
+* are direct calls the compiler inlines into the loop.
+*
+* The skeleton distinguishes per batch hooks from per item hooks. Run()
+* processes a single item, RunMany() processes a span of items calling the
+* per batch hooks once around the whole loop instead of once per item.
+*
+* Steps, in order:
+*
+*   BeginBatch(size_t count)     optional, once per batch
+*   bool Accept(const Item&)     optional, rejected items skip the rest
+*   Prepare(Item&)               optional
+*   Process(Item&)               required
+*   Finish(Item&)                optional
+*   EndBatch(size_t processed)   optional, once per batch
+*
+* Usage:
+*
+* class Scale : public TemplateMethod<Scale, float>
+* {
+*     public:
+*         void BeginBatch(size_t) { m_factor = LoadFactor(); }
+*         void Process(float& value) { value *= m_factor; }
+*     private:
+*         float m_factor = 1;
+* };
+*
+* Scale scale;
+* scale.RunMany(values);
+*
+* Notes:
+*
+* The hooks are found by name and signature. Hooks may be private when the
+* subclass befriends its TemplateMethod base, a hook with a misspelt name
+* or a wrong signature is silently not called, HasHook() can be used in a
+* static_assert to make sure it is. The algorithm is fixed at compile time,
+* to choose it at run time wrap RunMany() in a Strategy.
+*
+*/
+
+#ifndef __TEMPLATE_METHOD_H_
+#define __TEMPLATE_METHOD_H_
+
+
+#include <concepts>
+#include <cstddef>
+#include <span>
+
+
+/**
+ * Optional steps of the skeleton
+ */
+enum class Hook
+{
+    BeginBatch,
+    Accept,
+    Prepare,
+    Finish,
+    EndBatch
+};
+
+
+template <class Derived, class Item>
+class TemplateMethod
+{
+    public:
+
+        /**
+         * Run the algorithm for a single item, returns whether it was accepted.
+         */
+        bool Run(Item& item)
+        {
+            return RunMany(std::span<Item>(&item, 1)) == 1;
+        }
+
+        /**
+         * Run the algorithm for every item, the per batch hooks are called
+         * once. Returns the number of accepted items.
+         */
+        size_t RunMany(std::span<Item> items)
+        {
+            static_assert(requires(Derived& derived, Item& item) { derived.Process(item); },
+                          "TemplateMethod requires Derived::Process(Item&)");
+
+            Derived& derived = static_cast<Derived&>(*this);
+
+            if constexpr (HasHook<Hook::BeginBatch>())
+            {
+                derived.BeginBatch(items.size());
+            }
+
+            size_t processed = 0;
+            for (Item& item : items)
+            {
+                if constexpr (HasHook<Hook::Accept>())
+                {
+                    if (!derived.Accept(static_cast<const Item&>(item)))
+                    {
+                        continue;
+                    }
+                }
+                if constexpr (HasHook<Hook::Prepare>())
+                {
+                    derived.Prepare(item);
+                }
+                derived.Process(item);
+                if constexpr (HasHook<Hook::Finish>())
+                {
+                    derived.Finish(item);
+                }
+                processed++;
+            }
+
+            if constexpr (HasHook<Hook::EndBatch>())
+            {
+                derived.EndBatch(processed);
+            }
+            return processed;
+        }
+
+        /**
+         * Whether Derived declares the hook, evaluated where Derived is
+         * complete, e.g. static_assert(Derived::template HasHook<Hook::Accept>())
+         * after the class definition.
+         */
+        template <Hook H>
+        static constexpr bool HasHook()
+        {
+            if constexpr (H == Hook::BeginBatch)
+            {
+                return requires(Derived& derived, size_t count) { derived.BeginBatch(count); };
+            }
+            else if constexpr (H == Hook::Accept)
+            {
+                return requires(Derived& derived, const Item& item) { { derived.Accept(item) } -> std::convertible_to<bool>; };
+            }
+            else if constexpr (H == Hook::Prepare)
+            {
+                return requires(Derived& derived, Item& item) { derived.Prepare(item); };
+            }
+            else if constexpr (H == Hook::Finish)
+            {
+                return requires(Derived& derived, Item& item) { derived.Finish(item); };
+            }
+            else
+            {
+                return requires(Derived& derived, size_t processed) { derived.EndBatch(processed); };
+            }
+        }
+
+    protected:
+
+        // Only usable as a base class
+        TemplateMethod() = default;
+        ~TemplateMethod() = default;
+};
+
+
+#endif // __TEMPLATE_METHOD_H_
@@ -0,0 +1,290 @@
+/**
+* @file visitor-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Visitor benchmark
+*
+* Processes pairs of products, shaped after the A and B product families of
+* the abstract factory example, with four kinds of dispatch:
+*
+*   dynamic_cast   - chains of dynamic_cast over both objects
+*   virtual        - classic double dispatch, Accept() and Visit()
+*   table          - generated 2-D table indexed by Kind()
+*   variant        - products stored by value in std::variant, 2-D table
+*
+* and single objects with a dynamic_cast chain, Accept() and VisitClosed().
+*
+* Build:
+* g++ -std=c++20 -O2 visitor-benchmark.cpp -o visitor-benchmark
+* ./visitor-benchmark [pairs] [rounds]
+*
+*/
+
+#include "visitor.h"
+#include "../../benchmark.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <variant>
+#include <vector>
+
+
+/**
+ * Product family A and B, the classes of the abstract factory example with
+ * a Kind() tag and visitor support added.
+ */
+class SpecializedProductA1;
+class SpecializedProductA2;
+class SpecializedProductB1;
+class SpecializedProductB2;
+
+using ProductVisitor = Visitor<SpecializedProductA1, SpecializedProductA2, SpecializedProductB1, SpecializedProductB2>;
+
+class AbstractProductA
+{
+    public:
+        virtual ~AbstractProductA() = default;
+        virtual size_t Kind() const = 0;
+        virtual void Accept(ProductVisitor& visitor) const = 0;
+};
+
+class AbstractProductB
+{
+    public:
+        virtual ~AbstractProductB() = default;
+        virtual size_t Kind() const = 0;
+        virtual void Accept(ProductVisitor& visitor) const = 0;
+};
+
+class SpecializedProductA1 : public Visitable<AbstractProductA, SpecializedProductA1, ProductVisitor>
+{
+    public:
+        size_t Kind() const override { return 0; }
+        uint64_t m_value = 1;
+};
+
+class SpecializedProductA2 : public Visitable<AbstractProductA, SpecializedProductA2, ProductVisitor>
+{
+    public:
+        size_t Kind() const override { return 1; }
+        uint64_t m_value = 2;
+};
+
+class SpecializedProductB1 : public Visitable<AbstractProductB, SpecializedProductB1, ProductVisitor>
+{
+    public:
+        size_t Kind() const override { return 0; }
+        uint64_t m_value = 3;
+};
+
+class SpecializedProductB2 : public Visitable<AbstractProductB, SpecializedProductB2, ProductVisitor>
+{
+    public:
+        size_t Kind() const override { return 1; }
+        uint64_t m_value = 5;
+};
+
+
+/**
+ * The operation on a pair, different for every combination.
+ */
+struct Collaborate
+{
+    uint64_t operator()(const SpecializedProductA1& a, const SpecializedProductB1& b) const { return a.m_value + b.m_value; }
+    uint64_t operator()(const SpecializedProductA1& a, const SpecializedProductB2& b) const { return a.m_value * b.m_value; }
+    uint64_t operator()(const SpecializedProductA2& a, const SpecializedProductB1& b) const { return a.m_value ^ b.m_value; }
+    uint64_t operator()(const SpecializedProductA2& a, const SpecializedProductB2& b) const { return a.m_value << b.m_value; }
+};
+
+using CollaborateTable = DoubleDispatchTable<TypeList<SpecializedProductA1, SpecializedProductA2>,
+                                             TypeList<SpecializedProductB1, SpecializedProductB2>, const Collaborate>;
+
+
+uint64_t CollaborateByCast(const AbstractProductA& a, const AbstractProductB& b)
+{
+    Collaborate collaborate;
+    if (const SpecializedProductA1* a1 = dynamic_cast<const SpecializedProductA1*>(&a))
+    {
+        if (const SpecializedProductB1* b1 = dynamic_cast<const SpecializedProductB1*>(&b)) return collaborate(*a1, *b1);
+        if (const SpecializedProductB2* b2 = dynamic_cast<const SpecializedProductB2*>(&b)) return collaborate(*a1, *b2);
+    }
+    else if (const SpecializedProductA2* a2 = dynamic_cast<const SpecializedProductA2*>(&a))
+    {
+        if (const SpecializedProductB1* b1 = dynamic_cast<const SpecializedProductB1*>(&b)) return collaborate(*a2, *b1);
+        if (const SpecializedProductB2* b2 = dynamic_cast<const SpecializedProductB2*>(&b)) return collaborate(*a2, *b2);
+    }
+    return 0;
+}
+
+
+/**
+ * Classic double dispatch, the first visit records the A product and
+ * dispatches on the B product.
+ */
+class CollaborateVisitor : public ProductVisitor
+{
+    public:
+        uint64_t Run(const AbstractProductA& a, const AbstractProductB& b)
+        {
+            m_second = &b;
+            a.Accept(*this);
+            return m_result;
+        }
+
+        void Visit(const SpecializedProductA1& a) override { m_a1 = &a; m_a2 = nullptr; m_second->Accept(*this); }
+        void Visit(const SpecializedProductA2& a) override { m_a2 = &a; m_a1 = nullptr; m_second->Accept(*this); }
+        void Visit(const SpecializedProductB1& b) override { m_result = m_a1 ? m_collaborate(*m_a1, b) : m_collaborate(*m_a2, b); }
+        void Visit(const SpecializedProductB2& b) override { m_result = m_a1 ? m_collaborate(*m_a1, b) : m_collaborate(*m_a2, b); }
+
+    private:
+        Collaborate m_collaborate;
+        const AbstractProductB* m_second = nullptr;
+        const SpecializedProductA1* m_a1 = nullptr;
+        const SpecializedProductA2* m_a2 = nullptr;
+        uint64_t m_result = 0;
+};
+
+
+/**
+ * Single dispatch, sum of the product values.
+ */
+class SumVisitor : public ProductVisitor
+{
+    public:
+        void Visit(const SpecializedProductA1& a) override { m_sum += a.m_value; }
+        void Visit(const SpecializedProductA2& a) override { m_sum += a.m_value * 3; }
+        void Visit(const SpecializedProductB1& b) override { m_sum += b.m_value; }
+        void Visit(const SpecializedProductB2& b) override { m_sum += b.m_value * 3; }
+        uint64_t m_sum = 0;
+};
+
+uint64_t ValueByCast(const AbstractProductA& a)
+{
+    if (const SpecializedProductA1* a1 = dynamic_cast<const SpecializedProductA1*>(&a)) return a1->m_value;
+    if (const SpecializedProductA2* a2 = dynamic_cast<const SpecializedProductA2*>(&a)) return a2->m_value * 3;
+    return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t pairs = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    const size_t rounds = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20;
+
+    using VariantA = std::variant<SpecializedProductA1, SpecializedProductA2>;
+    using VariantB = std::variant<SpecializedProductB1, SpecializedProductB2>;
+
+    std::vector<std::unique_ptr<AbstractProductA> > productsA;
+    std::vector<std::unique_ptr<AbstractProductB> > productsB;
+    std::vector<VariantA> variantsA;
+    std::vector<VariantB> variantsB;
+
+    // Random mix of the specialized products
+    std::mt19937 random(42);
+    for (size_t i = 0; i < pairs; i++)
+    {
+        if (random() & 1)
+        {
+            productsA.push_back(std::make_unique<SpecializedProductA1>());
+            variantsA.emplace_back(SpecializedProductA1());
+        }
+        else
+        {
+            productsA.push_back(std::make_unique<SpecializedProductA2>());
+            variantsA.emplace_back(SpecializedProductA2());
+        }
+
+        if (random() & 1)
+        {
+            productsB.push_back(std::make_unique<SpecializedProductB1>());
+            variantsB.emplace_back(SpecializedProductB1());
+        }
+        else
+        {
+            productsB.push_back(std::make_unique<SpecializedProductB2>());
+            variantsB.emplace_back(SpecializedProductB2());
+        }
+    }
+
+    const size_t operations = pairs * rounds;
+    std::cout << "Pairs: " << pairs << ", rounds: " << rounds << "\n\nDouble dispatch\n";
+
+    Measure("  dynamic_cast", operations, [&]()
+    {
+        uint64_t checksum = 0;
+        for (size_t round = 0; round < rounds; round++)
+            for (size_t i = 0; i < pairs; i++)
+                checksum += CollaborateByCast(*productsA[i], *productsB[i]);
+        return checksum;
+    });
+
+    Measure("  virtual     ", operations, [&]()
+    {
+        CollaborateVisitor visitor;
+        uint64_t checksum = 0;
+        for (size_t round = 0; round < rounds; round++)
+            for (size_t i = 0; i < pairs; i++)
+                checksum += visitor.Run(*productsA[i], *productsB[i]);
+        return checksum;
+    });
+
+    Measure("  table       ", operations, [&]()
+    {
+        const Collaborate collaborate;
+        uint64_t checksum = 0;
+        for (size_t round = 0; round < rounds; round++)
+            for (size_t i = 0; i < pairs; i++)
+                checksum += CollaborateTable::Dispatch(collaborate, *productsA[i], *productsB[i]);
+        return checksum;
+    });
+
+    Measure("  variant     ", operations, [&]()
+    {
+        const Collaborate collaborate;
+        uint64_t checksum = 0;
+        for (size_t round = 0; round < rounds; round++)
+            for (size_t i = 0; i < pairs; i++)
+                checksum += CollaborateTable::DispatchVariant(collaborate, variantsA[i], variantsB[i]);
+        return checksum;
+    });
+
+    std::cout << "\nSingle dispatch\n";
+
+    Measure("  dynamic_cast", operations, [&]()
+    {
+        uint64_t checksum = 0;
+        for (size_t round = 0; round < rounds; round++)
+            for (size_t i = 0; i < pairs; i++)
+                checksum += ValueByCast(*productsA[i]);
+        return checksum;
+    });
+
+    Measure("  virtual     ", operations, [&]()
+    {
+        SumVisitor visitor;
+        for (size_t round = 0; round < rounds; round++)
+            for (size_t i = 0; i < pairs; i++)
+                productsA[i]->Accept(visitor);
+        return visitor.m_sum;
+    });
+
+    Measure("  variant     ", operations, [&]()
+    {
+        const Overloaded sum{
+            [](const SpecializedProductA1& a) { return a.m_value; },
+            [](const SpecializedProductA2& a) { return a.m_value * 3; } };
+
+        uint64_t checksum = 0;
+        for (size_t round = 0; round < rounds; round++)
+            for (size_t i = 0; i < pairs; i++)
+                checksum += VisitClosed(variantsA[i], sum);
+        return checksum;
+    });
+
+    return 0;
+}
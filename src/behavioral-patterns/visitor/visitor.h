@@ -0,0 +1,240 @@
+/**
+* @file visitor.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Visitor behavioral pattern
+*
+* The Problem:
+*
+* Operations over a hierarchy of objects, such as the products returned by
+* a factory, are often written as chains of dynamic_cast, one per concrete
+* type. Every cast walks the type information of the object, the chain is
+* linear in the number of types and silently misses newly added types.
+*
+* Solution:
+*
+* Move the operation into a visitor object with one overload per concrete
+* type, the visited object selects the overload itself.
+*
+*   * Open hierarchies - classic double dispatch. Visitable<Base, Derived,
+*     Visitor> implements Accept() which calls back the Visit() overload of
+*     the concrete type, two virtual calls and no casts.
+*
+*   * Closed hierarchies - the set of types is fixed in a std::variant and
+*     VisitClosed() selects the overload from the stored index. With the
+*     whole call graph visible the compiler inlines the overloads.
+*
+*   * Pairs of types - DoubleDispatchTable generates a 2-D table of
+*     function pointers, one per combination of types, at compile time.
+*     Dispatching over two objects is a single indexed indirect call.
+*
+* Usage:
+*
+* using Shape = std::variant<Circle, Square>;
+* VisitClosed(shape, Overloaded{
+*     [](const Circle& circle) { ... },
+*     [](const Square& square) { ... } });
+*
+* using CollideTable = DoubleDispatchTable<TypeList<Circle, Square>, TypeList<Circle, Square>, Collide>;
+* CollideTable::DispatchVariant(collide, first, second);
+*
+* References:
+* https://en.wikipedia.org/wiki/Double_dispatch
+*
+*/
+
+#ifndef __VISITOR_H_
+#define __VISITOR_H_
+
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+
+/**
+ * Compile time list of types.
+ */
+template <class... Types>
+struct TypeList
+{
+    static const size_t Size = sizeof...(Types);
+};
+
+
+/**
+ * Visitor of a single type, the abstract visitor of an open hierarchy
+ * derives from one of these per concrete type.
+ */
+template <class T>
+class VisitorFor
+{
+    public:
+        virtual ~VisitorFor() = default;
+        virtual void Visit(const T& visitable) = 0;
+};
+
+/**
+ * Abstract visitor of all given types.
+ */
+template <class... Types>
+class Visitor : public VisitorFor<Types>...
+{
+    public:
+        using VisitorFor<Types>::Visit...;
+};
+
+/**
+ * Implements Accept() of Base for the concrete type Derived (CRTP).
+ * Base must declare virtual void Accept(VisitorType&) const.
+ */
+template <class Base, class Derived, class VisitorType>
+class Visitable : public Base
+{
+    public:
+        using Base::Base;
+
+        void Accept(VisitorType& visitor) const override
+        {
+            visitor.Visit(static_cast<const Derived&>(*this));
+        }
+};
+
+
+/**
+ * Combines several callables into one overload set.
+ */
+template <class... Fs>
+struct Overloaded : Fs...
+{
+    using Fs::operator()...;
+};
+
+template <class... Fs>
+Overloaded(Fs...) -> Overloaded<Fs...>;
+
+
+namespace VisitorDetail
+{
+    template <size_t I, class Variant, class F>
+    decltype(auto) VisitFrom(Variant&& variant, F&& visitor)
+    {
+        constexpr size_t Count = std::variant_size_v<std::remove_reference_t<Variant> >;
+
+        if constexpr (I + 1 == Count)
+        {
+            return std::forward<F>(visitor)(*std::get_if<I>(&variant));
+        }
+        else
+        {
+            if (variant.index() == I)
+            {
+                return std::forward<F>(visitor)(*std::get_if<I>(&variant));
+            }
+            return VisitFrom<I + 1>(std::forward<Variant>(variant), std::forward<F>(visitor));
+        }
+    }
+}
+
+/**
+ * Visit the alternative held by a variant.
+ * Unlike std::visit the dispatch is a plain chain of index comparisons,
+ * which the compiler turns into a switch and inlines completely. The
+ * variant must not be valueless.
+ */
+template <class Variant, class F>
+decltype(auto) VisitClosed(Variant&& variant, F&& visitor)
+{
+    return VisitorDetail::VisitFrom<0>(std::forward<Variant>(variant), std::forward<F>(visitor));
+}
+
+
+/**
+ * Double dispatch over pairs of types through a generated 2-D table.
+ *
+ * Dispatch() accepts either two variants over the listed types, or two
+ * references to polymorphic bases whose Kind() returns the index of the
+ * concrete type within the respective list. The callable must accept
+ * every combination (const First&, const Second&).
+ */
+template <class FirstList, class SecondList, class F>
+class DoubleDispatchTable;
+
+template <class... Firsts, class... Seconds, class F>
+class DoubleDispatchTable<TypeList<Firsts...>, TypeList<Seconds...>, F>
+{
+
+    public:
+
+        using Result = std::common_type_t<std::invoke_result_t<F&, const Firsts&, const Seconds&>...>;
+
+        static const size_t Rows = sizeof...(Firsts);
+        static const size_t Columns = sizeof...(Seconds);
+
+        /**
+         * Dispatch over two variants, the alternatives must be in list order.
+         */
+        template <class FirstVariant, class SecondVariant>
+        static Result DispatchVariant(F& function, const FirstVariant& first, const SecondVariant& second)
+        {
+            static_assert(std::is_same_v<FirstVariant, std::variant<Firsts...> >, "First variant does not match the list");
+            static_assert(std::is_same_v<SecondVariant, std::variant<Seconds...> >, "Second variant does not match the list");
+            return s_variantTable<FirstVariant, SecondVariant>[first.index()][second.index()](function, &first, &second);
+        }
+
+        /**
+         * Dispatch over two objects of polymorphic hierarchies.
+         * The objects are cast with static_cast, Kind() must be accurate.
+         */
+        template <class FirstBase, class SecondBase>
+        static Result Dispatch(F& function, const FirstBase& first, const SecondBase& second)
+        {
+            return s_objectTable<FirstBase, SecondBase>[first.Kind()][second.Kind()](function, &first, &second);
+        }
+
+    private:
+
+        using Thunk = Result (*)(F&, const void*, const void*);
+
+        template <class A, class B, class FirstVariant, class SecondVariant>
+        static Result VariantThunk(F& function, const void* first, const void* second)
+        {
+            return function(*std::get_if<A>(static_cast<const FirstVariant*>(first)),
+                            *std::get_if<B>(static_cast<const SecondVariant*>(second)));
+        }
+
+        template <class A, class B, class FirstBase, class SecondBase>
+        static Result ObjectThunk(F& function, const void* first, const void* second)
+        {
+            return function(static_cast<const A&>(*static_cast<const FirstBase*>(first)),
+                            static_cast<const B&>(*static_cast<const SecondBase*>(second)));
+        }
+
+        // One row of thunks, the first type fixed
+        template <class A, class FirstVariant, class SecondVariant>
+        static constexpr std::array<Thunk, Columns> VariantRow()
+        {
+            return {{ &VariantThunk<A, Seconds, FirstVariant, SecondVariant>... }};
+        }
+
+        template <class A, class FirstBase, class SecondBase>
+        static constexpr std::array<Thunk, Columns> ObjectRow()
+        {
+            return {{ &ObjectThunk<A, Seconds, FirstBase, SecondBase>... }};
+        }
+
+        // Tables are generated once per combination of argument types
+        template <class FirstVariant, class SecondVariant>
+        static constexpr std::array<std::array<Thunk, Columns>, Rows> s_variantTable =
+            {{ VariantRow<Firsts, FirstVariant, SecondVariant>()... }};
+
+        template <class FirstBase, class SecondBase>
+        static constexpr std::array<std::array<Thunk, Columns>, Rows> s_objectTable =
+            {{ ObjectRow<Firsts, FirstBase, SecondBase>()... }};
+};
+
+
+#endif //__VISITOR_H_
@@ -0,0 +1,49 @@
+/**
+* @file benchmark.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Benchmark helpers shared by the *-benchmark.cpp programs
+*
+* Usage:
+*
+* Measure("  variant", operations, [&]()
+* {
+*     uint64_t checksum = 0;
+*     ...
+*     return checksum;
+* }, "request");
+*
+* Notes:
+*
+* The function returns a checksum of its work which is printed, so the
+* compiler cannot drop the measured loop and the variants can be compared.
+*
+*/
+
+#ifndef __BENCHMARK_H_
+#define __BENCHMARK_H_
+
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+
+/**
+ * Run function once and print the time per operation and its checksum.
+ */
+template <class F>
+void Measure(const std::string& name, size_t operations, F&& function, const char* unit = "op")
+{
+    auto start = std::chrono::steady_clock::now();
+    auto checksum = function();
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << name << ": " << (seconds * 1e9 / operations) << " ns/" << unit << " (checksum " << checksum << ")\n";
+}
+
+
+#endif //__BENCHMARK_H_
@@ -0,0 +1,436 @@
+/**
+* @file epoch-reclamation.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Epoch-based reclamation (EBR)
+*
+* The Problem:
+*
+* Hazard pointers make every read pay for a store and a full fence. Read
+* mostly structures would rather pay once per operation than once per node.
+*
+* Solution:
+*
+* A global epoch counter advances over time. A thread entering an operation
+* pins itself to the current epoch with an EpochGuard. Nodes retired during
+* epoch E are tagged with E, and the global epoch can only move forward once
+* every pinned thread has observed the current epoch. When the global epoch
+* reaches E + 2 no thread can still hold a reference obtained in epoch E and
+* the nodes tagged with E are deleted.
+*
+* Retired nodes are kept on per-thread lists and reclaimed in batches.
+*
+* Usage:
+*
+* EpochDomain& domain = EpochDomain::Global();
+*
+* // Reader or writer
+* {
+*     EpochGuard guard(domain);
+*     Node* node = m_head.load();
+*     ...use node...
+* }
+*
+* // After unlinking a node
+* domain.Retire(node);
+*
+* Notes:
+*
+* Memory stays bounded only while guards are short lived, a thread stalled
+* inside a guard blocks reclamation for everybody. To keep that from growing
+* without limit, a thread whose retire list exceeds MaxPending waits in
+* Synchronize() until its backlog can be freed.
+*
+* As with HazardPointerDomain, a domain must outlive its guards and
+* retires, the threads which used it may exit after it is destroyed.
+*
+* References:
+* K. Fraser, Practical lock-freedom, 2004
+*
+*/
+
+#ifndef __EPOCH_RECLAMATION_H_
+#define __EPOCH_RECLAMATION_H_
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Epoch domain
+ * Owns the global epoch, the per-thread records and their retire lists.
+ */
+class EpochDomain
+{
+
+    public:
+
+        // Retired nodes per thread which trigger a reclamation attempt
+        static const size_t BatchSize = 64;
+
+        // Retired nodes per thread which force the thread to wait for a grace period
+        static const size_t MaxPending = 16 * 1024;
+
+        EpochDomain() :
+            m_id(NextId())
+        {
+            Registry& registry = LiveDomains();
+            std::lock_guard<std::mutex> lock(registry.m_mutex);
+            registry.m_live.insert(m_id);
+        }
+
+        /**
+         * Destructor
+         * Deletes every node which is still retired.
+         */
+        ~EpochDomain()
+        {
+            // From here on exiting threads leave the records alone
+            {
+                Registry& registry = LiveDomains();
+                std::lock_guard<std::mutex> lock(registry.m_mutex);
+                registry.m_live.erase(m_id);
+            }
+
+            ThreadRecord* record = m_records.load();
+            while (record != nullptr)
+            {
+                ThreadRecord* next = record->m_next;
+                for (RetiredNode& node : record->m_retired)
+                {
+                    node.m_deleter(node.m_pointer);
+                }
+                delete record;
+                record = next;
+            }
+        }
+
+        // Delete copy constructor and copy-assignment
+        EpochDomain(EpochDomain const&) = delete;
+        EpochDomain& operator=(EpochDomain const&) = delete;
+
+        /**
+         * Domain shared by the whole program.
+         * Instantiated on first use.
+         */
+        static EpochDomain& Global()
+        {
+            static EpochDomain instance;
+            return instance;
+        }
+
+        /**
+         * Hand an unlinked node over to the domain, it is deleted once
+         * every thread has left the epoch it was retired in.
+         */
+        template <class T>
+        void Retire(T* pointer)
+        {
+            Retire(pointer, [](void* node)
+            {
+                delete static_cast<T*>(node);
+            });
+        }
+
+        // Retire a node with a custom deleter
+        void Retire(void* pointer, void (*deleter)(void*))
+        {
+            ThreadRecord& record = LocalRecord();
+            record.m_retired.push_back(RetiredNode{pointer, deleter, m_epoch.load(std::memory_order_acquire)});
+
+            if (record.m_retired.size() % BatchSize == 0)
+            {
+                TryAdvance();
+                Collect(record);
+
+                // Reclamation is stuck behind a slow reader, wait for it
+                // unless the caller itself is inside a guard
+                if (record.m_retired.size() >= MaxPending && record.m_nesting == 0)
+                {
+                    Synchronize();
+                }
+            }
+        }
+
+        /**
+         * Wait for a grace period.
+         * Every node retired before the call is deleted on return, and every
+         * guard active at the time of the call has been released.
+         * Must not be called while holding a guard of this domain.
+         */
+        void Synchronize()
+        {
+            const uint64_t target = m_epoch.load(std::memory_order_acquire) + 2;
+            while (m_epoch.load(std::memory_order_acquire) < target)
+            {
+                if (!TryAdvance())
+                {
+                    std::this_thread::yield();
+                }
+            }
+            Collect(LocalRecord());
+        }
+
+        /**
+         * Retired nodes of the calling thread waiting for deletion.
+         */
+        size_t PendingCount()
+        {
+            return LocalRecord().m_retired.size();
+        }
+
+        // Whether the calling thread currently holds a guard of this domain
+        bool InGuard()
+        {
+            return LocalRecord().m_nesting != 0;
+        }
+
+        // Current global epoch
+        uint64_t Epoch() const
+        {
+            return m_epoch.load(std::memory_order_acquire);
+        }
+
+    private:
+
+        friend class EpochGuard;
+
+        // Epoch value of a thread which is not inside a guard
+        static const uint64_t Quiescent = UINT64_MAX;
+
+        struct RetiredNode
+        {
+            void* m_pointer;
+            void (*m_deleter)(void*);
+            uint64_t m_epoch;
+        };
+
+        /**
+         * Epoch and retire list of a single thread.
+         * Records are never freed before the domain, threads exiting give
+         * their record back for reuse, including any pending retired nodes.
+         */
+        struct alignas(64) ThreadRecord
+        {
+            std::atomic<uint64_t> m_localEpoch{Quiescent};
+            std::atomic<bool> m_inUse{true};
+            ThreadRecord* m_next = nullptr;
+            // Only touched by the owner
+            std::vector<RetiredNode> m_retired;
+            size_t m_nesting = 0;
+        };
+
+        /**
+         * Ids of the domains still alive. A domain may be destroyed before
+         * the threads which used it exit, their caches then hold records
+         * which are already freed and must not be touched.
+         */
+        struct Registry
+        {
+            std::mutex m_mutex;
+            std::unordered_set<uint64_t> m_live;
+        };
+
+        static Registry& LiveDomains()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        /**
+         * Thread local list of records owned by this thread, one per domain.
+         * Releases the records of the live domains when the thread exits.
+         */
+        struct ThreadCache
+        {
+            ~ThreadCache()
+            {
+                if (m_entries.empty())
+                {
+                    return;
+                }
+
+                Registry& registry = LiveDomains();
+                std::lock_guard<std::mutex> lock(registry.m_mutex);
+                for (std::pair<uint64_t, ThreadRecord*>& entry : m_entries)
+                {
+                    if (registry.m_live.count(entry.first) != 0)
+                    {
+                        entry.second->m_inUse.store(false, std::memory_order_release);
+                    }
+                }
+            }
+
+            // Forget the records of destroyed domains
+            void Prune()
+            {
+                Registry& registry = LiveDomains();
+                std::lock_guard<std::mutex> lock(registry.m_mutex);
+                std::erase_if(m_entries, [&](const std::pair<uint64_t, ThreadRecord*>& entry)
+                {
+                    return registry.m_live.count(entry.first) == 0;
+                });
+            }
+
+            std::vector<std::pair<uint64_t, ThreadRecord*> > m_entries;
+        };
+
+        static uint64_t NextId()
+        {
+            static std::atomic<uint64_t> counter{0};
+            return counter.fetch_add(1) + 1;
+        }
+
+        // Record of the calling thread, acquired on first use
+        ThreadRecord& LocalRecord()
+        {
+            static thread_local ThreadCache cache;
+            for (std::pair<uint64_t, ThreadRecord*>& entry : cache.m_entries)
+            {
+                if (entry.first == m_id)
+                {
+                    return *entry.second;
+                }
+            }
+
+            cache.Prune();
+            ThreadRecord* record = AcquireRecord();
+            cache.m_entries.emplace_back(m_id, record);
+            return *record;
+        }
+
+        ThreadRecord* AcquireRecord()
+        {
+            // Reuse a record left behind by a finished thread
+            for (ThreadRecord* record = m_records.load(std::memory_order_acquire); record != nullptr; record = record->m_next)
+            {
+                bool expected = false;
+                if (!record->m_inUse.load(std::memory_order_relaxed)
+                    && record->m_inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                {
+                    return record;
+                }
+            }
+
+            // Otherwise push a new one
+            ThreadRecord* record = new ThreadRecord();
+            ThreadRecord* head = m_records.load(std::memory_order_relaxed);
+            do
+            {
+                record->m_next = head;
+            }
+            while (!m_records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+
+            return record;
+        }
+
+        // Pin the calling thread to the current epoch
+        void Enter(ThreadRecord& record)
+        {
+            if (record.m_nesting++ == 0)
+            {
+                // The store must be visible before any shared pointer is read,
+                // only a fence orders it before the later acquire loads.
+                // Pairs with the seq_cst loads of TryAdvance()
+                record.m_localEpoch.store(m_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+
+        void Exit(ThreadRecord& record)
+        {
+            if (--record.m_nesting == 0)
+            {
+                record.m_localEpoch.store(Quiescent, std::memory_order_release);
+            }
+        }
+
+        /**
+         * Advance the global epoch if every pinned thread has observed it.
+         * Returns false if a thread still lags behind.
+         */
+        bool TryAdvance()
+        {
+            uint64_t epoch = m_epoch.load(std::memory_order_seq_cst);
+            for (ThreadRecord* record = m_records.load(std::memory_order_acquire); record != nullptr; record = record->m_next)
+            {
+                const uint64_t local = record->m_localEpoch.load(std::memory_order_seq_cst);
+                if (local != Quiescent && local != epoch)
+                {
+                    return false;
+                }
+            }
+            return m_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+        }
+
+        /**
+         * Delete the nodes of the record which are two epochs old.
+         */
+        void Collect(ThreadRecord& record)
+        {
+            const uint64_t epoch = m_epoch.load(std::memory_order_acquire);
+
+            size_t kept = 0;
+            for (size_t i = 0; i < record.m_retired.size(); i++)
+            {
+                RetiredNode& node = record.m_retired[i];
+                if (node.m_epoch + 2 <= epoch)
+                {
+                    node.m_deleter(node.m_pointer);
+                }
+                else
+                {
+                    record.m_retired[kept++] = node;
+                }
+            }
+            record.m_retired.resize(kept);
+        }
+
+        const uint64_t m_id;
+        std::atomic<uint64_t> m_epoch{0};
+        std::atomic<ThreadRecord*> m_records{nullptr};
+};
+
+
+/**
+ * Epoch Guard
+ * Pins the calling thread to the current epoch for its lifetime, nodes
+ * loaded from shared structures stay valid until it is destroyed.
+ * Guards may be nested.
+ */
+class EpochGuard
+{
+
+    public:
+
+        explicit EpochGuard(EpochDomain& domain = EpochDomain::Global()) :
+            m_domain(domain), m_record(domain.LocalRecord())
+        {
+            m_domain.Enter(m_record);
+        }
+
+        ~EpochGuard()
+        {
+            m_domain.Exit(m_record);
+        }
+
+        // Delete copy constructor and copy-assignment
+        EpochGuard(EpochGuard const&) = delete;
+        EpochGuard& operator=(EpochGuard const&) = delete;
+
+    private:
+
+        EpochDomain& m_domain;
+        EpochDomain::ThreadRecord& m_record;
+};
+
+
+#endif //__EPOCH_RECLAMATION_H_
@@ -0,0 +1,266 @@
+/**
+* @file fork-join-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Fork-join scheduler benchmark
+*
+* Compares the ForkJoinPool against the naive approach of creating a
+* ScopedThread for every split on three recursive workloads:
+*
+*   * Parallel fibonacci, no cut-off, one task per call.
+*
+*   * Merge sort, split until a small sequential cut-off.
+*
+*   * Reduction over a balanced binary tree, one task per node.
+*
+* The naive variant is run on smaller inputs, millions of threads cannot
+* be created on most systems.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread fork-join-benchmark.cpp -o fork-join-benchmark
+* ./fork-join-benchmark [thread count]
+*
+*/
+
+#include "fork-join.h"
+#include "scoped-thread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+/**
+ * Measure the wall clock time of a callable in milliseconds.
+ */
+template <class F>
+double MeasureMs(F&& func)
+{
+    const auto start = std::chrono::steady_clock::now();
+    func();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void Report(const std::string& name, double forkJoinMs, double threadMs)
+{
+    std::cout << name << "\n";
+    std::cout << "    fork-join:       " << forkJoinMs << " ms\n";
+    std::cout << "    thread-per-task: " << threadMs << " ms\n";
+}
+
+
+// Fibonacci
+
+int64_t FibForkJoin(ForkJoinPool& pool, int n)
+{
+    if (n < 2)
+    {
+        return n;
+    }
+
+    int64_t a = 0;
+    int64_t b = 0;
+    ParallelInvoke(pool,
+        [&] { a = FibForkJoin(pool, n - 1); },
+        [&] { b = FibForkJoin(pool, n - 2); });
+    return a + b;
+}
+
+int64_t FibThreads(int n)
+{
+    if (n < 2)
+    {
+        return n;
+    }
+
+    int64_t a = 0;
+    int64_t b = 0;
+    {
+        ScopedThread thr(std::thread([&] { b = FibThreads(n - 2); }));
+        a = FibThreads(n - 1);
+    }
+    return a + b;
+}
+
+
+// Merge sort
+
+static const size_t SortCutOff = 2048;
+
+void MergeSortForkJoin(ForkJoinPool& pool, int* data, int* scratch, size_t size)
+{
+    if (size <= SortCutOff)
+    {
+        std::sort(data, data + size);
+        return;
+    }
+
+    const size_t half = size / 2;
+    ParallelInvoke(pool,
+        [&] { MergeSortForkJoin(pool, data, scratch, half); },
+        [&] { MergeSortForkJoin(pool, data + half, scratch + half, size - half); });
+
+    std::merge(data, data + half, data + half, data + size, scratch);
+    std::copy(scratch, scratch + size, data);
+}
+
+void MergeSortThreads(int* data, int* scratch, size_t size)
+{
+    if (size <= SortCutOff)
+    {
+        std::sort(data, data + size);
+        return;
+    }
+
+    const size_t half = size / 2;
+    {
+        ScopedThread thr(std::thread([=] { MergeSortThreads(data + half, scratch + half, size - half); }));
+        MergeSortThreads(data, scratch, half);
+    }
+
+    std::merge(data, data + half, data + half, data + size, scratch);
+    std::copy(scratch, scratch + size, data);
+}
+
+
+// Tree reduction
+
+struct TreeNode
+{
+    int64_t m_value = 0;
+    std::unique_ptr<TreeNode> m_left;
+    std::unique_ptr<TreeNode> m_right;
+};
+
+std::unique_ptr<TreeNode> BuildTree(int depth, int64_t& next)
+{
+    if (depth == 0)
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<TreeNode> node(new TreeNode());
+    node->m_value = next++;
+    node->m_left = BuildTree(depth - 1, next);
+    node->m_right = BuildTree(depth - 1, next);
+    return node;
+}
+
+int64_t ReduceForkJoin(ForkJoinPool& pool, const TreeNode* node)
+{
+    if (node == nullptr)
+    {
+        return 0;
+    }
+
+    int64_t left = 0;
+    int64_t right = 0;
+    ParallelInvoke(pool,
+        [&] { left = ReduceForkJoin(pool, node->m_left.get()); },
+        [&] { right = ReduceForkJoin(pool, node->m_right.get()); });
+    return node->m_value + left + right;
+}
+
+int64_t ReduceThreads(const TreeNode* node)
+{
+    if (node == nullptr)
+    {
+        return 0;
+    }
+
+    int64_t left = 0;
+    int64_t right = 0;
+    {
+        ScopedThread thr(std::thread([&] { right = ReduceThreads(node->m_right.get()); }));
+        left = ReduceThreads(node->m_left.get());
+    }
+    return node->m_value + left + right;
+}
+
+
+int main(int argc, char* argv[])
+{
+    // Optional number of worker threads
+    const size_t threadCount = (argc > 1) ? std::stoul(argv[1]) : std::thread::hardware_concurrency();
+
+    ForkJoinPool pool(threadCount);
+    std::cout << "Worker threads: " << pool.ThreadCount() << "\n\n";
+
+    // Fibonacci on equal input
+    {
+        const int n = 18;
+        int64_t forkJoinResult = 0;
+        int64_t threadResult = 0;
+        const double forkJoinMs = MeasureMs([&] { pool.Invoke([&] { forkJoinResult = FibForkJoin(pool, n); }); });
+        const double threadMs = MeasureMs([&] { threadResult = FibThreads(n); });
+        Report("fib(" + std::to_string(n) + ") = " + std::to_string(forkJoinResult), forkJoinMs, threadMs);
+
+        if (forkJoinResult != threadResult)
+        {
+            std::cout << "    result mismatch!\n";
+            return 1;
+        }
+    }
+
+    // Fibonacci with millions of tasks, fork-join only
+    {
+        const int n = 30;
+        int64_t result = 0;
+        const double forkJoinMs = MeasureMs([&] { pool.Invoke([&] { result = FibForkJoin(pool, n); }); });
+        std::cout << "fib(" << n << ") = " << result << " (" << 2 * result << " tasks)\n";
+        std::cout << "    fork-join:       " << forkJoinMs << " ms\n";
+    }
+
+    // Merge sort
+    {
+        const size_t size = 1 << 22;
+        std::vector<int> input(size);
+        std::mt19937 generator(42);
+        for (int& value : input)
+        {
+            value = static_cast<int>(generator());
+        }
+
+        std::vector<int> a = input;
+        std::vector<int> b = input;
+        std::vector<int> scratch(size);
+        const double forkJoinMs = MeasureMs([&] { pool.Invoke([&] { MergeSortForkJoin(pool, a.data(), scratch.data(), size); }); });
+        const double threadMs = MeasureMs([&] { MergeSortThreads(b.data(), scratch.data(), size); });
+        Report("mergesort(" + std::to_string(size) + ")", forkJoinMs, threadMs);
+
+        if (!std::is_sorted(a.begin(), a.end()) || a != b)
+        {
+            std::cout << "    sort failed!\n";
+            return 1;
+        }
+    }
+
+    // Tree reduction
+    {
+        const int depth = 14;
+        int64_t next = 0;
+        std::unique_ptr<TreeNode> root = BuildTree(depth, next);
+
+        int64_t forkJoinResult = 0;
+        int64_t threadResult = 0;
+        const double forkJoinMs = MeasureMs([&] { pool.Invoke([&] { forkJoinResult = ReduceForkJoin(pool, root.get()); }); });
+        const double threadMs = MeasureMs([&] { threadResult = ReduceThreads(root.get()); });
+        Report("tree reduction(" + std::to_string(next) + " nodes)", forkJoinMs, threadMs);
+
+        if (forkJoinResult != threadResult)
+        {
+            std::cout << "    result mismatch!\n";
+            return 1;
+        }
+    }
+
+    std::cout << "\nTasks stolen: " << pool.StealCount() << "\n";
+    return 0;
+}
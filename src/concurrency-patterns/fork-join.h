@@ -0,0 +1,597 @@
+/**
+* @file fork-join.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Fork-join task scheduler
+*
+* The Problem:
+*
+* Divide-and-conquer algorithms split the work recursively. Creating a
+* ScopedThread for every split quickly exhausts the operating system, each
+* thread costs a stack, a kernel object and a context switch, while the
+* amount of work per split keeps shrinking.
+*
+* Solution:
+*
+* Keep a bounded number of worker threads, each owning a double-ended queue
+* of tasks. Spawn() pushes a task onto the calling worker's own queue, the
+* owner pops from the back (last in, first out) which keeps the working set
+* hot in cache, while idle workers steal from the front of other queues
+* (first in, first out) where the oldest and therefore largest pieces of
+* work live. Sync() called on a worker never blocks the thread, it keeps
+* executing pending tasks until all children of the group have completed.
+* Threads outside of the pool simply block in Sync().
+*
+* Usage:
+*
+* ForkJoinPool pool(4);
+* pool.Invoke([&]
+* {
+*     TaskGroup group(pool);
+*     group.Spawn([&]{ left = Solve(lhs); });
+*     right = Solve(rhs);
+*     group.Sync();
+* });
+*
+* Notes:
+*
+* True continuation stealing (the parent continuation is made stealable
+* while the child runs) requires compiler support such as Cilk or stackless
+* coroutines. This scheduler uses child stealing instead, ParallelInvoke()
+* runs the first branch inline (work-first) and only makes the second one
+* stealable, which gives the same depth-first execution order on a worker.
+*
+*/
+
+#ifndef __FORK_JOIN_H_
+#define __FORK_JOIN_H_
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+class ForkJoinPool;
+class TaskGroup;
+
+/**
+ * Unit of work executed by the pool.
+ * Holds the group it belongs to, so completion can be reported back.
+ */
+class ForkJoinTask
+{
+    public:
+        explicit ForkJoinTask(TaskGroup* group) :
+            m_group(group) {}
+
+        virtual ~ForkJoinTask() = default;
+
+        // Perform the work of the task
+        virtual void Execute() = 0;
+
+        TaskGroup* Group() const
+        {
+            return m_group;
+        }
+
+    private:
+
+        // Group waiting for this task, nullptr for detached tasks
+        TaskGroup* m_group;
+};
+
+/**
+ * Task wrapping any callable object.
+ */
+template <class F>
+class ForkJoinCallableTask : public ForkJoinTask
+{
+    public:
+        ForkJoinCallableTask(TaskGroup* group, F func) :
+            ForkJoinTask(group), m_func(std::move(func)) {}
+
+        void Execute() override
+        {
+            m_func();
+        }
+
+    private:
+
+        F m_func;
+};
+
+
+/**
+ * Fork-join pool
+ * Owns a fixed number of worker threads, each with its own work queue.
+ */
+class ForkJoinPool
+{
+    public:
+
+        /**
+         * Constructor
+         * Starts the requested number of worker threads.
+         */
+        explicit ForkJoinPool(size_t threadCount = std::thread::hardware_concurrency())
+        {
+            // Always start at least one worker
+            if (threadCount == 0)
+            {
+                threadCount = 1;
+            }
+
+            m_queues.reserve(threadCount);
+            for (size_t i = 0; i < threadCount; i++)
+            {
+                m_queues.emplace_back(new WorkQueue());
+            }
+
+            m_workers.reserve(threadCount);
+            for (size_t i = 0; i < threadCount; i++)
+            {
+                m_workers.emplace_back(&ForkJoinPool::WorkerLoop, this, i);
+            }
+        }
+
+        /**
+         * Destructor
+         * Stops and joins all workers. Tasks still queued are discarded.
+         */
+        ~ForkJoinPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_sleepMutex);
+                m_stop.store(true);
+            }
+            m_sleepCondition.notify_all();
+
+            for (std::thread& worker : m_workers)
+            {
+                worker.join();
+            }
+
+            for (std::unique_ptr<WorkQueue>& queue : m_queues)
+            {
+                for (ForkJoinTask* task : queue->m_tasks)
+                {
+                    delete task;
+                }
+            }
+
+            for (ForkJoinTask* task : m_injected)
+            {
+                delete task;
+            }
+        }
+
+        // Delete copy constructor and copy-assignment
+        ForkJoinPool(ForkJoinPool const&) = delete;
+        ForkJoinPool& operator=(ForkJoinPool const&) = delete;
+
+        /**
+         * Run the root task inside the pool and wait for its completion.
+         */
+        template <class F>
+        void Invoke(F&& func);
+
+        /**
+         * Run the callable on the pool without waiting for it.
+         * Allows the pool to be used as an executor, an exception escaping
+         * a detached task terminates the program like it would on std::thread.
+         */
+        template <class F>
+        void Post(F&& func);
+
+        /**
+         * Run the callable on the pool behind every task already submitted
+         * from outside of it. Post() from a worker runs the task next on the
+         * same worker, which lets a task re-posting itself starve the rest.
+         */
+        template <class F>
+        void PostShared(F&& func);
+
+        /**
+         * Executor interface, same as Post().
+         */
+        template <class F>
+        void Execute(F&& func)
+        {
+            Post(std::forward<F>(func));
+        }
+
+        /**
+         * Process wide pool with one worker per hardware thread, for
+         * algorithms whose caller does not provide a pool of its own.
+         * Started on first use.
+         */
+        static ForkJoinPool& Global()
+        {
+            static ForkJoinPool pool;
+            return pool;
+        }
+
+        // Number of worker threads
+        size_t ThreadCount() const
+        {
+            return m_workers.size();
+        }
+
+        // Number of tasks stolen from other workers since construction
+        size_t StealCount() const
+        {
+            return m_steals.load(std::memory_order_relaxed);
+        }
+
+    private:
+
+        friend class TaskGroup;
+
+        /**
+         * Double-ended queue of a single worker.
+         * Aligned to a cache line so that neighbouring queues do not
+         * falsely share their locks.
+         */
+        struct alignas(64) WorkQueue
+        {
+            std::mutex m_mutex;
+            std::deque<ForkJoinTask*> m_tasks;
+        };
+
+        /**
+         * Push task onto the queue of the calling worker, or onto the
+         * injection queue when called from outside of the pool or shared.
+         */
+        void Push(ForkJoinTask* task, bool shared = false)
+        {
+            if (t_pool == this && !shared)
+            {
+                WorkQueue& queue = *m_queues[t_index];
+                std::lock_guard<std::mutex> lock(queue.m_mutex);
+                queue.m_tasks.push_back(task);
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(m_injectedMutex);
+                m_injected.push_back(task);
+            }
+
+            // Wake a sleeping worker if there is one
+            m_signal.fetch_add(1);
+            if (m_sleepers.load() > 0)
+            {
+                std::lock_guard<std::mutex> lock(m_sleepMutex);
+                m_sleepCondition.notify_one();
+            }
+        }
+
+        /**
+         * Take a single task, own queue first, then the injection queue,
+         * then steal from the other workers.
+         * Returns nullptr if there is no work anywhere.
+         */
+        ForkJoinTask* Take()
+        {
+            ForkJoinTask* task = nullptr;
+            const bool isWorker = (t_pool == this);
+            const size_t self = isWorker ? t_index : 0;
+
+            // Own queue, newest task first
+            if (isWorker)
+            {
+                WorkQueue& queue = *m_queues[self];
+                std::lock_guard<std::mutex> lock(queue.m_mutex);
+                if (!queue.m_tasks.empty())
+                {
+                    task = queue.m_tasks.back();
+                    queue.m_tasks.pop_back();
+                    return task;
+                }
+            }
+
+            // Tasks submitted from outside of the pool
+            {
+                std::lock_guard<std::mutex> lock(m_injectedMutex);
+                if (!m_injected.empty())
+                {
+                    task = m_injected.front();
+                    m_injected.pop_front();
+                    return task;
+                }
+            }
+
+            // Steal the oldest task of another worker
+            const size_t count = m_queues.size();
+            for (size_t i = 1; i <= count; i++)
+            {
+                const size_t victim = (self + i) % count;
+                if (isWorker && victim == self)
+                {
+                    continue;
+                }
+
+                WorkQueue& queue = *m_queues[victim];
+                std::unique_lock<std::mutex> lock(queue.m_mutex, std::try_to_lock);
+                if (lock.owns_lock() && !queue.m_tasks.empty())
+                {
+                    task = queue.m_tasks.front();
+                    queue.m_tasks.pop_front();
+                    m_steals.fetch_add(1, std::memory_order_relaxed);
+                    return task;
+                }
+            }
+
+            return nullptr;
+        }
+
+        /**
+         * Execute one task if any is available.
+         * Returns false if no work was found.
+         */
+        bool RunOne();
+
+        // Body of each worker thread
+        void WorkerLoop(size_t index)
+        {
+            t_pool = this;
+            t_index = index;
+
+            while (!m_stop.load())
+            {
+                const size_t signal = m_signal.load();
+
+                if (RunOne())
+                {
+                    continue;
+                }
+
+                // Nothing to do, sleep until new work is pushed
+                std::unique_lock<std::mutex> lock(m_sleepMutex);
+                m_sleepers.fetch_add(1);
+                m_sleepCondition.wait(lock, [this, signal]
+                {
+                    return m_stop.load() || m_signal.load() != signal;
+                });
+                m_sleepers.fetch_sub(1);
+            }
+
+            t_pool = nullptr;
+        }
+
+        // Pool and queue index of the calling thread
+        static thread_local ForkJoinPool* t_pool;
+        static thread_local size_t t_index;
+
+        // Worker queues, one per thread
+        std::vector<std::unique_ptr<WorkQueue> > m_queues;
+
+        // Queue of tasks pushed by threads outside of the pool
+        std::mutex m_injectedMutex;
+        std::deque<ForkJoinTask*> m_injected;
+
+        // Sleeping workers
+        std::mutex m_sleepMutex;
+        std::condition_variable m_sleepCondition;
+        std::atomic<size_t> m_sleepers{0};
+        std::atomic<size_t> m_signal{0};
+
+        std::atomic<bool> m_stop{false};
+        std::atomic<size_t> m_steals{0};
+
+        std::vector<std::thread> m_workers;
+};
+
+inline thread_local ForkJoinPool* ForkJoinPool::t_pool = nullptr;
+inline thread_local size_t ForkJoinPool::t_index = 0;
+
+
+/**
+ * Task Group
+ * Tracks a set of spawned children. Sync() waits for all of them and
+ * rethrows the first exception thrown by any child.
+ */
+class TaskGroup
+{
+    public:
+        explicit TaskGroup(ForkJoinPool& pool) :
+            m_pool(pool) {}
+
+        /**
+         * Destructor
+         * Children reference the group, so it must not go out of scope
+         * before they complete.
+         */
+        ~TaskGroup()
+        {
+            Wait();
+        }
+
+        // Delete copy constructor and copy-assignment
+        TaskGroup(TaskGroup const&) = delete;
+        TaskGroup& operator=(TaskGroup const&) = delete;
+
+        /**
+         * Make the callable available for execution by any worker.
+         */
+        template <class F>
+        void Spawn(F&& func)
+        {
+            m_pending.fetch_add(1, std::memory_order_relaxed);
+            m_pool.Push(new ForkJoinCallableTask<std::decay_t<F> >(this, std::forward<F>(func)));
+        }
+
+        /**
+         * Wait for all spawned children.
+         * The calling thread keeps executing queued tasks instead of blocking.
+         */
+        void Sync()
+        {
+            Wait();
+
+            // Propagate failure of a child to the parent
+            if (m_failed.load())
+            {
+                std::exception_ptr error = m_error;
+                m_error = nullptr;
+                m_failed.store(false);
+                std::rethrow_exception(error);
+            }
+        }
+
+    private:
+
+        friend class ForkJoinPool;
+
+        void Wait()
+        {
+            // Threads outside of the pool block, helping from there would
+            // run arbitrary tasks on a stack the pool does not control
+            if (ForkJoinPool::t_pool != &m_pool)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_done.wait(lock, [&]() { return m_pending.load(std::memory_order_acquire) == 0; });
+                return;
+            }
+
+            while (m_pending.load(std::memory_order_acquire) != 0)
+            {
+                if (!m_pool.RunOne())
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            // The last child decrements under the lock, once it is ours
+            // that child no longer touches the group
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+
+        // Called by the pool once a child has finished
+        void Complete(std::exception_ptr error)
+        {
+            if (error)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_failed.load())
+                {
+                    m_error = error;
+                    m_failed.store(true);
+                }
+            }
+
+            // Children which are not the last leave without the lock
+            size_t pending = m_pending.load(std::memory_order_relaxed);
+            while (pending > 1)
+            {
+                if (m_pending.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+                {
+                    return;
+                }
+            }
+
+            // Possibly the last one, a waiter may destroy the group as soon
+            // as it sees zero, so the decrement and the wake up happen under
+            // the lock the waiter takes before returning
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                m_done.notify_all();
+            }
+        }
+
+        ForkJoinPool& m_pool;
+
+        // Number of children still running
+        std::atomic<size_t> m_pending{0};
+
+        // Guards the first exception and the completion of the last child
+        std::mutex m_mutex;
+        std::condition_variable m_done;
+
+        // First exception thrown by a child
+        std::exception_ptr m_error;
+        std::atomic<bool> m_failed{false};
+};
+
+
+inline bool ForkJoinPool::RunOne()
+{
+    ForkJoinTask* task = Take();
+    if (task == nullptr)
+    {
+        return false;
+    }
+
+    std::exception_ptr error;
+    try
+    {
+        task->Execute();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    TaskGroup* group = task->Group();
+    delete task;
+
+    // Detached tasks have nobody to report a failure to
+    if (group == nullptr)
+    {
+        if (error)
+        {
+            std::terminate();
+        }
+        return true;
+    }
+
+    group->Complete(error);
+    return true;
+}
+
+template <class F>
+void ForkJoinPool::Post(F&& func)
+{
+    Push(new ForkJoinCallableTask<std::decay_t<F> >(nullptr, std::forward<F>(func)));
+}
+
+template <class F>
+void ForkJoinPool::PostShared(F&& func)
+{
+    Push(new ForkJoinCallableTask<std::decay_t<F> >(nullptr, std::forward<F>(func)), true);
+}
+
+template <class F>
+void ForkJoinPool::Invoke(F&& func)
+{
+    TaskGroup group(*this);
+    group.Spawn(std::forward<F>(func));
+    group.Sync();
+}
+
+/**
+ * Run two branches in parallel.
+ * The second branch is made available for stealing, the first one runs
+ * immediately on the calling thread.
+ */
+template <class A, class B>
+void ParallelInvoke(ForkJoinPool& pool, A&& first, B&& second)
+{
+    TaskGroup group(pool);
+    group.Spawn(std::forward<B>(second));
+    first();
+    group.Sync();
+}
+
+
+#endif //__FORK_JOIN_H_
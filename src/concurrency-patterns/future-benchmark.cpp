@@ -0,0 +1,258 @@
+/**
+* @file future-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Future benchmark
+*
+* Compares Future/Promise with std::promise/std::future on a value handed
+* over on one thread, then runs a chain of inline continuations, WhenAll
+* over a batch of futures, void futures and continuations posted to a
+* ForkJoinPool. Finally a producer thread creates and completes futures
+* which a consumer thread reads and releases, the case where the states are
+* freed on another thread than they were allocated on. Every line reports
+* the global heap allocations per operation, counted by replacing the
+* global operator new.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread future-benchmark.cpp -o future-benchmark
+* ./future-benchmark [operations]
+*
+*/
+
+#include "future.h"
+#include "fork-join.h"
+#include "../benchmark.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+
+// Global heap allocations made by the measured function, per operation
+template <class F>
+void MeasureAllocations(const std::string& name, size_t operations, F&& function)
+{
+    uint64_t allocations = 0;
+    Measure(name, operations, [&]()
+    {
+        const uint64_t before = g_allocations.load();
+        uint64_t checksum = function();
+        allocations = g_allocations.load() - before;
+        return checksum;
+    });
+    std::cout << "      " << static_cast<double>(allocations) / operations << " allocations/op\n";
+}
+
+
+/**
+ * Producer creates and completes futures in batches, the consumer takes
+ * their values and drops them, releasing the shared states.
+ */
+uint64_t CrossThread(size_t operations)
+{
+    const size_t batchSize = 256;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Future<uint64_t> > handed;
+    handed.reserve(batchSize);
+    bool full = false;
+    bool finished = false;
+    uint64_t checksum = 0;
+
+    std::thread consumer([&]()
+    {
+        std::vector<Future<uint64_t> > batch;
+        batch.reserve(batchSize);
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return full || finished; });
+                if (!full)
+                {
+                    return;
+                }
+                batch.swap(handed);
+                full = false;
+            }
+            changed.notify_all();
+            for (Future<uint64_t>& future : batch)
+            {
+                checksum += future.Get();
+            }
+            batch.clear();
+        }
+    });
+
+    std::vector<Future<uint64_t> > futures;
+    futures.reserve(batchSize);
+    for (size_t sent = 0; sent < operations; sent += batchSize)
+    {
+        for (size_t i = 0; i < batchSize; i++)
+        {
+            Promise<uint64_t> promise;
+            futures.push_back(promise.GetFuture());
+            promise.SetValue(i);
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return !full; });
+            handed.swap(futures);
+            full = true;
+        }
+        changed.notify_all();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return !full; });
+        finished = true;
+    }
+    changed.notify_all();
+    consumer.join();
+    return checksum;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t operations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    std::cout << "Operations: " << operations << "\n";
+
+    // Warm the caches of this thread
+    for (size_t i = 0; i < 1024; i++)
+    {
+        MakeReadyFuture(i).Get();
+    }
+
+    MeasureAllocations("  std::promise set and get  ", operations, [&]()
+    {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < operations; i++)
+        {
+            std::promise<uint64_t> promise;
+            std::future<uint64_t> future = promise.get_future();
+            promise.set_value(i);
+            checksum += future.get();
+        }
+        return checksum;
+    });
+    MeasureAllocations("  Promise set and get       ", operations, [&]()
+    {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < operations; i++)
+        {
+            Promise<uint64_t> promise;
+            Future<uint64_t> future = promise.GetFuture();
+            promise.SetValue(i);
+            checksum += future.Get();
+        }
+        return checksum;
+    });
+
+    MeasureAllocations("  three Then, inline        ", operations, [&]()
+    {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < operations; i++)
+        {
+            Promise<uint64_t> promise;
+            Future<uint64_t> future = promise.GetFuture()
+                .Then([](uint64_t value) { return value + 1; })
+                .Then([](uint64_t value) { return value * 2; })
+                .Then([](uint64_t value) { return value - 2; });
+            promise.SetValue(i);
+            checksum += future.Get();
+        }
+        return checksum;
+    });
+
+    MeasureAllocations("  void Then void            ", operations, [&]()
+    {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < operations; i++)
+        {
+            Promise<void> promise;
+            Future<void> future = promise.GetFuture().Then([&checksum]() { checksum++; });
+            promise.SetValue();
+            future.Get();
+        }
+        return checksum;
+    });
+
+    const size_t batch = 64;
+    MeasureAllocations("  WhenAll of 64, per input  ", operations / batch * batch, [&]()
+    {
+        uint64_t checksum = 0;
+        std::vector<Promise<uint64_t> > promises(batch);
+        for (size_t round = 0; round < operations / batch; round++)
+        {
+            std::vector<Future<uint64_t> > futures;
+            futures.reserve(batch);
+            for (Promise<uint64_t>& promise : promises)
+            {
+                promise = Promise<uint64_t>();
+                futures.push_back(promise.GetFuture());
+            }
+            Future<std::vector<uint64_t> > all = WhenAll(std::move(futures));
+            for (size_t i = 0; i < batch; i++)
+            {
+                promises[i].SetValue(i);
+            }
+            for (uint64_t value : all.Get())
+            {
+                checksum += value;
+            }
+        }
+        return checksum;
+    });
+
+    ForkJoinPool pool(2);
+    MeasureAllocations("  Then on ForkJoinPool      ", operations / 10, [&]()
+    {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < operations / 10; i++)
+        {
+            Promise<uint64_t> promise;
+            Future<uint64_t> future = promise.GetFuture().Then(pool, [](uint64_t value) { return value * 3; });
+            promise.SetValue(i);
+            checksum += future.Get();
+        }
+        return checksum;
+    });
+
+    MeasureAllocations("  released on another thread", operations, [&]() { return CrossThread(operations); });
+    return 0;
+}
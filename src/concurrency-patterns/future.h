@@ -0,0 +1,884 @@
+/**
+* @file future.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Future/Promise with continuations
+*
+* The Problem:
+*
+* Getting a result out of a ThreadObject or a ScopedThread requires the
+* caller to manage shared state and synchronisation by hand. std::future
+* solves the hand-off, but it cannot chain further work and get() blocks a
+* whole thread until the value arrives.
+*
+* Solution:
+*
+* A Promise is the writing end and a Future the reading end of a shared
+* state. Instead of blocking, the reader attaches a continuation with Then().
+* Whoever comes second, the producer setting the value or the consumer
+* attaching the continuation, runs it. Continuations attached to a future
+* which is already ready therefore run inline without any hand-off.
+*
+* A continuation may be bound to an executor, any object providing
+* Execute(callable), e.g. InlineExecutor or ForkJoinPool, in which case it
+* is posted there instead of running on the thread which completed the
+* promise.
+*
+* Shared states are recycled through per-thread free lists. A state
+* released on another thread returns to the thread which allocated it, so
+* creating a future does not normally reach the global heap, also when the
+* producer and the consumer run on different threads.
+*
+* Usage:
+*
+* Promise<int> promise;
+* Future<std::string> text = promise.GetFuture()
+*     .Then([](int value){ return value * 2; })
+*     .Then(pool, [](int value){ return std::to_string(value); });
+* promise.SetValue(21);
+* std::cout << text.Get();
+*
+* Notes:
+*
+* A state holds at most one continuation, Then() consumes the future.
+*
+*/
+
+#ifndef __FUTURE_H_
+#define __FUTURE_H_
+
+
+#include "../behavioral-patterns/strategy/strategy.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+template <class T> class Future;
+template <class T> class Promise;
+
+
+/**
+ * Executor running the callable immediately on the calling thread.
+ */
+class InlineExecutor
+{
+    public:
+        template <class F>
+        void Execute(F&& func)
+        {
+            func();
+        }
+};
+
+
+/**
+ * Per-thread cache of fixed size memory blocks.
+ * Every block remembers the thread which allocated it. A block released on
+ * that thread goes straight back to its cache, a block released on another
+ * thread is pushed onto the remote list of the owner with one compare and
+ * swap, and the owner takes the whole list back once its cache runs dry.
+ * A producer allocating states which consumers release elsewhere keeps
+ * reusing its blocks instead of reaching the heap.
+ */
+template <size_t BlockSize>
+class FutureStatePool
+{
+    public:
+        static void* Allocate()
+        {
+            Owner* owner = LocalOwner();
+            if (owner->m_local == nullptr)
+            {
+                Reclaim(*owner);
+            }
+
+            Header* block = owner->m_local;
+            if (block != nullptr)
+            {
+                owner->m_local = block->m_next;
+                owner->m_localCount--;
+                return Payload(block);
+            }
+
+            block = static_cast<Header*>(::operator new(sizeof(Header) + BlockSize));
+            block->m_owner = owner;
+            owner->m_references.fetch_add(1, std::memory_order_relaxed);
+            return Payload(block);
+        }
+
+        static void Deallocate(void* payload)
+        {
+            Header* block = reinterpret_cast<Header*>(static_cast<unsigned char*>(payload) - sizeof(Header));
+            Owner* owner = block->m_owner;
+
+            if (owner == t_owner.m_owner)
+            {
+                if (owner->m_localCount < MaxCachedBlocks)
+                {
+                    block->m_next = owner->m_local;
+                    owner->m_local = block;
+                    owner->m_localCount++;
+                    return;
+                }
+                Destroy(block);
+                return;
+            }
+
+            // Hand it back to the thread which allocated it, unless it has exited
+            Header* head = owner->m_remote.load(std::memory_order_relaxed);
+            do
+            {
+                if (head == Closed())
+                {
+                    Destroy(block);
+                    return;
+                }
+                block->m_next = head;
+            }
+            while (!owner->m_remote.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+    private:
+
+        static const size_t MaxCachedBlocks = 4096;
+
+        struct Owner;
+
+        // Precedes every block, keeps the payload aligned
+        struct alignas(std::max_align_t) Header
+        {
+            Owner* m_owner;
+            Header* m_next;
+        };
+
+        /**
+         * Blocks of one thread. Lives while the thread runs or any of its
+         * blocks exists, whichever is longer.
+         */
+        struct Owner
+        {
+            // Owning thread only
+            Header* m_local = nullptr;
+            size_t m_localCount = 0;
+
+            // The thread and every block it allocated
+            std::atomic<size_t> m_references{1};
+
+            // Released by other threads, Closed() once the owner has exited
+            alignas(64) std::atomic<Header*> m_remote{nullptr};
+        };
+
+        struct ThreadOwner
+        {
+            ~ThreadOwner()
+            {
+                if (m_owner == nullptr)
+                {
+                    return;
+                }
+
+                // Later remote releases delete their blocks themselves
+                Header* remote = m_owner->m_remote.exchange(Closed(), std::memory_order_acq_rel);
+                DestroyList(m_owner->m_local);
+                DestroyList(remote);
+                m_owner->m_local = nullptr;
+                Unreference(m_owner);
+                m_owner = nullptr;
+            }
+
+            Owner* m_owner = nullptr;
+        };
+
+        static Header* Closed()
+        {
+            static Header closed{nullptr, nullptr};
+            return &closed;
+        }
+
+        static void* Payload(Header* block)
+        {
+            return reinterpret_cast<unsigned char*>(block) + sizeof(Header);
+        }
+
+        static Owner* LocalOwner()
+        {
+            ThreadOwner& local = t_owner;
+            if (local.m_owner == nullptr)
+            {
+                local.m_owner = new Owner();
+            }
+            return local.m_owner;
+        }
+
+        // Move the blocks released by other threads into the local cache
+        static void Reclaim(Owner& owner)
+        {
+            if (owner.m_remote.load(std::memory_order_relaxed) == nullptr)
+            {
+                return;
+            }
+
+            Header* block = owner.m_remote.exchange(nullptr, std::memory_order_acquire);
+            while (block != nullptr)
+            {
+                Header* next = block->m_next;
+                if (owner.m_localCount < MaxCachedBlocks)
+                {
+                    block->m_next = owner.m_local;
+                    owner.m_local = block;
+                    owner.m_localCount++;
+                }
+                else
+                {
+                    Destroy(block);
+                }
+                block = next;
+            }
+        }
+
+        static void Destroy(Header* block)
+        {
+            Owner* owner = block->m_owner;
+            ::operator delete(block);
+            Unreference(owner);
+        }
+
+        static void DestroyList(Header* block)
+        {
+            while (block != nullptr)
+            {
+                Header* next = block->m_next;
+                Destroy(block);
+                block = next;
+            }
+        }
+
+        static void Unreference(Owner* owner)
+        {
+            if (owner->m_references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                delete owner;
+            }
+        }
+
+        static thread_local ThreadOwner t_owner;
+};
+
+template <size_t BlockSize>
+thread_local typename FutureStatePool<BlockSize>::ThreadOwner FutureStatePool<BlockSize>::t_owner;
+
+
+/**
+ * Continuation of a shared state, move-only since continuations own the
+ * promise of the next future. Small callables are stored inline, larger
+ * ones on the heap.
+ */
+using FutureCallback = MoveOnlyStrategy<void(), 48>;
+
+
+// Placeholder value stored by Future<void>
+struct FutureUnit {};
+
+template <class T>
+using FutureValue = std::conditional_t<std::is_void_v<T>, FutureUnit, T>;
+
+
+/**
+ * Result of WhenAny, index of the first completed input and its value.
+ */
+template <class T>
+struct WhenAnyResult
+{
+    size_t m_index;
+    FutureValue<T> m_value;
+};
+
+/**
+ * State shared by a promise, its future and the attached continuation.
+ * Reference counted, the memory comes from FutureStatePool.
+ */
+template <class T>
+class FutureSharedState
+{
+    public:
+        static FutureSharedState* Create()
+        {
+            return new (Pool<FutureSharedState>::Allocate()) FutureSharedState();
+        }
+
+        void AddRef()
+        {
+            m_references.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void Release()
+        {
+            if (m_references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                this->~FutureSharedState();
+                Pool<FutureSharedState>::Deallocate(this);
+            }
+        }
+
+        template <class... Args>
+        void SetValue(Args&&... args)
+        {
+            m_value.emplace(std::forward<Args>(args)...);
+            Publish();
+        }
+
+        void SetException(std::exception_ptr error)
+        {
+            m_error = error;
+            Publish();
+        }
+
+        /**
+         * Attach the continuation.
+         * If the value is already there the continuation runs right away.
+         */
+        void SetContinuation(FutureCallback continuation)
+        {
+            m_continuation = std::move(continuation);
+            const uint32_t previous = m_flags.fetch_or(HasContinuation, std::memory_order_acq_rel);
+            if (previous & Ready)
+            {
+                RunContinuation();
+            }
+        }
+
+        bool IsReady() const
+        {
+            return (m_flags.load(std::memory_order_acquire) & Ready) != 0;
+        }
+
+        // Block the calling thread until the state is ready
+        void Wait() const
+        {
+            uint32_t flags = m_flags.load(std::memory_order_acquire);
+            while ((flags & Ready) == 0)
+            {
+                m_flags.wait(flags, std::memory_order_acquire);
+                flags = m_flags.load(std::memory_order_acquire);
+            }
+        }
+
+        std::exception_ptr Error() const
+        {
+            return m_error;
+        }
+
+        FutureValue<T>& Value()
+        {
+            return *m_value;
+        }
+
+    private:
+
+        // States of similar size share a pool, sizes are rounded up to a cache line
+        template <class State>
+        using Pool = FutureStatePool<(sizeof(State) + 63) / 64 * 64>;
+
+        enum Flags : uint32_t
+        {
+            Ready = 1,
+            HasContinuation = 2
+        };
+
+        FutureSharedState() = default;
+
+        void Publish()
+        {
+            const uint32_t previous = m_flags.fetch_or(Ready, std::memory_order_acq_rel);
+            m_flags.notify_all();
+            if (previous & HasContinuation)
+            {
+                RunContinuation();
+            }
+        }
+
+        void RunContinuation()
+        {
+            // The continuation may release the last reference to this state
+            FutureCallback continuation = std::move(m_continuation);
+            continuation();
+        }
+
+        std::atomic<uint32_t> m_flags{0};
+        std::atomic<uint32_t> m_references{1};
+        std::optional<FutureValue<T> > m_value;
+        std::exception_ptr m_error;
+        FutureCallback m_continuation;
+};
+
+
+/**
+ * Reading end of a shared state.
+ */
+template <class T>
+class Future
+{
+    public:
+        Future() = default;
+
+        Future(Future&& other) noexcept :
+            m_state(std::exchange(other.m_state, nullptr)) {}
+
+        Future& operator=(Future&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Reset();
+                m_state = std::exchange(other.m_state, nullptr);
+            }
+            return *this;
+        }
+
+        ~Future()
+        {
+            Reset();
+        }
+
+        Future(Future const&) = delete;
+        Future& operator=(Future const&) = delete;
+
+        // Whether the future refers to a shared state
+        bool Valid() const
+        {
+            return m_state != nullptr;
+        }
+
+        bool IsReady() const
+        {
+            return m_state != nullptr && m_state->IsReady();
+        }
+
+        // Block until the value is available
+        void Wait() const
+        {
+            CheckValid();
+            m_state->Wait();
+        }
+
+        /**
+         * Block until the value is available and return it, or rethrow the
+         * exception stored by the promise. Consumes the future.
+         */
+        T Get()
+        {
+            CheckValid();
+            m_state->Wait();
+
+            FutureSharedState<T>* state = std::exchange(m_state, nullptr);
+            std::exception_ptr error = state->Error();
+            if (error)
+            {
+                state->Release();
+                std::rethrow_exception(error);
+            }
+
+            if constexpr (std::is_void_v<T>)
+            {
+                state->Release();
+            }
+            else
+            {
+                T value = std::move(state->Value());
+                state->Release();
+                return value;
+            }
+        }
+
+        /**
+         * Attach a continuation running on the thread which completes the
+         * future, or inline if it is already complete.
+         * The callable receives the value, exceptions skip it and propagate
+         * to the returned future.
+         */
+        template <class F>
+        auto Then(F&& func)
+        {
+            using Result = typename ContinuationResult<std::decay_t<F> >::Type;
+
+            Promise<Result> promise;
+            Future<Result> result = promise.GetFuture();
+
+            OnReady([func = std::forward<F>(func), promise = std::move(promise)]
+                (FutureSharedState<T>* state) mutable
+            {
+                Fulfil(promise, *state, func);
+                state->Release();
+            });
+
+            return result;
+        }
+
+        /**
+         * Attach a continuation which is posted to the executor once the
+         * future completes. The executor must outlive the future.
+         */
+        template <class Executor, class F>
+        auto Then(Executor& executor, F&& func)
+        {
+            using Result = typename ContinuationResult<std::decay_t<F> >::Type;
+
+            Promise<Result> promise;
+            Future<Result> result = promise.GetFuture();
+
+            OnReady([executor = &executor, func = std::forward<F>(func), promise = std::move(promise)]
+                (FutureSharedState<T>* state) mutable
+            {
+                executor->Execute([state, func = std::move(func), promise = std::move(promise)]() mutable
+                {
+                    Fulfil(promise, *state, func);
+                    state->Release();
+                });
+            });
+
+            return result;
+        }
+
+    private:
+
+        friend class Promise<T>;
+        template <class U> friend class Future;
+        template <class U> friend Future<std::vector<FutureValue<U> > > WhenAll(std::vector<Future<U> > futures);
+        template <class U> friend Future<WhenAnyResult<U> > WhenAny(std::vector<Future<U> > futures);
+
+        template <class F, bool IsVoid = std::is_void_v<T> >
+        struct ContinuationResult
+        {
+            using Type = std::invoke_result_t<F&, T>;
+        };
+
+        template <class F>
+        struct ContinuationResult<F, true>
+        {
+            using Type = std::invoke_result_t<F&>;
+        };
+
+        explicit Future(FutureSharedState<T>* state) :
+            m_state(state) {}
+
+        void CheckValid() const
+        {
+            if (m_state == nullptr)
+            {
+                throw std::future_error(std::future_errc::no_state);
+            }
+        }
+
+        /**
+         * Hand the state over to a callback invoked once it is ready.
+         * The callback owns the state reference and must release it.
+         */
+        template <class F>
+        void OnReady(F&& callback)
+        {
+            CheckValid();
+            FutureSharedState<T>* state = std::exchange(m_state, nullptr);
+            state->SetContinuation([state, callback = std::forward<F>(callback)]() mutable
+            {
+                callback(state);
+            });
+        }
+
+        // Run the continuation with the value of the state and complete the promise
+        template <class R, class F>
+        static void Fulfil(Promise<R>& promise, FutureSharedState<T>& state, F& func)
+        {
+            if (state.Error())
+            {
+                promise.SetException(state.Error());
+                return;
+            }
+
+            try
+            {
+                if constexpr (std::is_void_v<T> && std::is_void_v<R>)
+                {
+                    func();
+                    promise.SetValue();
+                }
+                else if constexpr (std::is_void_v<T>)
+                {
+                    promise.SetValue(func());
+                }
+                else if constexpr (std::is_void_v<R>)
+                {
+                    func(std::move(state.Value()));
+                    promise.SetValue();
+                }
+                else
+                {
+                    promise.SetValue(func(std::move(state.Value())));
+                }
+            }
+            catch (...)
+            {
+                promise.SetException(std::current_exception());
+            }
+        }
+
+        void Reset()
+        {
+            if (m_state != nullptr)
+            {
+                m_state->Release();
+                m_state = nullptr;
+            }
+        }
+
+        FutureSharedState<T>* m_state = nullptr;
+};
+
+
+/**
+ * Writing end of a shared state.
+ * Destroying a promise without setting a value stores a broken_promise error.
+ */
+template <class T>
+class Promise
+{
+    public:
+        Promise() :
+            m_state(FutureSharedState<T>::Create()) {}
+
+        Promise(Promise&& other) noexcept :
+            m_state(std::exchange(other.m_state, nullptr)),
+            m_retrieved(other.m_retrieved) {}
+
+        Promise& operator=(Promise&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Abandon();
+                m_state = std::exchange(other.m_state, nullptr);
+                m_retrieved = other.m_retrieved;
+            }
+            return *this;
+        }
+
+        ~Promise()
+        {
+            Abandon();
+        }
+
+        Promise(Promise const&) = delete;
+        Promise& operator=(Promise const&) = delete;
+
+        // Future connected to this promise, may be retrieved once
+        Future<T> GetFuture()
+        {
+            if (m_state == nullptr)
+            {
+                throw std::future_error(std::future_errc::no_state);
+            }
+            if (m_retrieved)
+            {
+                throw std::future_error(std::future_errc::future_already_retrieved);
+            }
+
+            m_retrieved = true;
+            m_state->AddRef();
+            return Future<T>(m_state);
+        }
+
+        template <class... Args>
+        void SetValue(Args&&... args)
+        {
+            FutureSharedState<T>* state = Take();
+            state->SetValue(std::forward<Args>(args)...);
+            state->Release();
+        }
+
+        void SetException(std::exception_ptr error)
+        {
+            FutureSharedState<T>* state = Take();
+            state->SetException(error);
+            state->Release();
+        }
+
+    private:
+
+        FutureSharedState<T>* Take()
+        {
+            if (m_state == nullptr)
+            {
+                throw std::future_error(std::future_errc::promise_already_satisfied);
+            }
+            return std::exchange(m_state, nullptr);
+        }
+
+        void Abandon()
+        {
+            if (m_state != nullptr)
+            {
+                SetException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            }
+        }
+
+        FutureSharedState<T>* m_state;
+        bool m_retrieved = false;
+};
+
+
+/**
+ * Future which is ready from the start.
+ */
+template <class T>
+Future<std::decay_t<T> > MakeReadyFuture(T&& value)
+{
+    Promise<std::decay_t<T> > promise;
+    Future<std::decay_t<T> > future = promise.GetFuture();
+    promise.SetValue(std::forward<T>(value));
+    return future;
+}
+
+inline Future<void> MakeReadyFuture()
+{
+    Promise<void> promise;
+    Future<void> future = promise.GetFuture();
+    promise.SetValue();
+    return future;
+}
+
+template <class T>
+Future<T> MakeExceptionalFuture(std::exception_ptr error)
+{
+    Promise<T> promise;
+    Future<T> future = promise.GetFuture();
+    promise.SetException(error);
+    return future;
+}
+
+
+/**
+ * Future completing once all input futures have completed.
+ * Holds the values in input order, or the first exception.
+ * Future<void> inputs produce a vector of FutureUnit.
+ */
+template <class T>
+Future<std::vector<FutureValue<T> > > WhenAll(std::vector<Future<T> > futures)
+{
+    using Values = std::vector<FutureValue<T> >;
+
+    struct Context
+    {
+        std::vector<std::optional<FutureValue<T> > > m_values;
+        std::atomic<size_t> m_remaining;
+        std::atomic<bool> m_failed{false};
+        std::exception_ptr m_error;
+        Promise<Values> m_promise;
+    };
+
+    std::shared_ptr<Context> context = std::make_shared<Context>();
+    context->m_values.resize(futures.size());
+    context->m_remaining.store(futures.size());
+    Future<Values> result = context->m_promise.GetFuture();
+
+    if (futures.empty())
+    {
+        context->m_promise.SetValue();
+        return result;
+    }
+
+    for (size_t i = 0; i < futures.size(); i++)
+    {
+        futures[i].OnReady([context, i](FutureSharedState<T>* state)
+        {
+            if (state->Error())
+            {
+                // Keep only the first failure
+                if (!context->m_failed.exchange(true))
+                {
+                    context->m_error = state->Error();
+                }
+            }
+            else
+            {
+                context->m_values[i].emplace(std::move(state->Value()));
+            }
+            state->Release();
+
+            // Last one completes the combined future
+            if (context->m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                if (context->m_failed.load())
+                {
+                    context->m_promise.SetException(context->m_error);
+                    return;
+                }
+
+                Values values;
+                values.reserve(context->m_values.size());
+                for (std::optional<FutureValue<T> >& value : context->m_values)
+                {
+                    values.push_back(std::move(*value));
+                }
+                context->m_promise.SetValue(std::move(values));
+            }
+        });
+    }
+
+    return result;
+}
+
+
+/**
+ * Future completing with the first input future to complete.
+ * An exception of the first completed input is propagated.
+ */
+template <class T>
+Future<WhenAnyResult<T> > WhenAny(std::vector<Future<T> > futures)
+{
+    struct Context
+    {
+        std::atomic<bool> m_done{false};
+        Promise<WhenAnyResult<T> > m_promise;
+    };
+
+    if (futures.empty())
+    {
+        throw std::invalid_argument("WhenAny requires at least one future");
+    }
+
+    std::shared_ptr<Context> context = std::make_shared<Context>();
+    Future<WhenAnyResult<T> > result = context->m_promise.GetFuture();
+
+    for (size_t i = 0; i < futures.size(); i++)
+    {
+        futures[i].OnReady([context, i](FutureSharedState<T>* state)
+        {
+            if (!context->m_done.exchange(true))
+            {
+                if (state->Error())
+                {
+                    context->m_promise.SetException(state->Error());
+                }
+                else
+                {
+                    context->m_promise.SetValue(WhenAnyResult<T>{i, std::move(state->Value())});
+                }
+            }
+            state->Release();
+        });
+    }
+
+    return result;
+}
+
+
+#endif //__FUTURE_H_
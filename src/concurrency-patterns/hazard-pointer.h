@@ -0,0 +1,424 @@
+/**
+* @file hazard-pointer.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Hazard pointers
+*
+* The Problem:
+*
+* A lock-free structure unlinks a node while other threads may still be
+* reading it. Deleting the node right away makes those readers touch freed
+* memory, never deleting it leaks.
+*
+* Solution:
+*
+* Before dereferencing a shared pointer a reader publishes it in a hazard
+* pointer slot visible to all threads. A removed node is not deleted but
+* retired onto a per-thread list. Once the list reaches a threshold the
+* thread scans all published hazard pointers and deletes every retired node
+* which nobody protects, the rest stays on the list for the next scan.
+*
+* Because a scan can only fail to free the nodes which are currently
+* protected, the number of retired but not yet deleted nodes per thread is
+* bounded by the scan threshold, regardless of what other threads do.
+*
+* Usage:
+*
+* HazardPointerDomain& domain = HazardPointerDomain::Global();
+*
+* // Reader
+* HazardPointer hazard(domain);
+* Node* node = hazard.Protect(m_head);
+* ...use node...
+*
+* // Writer, after unlinking the node
+* domain.Retire(node);
+*
+* Notes:
+*
+* Per-thread state is attached to the domain and recycled when threads
+* exit. A domain must outlive its hazard pointers and retires, the threads
+* which used it may exit after it is destroyed. The Global() domain lives
+* until the end of the program.
+*
+* References:
+* M. M. Michael, Hazard Pointers: Safe Memory Reclamation for Lock-Free Objects, 2004
+*
+*/
+
+#ifndef __HAZARD_POINTER_H_
+#define __HAZARD_POINTER_H_
+
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Hazard pointer domain
+ * Owns the hazard slots of all threads and their retire lists.
+ */
+class HazardPointerDomain
+{
+
+    public:
+
+        // Hazard slots available to a single thread at the same time
+        static const size_t SlotsPerThread = 4;
+
+        HazardPointerDomain() :
+            m_id(NextId())
+        {
+            Registry& registry = LiveDomains();
+            std::lock_guard<std::mutex> lock(registry.m_mutex);
+            registry.m_live.insert(m_id);
+        }
+
+        /**
+         * Destructor
+         * Deletes every node which is still retired.
+         */
+        ~HazardPointerDomain()
+        {
+            // From here on exiting threads leave the records alone
+            {
+                Registry& registry = LiveDomains();
+                std::lock_guard<std::mutex> lock(registry.m_mutex);
+                registry.m_live.erase(m_id);
+            }
+
+            ThreadRecord* record = m_records.load();
+            while (record != nullptr)
+            {
+                ThreadRecord* next = record->m_next;
+                for (RetiredNode& node : record->m_retired)
+                {
+                    node.m_deleter(node.m_pointer);
+                }
+                delete record;
+                record = next;
+            }
+        }
+
+        // Delete copy constructor and copy-assignment
+        HazardPointerDomain(HazardPointerDomain const&) = delete;
+        HazardPointerDomain& operator=(HazardPointerDomain const&) = delete;
+
+        /**
+         * Domain shared by the whole program.
+         * Instantiated on first use.
+         */
+        static HazardPointerDomain& Global()
+        {
+            static HazardPointerDomain instance;
+            return instance;
+        }
+
+        /**
+         * Hand a node unlinked from a shared structure over to the domain.
+         * The node is deleted once no hazard pointer protects it.
+         */
+        template <class T>
+        void Retire(T* pointer)
+        {
+            Retire(pointer, [](void* node)
+            {
+                delete static_cast<T*>(node);
+            });
+        }
+
+        // Retire a node with a custom deleter
+        void Retire(void* pointer, void (*deleter)(void*))
+        {
+            ThreadRecord& record = LocalRecord();
+            record.m_retired.push_back(RetiredNode{pointer, deleter});
+
+            // Scan in batches, the cost of a scan is amortised over the batch
+            if (record.m_retired.size() >= ScanThreshold())
+            {
+                Scan(record);
+            }
+        }
+
+        /**
+         * Delete every retired node of the calling thread which is not
+         * currently protected.
+         */
+        void Reclaim()
+        {
+            Scan(LocalRecord());
+        }
+
+        /**
+         * Retired nodes of the calling thread waiting for deletion.
+         */
+        size_t PendingCount()
+        {
+            return LocalRecord().m_retired.size();
+        }
+
+        /**
+         * Upper bound of nodes retired by a single thread and not deleted yet.
+         */
+        size_t ScanThreshold() const
+        {
+            // Twice the number of hazard slots keeps at least half of every
+            // batch reclaimable
+            return 2 * SlotsPerThread * m_recordCount.load(std::memory_order_relaxed) + 64;
+        }
+
+    private:
+
+        friend class HazardPointer;
+
+        struct RetiredNode
+        {
+            void* m_pointer;
+            void (*m_deleter)(void*);
+        };
+
+        /**
+         * Hazard slots and retire list of a single thread.
+         * Records are never freed before the domain, threads exiting give
+         * their record back for reuse, including any pending retired nodes.
+         */
+        struct alignas(64) ThreadRecord
+        {
+            std::atomic<void*> m_hazards[SlotsPerThread] = {};
+            std::atomic<bool> m_inUse{true};
+            ThreadRecord* m_next = nullptr;
+            // Only touched by the owner
+            std::vector<RetiredNode> m_retired;
+            // Bit i is set while a HazardPointer owns m_hazards[i]
+            uint32_t m_usedSlots = 0;
+        };
+        static_assert(SlotsPerThread < 32, "Slot mask holds one bit per slot");
+
+        /**
+         * Ids of the domains still alive. A domain may be destroyed before
+         * the threads which used it exit, their caches then hold records
+         * which are already freed and must not be touched.
+         */
+        struct Registry
+        {
+            std::mutex m_mutex;
+            std::unordered_set<uint64_t> m_live;
+        };
+
+        static Registry& LiveDomains()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        /**
+         * Thread local list of records owned by this thread, one per domain.
+         * Releases the records of the live domains when the thread exits.
+         */
+        struct ThreadCache
+        {
+            ~ThreadCache()
+            {
+                if (m_entries.empty())
+                {
+                    return;
+                }
+
+                Registry& registry = LiveDomains();
+                std::lock_guard<std::mutex> lock(registry.m_mutex);
+                for (std::pair<uint64_t, ThreadRecord*>& entry : m_entries)
+                {
+                    if (registry.m_live.count(entry.first) != 0)
+                    {
+                        entry.second->m_inUse.store(false, std::memory_order_release);
+                    }
+                }
+            }
+
+            // Forget the records of destroyed domains
+            void Prune()
+            {
+                Registry& registry = LiveDomains();
+                std::lock_guard<std::mutex> lock(registry.m_mutex);
+                std::erase_if(m_entries, [&](const std::pair<uint64_t, ThreadRecord*>& entry)
+                {
+                    return registry.m_live.count(entry.first) == 0;
+                });
+            }
+
+            std::vector<std::pair<uint64_t, ThreadRecord*> > m_entries;
+        };
+
+        static uint64_t NextId()
+        {
+            static std::atomic<uint64_t> counter{0};
+            return counter.fetch_add(1) + 1;
+        }
+
+        // Record of the calling thread, acquired on first use
+        ThreadRecord& LocalRecord()
+        {
+            static thread_local ThreadCache cache;
+            for (std::pair<uint64_t, ThreadRecord*>& entry : cache.m_entries)
+            {
+                if (entry.first == m_id)
+                {
+                    return *entry.second;
+                }
+            }
+
+            cache.Prune();
+            ThreadRecord* record = AcquireRecord();
+            cache.m_entries.emplace_back(m_id, record);
+            return *record;
+        }
+
+        ThreadRecord* AcquireRecord()
+        {
+            // Reuse a record left behind by a finished thread
+            for (ThreadRecord* record = m_records.load(std::memory_order_acquire); record != nullptr; record = record->m_next)
+            {
+                bool expected = false;
+                if (!record->m_inUse.load(std::memory_order_relaxed)
+                    && record->m_inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                {
+                    return record;
+                }
+            }
+
+            // Otherwise push a new one
+            ThreadRecord* record = new ThreadRecord();
+            ThreadRecord* head = m_records.load(std::memory_order_relaxed);
+            do
+            {
+                record->m_next = head;
+            }
+            while (!m_records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+
+            m_recordCount.fetch_add(1, std::memory_order_relaxed);
+            return record;
+        }
+
+        /**
+         * Collect all published hazards and delete every retired node of
+         * the record which is not among them.
+         */
+        void Scan(ThreadRecord& record)
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            std::vector<void*> hazards;
+            hazards.reserve(SlotsPerThread * m_recordCount.load(std::memory_order_relaxed));
+            for (ThreadRecord* other = m_records.load(std::memory_order_acquire); other != nullptr; other = other->m_next)
+            {
+                for (std::atomic<void*>& slot : other->m_hazards)
+                {
+                    void* hazard = slot.load(std::memory_order_seq_cst);
+                    if (hazard != nullptr)
+                    {
+                        hazards.push_back(hazard);
+                    }
+                }
+            }
+            std::sort(hazards.begin(), hazards.end());
+
+            std::vector<RetiredNode> stillProtected;
+            for (RetiredNode& node : record.m_retired)
+            {
+                if (std::binary_search(hazards.begin(), hazards.end(), node.m_pointer))
+                {
+                    stillProtected.push_back(node);
+                }
+                else
+                {
+                    node.m_deleter(node.m_pointer);
+                }
+            }
+            record.m_retired.swap(stillProtected);
+        }
+
+        const uint64_t m_id;
+        std::atomic<ThreadRecord*> m_records{nullptr};
+        std::atomic<size_t> m_recordCount{0};
+};
+
+
+/**
+ * Hazard Pointer
+ * Owns one hazard slot of the calling thread for its lifetime.
+ */
+class HazardPointer
+{
+
+    public:
+
+        explicit HazardPointer(HazardPointerDomain& domain = HazardPointerDomain::Global()) :
+            m_record(domain.LocalRecord())
+        {
+            // Take the lowest free slot, guards may be released in any order
+            const uint32_t all = (1u << HazardPointerDomain::SlotsPerThread) - 1;
+            const uint32_t free = ~m_record.m_usedSlots & all;
+            if (free == 0)
+            {
+                throw std::logic_error("Hazard pointer slots exhausted");
+            }
+            m_index = static_cast<uint32_t>(std::countr_zero(free));
+            m_record.m_usedSlots |= 1u << m_index;
+            m_slot = &m_record.m_hazards[m_index];
+        }
+
+        ~HazardPointer()
+        {
+            m_slot->store(nullptr, std::memory_order_release);
+            m_record.m_usedSlots &= ~(1u << m_index);
+        }
+
+        // Delete copy constructor and copy-assignment
+        HazardPointer(HazardPointer const&) = delete;
+        HazardPointer& operator=(HazardPointer const&) = delete;
+
+        /**
+         * Load the shared pointer and protect it.
+         * Retries until the published value is still the current one, from
+         * then on the node cannot be deleted until Reset() or destruction.
+         */
+        template <class T>
+        T* Protect(const std::atomic<T*>& source)
+        {
+            T* pointer = source.load(std::memory_order_relaxed);
+            while (true)
+            {
+                m_slot->store(pointer, std::memory_order_seq_cst);
+                T* current = source.load(std::memory_order_seq_cst);
+                if (current == pointer)
+                {
+                    return pointer;
+                }
+                pointer = current;
+            }
+        }
+
+        // Stop protecting the node
+        void Reset()
+        {
+            m_slot->store(nullptr, std::memory_order_release);
+        }
+
+    private:
+
+        HazardPointerDomain::ThreadRecord& m_record;
+        std::atomic<void*>* m_slot;
+        uint32_t m_index;
+};
+
+
+#endif //__HAZARD_POINTER_H_
@@ -0,0 +1,297 @@
+/**
+* @file leader-followers-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Leader/Followers versus half-sync/half-async latency benchmark
+*
+* A producer thread writes timestamped requests into a pipe at a fixed rate.
+*
+*   * Leader/Followers - the current leader reads the request from the pipe
+*     and handles it on the same thread.
+*
+*   * Half-sync/half-async - a dedicated reader thread reads the request and
+*     pushes it onto a mutex protected queue drained by the workers.
+*
+* The time from writing a request to the start of its handling is recorded
+* in a log2 latency histogram.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread leader-followers-benchmark.cpp -o leader-followers-benchmark
+* ./leader-followers-benchmark [thread count] [request count]
+*
+* Notes:
+*
+* Uses POSIX pipes.
+*
+*/
+
+#include "leader-followers.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+
+using Clock = std::chrono::steady_clock;
+
+int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+
+/**
+ * Latency histogram with power of two buckets in nanoseconds.
+ * Safe to record from many threads.
+ */
+class LatencyHistogram
+{
+    public:
+        void Record(int64_t ns)
+        {
+            size_t bucket = 0;
+            while (bucket + 1 < BucketCount && (int64_t(1) << (bucket + 1)) <= ns)
+            {
+                bucket++;
+            }
+            m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            m_count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Upper bound of the bucket holding the given percentile
+        int64_t Percentile(double percentile) const
+        {
+            const uint64_t total = m_count.load();
+            const uint64_t target = static_cast<uint64_t>(percentile / 100.0 * total);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BucketCount; i++)
+            {
+                seen += m_buckets[i].load();
+                if (seen > target)
+                {
+                    return int64_t(1) << (i + 1);
+                }
+            }
+            return int64_t(1) << BucketCount;
+        }
+
+        void Print(const std::string& name) const
+        {
+            std::cout << name << " (" << m_count.load() << " requests)\n";
+            std::cout << "    p50   < " << Percentile(50.0) / 1000.0 << " us\n";
+            std::cout << "    p90   < " << Percentile(90.0) / 1000.0 << " us\n";
+            std::cout << "    p99   < " << Percentile(99.0) / 1000.0 << " us\n";
+            std::cout << "    p99.9 < " << Percentile(99.9) / 1000.0 << " us\n";
+        }
+
+    private:
+
+        static const size_t BucketCount = 40;
+
+        std::array<std::atomic<uint64_t>, BucketCount> m_buckets{};
+        std::atomic<uint64_t> m_count{0};
+};
+
+
+/**
+ * Event source reading timestamps from a pipe.
+ */
+class PipeEventSource
+{
+    public:
+        PipeEventSource()
+        {
+            if (pipe(m_fds) != 0)
+            {
+                throw std::runtime_error("Unable to create pipe");
+            }
+        }
+
+        ~PipeEventSource()
+        {
+            close(m_fds[0]);
+            Close();
+        }
+
+        // Producer side, one request
+        void Send(int64_t timestamp)
+        {
+            if (write(m_fds[1], &timestamp, sizeof(timestamp)) != sizeof(timestamp))
+            {
+                throw std::runtime_error("Pipe write failed");
+            }
+        }
+
+        // Closing the write end makes every reader observe end of stream
+        void Close()
+        {
+            if (m_fds[1] >= 0)
+            {
+                close(m_fds[1]);
+                m_fds[1] = -1;
+            }
+        }
+
+        bool WaitForEvent(int64_t& timestamp)
+        {
+            return read(m_fds[0], &timestamp, sizeof(timestamp)) == sizeof(timestamp);
+        }
+
+    private:
+
+        int m_fds[2];
+};
+
+
+/**
+ * Request handler, records latency and burns a little CPU.
+ */
+class RequestHandler
+{
+    public:
+        explicit RequestHandler(LatencyHistogram& histogram) :
+            m_histogram(histogram) {}
+
+        void operator()(int64_t& timestamp)
+        {
+            m_histogram.Record(NowNs() - timestamp);
+
+            // Simulated request processing
+            volatile uint64_t work = 0;
+            for (int i = 0; i < 500; i++)
+            {
+                work = work + i;
+            }
+        }
+
+    private:
+
+        LatencyHistogram& m_histogram;
+};
+
+
+/**
+ * Write requests at a fixed rate and close the source.
+ */
+void Produce(PipeEventSource& source, size_t requestCount)
+{
+    const auto interval = std::chrono::microseconds(20);
+    auto next = Clock::now();
+    for (size_t i = 0; i < requestCount; i++)
+    {
+        while (Clock::now() < next)
+        {
+            // Busy wait for precise pacing
+        }
+        source.Send(NowNs());
+        next += interval;
+    }
+    source.Close();
+}
+
+
+void RunLeaderFollowers(size_t threadCount, size_t requestCount)
+{
+    LatencyHistogram histogram;
+    RequestHandler handler(histogram);
+    PipeEventSource source;
+
+    LeaderFollowersPool<PipeEventSource, int64_t, RequestHandler> pool(source, handler, threadCount);
+    pool.Start();
+    Produce(source, requestCount);
+    pool.Join();
+
+    histogram.Print("Leader/Followers");
+}
+
+
+void RunHalfSyncHalfAsync(size_t threadCount, size_t requestCount)
+{
+    LatencyHistogram histogram;
+    RequestHandler handler(histogram);
+    PipeEventSource source;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<int64_t> queue;
+    bool closed = false;
+
+    // Asynchronous layer, reads the source and queues the requests
+    std::thread reader([&]
+    {
+        int64_t timestamp = 0;
+        while (source.WaitForEvent(timestamp))
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(timestamp);
+            }
+            condition.notify_one();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        condition.notify_all();
+    });
+
+    // Synchronous layer, workers handling queued requests
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        workers.emplace_back([&]
+        {
+            while (true)
+            {
+                int64_t timestamp = 0;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [&]
+                    {
+                        return closed || !queue.empty();
+                    });
+                    if (queue.empty())
+                    {
+                        return;
+                    }
+                    timestamp = queue.front();
+                    queue.pop_front();
+                }
+                handler(timestamp);
+            }
+        });
+    }
+
+    Produce(source, requestCount);
+
+    reader.join();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    histogram.Print("Half-sync/half-async");
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t threadCount = (argc > 1) ? std::stoul(argv[1]) : 4;
+    const size_t requestCount = (argc > 2) ? std::stoul(argv[2]) : 100000;
+
+    std::cout << "Threads: " << threadCount << ", requests: " << requestCount << "\n\n";
+
+    RunLeaderFollowers(threadCount, requestCount);
+    RunHalfSyncHalfAsync(threadCount, requestCount);
+    return 0;
+}
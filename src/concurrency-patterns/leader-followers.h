@@ -0,0 +1,192 @@
+/**
+* @file leader-followers.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Leader/Followers thread pool
+*
+* The Problem:
+*
+* In the half-sync/half-async design one thread waits on the event source
+* and hands every event over to a pool of workers through a queue. Each
+* request pays for a queue push, a queue pop and at least one context
+* switch before any work is done.
+*
+* Solution:
+*
+* The threads of the pool take turns. Exactly one thread, the leader, waits
+* on the event source while the others, the followers, wait to become the
+* leader. Once the leader receives an event it promotes a follower to be
+* the new leader and processes the event itself. The event never leaves the
+* thread which received it, there is no queue and no hand-off.
+*
+* Usage:
+*
+* The event source must provide
+*
+*   bool WaitForEvent(Event& event);
+*
+* returning false once the source is closed, and it is only ever called by
+* one thread at a time. The handler is any callable accepting Event&.
+*
+* LeaderFollowersPool<Source, Event, Handler> pool(source, handler, 4);
+* pool.Start();
+* ...
+* source.Close();
+* pool.Join();
+*
+* Notes:
+*
+* The worker threads are ThreadObject instances.
+*
+*/
+
+#ifndef __LEADER_FOLLOWERS_H_
+#define __LEADER_FOLLOWERS_H_
+
+
+#include "thread-object.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+template <class EventSource, class Event, class Handler>
+class LeaderFollowersPool
+{
+
+    public:
+
+        /**
+         * Constructor
+         * The event source and handler must outlive the pool.
+         */
+        LeaderFollowersPool(EventSource& source, Handler& handler, size_t threadCount) :
+            m_source(source), m_handler(handler)
+        {
+            // Always run at least one thread
+            if (threadCount == 0)
+            {
+                threadCount = 1;
+            }
+
+            for (size_t i = 0; i < threadCount; i++)
+            {
+                m_workers.emplace_back(new Worker(*this));
+            }
+        }
+
+        /**
+         * Destructor
+         * Waits for the workers, the event source must have been closed.
+         */
+        ~LeaderFollowersPool()
+        {
+            Join();
+        }
+
+        // Delete copy constructor and copy-assignment
+        LeaderFollowersPool(LeaderFollowersPool const&) = delete;
+        LeaderFollowersPool& operator=(LeaderFollowersPool const&) = delete;
+
+        /**
+         * Start all threads, the first one to arrive becomes the leader.
+         */
+        void Start()
+        {
+            for (std::unique_ptr<Worker>& worker : m_workers)
+            {
+                worker->Start();
+            }
+        }
+
+        /**
+         * Wait for all threads, they finish once the event source is closed.
+         */
+        void Join()
+        {
+            for (std::unique_ptr<Worker>& worker : m_workers)
+            {
+                worker->Join();
+            }
+        }
+
+    private:
+
+        /**
+         * Thread of the pool
+         */
+        class Worker : public ThreadObject
+        {
+            public:
+                explicit Worker(LeaderFollowersPool& pool) :
+                    m_pool(pool) {}
+
+            protected:
+                void Run() override
+                {
+                    m_pool.FollowLoop();
+                }
+
+            private:
+                LeaderFollowersPool& m_pool;
+        };
+
+        /**
+         * Body of every thread.
+         * Wait to become the leader, wait for an event, promote a follower
+         * and handle the event.
+         */
+        void FollowLoop()
+        {
+            Event event;
+
+            while (true)
+            {
+                // Become the leader
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_followers.wait(lock, [this]
+                    {
+                        return !m_hasLeader;
+                    });
+                    m_hasLeader = true;
+                }
+
+                // Only the leader waits on the event source
+                const bool received = m_source.WaitForEvent(event);
+
+                // Promote a follower to be the new leader
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_hasLeader = false;
+                }
+                m_followers.notify_one();
+
+                // Source closed, the promoted follower will observe the same
+                if (!received)
+                {
+                    return;
+                }
+
+                // Process the event on this thread, no hand-off
+                m_handler(event);
+            }
+        }
+
+        EventSource& m_source;
+        Handler& m_handler;
+
+        // Leader election
+        std::mutex m_mutex;
+        std::condition_variable m_followers;
+        bool m_hasLeader = false;
+
+        std::vector<std::unique_ptr<Worker> > m_workers;
+};
+
+
+#endif //__LEADER_FOLLOWERS_H_
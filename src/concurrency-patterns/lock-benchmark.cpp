@@ -0,0 +1,173 @@
+/**
+* @file lock-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Lock contention benchmark
+*
+* Runs a matrix of thread counts and critical section lengths for
+* std::mutex, Spinlock, McsLock and AdaptiveMutex. Each thread repeatedly
+* takes the lock, increments a shared counter and performs the given
+* amount of work inside and outside of the critical section. The table
+* reports lock acquisitions per second.
+*
+* Queue locks hand the lock to a specific waiter, with more threads than
+* cores that waiter is often descheduled and McsLock throughput collapses.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread lock-benchmark.cpp -o lock-benchmark
+* ./lock-benchmark [milliseconds per cell]
+*
+*/
+
+#include "spinlock.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Simulated work which the compiler cannot remove.
+ */
+inline void Work(uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+}
+
+/**
+ * Every lock of spinlock.h offers a ScopedLock, std::mutex needs the guard
+ */
+template <class Lock>
+struct LockAdapter
+{
+    template <class F>
+    static void Run(Lock& lock, F&& critical)
+    {
+        typename Lock::ScopedLock guard(lock);
+        critical();
+    }
+};
+
+template <>
+struct LockAdapter<std::mutex>
+{
+    template <class F>
+    static void Run(std::mutex& lock, F&& critical)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        critical();
+    }
+};
+
+
+/**
+ * Measure acquisitions per second for one cell of the matrix.
+ */
+template <class Lock>
+double MeasureCell(size_t threadCount, uint32_t criticalWork, std::chrono::milliseconds duration)
+{
+    Lock lock;
+    uint64_t counter = 0;
+    std::atomic<bool> start{false};
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> acquisitions{0};
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&]
+        {
+            while (!start.load())
+            {
+                std::this_thread::yield();
+            }
+
+            uint64_t local = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                LockAdapter<Lock>::Run(lock, [&]
+                {
+                    counter++;
+                    Work(criticalWork);
+                });
+                local++;
+
+                // Non critical work between acquisitions
+                Work(criticalWork);
+            }
+            acquisitions.fetch_add(local);
+        });
+    }
+
+    const auto begin = std::chrono::steady_clock::now();
+    start.store(true);
+    std::this_thread::sleep_for(duration);
+    stop.store(true);
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    // The counter is only correct if mutual exclusion holds
+    if (counter != acquisitions.load())
+    {
+        std::cout << "Mutual exclusion violated!\n";
+        std::exit(1);
+    }
+
+    const double seconds = std::chrono::duration<double>(end - begin).count();
+    return acquisitions.load() / seconds;
+}
+
+template <class Lock>
+void MeasureRow(const std::string& name, const std::vector<size_t>& threadCounts, uint32_t criticalWork,
+    std::chrono::milliseconds duration)
+{
+    std::cout << std::setw(16) << name;
+    for (size_t threadCount : threadCounts)
+    {
+        const double rate = MeasureCell<Lock>(threadCount, criticalWork, duration);
+        std::cout << std::setw(14) << std::fixed << std::setprecision(2) << rate / 1e6;
+    }
+    std::cout << "\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    const std::chrono::milliseconds duration((argc > 1) ? std::stoul(argv[1]) : 100);
+    const std::vector<size_t> threadCounts = {1, 2, 4, 8};
+    const std::vector<uint32_t> criticalSections = {0, 100, 1000};
+
+    std::cout << "Million acquisitions per second\n";
+
+    for (uint32_t criticalWork : criticalSections)
+    {
+        std::cout << "\nCritical section: " << criticalWork << " iterations\n";
+        std::cout << std::setw(16) << "threads";
+        for (size_t threadCount : threadCounts)
+        {
+            std::cout << std::setw(14) << threadCount;
+        }
+        std::cout << "\n";
+
+        MeasureRow<std::mutex>("std::mutex", threadCounts, criticalWork, duration);
+        MeasureRow<Spinlock>("Spinlock", threadCounts, criticalWork, duration);
+        MeasureRow<McsLock>("McsLock", threadCounts, criticalWork, duration);
+        MeasureRow<AdaptiveMutex>("AdaptiveMutex", threadCounts, criticalWork, duration);
+    }
+
+    return 0;
+}
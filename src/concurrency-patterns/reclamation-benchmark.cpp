@@ -0,0 +1,324 @@
+/**
+* @file reclamation-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Memory reclamation stress benchmark
+*
+* Hammers a lock-free Treiber stack from several threads, once protected by
+* hazard pointers and once by epoch-based reclamation. Every node counts its
+* constructions and destructions, after the domain is destroyed all nodes
+* must have been freed exactly once. The largest retire list observed by
+* any thread shows the memory bound in practice. Finally local domains are
+* destroyed while the threads which used them are still running.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread reclamation-benchmark.cpp -o reclamation-benchmark
+*
+* Build for ThreadSanitizer:
+* g++ -std=c++20 -O1 -g -fsanitize=thread -pthread reclamation-benchmark.cpp -o reclamation-benchmark
+*
+* ./reclamation-benchmark [thread count] [operations per thread]
+*
+*/
+
+#include "hazard-pointer.h"
+#include "epoch-reclamation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Node bookkeeping shared by both variants
+static std::atomic<int64_t> g_liveNodes{0};
+static std::atomic<size_t> g_maxPending{0};
+
+struct Node
+{
+    explicit Node(int64_t value) :
+        m_value(value)
+    {
+        g_liveNodes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~Node()
+    {
+        g_liveNodes.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    int64_t m_value;
+    Node* m_next = nullptr;
+};
+
+void RecordPending(size_t pending)
+{
+    size_t current = g_maxPending.load(std::memory_order_relaxed);
+    while (pending > current && !g_maxPending.compare_exchange_weak(current, pending))
+    {
+    }
+}
+
+
+/**
+ * Treiber stack protected by hazard pointers
+ */
+class HazardPointerStack
+{
+    public:
+        explicit HazardPointerStack(HazardPointerDomain& domain) :
+            m_domain(domain) {}
+
+        ~HazardPointerStack()
+        {
+            Node* node = m_head.load();
+            while (node != nullptr)
+            {
+                Node* next = node->m_next;
+                delete node;
+                node = next;
+            }
+        }
+
+        void Push(int64_t value)
+        {
+            Node* node = new Node(value);
+            node->m_next = m_head.load(std::memory_order_relaxed);
+            while (!m_head.compare_exchange_weak(node->m_next, node, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        bool Pop(int64_t& value)
+        {
+            HazardPointer hazard(m_domain);
+            while (true)
+            {
+                Node* head = hazard.Protect(m_head);
+                if (head == nullptr)
+                {
+                    return false;
+                }
+
+                // Safe to read, head is protected
+                Node* next = head->m_next;
+                if (m_head.compare_exchange_strong(head, next, std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    value = head->m_value;
+                    hazard.Reset();
+                    m_domain.Retire(head);
+                    RecordPending(m_domain.PendingCount());
+                    return true;
+                }
+            }
+        }
+
+    private:
+
+        HazardPointerDomain& m_domain;
+        std::atomic<Node*> m_head{nullptr};
+};
+
+
+/**
+ * Treiber stack protected by epochs
+ */
+class EpochStack
+{
+    public:
+        explicit EpochStack(EpochDomain& domain) :
+            m_domain(domain) {}
+
+        ~EpochStack()
+        {
+            Node* node = m_head.load();
+            while (node != nullptr)
+            {
+                Node* next = node->m_next;
+                delete node;
+                node = next;
+            }
+        }
+
+        void Push(int64_t value)
+        {
+            Node* node = new Node(value);
+            node->m_next = m_head.load(std::memory_order_relaxed);
+            while (!m_head.compare_exchange_weak(node->m_next, node, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        bool Pop(int64_t& value)
+        {
+            Node* head = nullptr;
+            {
+                EpochGuard guard(m_domain);
+                head = m_head.load(std::memory_order_acquire);
+                while (head != nullptr
+                    && !m_head.compare_exchange_weak(head, head->m_next, std::memory_order_acquire, std::memory_order_acquire))
+                {
+                }
+                if (head == nullptr)
+                {
+                    return false;
+                }
+                value = head->m_value;
+            }
+
+            m_domain.Retire(head);
+            RecordPending(m_domain.PendingCount());
+            return true;
+        }
+
+    private:
+
+        EpochDomain& m_domain;
+        std::atomic<Node*> m_head{nullptr};
+};
+
+
+/**
+ * Run push/pop pairs on all threads and verify the sum of popped values.
+ */
+template <class Stack, class Domain>
+void Stress(const std::string& name, size_t threadCount, size_t operations)
+{
+    g_maxPending.store(0);
+    std::atomic<int64_t> pushed{0};
+    std::atomic<int64_t> popped{0};
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+        Domain domain;
+        {
+            Stack stack(domain);
+
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < threadCount; t++)
+            {
+                threads.emplace_back([&, t]
+                {
+                    int64_t localPushed = 0;
+                    int64_t localPopped = 0;
+                    for (size_t i = 0; i < operations; i++)
+                    {
+                        const int64_t value = static_cast<int64_t>(t * operations + i);
+                        stack.Push(value);
+                        localPushed += value;
+
+                        int64_t out = 0;
+                        if (stack.Pop(out))
+                        {
+                            localPopped += out;
+                        }
+                    }
+                    pushed.fetch_add(localPushed);
+                    popped.fetch_add(localPopped);
+                });
+            }
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            // Nodes still on the stack are freed by its destructor,
+            // retired nodes by the destructor of the domain
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    std::cout << name << "\n";
+    std::cout << "    time:                " << ms << " ms\n";
+    std::cout << "    max pending / thread: " << g_maxPending.load() << "\n";
+    std::cout << "    leaked nodes:         " << g_liveNodes.load() << "\n";
+    std::cout << "    popped <= pushed:     " << (popped.load() <= pushed.load() ? "yes" : "no") << "\n";
+}
+
+
+/**
+ * Destroy a local domain before the threads which used it exit, then use
+ * a new domain from the same threads. Run under AddressSanitizer.
+ */
+template <class Stack, class Domain>
+void Outlive(const std::string& name)
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    int step = 0;
+    auto advance = [&](int next)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        step = next;
+        changed.notify_all();
+    };
+    auto await = [&](int target)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return step >= target; });
+    };
+
+    auto use = [](Domain& domain)
+    {
+        Stack stack(domain);
+        int64_t value = 0;
+        for (int64_t i = 0; i < 1000; i++)
+        {
+            stack.Push(i);
+            stack.Pop(value);
+        }
+    };
+
+    auto first = std::make_unique<Domain>();
+    std::thread worker([&]()
+    {
+        use(*first);
+        advance(1);
+        // Still alive while the domain is destroyed
+        await(2);
+        Domain second;
+        use(second);
+    });
+
+    use(*first);
+    await(1);
+    first.reset();
+    advance(2);
+    worker.join();
+
+    // The calling thread holds a stale entry for the first domain
+    {
+        Domain third;
+        use(third);
+    }
+
+    std::cout << name << " domain destroyed before its threads: leaked nodes " << g_liveNodes.load() << "\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t threadCount = (argc > 1) ? std::stoul(argv[1]) : 4;
+    const size_t operations = (argc > 2) ? std::stoul(argv[2]) : 200000;
+
+    std::cout << "Threads: " << threadCount << ", push/pop pairs per thread: " << operations << "\n\n";
+
+    Stress<HazardPointerStack, HazardPointerDomain>("Hazard pointers", threadCount, operations);
+    Stress<EpochStack, EpochDomain>("Epoch-based reclamation", threadCount, operations);
+
+    std::cout << "\n";
+    Outlive<HazardPointerStack, HazardPointerDomain>("Hazard pointers");
+    Outlive<EpochStack, EpochDomain>("Epoch-based reclamation");
+
+    return g_liveNodes.load() == 0 ? 0 : 1;
+}
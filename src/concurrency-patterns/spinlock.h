@@ -0,0 +1,352 @@
+/**
+* @file spinlock.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Spinlock and adaptive mutex family
+*
+* The Problem:
+*
+* std::mutex always takes the slow path through the kernel once contended,
+* which is expensive for critical sections of a few instructions. Plain
+* spinning on the other hand hammers the cache line of the lock, gives no
+* ordering guarantee under heavy contention and wastes the CPU if the
+* owner has been descheduled.
+*
+* Solution:
+*
+*   * Spinlock - test-and-test-and-set. Waiters spin on a plain load, which
+*     stays in their local cache, and only attempt the atomic exchange once
+*     the lock looks free. Failed attempts back off exponentially, executing
+*     the CPU pause instruction between polls.
+*
+*   * McsLock - queue lock. Every waiter spins on a flag in its own queue
+*     node and the owner hands the lock over to its successor, the lock is
+*     granted in arrival order and each release touches one remote line.
+*
+*   * AdaptiveMutex - spins for a short while, then sleeps in the kernel on
+*     a futex. Cheap when held briefly, does not burn the CPU when not.
+*
+* Spinlock and AdaptiveMutex satisfy the Lockable requirements, which is
+* why they spell lock(), try_lock() and unlock() in lower case, and work
+* with std::lock_guard and std::unique_lock. McsLock needs a queue node per
+* acquisition and cannot, its Lock() and Unlock() take the node. Every lock
+* offers a ScopedLock, the one spelling to use when the type may change:
+*
+* Spinlock::ScopedLock lock(spinlock);
+* McsLock::ScopedLock lock(mcs);
+* AdaptiveMutex::ScopedLock lock(mutex);
+*
+* References:
+* J. M. Mellor-Crummey, M. L. Scott, Algorithms for Scalable Synchronization on Shared-Memory Multiprocessors, 1991
+* U. Drepper, Futexes Are Tricky, 2011
+*
+*/
+
+#ifndef __SPINLOCK_H_
+#define __SPINLOCK_H_
+
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+/**
+ * Hint to the CPU that the caller is busy waiting.
+ */
+inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+
+/**
+ * Exponential backoff
+ * Doubles the number of pause instructions per failed attempt, once the
+ * limit is reached the thread yields, the lock owner may not be running.
+ */
+class Backoff
+{
+    public:
+
+        void Pause()
+        {
+            if (m_spins < MaxSpins)
+            {
+                for (uint32_t i = 0; i < m_spins; i++)
+                {
+                    CpuRelax();
+                }
+                m_spins *= 2;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        void Reset()
+        {
+            m_spins = 1;
+        }
+
+    private:
+
+        static const uint32_t MaxSpins = 1024;
+        uint32_t m_spins = 1;
+};
+
+
+/**
+ * Test-and-test-and-set spinlock with exponential backoff.
+ * Occupies its own cache line.
+ */
+class alignas(64) Spinlock
+{
+    public:
+
+        using ScopedLock = std::lock_guard<Spinlock>;
+
+        // Lower case names required by BasicLockable and Lockable
+        void lock()
+        {
+            Backoff backoff;
+            while (true)
+            {
+                // Test, spin on a load which stays in the local cache
+                while (m_locked.load(std::memory_order_relaxed))
+                {
+                    backoff.Pause();
+                }
+
+                // Test-and-set, only once the lock looks free
+                if (!m_locked.exchange(true, std::memory_order_acquire))
+                {
+                    return;
+                }
+            }
+        }
+
+        bool try_lock()
+        {
+            return !m_locked.load(std::memory_order_relaxed)
+                && !m_locked.exchange(true, std::memory_order_acquire);
+        }
+
+        void unlock()
+        {
+            m_locked.store(false, std::memory_order_release);
+        }
+
+    private:
+
+        std::atomic<bool> m_locked{false};
+};
+
+
+/**
+ * MCS queue lock
+ * Waiters form a linked queue of nodes, usually on their stacks, and each
+ * one spins on its own node. The lock is granted in FIFO order.
+ *
+ * Usage:
+ *
+ * McsLock::ScopedLock lock(mcs);
+ */
+class alignas(64) McsLock
+{
+    public:
+
+        /**
+         * Queue node of a single acquisition.
+         * Must stay alive and in place until Unlock() returns.
+         */
+        struct alignas(64) Node
+        {
+            std::atomic<Node*> m_next{nullptr};
+            std::atomic<bool> m_locked{false};
+        };
+
+        void Lock(Node& node)
+        {
+            node.m_next.store(nullptr, std::memory_order_relaxed);
+            node.m_locked.store(true, std::memory_order_relaxed);
+
+            // Append ourselves to the queue
+            Node* predecessor = m_tail.exchange(&node, std::memory_order_acq_rel);
+            if (predecessor == nullptr)
+            {
+                return;
+            }
+
+            // Wait for the predecessor to hand the lock over
+            predecessor->m_next.store(&node, std::memory_order_release);
+            Backoff backoff;
+            while (node.m_locked.load(std::memory_order_acquire))
+            {
+                backoff.Pause();
+            }
+        }
+
+        void Unlock(Node& node)
+        {
+            Node* successor = node.m_next.load(std::memory_order_acquire);
+            if (successor == nullptr)
+            {
+                // No known successor, try to mark the queue empty
+                Node* expected = &node;
+                if (m_tail.compare_exchange_strong(expected, nullptr, std::memory_order_release, std::memory_order_relaxed))
+                {
+                    return;
+                }
+
+                // A successor is enqueueing, wait until it links itself
+                while ((successor = node.m_next.load(std::memory_order_acquire)) == nullptr)
+                {
+                    CpuRelax();
+                }
+            }
+
+            successor->m_locked.store(false, std::memory_order_release);
+        }
+
+        /**
+         * RAII acquisition holding its queue node, the counterpart of
+         * std::lock_guard which McsLock cannot be used with
+         */
+        class ScopedLock
+        {
+            public:
+                explicit ScopedLock(McsLock& lock) :
+                    m_lock(lock)
+                {
+                    m_lock.Lock(m_node);
+                }
+
+                ~ScopedLock()
+                {
+                    m_lock.Unlock(m_node);
+                }
+
+                ScopedLock(ScopedLock const&) = delete;
+                ScopedLock& operator=(ScopedLock const&) = delete;
+
+            private:
+                McsLock& m_lock;
+                Node m_node;
+        };
+
+    private:
+
+        std::atomic<Node*> m_tail{nullptr};
+};
+
+
+/**
+ * Adaptive mutex
+ * Spins with backoff for a bounded number of attempts, then sleeps on a
+ * futex. The state is 0 unlocked, 1 locked, 2 locked with sleepers, so an
+ * uncontended unlock never enters the kernel.
+ */
+class alignas(64) AdaptiveMutex
+{
+    public:
+
+        using ScopedLock = std::lock_guard<AdaptiveMutex>;
+
+        // Lower case names required by BasicLockable and Lockable
+        void lock()
+        {
+            // Fast path
+            uint32_t expected = Unlocked;
+            if (m_state.compare_exchange_strong(expected, Locked, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                return;
+            }
+
+            // Spin phase, the owner is likely to release soon
+            for (uint32_t i = 0; i < SpinLimit; i++)
+            {
+                CpuRelax();
+                expected = Unlocked;
+                if (m_state.load(std::memory_order_relaxed) == Unlocked
+                    && m_state.compare_exchange_weak(expected, Locked, std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    return;
+                }
+            }
+
+            // Sleep phase, announce the sleeper and wait
+            while (m_state.exchange(Contended, std::memory_order_acquire) != Unlocked)
+            {
+                Wait(Contended);
+            }
+        }
+
+        bool try_lock()
+        {
+            uint32_t expected = Unlocked;
+            return m_state.compare_exchange_strong(expected, Locked, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        void unlock()
+        {
+            // Only wake somebody if a sleeper announced itself
+            if (m_state.exchange(Unlocked, std::memory_order_release) == Contended)
+            {
+                WakeOne();
+            }
+        }
+
+    private:
+
+        static const uint32_t Unlocked = 0;
+        static const uint32_t Locked = 1;
+        static const uint32_t Contended = 2;
+
+        static const uint32_t SpinLimit = 100;
+
+        // The futex system call operates on the raw 32-bit word
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futex word must be 32 bits");
+
+        void Wait(uint32_t value)
+        {
+#if defined(__linux__)
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_state), FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+#else
+            m_state.wait(value, std::memory_order_relaxed);
+#endif
+        }
+
+        void WakeOne()
+        {
+#if defined(__linux__)
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+            m_state.notify_one();
+#endif
+        }
+
+        std::atomic<uint32_t> m_state{Unlocked};
+};
+
+
+#endif //__SPINLOCK_H_
@@ -0,0 +1,244 @@
+/**
+* @file timer-wheel-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Timing wheel benchmark
+*
+* Timeouts are mostly cancelled before they expire. Schedules a large
+* number of timers with random delays, cancels most of them and lets the
+* rest expire, comparing TimerWheel with a binary heap which can only mark
+* cancelled timers and drop them when they reach the top. Then several
+* threads schedule and cancel timeouts concurrently on a heap behind a
+* mutex, a TimerScheduler and a ShardedTimerScheduler.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread timer-wheel-benchmark.cpp -o timer-wheel-benchmark
+* ./timer-wheel-benchmark [timers] [threads]
+*
+*/
+
+#include "timer-wheel.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Timers in a binary heap ordered by expiry, cancelled timers stay in the
+ * heap until they reach the top.
+ */
+class HeapTimers
+{
+    public:
+        void Reserve(size_t timers)
+        {
+            m_tasks.reserve(timers);
+        }
+
+        TimerId Schedule(uint64_t delay, TimerTask task)
+        {
+            TimerId id = m_tasks.size();
+            m_tasks.push_back(std::move(task));
+            m_heap.push({m_now + std::max<uint64_t>(delay, 1), id});
+            return id;
+        }
+
+        bool Cancel(TimerId id)
+        {
+            if (!m_tasks[id])
+            {
+                return false;
+            }
+            m_tasks[id] = nullptr;
+            return true;
+        }
+
+        size_t Advance(uint64_t target)
+        {
+            size_t expired = 0;
+            m_now = target;
+            while (!m_heap.empty() && m_heap.top().m_expires <= target)
+            {
+                TimerId id = m_heap.top().m_id;
+                m_heap.pop();
+                if (m_tasks[id])
+                {
+                    TimerTask task = std::move(m_tasks[id]);
+                    m_tasks[id] = nullptr;
+                    task();
+                    expired++;
+                }
+            }
+            return expired;
+        }
+
+    private:
+        struct Entry
+        {
+            uint64_t m_expires;
+            TimerId m_id;
+
+            bool operator>(const Entry& other) const
+            {
+                return m_expires > other.m_expires;
+            }
+        };
+
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > m_heap;
+        std::vector<TimerTask> m_tasks;
+        uint64_t m_now = 0;
+};
+
+/**
+ * The heap shared by several threads.
+ */
+class LockedHeapTimers
+{
+    public:
+        TimerId Schedule(uint64_t delay, TimerTask task)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_timers.Schedule(delay, std::move(task));
+        }
+
+        bool Cancel(TimerId id)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_timers.Cancel(id);
+        }
+
+    private:
+        std::mutex m_mutex;
+        HeapTimers m_timers;
+};
+
+
+double Seconds(const std::function<void()>& function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/**
+ * Schedule every timer, cancel nine in ten and expire the rest.
+ */
+template <class Timers>
+void SingleThreaded(const std::string& name, const std::vector<uint64_t>& delays)
+{
+    Timers timers;
+    timers.Reserve(delays.size());
+    std::vector<TimerId> ids(delays.size());
+    uint64_t fired = 0;
+
+    double schedule = Seconds([&]()
+    {
+        for (size_t i = 0; i < delays.size(); i++)
+        {
+            ids[i] = timers.Schedule(delays[i], [&fired]() { fired++; });
+        }
+    });
+    double cancel = Seconds([&]()
+    {
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            if (i % 10 != 0)
+            {
+                timers.Cancel(ids[i]);
+            }
+        }
+    });
+    double expire = Seconds([&]()
+    {
+        for (uint64_t tick = 0; tick <= 65536; tick += 16)
+        {
+            timers.Advance(tick);
+        }
+    });
+
+    size_t count = delays.size();
+    std::cout << name << ": schedule " << (schedule * 1e9 / count) << " ns, cancel " << (cancel * 1e9 / (count - count / 10))
+              << " ns, expire " << (expire * 1e9 / count) << " ns per timer (fired " << fired << ")\n";
+}
+
+/**
+ * Every thread schedules timeouts and cancels them again, as a request
+ * completing before its timeout would.
+ */
+template <class Schedule, class Cancel>
+void MultiThreaded(const std::string& name, size_t threads, size_t operations, Schedule&& schedule, Cancel&& cancel)
+{
+    double seconds = Seconds([&]()
+    {
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&, t]()
+            {
+                std::mt19937 random(static_cast<uint32_t>(t));
+                for (size_t i = 0; i < operations; i++)
+                {
+                    cancel(schedule(1000 + random() % 30000));
+                }
+            });
+        }
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+    });
+
+    std::cout << name << ": " << (threads * operations / seconds / 1e6) << " M schedule+cancel/s\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 20;
+    const size_t threads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4;
+
+    std::cout << "Timers: " << count << ", threads: " << threads << ", cores: " << std::thread::hardware_concurrency() << "\n";
+
+    // Up to a minute of one millisecond ticks
+    std::mt19937 random(42);
+    std::vector<uint64_t> delays(count);
+    for (uint64_t& delay : delays)
+    {
+        delay = 1 + random() % 60000;
+    }
+
+    SingleThreaded<HeapTimers>("  heap  ", delays);
+    SingleThreaded<TimerWheel>("  wheel ", delays);
+
+    const size_t operations = count / threads;
+    {
+        LockedHeapTimers timers;
+        MultiThreaded("  locked heap     ", threads, operations,
+            [&](uint64_t delay) { return timers.Schedule(delay, []() {}); },
+            [&](TimerId id) { timers.Cancel(id); });
+    }
+    {
+        TimerScheduler scheduler;
+        MultiThreaded("  scheduler       ", threads, operations,
+            [&](uint64_t delay) { return scheduler.Schedule(std::chrono::milliseconds(delay), []() {}); },
+            [&](TimerId id) { scheduler.Cancel(id); });
+    }
+    {
+        ShardedTimerScheduler scheduler(threads);
+        MultiThreaded("  sharded         ", threads, operations,
+            [&](uint64_t delay) { return scheduler.Schedule(std::chrono::milliseconds(delay), []() {}); },
+            [&](ShardedTimerScheduler::Id id) { scheduler.Cancel(id); });
+    }
+    return 0;
+}
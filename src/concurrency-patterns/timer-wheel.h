@@ -0,0 +1,627 @@
+/**
+* @file timer-wheel.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Scheduled commands on a hierarchical timing wheel
+*
+* The Problem:
+*
+* Servers keep millions of pending timeouts and retries, most of which are
+* cancelled long before they expire. A sleeping thread per timer exhausts
+* the system, and a priority queue behind a mutex costs O(log n) for every
+* schedule, cannot remove a cancelled entry without searching for it and
+* serialises every thread scheduling work on one lock.
+*
+* Solution:
+*
+* TimerWheel keeps the timers in a hierarchy of circular arrays of slots,
+* like the hands of a clock. The first level has a slot per tick, every
+* further level a slot per full turn of the level below. A timer is linked
+* into the slot of the level matching how far away it expires:
+*
+*   * Schedule - compute the slot, link the timer in, O(1).
+*   * Cancel - unlink the timer from its slot, O(1), no search.
+*   * Advance - every tick expires the whole slot under the first hand as
+*     one batch. When a hand completes a turn the next slot of the level
+*     above is redistributed into the levels below, each timer moves down at
+*     most once per level.
+*
+* Timers are nodes in one contiguous array linked by index, released nodes
+* are reused, a timer id carries a generation so a stale id cannot cancel
+* a later timer reusing the node.
+*
+* TimerScheduler runs a wheel on a dedicated thread, advancing it with the
+* clock and running the expired commands as a batch outside of its lock.
+* ShardedTimerScheduler runs one such scheduler per core, every thread
+* schedules on its own shard so producers do not contend on a single lock.
+*
+* Usage:
+*
+* TimerScheduler scheduler(std::chrono::milliseconds(1));
+* TimerId timeout = scheduler.Schedule(std::chrono::seconds(30), [&]{ connection.Close(); });
+* TimerId heartbeat = scheduler.SchedulePeriodic(std::chrono::seconds(1), std::chrono::seconds(1), [&]{ SendHeartbeat(); });
+* scheduler.Cancel(timeout);
+*
+* Notes:
+*
+* The wheel itself is not thread safe. Timers fire on the first tick at or
+* after their expiry, never early, the resolution is one tick. Delays over
+* MaxDelay ticks wait on the top level and are redistributed until due.
+* A command already collected for execution still runs once if cancelled
+* before it has started. Commands run on the scheduler thread and should
+* be short, longer work should be handed over to a pool.
+*
+* References:
+* Varghese, Lauck, Hashed and Hierarchical Timing Wheels, SOSP 1987
+* https://lwn.net/Articles/646950/
+*
+*/
+
+#ifndef __TIMER_WHEEL_H_
+#define __TIMER_WHEEL_H_
+
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+using TimerTask = std::function<void()>;
+
+// Generation in the upper half, node index in the lower half, never 0
+using TimerId = uint64_t;
+
+static constexpr TimerId InvalidTimer = 0;
+
+
+/**
+ * Hierarchical timing wheel counting in ticks, single threaded.
+ */
+class TimerWheel
+{
+    public:
+
+        // 256 slots on the first level, 64 on each of the three above
+        static constexpr uint32_t RootBits = 8;
+        static constexpr uint32_t LevelBits = 6;
+        static constexpr uint32_t Levels = 4;
+        static constexpr uint64_t MaxDelay = (uint64_t(1) << (RootBits + LevelBits * (Levels - 1))) - 1;
+
+        explicit TimerWheel(uint64_t now = 0) :
+            m_now(now)
+        {
+            m_heads.fill(None);
+        }
+
+        /**
+         * Schedule the task delay ticks from now, at least one tick. A
+         * periodic task is scheduled again every period ticks after it
+         * expires, until cancelled.
+         */
+        TimerId Schedule(uint64_t delay, TimerTask task, uint64_t period = 0)
+        {
+            return ScheduleAt(m_now + std::max<uint64_t>(delay, 1), std::move(task), period);
+        }
+
+        /**
+         * Schedule the task at an absolute tick, one in the past expires on
+         * the next tick.
+         */
+        TimerId ScheduleAt(uint64_t expires, TimerTask task, uint64_t period = 0)
+        {
+            uint32_t index = Allocate();
+            Node& node = m_nodes[index];
+            node.m_task = std::move(task);
+            node.m_expires = std::max(expires, m_now + 1);
+            node.m_period = period;
+            Link(index);
+            m_size++;
+            return (static_cast<TimerId>(node.m_generation) << 32) | index;
+        }
+
+        /**
+         * Remove a pending timer, returns false when it has already expired
+         * or was cancelled. A periodic task cancelled from its own callback
+         * is not scheduled again.
+         */
+        bool Cancel(TimerId id)
+        {
+            uint32_t index = static_cast<uint32_t>(id);
+            if (index >= m_nodes.size() || m_nodes[index].m_generation != static_cast<uint32_t>(id >> 32))
+            {
+                return false;
+            }
+            Unlink(index);
+            Release(index);
+            return true;
+        }
+
+        /**
+         * Move the wheel to tick target, calling expire(TimerTask& task,
+         * bool periodic) for every timer due on the way, in expiry order.
+         * The callback may schedule and cancel timers, it may move from
+         * the task only when it is not periodic. Returns the number of
+         * expired timers.
+         */
+        template <class F>
+        size_t Advance(uint64_t target, F&& expire)
+        {
+            size_t expired = 0;
+            while (m_now < target)
+            {
+                // Nothing to expire on the way, jump
+                if (m_size == 0)
+                {
+                    m_now = target;
+                    break;
+                }
+
+                m_now++;
+                uint32_t index = static_cast<uint32_t>(m_now & RootMask);
+                for (uint32_t level = 1; index == 0 && level < Levels; level++)
+                {
+                    index = Cascade(level);
+                }
+                expired += Expire(static_cast<uint32_t>(m_now & RootMask), expire);
+            }
+            return expired;
+        }
+
+        /**
+         * Move the wheel to tick target running the expired tasks.
+         */
+        size_t Advance(uint64_t target)
+        {
+            return Advance(target, [](TimerTask& task, bool) { task(); });
+        }
+
+        /**
+         * Preallocate nodes for the expected number of pending timers.
+         */
+        void Reserve(size_t timers)
+        {
+            m_nodes.reserve(timers);
+        }
+
+        uint64_t Now() const
+        {
+            return m_now;
+        }
+
+        // Number of pending timers
+        size_t Size() const
+        {
+            return m_size;
+        }
+
+    private:
+
+        static constexpr uint32_t None = 0xffffffff;
+        static constexpr uint64_t RootMask = (uint64_t(1) << RootBits) - 1;
+        static constexpr uint64_t LevelMask = (uint64_t(1) << LevelBits) - 1;
+        static constexpr uint32_t SlotCount = (1 << RootBits) + (Levels - 1) * (1 << LevelBits);
+
+        // Slot holding the batch being expired
+        static constexpr uint32_t ExpiringSlot = SlotCount;
+        static constexpr uint32_t NoSlot = SlotCount + 1;
+
+        struct Node
+        {
+            TimerTask m_task;
+            uint64_t m_expires = 0;
+            uint64_t m_period = 0;
+            uint32_t m_next = None;
+            uint32_t m_prev = None;
+            uint32_t m_generation = 1;
+            uint32_t m_slot = NoSlot;
+        };
+
+        // First slot of a level
+        static constexpr uint32_t LevelBase(uint32_t level)
+        {
+            return level == 0 ? 0 : (1 << RootBits) + (level - 1) * (1 << LevelBits);
+        }
+
+        static constexpr uint32_t LevelShift(uint32_t level)
+        {
+            return level == 0 ? 0 : RootBits + (level - 1) * LevelBits;
+        }
+
+        uint32_t Allocate()
+        {
+            if (m_free != None)
+            {
+                uint32_t index = m_free;
+                m_free = m_nodes[index].m_next;
+                return index;
+            }
+            m_nodes.emplace_back();
+            return static_cast<uint32_t>(m_nodes.size() - 1);
+        }
+
+        // Invalidates all ids of the node and returns it to the free list
+        void Release(uint32_t index)
+        {
+            Node& node = m_nodes[index];
+            node.m_task = nullptr;
+            node.m_slot = NoSlot;
+            if (++node.m_generation == 0)
+            {
+                node.m_generation = 1;
+            }
+            node.m_next = m_free;
+            m_free = index;
+            m_size--;
+        }
+
+        // Put the node in the slot matching its distance from now
+        void Link(uint32_t index)
+        {
+            Node& node = m_nodes[index];
+            uint64_t expires = node.m_expires;
+            uint64_t delta = expires - m_now;
+            if (delta > MaxDelay)
+            {
+                expires = m_now + MaxDelay;
+                delta = MaxDelay;
+            }
+
+            uint32_t slot;
+            if (delta <= RootMask)
+            {
+                slot = static_cast<uint32_t>(expires & RootMask);
+            }
+            else
+            {
+                uint32_t level = 1;
+                while (delta >> LevelShift(level + 1) != 0)
+                {
+                    level++;
+                }
+                slot = LevelBase(level) + static_cast<uint32_t>((expires >> LevelShift(level)) & LevelMask);
+            }
+            PushFront(slot, index);
+        }
+
+        void PushFront(uint32_t slot, uint32_t index)
+        {
+            Node& node = m_nodes[index];
+            node.m_slot = slot;
+            node.m_prev = None;
+            node.m_next = m_heads[slot];
+            if (node.m_next != None)
+            {
+                m_nodes[node.m_next].m_prev = index;
+            }
+            m_heads[slot] = index;
+        }
+
+        void Unlink(uint32_t index)
+        {
+            Node& node = m_nodes[index];
+            if (node.m_slot == NoSlot)
+            {
+                return;
+            }
+            if (node.m_prev != None)
+            {
+                m_nodes[node.m_prev].m_next = node.m_next;
+            }
+            else
+            {
+                m_heads[node.m_slot] = node.m_next;
+            }
+            if (node.m_next != None)
+            {
+                m_nodes[node.m_next].m_prev = node.m_prev;
+            }
+            node.m_slot = NoSlot;
+        }
+
+        // Redistribute the slot under the hand of the level, returns the hand position
+        uint32_t Cascade(uint32_t level)
+        {
+            uint32_t position = static_cast<uint32_t>((m_now >> LevelShift(level)) & LevelMask);
+            uint32_t slot = LevelBase(level) + position;
+
+            uint32_t index = m_heads[slot];
+            m_heads[slot] = None;
+            while (index != None)
+            {
+                uint32_t next = m_nodes[index].m_next;
+                Link(index);
+                index = next;
+            }
+            return position;
+        }
+
+        template <class F>
+        size_t Expire(uint32_t slot, F& expire)
+        {
+            // Move the batch aside, callbacks may cancel any of its timers
+            uint32_t index = m_heads[slot];
+            m_heads[slot] = None;
+            while (index != None)
+            {
+                uint32_t next = m_nodes[index].m_next;
+                PushFront(ExpiringSlot, index);
+                index = next;
+            }
+
+            size_t expired = 0;
+            while ((index = m_heads[ExpiringSlot]) != None)
+            {
+                Unlink(index);
+                expired++;
+
+                Node& node = m_nodes[index];
+                if (node.m_period == 0)
+                {
+                    TimerTask task = std::move(node.m_task);
+                    Release(index);
+                    expire(task, false);
+                    continue;
+                }
+
+                // Schedule the next run first, so the callback can cancel it
+                uint32_t generation = node.m_generation;
+                node.m_expires += node.m_period;
+                TimerTask task = std::move(node.m_task);
+                Link(index);
+                expire(task, true);
+
+                // The node array may have grown, look the node up again
+                if (m_nodes[index].m_generation == generation)
+                {
+                    m_nodes[index].m_task = std::move(task);
+                }
+            }
+            return expired;
+        }
+
+        std::vector<Node> m_nodes;
+        std::array<uint32_t, SlotCount + 1> m_heads;
+        uint32_t m_free = None;
+        size_t m_size = 0;
+        uint64_t m_now;
+};
+
+
+/**
+ * Timing wheel driven by a dedicated thread.
+ */
+class TimerScheduler
+{
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit TimerScheduler(Clock::duration tick = std::chrono::milliseconds(1)) :
+            m_tick(std::max<Clock::duration>(tick, Clock::duration(1))),
+            m_start(Clock::now())
+        {
+            m_thread = std::thread(&TimerScheduler::Run, this);
+        }
+
+        /**
+         * Destructor
+         * Stops the thread, pending timers never run.
+         */
+        ~TimerScheduler()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_signal.notify_one();
+            m_thread.join();
+        }
+
+        // Delete copy constructor and copy-assignment
+        TimerScheduler(TimerScheduler const&) = delete;
+        TimerScheduler& operator=(TimerScheduler const&) = delete;
+
+        TimerId Schedule(Clock::duration delay, TimerTask task)
+        {
+            return SchedulePeriodic(delay, Clock::duration::zero(), std::move(task));
+        }
+
+        /**
+         * Run the task after delay and then every period, a zero period
+         * runs it once.
+         */
+        TimerId SchedulePeriodic(Clock::duration delay, Clock::duration period, TimerTask task)
+        {
+            Clock::duration elapsed = Clock::now() - m_start;
+            uint64_t now = static_cast<uint64_t>(elapsed / m_tick);
+            uint64_t expires = ToTicks(elapsed + std::max(delay, Clock::duration::zero()));
+            uint64_t periodTicks = period > Clock::duration::zero() ? std::max<uint64_t>(1, ToTicks(period)) : 0;
+
+            bool wake = false;
+            TimerId id;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                // An idle wheel may have fallen behind the clock
+                if (m_wheel.Size() == 0)
+                {
+                    m_wheel.Advance(now);
+                    wake = m_idle;
+                }
+                id = m_wheel.ScheduleAt(expires, std::move(task), periodTicks);
+            }
+            if (wake)
+            {
+                m_signal.notify_one();
+            }
+            return id;
+        }
+
+        bool Cancel(TimerId id)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_wheel.Cancel(id);
+        }
+
+        size_t Pending() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_wheel.Size();
+        }
+
+    private:
+
+        // Rounded up, a timer never fires early
+        uint64_t ToTicks(Clock::duration duration) const
+        {
+            if (duration <= Clock::duration::zero())
+            {
+                return 0;
+            }
+            return static_cast<uint64_t>((duration + m_tick - Clock::duration(1)) / m_tick);
+        }
+
+        uint64_t TicksSinceStart(Clock::time_point time) const
+        {
+            return static_cast<uint64_t>((time - m_start) / m_tick);
+        }
+
+        void Run()
+        {
+            std::vector<TimerTask> batch;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (!m_stop)
+            {
+                if (m_wheel.Size() == 0)
+                {
+                    m_idle = true;
+                    m_signal.wait(lock, [this]() { return m_stop || m_wheel.Size() != 0; });
+                    m_idle = false;
+                    continue;
+                }
+
+                uint64_t now = TicksSinceStart(Clock::now());
+                if (now <= m_wheel.Now())
+                {
+                    m_signal.wait_until(lock, m_start + m_tick * (m_wheel.Now() + 1));
+                    continue;
+                }
+
+                m_wheel.Advance(now, [&batch](TimerTask& task, bool periodic)
+                {
+                    if (periodic)
+                    {
+                        batch.push_back(task);
+                    }
+                    else
+                    {
+                        batch.push_back(std::move(task));
+                    }
+                });
+
+                if (!batch.empty())
+                {
+                    lock.unlock();
+                    for (TimerTask& task : batch)
+                    {
+                        task();
+                    }
+                    batch.clear();
+                    lock.lock();
+                }
+            }
+        }
+
+        const Clock::duration m_tick;
+        const Clock::time_point m_start;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_signal;
+        TimerWheel m_wheel;
+        bool m_idle = false;
+        bool m_stop = false;
+        std::thread m_thread;
+};
+
+
+/**
+ * One TimerScheduler per core. A thread always schedules on the same
+ * shard, threads are spread over the shards in the order they first
+ * schedule.
+ */
+class ShardedTimerScheduler
+{
+    public:
+        using Clock = TimerScheduler::Clock;
+
+        struct Id
+        {
+            uint32_t m_shard = 0;
+            TimerId m_timer = InvalidTimer;
+        };
+
+        explicit ShardedTimerScheduler(size_t shardCount = std::thread::hardware_concurrency(),
+                                       Clock::duration tick = std::chrono::milliseconds(1))
+        {
+            shardCount = std::max<size_t>(1, shardCount);
+            for (size_t i = 0; i < shardCount; i++)
+            {
+                m_shards.emplace_back(new TimerScheduler(tick));
+            }
+        }
+
+        Id Schedule(Clock::duration delay, TimerTask task)
+        {
+            return SchedulePeriodic(delay, Clock::duration::zero(), std::move(task));
+        }
+
+        Id SchedulePeriodic(Clock::duration delay, Clock::duration period, TimerTask task)
+        {
+            uint32_t shard = CurrentShard();
+            return Id{shard, m_shards[shard]->SchedulePeriodic(delay, period, std::move(task))};
+        }
+
+        // Any thread may cancel a timer of any shard
+        bool Cancel(Id id)
+        {
+            return id.m_shard < m_shards.size() && m_shards[id.m_shard]->Cancel(id.m_timer);
+        }
+
+        size_t Pending() const
+        {
+            size_t pending = 0;
+            for (const std::unique_ptr<TimerScheduler>& shard : m_shards)
+            {
+                pending += shard->Pending();
+            }
+            return pending;
+        }
+
+        size_t ShardCount() const
+        {
+            return m_shards.size();
+        }
+
+    private:
+
+        uint32_t CurrentShard()
+        {
+            static std::atomic<uint32_t> s_nextThread{0};
+            static thread_local uint32_t t_thread = s_nextThread.fetch_add(1, std::memory_order_relaxed);
+            return t_thread % static_cast<uint32_t>(m_shards.size());
+        }
+
+        std::vector<std::unique_ptr<TimerScheduler> > m_shards;
+};
+
+
+#endif // __TIMER_WHEEL_H_
@@ -19,7 +19,15 @@
  *
 */
 
+#ifndef __OBJECT_POOL_H_
+#define __OBJECT_POOL_H_
+
+
+#include <cassert>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <stack>
 #include <string>
 
 /**
@@ -92,7 +100,7 @@ class SharedPool
                     this->Add(std::unique_ptr<T>(ptr));
                 });
             m_pool.pop();
-            return std::move(tmp);
+            return tmp;
         }
 
         // Check if pool is empty 
@@ -110,4 +118,7 @@ class SharedPool
     private:
 
         std::stack<std::unique_ptr<T> > m_pool;
-};
\ No newline at end of file
+};
+
+
+#endif // __OBJECT_POOL_H_
@@ -0,0 +1,194 @@
+/**
+* @file adapter-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Wire adapter benchmark
+*
+* A buffer of big endian sensor readings as they arrive from the network.
+* Decodes every record field by field as a hand written adapter would, then
+* with WireArrayView::LoadAll() swapping whole records with the generic and
+* the vector kernel, and reads a single field of every record through the
+* view without decoding the rest. Then a record mixing widths and byte
+* orders, which falls back to field by field conversion, and objects
+* exposed as their own wire buffer.
+*
+* Build:
+* g++ -std=c++20 -O2 adapter-benchmark.cpp -o adapter-benchmark
+* ./adapter-benchmark [records] [rounds]
+*
+*/
+
+#include "wire-adapter.h"
+
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+
+struct Reading
+{
+    uint32_t m_sensor;
+    uint32_t m_sequence;
+    float m_value;
+    uint32_t m_timestamp;
+};
+
+using ReadingWire = WireLayout<Reading,
+    WireField<&Reading::m_sensor, 0, std::endian::big>,
+    WireField<&Reading::m_sequence, 4, std::endian::big>,
+    WireField<&Reading::m_value, 8, std::endian::big>,
+    WireField<&Reading::m_timestamp, 12, std::endian::big> >;
+
+// Same record in host order, the object is its own wire format
+using ReadingNative = WireLayout<Reading,
+    WireField<&Reading::m_sensor, 0, std::endian::native>,
+    WireField<&Reading::m_sequence, 4, std::endian::native>,
+    WireField<&Reading::m_value, 8, std::endian::native>,
+    WireField<&Reading::m_timestamp, 12, std::endian::native> >;
+
+struct Part
+{
+    uint64_t m_id;
+    uint16_t m_kind;
+    uint8_t m_flags;
+    uint32_t m_count;
+};
+
+// Packed, mixed widths and orders
+using PartWire = WireLayout<Part,
+    WireField<&Part::m_id, 0, std::endian::big>,
+    WireField<&Part::m_kind, 8, std::endian::little>,
+    WireField<&Part::m_flags, 10>,
+    WireField<&Part::m_count, 11, std::endian::big> >;
+
+
+/**
+ * The hand written adapter, every field decoded on its own.
+ */
+uint32_t ReadBig32(const std::byte* bytes)
+{
+    uint32_t word;
+    std::memcpy(&word, bytes, 4);
+    return __builtin_bswap32(word);
+}
+
+void DecodeByHand(std::span<const std::byte> bytes, std::span<Reading> out)
+{
+    for (size_t i = 0; i < out.size(); i++)
+    {
+        const std::byte* record = bytes.data() + i * 16;
+        out[i].m_sensor = ReadBig32(record);
+        out[i].m_sequence = ReadBig32(record + 4);
+        out[i].m_value = std::bit_cast<float>(ReadBig32(record + 8));
+        out[i].m_timestamp = ReadBig32(record + 12);
+    }
+}
+
+
+template <class F>
+void Measure(const std::string& name, size_t records, size_t recordSize, size_t rounds, F&& function)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t checksum = 0;
+    for (size_t round = 0; round < rounds; round++)
+    {
+        checksum += function();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << name << ": " << (seconds * 1e9 / (records * rounds)) << " ns/record, "
+              << (records * rounds * recordSize / seconds / 1e9) << " GB/s (checksum " << checksum << ")\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 16;
+    const size_t rounds = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000;
+    std::cout << "Records: " << count << ", rounds: " << rounds << ", level: " << CpuLevelName(DetectCpuLevel()) << "\n";
+
+    std::mt19937 random(42);
+    std::vector<Reading> original(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        original[i] = {static_cast<uint32_t>(random() % 64), static_cast<uint32_t>(i), static_cast<float>(random() % 1000) / 8, static_cast<uint32_t>(random())};
+    }
+    std::vector<std::byte> packet(count * ReadingWire::Size);
+    WireArrayView<ReadingWire, std::byte>(packet).StoreAll(original);
+
+    std::vector<Reading> decoded(count);
+    auto sequences = [&]()
+    {
+        uint64_t checksum = 0;
+        for (const Reading& reading : decoded)
+        {
+            checksum += reading.m_sequence;
+        }
+        return checksum;
+    };
+
+    Measure("  by hand         ", count, ReadingWire::Size, rounds, [&]()
+    {
+        DecodeByHand(packet, decoded);
+        return decoded[count / 2].m_sequence;
+    });
+
+    WireArrayView<ReadingWire> readings(packet);
+    const WireKernels::ByteSwapFunction generic = WireKernels::ByteSwapTable<4>().Select(CpuLevel::Generic);
+    Measure("  swap generic    ", count, ReadingWire::Size, rounds, [&]()
+    {
+        generic(packet.data(), decoded.data(), count * 4);
+        return decoded[count / 2].m_sequence;
+    });
+    Measure("  LoadAll         ", count, ReadingWire::Size, rounds, [&]()
+    {
+        readings.LoadAll(decoded);
+        return decoded[count / 2].m_sequence;
+    });
+    std::cout << "  decoded checksum " << sequences() << "\n";
+
+    Measure("  one field, view ", count, ReadingWire::Size, rounds, [&]()
+    {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < readings.Size(); i++)
+        {
+            checksum += readings[i].Get<&Reading::m_sequence>();
+        }
+        return checksum;
+    });
+
+    // Mixed layout, converted field by field
+    std::vector<Part> parts(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        parts[i] = {random(), static_cast<uint16_t>(random()), static_cast<uint8_t>(random()), static_cast<uint32_t>(i)};
+    }
+    std::vector<std::byte> partBytes(count * PartWire::Size);
+    WireArrayView<PartWire, std::byte> partView(partBytes);
+    Measure("  mixed StoreAll  ", count, PartWire::Size, rounds, [&]()
+    {
+        partView.StoreAll(parts);
+        return static_cast<uint64_t>(partBytes[count]);
+    });
+    Measure("  mixed LoadAll   ", count, PartWire::Size, rounds, [&]()
+    {
+        partView.LoadAll(parts);
+        return static_cast<uint64_t>(parts[count / 2].m_count);
+    });
+
+    // Host order objects need no conversion at all
+    std::span<const std::byte> exposed = WireBytes<ReadingNative>(std::span<const Reading>(original));
+    std::cout << "  native objects exposed as " << exposed.size() << " wire bytes in place: "
+              << (static_cast<const void*>(exposed.data()) == static_cast<const void*>(original.data())) << "\n";
+    return 0;
+}
@@ -0,0 +1,530 @@
+/**
+* @file wire-adapter.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Adapter structural pattern, zero-copy views over wire buffers
+*
+* The Problem:
+*
+* Objects have to be exchanged with code speaking another format, network
+* messages, files, shared memory, each with its own field order, padding
+* and byte order. The usual adapter decodes the whole buffer into objects
+* and encodes them back, copying every record twice even when only a few
+* fields are ever read.
+*
+* Solution:
+*
+* Describe the wire format of a type once, at compile time, as a list of
+* fields, each naming a data member, its offset in the record and its byte
+* order:
+*
+* using ReadingWire = WireLayout<Reading,
+*     WireField<&Reading::m_sensor, 0, std::endian::big>,
+*     WireField<&Reading::m_value, 4, std::endian::big> >;
+*
+* The adapters are views, they own nothing and copy nothing up front:
+*
+*   * WireView adapts one record in a byte buffer to the interface of the
+*     object, Get<&Reading::m_value>() reads a single field straight from
+*     the buffer, swapping its bytes when needed, Set<>() writes one.
+*
+*   * WireArrayView adapts a buffer of records to an array of objects.
+*     LoadAll() and StoreAll() convert in bulk, a layout which is the
+*     native layout of the type is a plain copy, a layout which only differs
+*     in byte order is swapped with vector instructions chosen for the CPU
+*     through CpuDispatch, any other layout is converted field by field.
+*
+*   * WireBytes() adapts the other way, an array of objects whose native
+*     layout is the wire layout is exposed as the wire buffer itself.
+*
+* Usage:
+*
+* WireArrayView<ReadingWire> readings(std::as_bytes(std::span(packet)));
+* float first = readings[0].Get<&Reading::m_value>();
+* std::vector<Reading> decoded(readings.Size());
+* readings.LoadAll(decoded);
+*
+* Notes:
+*
+* Fields are trivially copyable scalars or enums of 1, 2, 4 or 8 bytes,
+* members holding heap memory, strings or vectors, have no fixed wire
+* layout and are left to a serializer. Views read unaligned data through
+* memcpy and never alias the buffer as the object type. The buffer must
+* outlive its views.
+*
+* References:
+* https://en.wikipedia.org/wiki/Adapter_pattern
+* https://en.wikipedia.org/wiki/Endianness
+*
+*/
+
+#ifndef __WIRE_ADAPTER_H_
+#define __WIRE_ADAPTER_H_
+
+
+#include "../../behavioral-patterns/strategy/cpu-dispatch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+
+
+/**
+ * Byte swapping kernels
+ */
+namespace WireKernels
+{
+    using ByteSwapFunction = void (*)(const void* in, void* out, size_t count);
+
+    template <size_t Width>
+    using Word = std::conditional_t<Width == 2, uint16_t, std::conditional_t<Width == 4, uint32_t, uint64_t> >;
+
+    template <size_t Width>
+    inline Word<Width> ByteSwap(Word<Width> value)
+    {
+        if constexpr (Width == 2)
+        {
+            return __builtin_bswap16(value);
+        }
+        else if constexpr (Width == 4)
+        {
+            return __builtin_bswap32(value);
+        }
+        else
+        {
+            return __builtin_bswap64(value);
+        }
+    }
+
+    template <size_t Width>
+    inline void ByteSwapGeneric(const void* in, void* out, size_t count)
+    {
+        const unsigned char* source = static_cast<const unsigned char*>(in);
+        unsigned char* target = static_cast<unsigned char*>(out);
+        for (size_t i = 0; i < count; i++)
+        {
+            Word<Width> word;
+            std::memcpy(&word, source + i * Width, Width);
+            word = ByteSwap<Width>(word);
+            std::memcpy(target + i * Width, &word, Width);
+        }
+    }
+
+#if CPU_DISPATCH_X86
+
+    // Reverses the bytes of every word in each 128 bit lane
+    template <size_t Width>
+    __attribute__((target("avx2")))
+    inline __m256i ByteSwapMask()
+    {
+        alignas(32) char mask[32];
+        for (int i = 0; i < 32; i++)
+        {
+            mask[i] = static_cast<char>((i % 16) / Width * Width + (Width - 1 - i % Width));
+        }
+        return _mm256_load_si256(reinterpret_cast<const __m256i*>(mask));
+    }
+
+    template <size_t Width>
+    __attribute__((target("avx2")))
+    inline void ByteSwapAvx2(const void* in, void* out, size_t count)
+    {
+        const __m256i mask = ByteSwapMask<Width>();
+        const unsigned char* source = static_cast<const unsigned char*>(in);
+        unsigned char* target = static_cast<unsigned char*>(out);
+        const size_t bytes = count * Width;
+        size_t i = 0;
+        for (; i + 64 <= bytes; i += 64)
+        {
+            __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+            __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i + 32));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + i), _mm256_shuffle_epi8(first, mask));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + i + 32), _mm256_shuffle_epi8(second, mask));
+        }
+        for (; i + 32 <= bytes; i += 32)
+        {
+            __m256i words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + i), _mm256_shuffle_epi8(words, mask));
+        }
+        ByteSwapGeneric<Width>(source + i, target + i, (bytes - i) / Width);
+    }
+
+#endif
+
+    template <size_t Width>
+    inline const CpuDispatch<ByteSwapFunction>& ByteSwapTable()
+    {
+        static const CpuDispatch<ByteSwapFunction> table = CpuDispatch<ByteSwapFunction>(&ByteSwapGeneric<Width>)
+#if CPU_DISPATCH_X86
+            .Add(CpuLevel::Avx2, &ByteSwapAvx2<Width>)
+#endif
+            ;
+        return table;
+    }
+}
+
+
+/**
+ * Reverse the bytes of count words of 2, 4 or 8 bytes, in may equal out.
+ */
+inline void ByteSwapWords(const void* in, void* out, size_t count, size_t width)
+{
+    static const WireKernels::ByteSwapFunction swap16 = WireKernels::ByteSwapTable<2>().Select();
+    static const WireKernels::ByteSwapFunction swap32 = WireKernels::ByteSwapTable<4>().Select();
+    static const WireKernels::ByteSwapFunction swap64 = WireKernels::ByteSwapTable<8>().Select();
+
+    switch (width)
+    {
+        case 1:
+            if (in != out)
+            {
+                std::memmove(out, in, count);
+            }
+            break;
+        case 2: swap16(in, out, count); break;
+        case 4: swap32(in, out, count); break;
+        case 8: swap64(in, out, count); break;
+        default: throw std::invalid_argument("Word width must be 1, 2, 4 or 8 bytes");
+    }
+}
+
+
+template <class Member>
+struct WireMemberTraits;
+
+template <class Class, class Type>
+struct WireMemberTraits<Type Class::*>
+{
+    using ClassType = Class;
+    using FieldType = Type;
+};
+
+/**
+ * A data member stored at a byte offset of the record in the given order.
+ */
+template <auto Member, size_t Offset, std::endian Order = std::endian::little>
+struct WireField
+{
+    using Class = typename WireMemberTraits<decltype(Member)>::ClassType;
+    using Type = typename WireMemberTraits<decltype(Member)>::FieldType;
+
+    static_assert(std::is_arithmetic_v<Type> || std::is_enum_v<Type>, "Wire fields must be scalars or enums");
+    static_assert(sizeof(Type) == 1 || sizeof(Type) == 2 || sizeof(Type) == 4 || sizeof(Type) == 8,
+                  "Wire fields must be 1, 2, 4 or 8 bytes");
+
+    static constexpr auto Pointer = Member;
+    static constexpr size_t Begin = Offset;
+    static constexpr size_t End = Offset + sizeof(Type);
+    static constexpr bool Swapped = Order != std::endian::native && sizeof(Type) > 1;
+
+    static Type Read(const std::byte* record)
+    {
+        using Word = std::conditional_t<sizeof(Type) == 1, uint8_t, WireKernels::Word<sizeof(Type)> >;
+        Word word;
+        std::memcpy(&word, record + Offset, sizeof(Type));
+        if constexpr (Swapped)
+        {
+            word = WireKernels::ByteSwap<sizeof(Type)>(word);
+        }
+        return std::bit_cast<Type>(word);
+    }
+
+    static void Write(std::byte* record, Type value)
+    {
+        using Word = std::conditional_t<sizeof(Type) == 1, uint8_t, WireKernels::Word<sizeof(Type)> >;
+        Word word = std::bit_cast<Word>(value);
+        if constexpr (Swapped)
+        {
+            word = WireKernels::ByteSwap<sizeof(Type)>(word);
+        }
+        std::memcpy(record + Offset, &word, sizeof(Type));
+    }
+
+    // Offset of the member in the object
+    static size_t NativeOffset()
+    {
+        static const Class object{};
+        return static_cast<size_t>(reinterpret_cast<const char*>(&(object.*Member)) - reinterpret_cast<const char*>(&object));
+    }
+};
+
+/**
+ * Wire format of T, the record spans the furthest field end.
+ */
+template <class T, class... Fields>
+struct WireLayout
+{
+    static_assert(sizeof...(Fields) > 0, "A layout requires at least one field");
+    static_assert((std::is_same_v<typename Fields::Class, T> && ...), "Fields must be members of the layout type");
+    static_assert(std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>,
+                  "Layout types must be trivially copyable and default constructible");
+
+    using Type = T;
+
+    static constexpr size_t Size = std::max({Fields::End...});
+
+    /**
+     * Field describing the member.
+     */
+    template <auto Member>
+    static constexpr size_t IndexOf()
+    {
+        size_t index = 0;
+        size_t found = sizeof...(Fields);
+        ((Matches<Member, Fields>() ? (found = index, ++index) : ++index), ...);
+        return found;
+    }
+
+    template <auto Member>
+    using FieldOf = std::tuple_element_t<IndexOf<Member>(), std::tuple<Fields...> >;
+
+    /**
+     * How LoadAll() and StoreAll() convert, the wire record equals the
+     * object, or equals it with the bytes of every word swapped, or
+     * neither. Detected once.
+     */
+    enum class Bulk
+    {
+        Copy,
+        Swap,
+        PerField
+    };
+
+    static Bulk BulkMode()
+    {
+        static const Bulk mode = []()
+        {
+            constexpr size_t width = std::max({sizeof(typename Fields::Type)...});
+            constexpr bool sameWidth = ((sizeof(typename Fields::Type) == width) && ...);
+            constexpr bool noneSwapped = (!Fields::Swapped && ...);
+            constexpr bool allSwapped = (Fields::Swapped && ...);
+            constexpr size_t covered = (sizeof(typename Fields::Type) + ...);
+
+            bool native = Size == sizeof(T) && ((Fields::NativeOffset() == Fields::Begin) && ...);
+            if (!native)
+            {
+                return Bulk::PerField;
+            }
+            if (noneSwapped && covered == Size)
+            {
+                return Bulk::Copy;
+            }
+            if (allSwapped && sameWidth && covered == Size)
+            {
+                return Bulk::Swap;
+            }
+            return Bulk::PerField;
+        }();
+        return mode;
+    }
+
+    static T Load(const std::byte* record)
+    {
+        T object{};
+        ((object.*Fields::Pointer = Fields::Read(record)), ...);
+        return object;
+    }
+
+    static void Store(std::byte* record, const T& object)
+    {
+        (Fields::Write(record, object.*Fields::Pointer), ...);
+    }
+
+    // Width of the words swapped in Bulk::Swap mode
+    static constexpr size_t WordWidth = std::max({sizeof(typename Fields::Type)...});
+
+    private:
+        template <auto Member, class Field>
+        static constexpr bool Matches()
+        {
+            if constexpr (std::is_same_v<decltype(Member), std::remove_cv_t<decltype(Field::Pointer)> >)
+            {
+                return Member == Field::Pointer;
+            }
+            return false;
+        }
+};
+
+
+/**
+ * One record of a buffer seen as an object, Byte is const std::byte for a
+ * read only view.
+ */
+template <class Layout, class Byte = const std::byte>
+class WireView
+{
+    public:
+        using Type = typename Layout::Type;
+
+        explicit WireView(std::span<Byte> bytes) :
+            m_record(bytes.data())
+        {
+            if (bytes.size() < Layout::Size)
+            {
+                throw std::invalid_argument("Buffer smaller than the wire record");
+            }
+        }
+
+        template <auto Member>
+        auto Get() const
+        {
+            return Layout::template FieldOf<Member>::Read(m_record);
+        }
+
+        template <auto Member>
+        void Set(typename Layout::template FieldOf<Member>::Type value) const requires (!std::is_const_v<Byte>)
+        {
+            Layout::template FieldOf<Member>::Write(m_record, value);
+        }
+
+        Type Load() const
+        {
+            return Layout::Load(m_record);
+        }
+
+        void Store(const Type& object) const requires (!std::is_const_v<Byte>)
+        {
+            Layout::Store(m_record, object);
+        }
+
+    private:
+        template <class, class> friend class WireArrayView;
+
+        explicit WireView(Byte* record) :
+            m_record(record) {}
+
+        Byte* m_record;
+};
+
+/**
+ * Buffer of consecutive records seen as an array of objects.
+ */
+template <class Layout, class Byte = const std::byte>
+class WireArrayView
+{
+    public:
+        using Type = typename Layout::Type;
+
+        explicit WireArrayView(std::span<Byte> bytes) :
+            m_bytes(bytes)
+        {
+            if (bytes.size() % Layout::Size != 0)
+            {
+                throw std::invalid_argument("Buffer size must be a multiple of the wire record size");
+            }
+        }
+
+        size_t Size() const
+        {
+            return m_bytes.size() / Layout::Size;
+        }
+
+        WireView<Layout, Byte> operator[](size_t index) const
+        {
+            return WireView<Layout, Byte>(m_bytes.data() + index * Layout::Size);
+        }
+
+        /**
+         * Convert every record into the objects, out must hold Size() objects.
+         */
+        void LoadAll(std::span<Type> out) const
+        {
+            if (out.size() != Size())
+            {
+                throw std::invalid_argument("Output must hold one object per record");
+            }
+            if (m_bytes.empty())
+            {
+                return;
+            }
+
+            switch (Layout::BulkMode())
+            {
+                case Layout::Bulk::Copy:
+                    std::memcpy(static_cast<void*>(out.data()), m_bytes.data(), m_bytes.size());
+                    break;
+                case Layout::Bulk::Swap:
+                    ByteSwapWords(m_bytes.data(), static_cast<void*>(out.data()), m_bytes.size() / Layout::WordWidth, Layout::WordWidth);
+                    break;
+                default:
+                    for (size_t i = 0; i < out.size(); i++)
+                    {
+                        out[i] = Layout::Load(m_bytes.data() + i * Layout::Size);
+                    }
+            }
+        }
+
+        /**
+         * Convert the objects into the records, in must hold Size() objects.
+         */
+        void StoreAll(std::span<const Type> in) const requires (!std::is_const_v<Byte>)
+        {
+            if (in.size() != Size())
+            {
+                throw std::invalid_argument("Input must hold one object per record");
+            }
+            if (m_bytes.empty())
+            {
+                return;
+            }
+
+            switch (Layout::BulkMode())
+            {
+                case Layout::Bulk::Copy:
+                    std::memcpy(m_bytes.data(), static_cast<const void*>(in.data()), m_bytes.size());
+                    break;
+                case Layout::Bulk::Swap:
+                    ByteSwapWords(static_cast<const void*>(in.data()), m_bytes.data(), m_bytes.size() / Layout::WordWidth, Layout::WordWidth);
+                    break;
+                default:
+                    for (size_t i = 0; i < in.size(); i++)
+                    {
+                        Layout::Store(m_bytes.data() + i * Layout::Size, in[i]);
+                    }
+            }
+        }
+
+        /**
+         * One field of every record, out must hold Size() values.
+         */
+        template <auto Member>
+        void LoadColumn(std::span<typename Layout::template FieldOf<Member>::Type> out) const
+        {
+            if (out.size() != Size())
+            {
+                throw std::invalid_argument("Output must hold one value per record");
+            }
+            for (size_t i = 0; i < out.size(); i++)
+            {
+                out[i] = Layout::template FieldOf<Member>::Read(m_bytes.data() + i * Layout::Size);
+            }
+        }
+
+    private:
+        std::span<Byte> m_bytes;
+};
+
+
+/**
+ * The objects as the wire buffer, without copying. Only possible when the
+ * native layout of the type is the wire layout.
+ */
+template <class Layout>
+std::span<const std::byte> WireBytes(std::span<const typename Layout::Type> objects)
+{
+    if (Layout::BulkMode() != Layout::Bulk::Copy)
+    {
+        throw std::logic_error("Native layout differs from the wire layout");
+    }
+    return std::as_bytes(objects);
+}
+
+
+#endif // __WIRE_ADAPTER_H_
@@ -0,0 +1,167 @@
+/**
+* @file bridge-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Bridge benchmark
+*
+* Reads records at random positions and scans all records of a store held
+* in memory and in a memory mapped file, the backend chosen at run time as
+* configuration would choose it. Compares the classic bridge forwarding
+* through a virtual implementation interface, Storage calling through its
+* function pointer table and RecordStore::Reduce() running a loop compiled
+* for the concrete backend.
+*
+* Build:
+* g++ -std=c++20 -O2 bridge-benchmark.cpp -o bridge-benchmark
+* ./bridge-benchmark [records] [path]
+*
+*/
+
+#include "bridge.h"
+#include "../../benchmark.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+struct Order
+{
+    uint64_t m_id;
+    uint32_t m_quantity;
+    float m_price;
+};
+
+
+/**
+ * Classic bridge, the implementation behind a virtual interface.
+ */
+class StorageImplementation
+{
+    public:
+        virtual ~StorageImplementation() = default;
+        virtual void Read(uint64_t offset, void* out, size_t bytes) const = 0;
+        virtual void Write(uint64_t offset, const void* in, size_t bytes) = 0;
+};
+
+template <class Backend>
+class VirtualStorage : public StorageImplementation
+{
+    public:
+        template <class... Args>
+        explicit VirtualStorage(Args&&... args) :
+            m_backend(std::forward<Args>(args)...) {}
+
+        void Read(uint64_t offset, void* out, size_t bytes) const override
+        {
+            m_backend.Read(offset, out, bytes);
+        }
+
+        void Write(uint64_t offset, const void* in, size_t bytes) override
+        {
+            m_backend.Write(offset, in, bytes);
+        }
+
+    private:
+        Backend m_backend;
+};
+
+
+double Add(double total, const Order& order)
+{
+    return total + order.m_price * order.m_quantity;
+}
+
+
+void Run(const std::string& backend, const std::string& path, size_t count, const std::vector<uint32_t>& positions)
+{
+    const size_t bytes = count * sizeof(Order);
+    std::cout << "Backend: " << backend << "\n";
+
+    std::unique_ptr<StorageImplementation> classic;
+    if (backend == MemoryStorage::Name)
+    {
+        classic = std::make_unique<VirtualStorage<MemoryStorage> >(bytes);
+    }
+    else
+    {
+        classic = std::make_unique<VirtualStorage<MappedFileStorage> >(path + ".classic", bytes);
+    }
+    RecordStore<Order> store(Storage::Create(backend, path, bytes));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Order order{i, static_cast<uint32_t>(i % 100), static_cast<float>(i % 1000) / 4};
+        classic->Write(i * sizeof(Order), &order, sizeof(Order));
+        store.Set(i, order);
+    }
+
+    Measure("  random virtual   ", positions.size(), [&]()
+    {
+        double total = 0;
+        for (uint32_t position : positions)
+        {
+            Order order;
+            classic->Read(position * sizeof(Order), &order, sizeof(Order));
+            total = Add(total, order);
+        }
+        return total;
+    }, "record");
+    Measure("  random table     ", positions.size(), [&]()
+    {
+        double total = 0;
+        for (uint32_t position : positions)
+        {
+            total = Add(total, store.Get(position));
+        }
+        return total;
+    }, "record");
+
+    Measure("  scan virtual     ", count, [&]()
+    {
+        double total = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            Order order;
+            classic->Read(i * sizeof(Order), &order, sizeof(Order));
+            total = Add(total, order);
+        }
+        return total;
+    }, "record");
+    Measure("  scan table       ", count, [&]()
+    {
+        return store.Reduce(0.0, Add);
+    }, "record");
+    Measure("  scan bound loop  ", count, [&]()
+    {
+        return store.Reduce<MemoryStorage, MappedFileStorage>(0.0, Add);
+    }, "record");
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 22;
+    const std::string path = argc > 2 ? argv[2] : "/tmp/bridge-benchmark.bin";
+    std::cout << "Records: " << count << ", record size: " << sizeof(Order) << "\n";
+
+    std::mt19937 random(42);
+    std::vector<uint32_t> positions(count);
+    for (uint32_t& position : positions)
+    {
+        position = static_cast<uint32_t>(random() % count);
+    }
+
+    Run("memory", path, count, positions);
+    Run("mmap", path, count, positions);
+
+    std::remove(path.c_str());
+    std::remove((path + ".classic").c_str());
+    return 0;
+}
@@ -0,0 +1,439 @@
+/**
+* @file bridge.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Bridge structural pattern, backends bound once
+*
+* The Problem:
+*
+* The bridge separates an abstraction from its implementation so both can
+* vary, the abstraction holds a pointer to an implementation interface and
+* forwards every operation through it. The implementation is usually chosen
+* once, from configuration at startup, yet every call pays for a virtual
+* lookup, and a loop over many small operations can never be inlined into
+* the implementation it calls.
+*
+* Solution:
+*
+* The implementation side is a table of plain function pointers, built at
+* compile time for every backend class by StorageTableFor<Backend>(). The
+* abstraction, Storage, copies the table of the backend it is bound to into
+* itself when it is created, every call afterwards is one indirect call
+* through a pointer already in the object, with no vtable to load and no
+* inheritance between the backends.
+*
+* Hot loops go one step further, Visit<Backends...>(function) compares the
+* bound table with the tables of the listed backends once and calls the
+* function with the concrete backend, the function is compiled once per
+* backend and every operation inside it is a direct call the compiler can
+* inline. RecordStore, the refined abstraction, uses it for its scans.
+*
+* Backends:
+*
+*   MemoryStorage       bytes in memory
+*   MappedFileStorage   a file mapped into memory with mmap, POSIX only
+*
+* A backend is a class with:
+*
+*   static constexpr const char* Name
+*   size_t Size() const
+*   void Read(uint64_t offset, void* out, size_t bytes) const
+*   void Write(uint64_t offset, const void* in, size_t bytes)
+*   void Flush()
+*
+* Usage:
+*
+* Storage storage = Storage::Create(config.backend, config.path, 1 << 30);
+* RecordStore<Order> orders(std::move(storage));
+* orders.Set(42, order);
+* orders.Reduce<MemoryStorage, MappedFileStorage>(0.0, [](double total, const Order& order) { ... });
+*
+* Notes:
+*
+* Reads and writes out of range throw std::out_of_range. Visit() with a
+* backend list not containing the bound one falls back to the table.
+*
+* References:
+* https://en.wikipedia.org/wiki/Bridge_pattern
+* https://man7.org/linux/man-pages/man2/mmap.2.html
+*
+*/
+
+#ifndef __BRIDGE_H_
+#define __BRIDGE_H_
+
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BRIDGE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define BRIDGE_MMAP 0
+#endif
+
+
+/**
+ * Checks a range against the size of the storage.
+ */
+inline void CheckStorageRange(uint64_t offset, size_t bytes, size_t size)
+{
+    if (offset > size || bytes > size - offset)
+    {
+        throw std::out_of_range("Storage access out of range");
+    }
+}
+
+
+/**
+ * Bytes held in memory.
+ */
+class MemoryStorage
+{
+    public:
+        static constexpr const char* Name = "memory";
+
+        explicit MemoryStorage(size_t size) :
+            m_bytes(size) {}
+
+        size_t Size() const
+        {
+            return m_bytes.size();
+        }
+
+        void Read(uint64_t offset, void* out, size_t bytes) const
+        {
+            CheckStorageRange(offset, bytes, m_bytes.size());
+            std::memcpy(out, m_bytes.data() + offset, bytes);
+        }
+
+        void Write(uint64_t offset, const void* in, size_t bytes)
+        {
+            CheckStorageRange(offset, bytes, m_bytes.size());
+            std::memcpy(m_bytes.data() + offset, in, bytes);
+        }
+
+        void Flush() {}
+
+    private:
+        std::vector<std::byte> m_bytes;
+};
+
+#if BRIDGE_MMAP
+
+/**
+ * A file mapped into memory, writes reach the file through the page cache,
+ * Flush() waits for them to reach the disk.
+ */
+class MappedFileStorage
+{
+    public:
+        static constexpr const char* Name = "mmap";
+
+        /**
+         * Constructor
+         * Opens or creates the file and grows it to the size, a size of zero
+         * maps an existing file as it is.
+         */
+        MappedFileStorage(const std::string& path, size_t size)
+        {
+            m_file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (m_file < 0)
+            {
+                throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+            }
+
+            struct stat status;
+            if (::fstat(m_file, &status) != 0 || (size > static_cast<size_t>(status.st_size) && ::ftruncate(m_file, static_cast<off_t>(size)) != 0))
+            {
+                int error = errno;
+                ::close(m_file);
+                throw std::system_error(error, std::generic_category(), "Cannot size " + path);
+            }
+            m_size = size != 0 ? size : static_cast<size_t>(status.st_size);
+            if (m_size == 0)
+            {
+                ::close(m_file);
+                throw std::invalid_argument("Cannot map an empty file");
+            }
+
+            void* mapping = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+            if (mapping == MAP_FAILED)
+            {
+                int error = errno;
+                ::close(m_file);
+                throw std::system_error(error, std::generic_category(), "Cannot map " + path);
+            }
+            m_bytes = static_cast<std::byte*>(mapping);
+        }
+
+        ~MappedFileStorage()
+        {
+            ::munmap(m_bytes, m_size);
+            ::close(m_file);
+        }
+
+        // Delete copy constructor and copy-assignment
+        MappedFileStorage(MappedFileStorage const&) = delete;
+        MappedFileStorage& operator=(MappedFileStorage const&) = delete;
+
+        size_t Size() const
+        {
+            return m_size;
+        }
+
+        void Read(uint64_t offset, void* out, size_t bytes) const
+        {
+            CheckStorageRange(offset, bytes, m_size);
+            std::memcpy(out, m_bytes + offset, bytes);
+        }
+
+        void Write(uint64_t offset, const void* in, size_t bytes)
+        {
+            CheckStorageRange(offset, bytes, m_size);
+            std::memcpy(m_bytes + offset, in, bytes);
+        }
+
+        void Flush()
+        {
+            if (::msync(m_bytes, m_size, MS_SYNC) != 0)
+            {
+                throw std::system_error(errno, std::generic_category(), "Cannot flush mapping");
+            }
+        }
+
+    private:
+        int m_file = -1;
+        size_t m_size = 0;
+        std::byte* m_bytes = nullptr;
+};
+
+#endif
+
+
+/**
+ * Implementation side of the bridge, one table per backend class.
+ */
+struct StorageTable
+{
+    const char* m_name;
+    size_t (*m_size)(const void* backend);
+    void (*m_read)(const void* backend, uint64_t offset, void* out, size_t bytes);
+    void (*m_write)(void* backend, uint64_t offset, const void* in, size_t bytes);
+    void (*m_flush)(void* backend);
+    void (*m_destroy)(void* backend);
+};
+
+template <class Backend>
+const StorageTable& StorageTableFor()
+{
+    static constexpr StorageTable table =
+    {
+        Backend::Name,
+        [](const void* backend) { return static_cast<const Backend*>(backend)->Size(); },
+        [](const void* backend, uint64_t offset, void* out, size_t bytes) { static_cast<const Backend*>(backend)->Read(offset, out, bytes); },
+        [](void* backend, uint64_t offset, const void* in, size_t bytes) { static_cast<Backend*>(backend)->Write(offset, in, bytes); },
+        [](void* backend) { static_cast<Backend*>(backend)->Flush(); },
+        [](void* backend) { delete static_cast<Backend*>(backend); }
+    };
+    return table;
+}
+
+
+/**
+ * Abstraction side of the bridge, owns the backend it is bound to.
+ */
+class Storage
+{
+    public:
+
+        template <class Backend>
+        explicit Storage(std::unique_ptr<Backend> backend) :
+            m_table(StorageTableFor<Backend>()),
+            m_identity(&StorageTableFor<Backend>()),
+            m_backend(backend.release())
+        {
+            if (m_backend == nullptr)
+            {
+                throw std::invalid_argument("Backend must not be null");
+            }
+        }
+
+        /**
+         * Bind the backend named at startup, "memory" or "mmap".
+         */
+        static Storage Create(std::string_view backend, const std::string& path, size_t size)
+        {
+            if (backend == MemoryStorage::Name)
+            {
+                return Storage(std::make_unique<MemoryStorage>(size));
+            }
+#if BRIDGE_MMAP
+            if (backend == MappedFileStorage::Name)
+            {
+                return Storage(std::make_unique<MappedFileStorage>(path, size));
+            }
+#endif
+            throw std::invalid_argument("Unknown storage backend: " + std::string(backend));
+        }
+
+        Storage(Storage&& other) noexcept :
+            m_table(other.m_table),
+            m_identity(other.m_identity),
+            m_backend(std::exchange(other.m_backend, nullptr)) {}
+
+        Storage& operator=(Storage&& other) noexcept
+        {
+            std::swap(m_table, other.m_table);
+            std::swap(m_identity, other.m_identity);
+            std::swap(m_backend, other.m_backend);
+            return *this;
+        }
+
+        ~Storage()
+        {
+            if (m_backend != nullptr)
+            {
+                m_table.m_destroy(m_backend);
+            }
+        }
+
+        const char* BackendName() const
+        {
+            return m_table.m_name;
+        }
+
+        size_t Size() const
+        {
+            return m_table.m_size(m_backend);
+        }
+
+        void Read(uint64_t offset, void* out, size_t bytes) const
+        {
+            m_table.m_read(m_backend, offset, out, bytes);
+        }
+
+        void Write(uint64_t offset, const void* in, size_t bytes)
+        {
+            m_table.m_write(m_backend, offset, in, bytes);
+        }
+
+        void Flush()
+        {
+            m_table.m_flush(m_backend);
+        }
+
+        /**
+         * Call the function with the bound backend as its concrete type when
+         * it is one of the listed backends, otherwise with the storage itself.
+         */
+        template <class... Backends, class F>
+        decltype(auto) Visit(F&& function)
+        {
+            return VisitAs<Backends...>(std::forward<F>(function));
+        }
+
+    private:
+        template <class First, class... Rest, class F>
+        decltype(auto) VisitAs(F&& function)
+        {
+            if (m_identity == &StorageTableFor<First>())
+            {
+                return function(*static_cast<First*>(m_backend));
+            }
+            return VisitAs<Rest...>(std::forward<F>(function));
+        }
+
+        template <class F>
+        decltype(auto) VisitAs(F&& function)
+        {
+            return function(*this);
+        }
+
+        // Copied so a call needs no load from the shared table
+        StorageTable m_table;
+        const StorageTable* m_identity;
+        void* m_backend;
+};
+
+
+/**
+ * Refined abstraction, fixed size records on any storage.
+ */
+template <class Record>
+class RecordStore
+{
+    static_assert(std::is_trivially_copyable_v<Record>, "Records must be trivially copyable");
+
+    public:
+        explicit RecordStore(Storage storage) :
+            m_storage(std::move(storage)) {}
+
+        size_t Size() const
+        {
+            return m_storage.Size() / sizeof(Record);
+        }
+
+        Record Get(size_t index) const
+        {
+            Record record;
+            m_storage.Read(index * sizeof(Record), &record, sizeof(Record));
+            return record;
+        }
+
+        void Set(size_t index, const Record& record)
+        {
+            m_storage.Write(index * sizeof(Record), &record, sizeof(Record));
+        }
+
+        /**
+         * Fold every record, the loop is compiled for each listed backend.
+         */
+        template <class... Backends, class T, class F>
+        T Reduce(T initial, F&& function)
+        {
+            const size_t count = Size();
+            return m_storage.Visit<Backends...>([&](auto& backend)
+            {
+                T result = std::move(initial);
+                for (size_t i = 0; i < count; i++)
+                {
+                    Record record;
+                    backend.Read(i * sizeof(Record), &record, sizeof(Record));
+                    result = function(std::move(result), record);
+                }
+                return result;
+            });
+        }
+
+        void Flush()
+        {
+            m_storage.Flush();
+        }
+
+        Storage& GetStorage()
+        {
+            return m_storage;
+        }
+
+    private:
+        Storage m_storage;
+};
+
+
+#endif // __BRIDGE_H_
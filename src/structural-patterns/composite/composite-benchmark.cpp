@@ -0,0 +1,254 @@
+/**
+* @file composite-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Composite benchmark
+*
+* A random tree of ten million nodes, each holding a size as a file system
+* would, built in creation order with every new node attached to a random
+* earlier one. Compares the classic composite, virtual components holding
+* their children in vectors of unique pointers, with FlatComposite on the
+* total of the whole tree, the total of every subtree, the totals of random
+* subtrees and scaling every value.
+*
+* Build:
+* g++ -std=c++20 -O2 composite-benchmark.cpp -o composite-benchmark
+* ./composite-benchmark [nodes] [queries]
+*
+*/
+
+#include "flat-composite.h"
+#include "../../benchmark.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+/**
+ * Classic composite
+ */
+class Component
+{
+    public:
+        virtual ~Component() = default;
+        virtual uint64_t Total() const = 0;
+        virtual uint64_t StoreTotals(std::vector<uint64_t>& totals) const = 0;
+        virtual void Scale(uint64_t factor) = 0;
+        virtual void Add(std::unique_ptr<Component>) {}
+};
+
+class File : public Component
+{
+    public:
+        File(uint64_t size, uint32_t id) :
+            m_size(size), m_id(id) {}
+
+        uint64_t Total() const override
+        {
+            return m_size;
+        }
+
+        uint64_t StoreTotals(std::vector<uint64_t>& totals) const override
+        {
+            totals[m_id] = m_size;
+            return m_size;
+        }
+
+        void Scale(uint64_t factor) override
+        {
+            m_size *= factor;
+        }
+
+    protected:
+        uint64_t m_size;
+        uint32_t m_id;
+};
+
+class Directory : public File
+{
+    public:
+        using File::File;
+
+        uint64_t Total() const override
+        {
+            uint64_t total = m_size;
+            for (const std::unique_ptr<Component>& child : m_children)
+            {
+                total += child->Total();
+            }
+            return total;
+        }
+
+        uint64_t StoreTotals(std::vector<uint64_t>& totals) const override
+        {
+            uint64_t total = m_size;
+            for (const std::unique_ptr<Component>& child : m_children)
+            {
+                total += child->StoreTotals(totals);
+            }
+            totals[m_id] = total;
+            return total;
+        }
+
+        void Scale(uint64_t factor) override
+        {
+            m_size *= factor;
+            for (const std::unique_ptr<Component>& child : m_children)
+            {
+                child->Scale(factor);
+            }
+        }
+
+        void Add(std::unique_ptr<Component> child) override
+        {
+            m_children.push_back(std::move(child));
+        }
+
+    private:
+        std::vector<std::unique_ptr<Component> > m_children;
+};
+
+
+int main(int argc, char* argv[])
+{
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+    const size_t queries = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000;
+    std::cout << "Nodes: " << count << ", subtree queries: " << queries << "\n";
+
+    // Random recursive tree, parents precede their children
+    std::mt19937 random(42);
+    std::vector<NodeId> parents(count);
+    std::vector<uint64_t> sizes(count);
+    parents[0] = NoParent;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i > 0)
+        {
+            parents[i] = static_cast<NodeId>(random() % i);
+        }
+        sizes[i] = random() % 4096;
+    }
+
+    // Classic composite built in creation order, directories known up front
+    std::vector<bool> hasChildren(count, false);
+    for (size_t i = 1; i < count; i++)
+    {
+        hasChildren[parents[i]] = true;
+    }
+    std::vector<Component*> nodes(count);
+    std::unique_ptr<Component> root;
+    Measure("  build pointer tree ", count, [&]()
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            std::unique_ptr<Component> node;
+            if (hasChildren[i])
+            {
+                node = std::make_unique<Directory>(sizes[i], static_cast<uint32_t>(i));
+            }
+            else
+            {
+                node = std::make_unique<File>(sizes[i], static_cast<uint32_t>(i));
+            }
+            nodes[i] = node.get();
+            if (i == 0)
+            {
+                root = std::move(node);
+            }
+            else
+            {
+                nodes[parents[i]]->Add(std::move(node));
+            }
+        }
+        return count;
+    }, "node");
+
+    std::vector<NodeId> order;
+    FlatComposite<uint64_t> flat;
+    Measure("  build flat tree    ", count, [&]()
+    {
+        flat = FlatComposite<uint64_t>::FromParents(sizes, parents, &order);
+        return flat.Size();
+    }, "node");
+
+    Measure("  total pointer      ", count, [&]() { return root->Total(); }, "node");
+    Measure("  total flat         ", count, [&]()
+    {
+        uint64_t total = 0;
+        for (uint64_t size : flat.Values())
+        {
+            total += size;
+        }
+        return total;
+    }, "node");
+
+    std::vector<uint64_t> totals(count);
+    Measure("  all totals pointer ", count, [&]()
+    {
+        root->StoreTotals(totals);
+        return totals[count / 2];
+    }, "node");
+    std::vector<uint64_t> flatTotals;
+    Measure("  all totals flat    ", count, [&]()
+    {
+        flatTotals = flat.ReduceSubtrees<uint64_t>([](uint64_t size) { return size; }, std::plus<>());
+        return flatTotals[order[count / 2]];
+    }, "node");
+
+    // Random subtrees, as many nodes visited by both
+    std::vector<NodeId> picked(queries);
+    size_t visited = 0;
+    for (NodeId& node : picked)
+    {
+        node = static_cast<NodeId>(random() % count);
+        visited += flat.SubtreeSize(order[node]);
+    }
+    Measure("  subtrees pointer   ", visited, [&]()
+    {
+        uint64_t checksum = 0;
+        for (NodeId node : picked)
+        {
+            checksum += nodes[node]->Total();
+        }
+        return checksum;
+    }, "node");
+    Measure("  subtrees flat      ", visited, [&]()
+    {
+        uint64_t checksum = 0;
+        for (NodeId node : picked)
+        {
+            for (uint64_t size : flat.Subtree(order[node]))
+            {
+                checksum += size;
+            }
+        }
+        return checksum;
+    }, "node");
+
+    Measure("  scale all pointer  ", count, [&]()
+    {
+        root->Scale(3);
+        return root->Total();
+    }, "node");
+    Measure("  scale all flat     ", count, [&]()
+    {
+        uint64_t total = 0;
+        for (uint64_t& size : flat.Subtree(0))
+        {
+            size *= 3;
+            total += size;
+        }
+        return total;
+    }, "node");
+
+    std::cout << "  memory pointer ~" << count * (sizeof(File) + 16 + sizeof(std::unique_ptr<Component>)) / (1 << 20)
+              << " MB, flat " << count * (sizeof(uint64_t) + 2 * sizeof(NodeId)) / (1 << 20) << " MB\n";
+    return 0;
+}
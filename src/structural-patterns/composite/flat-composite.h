@@ -0,0 +1,468 @@
+/**
+* @file flat-composite.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Composite structural pattern, flat layout
+*
+* The Problem:
+*
+* The classic composite is a tree of heap objects, every composite holding
+* its children through a vector of pointers to the component interface.
+* The nodes end up wherever the allocator put them, in the order they were
+* created rather than the order they are visited, and a traversal of a
+* large tree is one cache miss and one virtual call per node.
+*
+* Solution:
+*
+* Store the whole tree in arrays in pre-order, every node followed by its
+* descendants, with the size of its subtree and the index of its parent.
+*
+*   * The subtree of node n is the contiguous range [n, n + SubtreeSize(n)),
+*     an operation over a subtree is a linear scan, Subtree() returns it as
+*     a span.
+*
+*   * The children of n start at n + 1, each following child after the
+*     subtree of the previous one.
+*
+*   * Values computed bottom-up, sizes, totals, bounding boxes, take one
+*     backwards scan, every node is visited after all of its descendants.
+*
+* Values, sizes and parents are kept in separate arrays so a scan over the
+* values touches nothing else.
+*
+* The tree grows incrementally with AddChild() and Graft(). Appending under
+* the last node or one of its ancestors, the order a builder or a parser
+* produces, only appends to the arrays. Inserting elsewhere shifts the
+* nodes after the insertion point, to insert many nodes at once build them
+* as a separate tree and Graft() it, or collect a parent array and build
+* the tree in one pass with FromParents().
+*
+* Usage:
+*
+* FlatComposite<uint64_t> files;
+* NodeId root = files.AddRoot(0);
+* NodeId src = files.AddChild(root, 0);
+* files.AddChild(src, 1200);
+* files.AddChild(src, 800);
+* std::vector<uint64_t> totals = files.ReduceSubtrees<uint64_t>(
+*     [](uint64_t size) { return size; }, std::plus<>());
+* for (NodeId child : files.Children(root)) { ... }
+*
+* Notes:
+*
+* Node ids are indexes in pre-order, inserting or erasing nodes renumbers
+* the nodes after the affected range. Several roots form a forest, their
+* trees follow each other. Ids are 32 bit.
+*
+* References:
+* https://en.wikipedia.org/wiki/Composite_pattern
+* https://en.wikipedia.org/wiki/Tree_traversal#Pre-order
+*
+*/
+
+#ifndef __FLAT_COMPOSITE_H_
+#define __FLAT_COMPOSITE_H_
+
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+using NodeId = uint32_t;
+
+// Parent of a root
+inline constexpr NodeId NoParent = std::numeric_limits<NodeId>::max();
+
+
+template <class T>
+class FlatComposite
+{
+    public:
+
+        /**
+         * Children of a node, in order.
+         */
+        class ChildRange
+        {
+            public:
+                class Iterator
+                {
+                    public:
+                        using value_type = NodeId;
+                        using difference_type = std::ptrdiff_t;
+
+                        Iterator() = default;
+
+                        NodeId operator*() const
+                        {
+                            return m_node;
+                        }
+
+                        Iterator& operator++()
+                        {
+                            m_node += (*m_sizes)[m_node];
+                            return *this;
+                        }
+
+                        Iterator operator++(int)
+                        {
+                            Iterator previous = *this;
+                            ++*this;
+                            return previous;
+                        }
+
+                        bool operator==(const Iterator& other) const
+                        {
+                            return m_node == other.m_node;
+                        }
+
+                    private:
+                        friend class ChildRange;
+
+                        Iterator(const std::vector<NodeId>* sizes, NodeId node) :
+                            m_sizes(sizes), m_node(node) {}
+
+                        const std::vector<NodeId>* m_sizes = nullptr;
+                        NodeId m_node = 0;
+                };
+
+                Iterator begin() const
+                {
+                    return Iterator(m_sizes, m_begin);
+                }
+
+                Iterator end() const
+                {
+                    return Iterator(m_sizes, m_end);
+                }
+
+            private:
+                friend class FlatComposite;
+
+                ChildRange(const std::vector<NodeId>* sizes, NodeId begin, NodeId end) :
+                    m_sizes(sizes), m_begin(begin), m_end(end) {}
+
+                const std::vector<NodeId>* m_sizes;
+                NodeId m_begin;
+                NodeId m_end;
+        };
+
+        FlatComposite() = default;
+
+        /**
+         * Build the tree from a parent array in one pass. Every parent must
+         * precede its children, parents[i] < i, or be NoParent. Children
+         * keep their relative order, node i of the input becomes node
+         * order[i] of the tree when order is given.
+         */
+        static FlatComposite FromParents(std::vector<T> values, std::span<const NodeId> parents, std::vector<NodeId>* order = nullptr)
+        {
+            const size_t count = values.size();
+            if (parents.size() != count)
+            {
+                throw std::invalid_argument("Every node requires a parent");
+            }
+            CheckCapacity(count);
+
+            // Children of every node in compressed rows, roots under the extra row count
+            std::vector<NodeId> firstChild(count + 3, 0);
+            for (size_t i = 0; i < count; i++)
+            {
+                NodeId parent = parents[i];
+                if (parent != NoParent && parent >= i)
+                {
+                    throw std::invalid_argument("Parents must precede their children");
+                }
+                firstChild[(parent == NoParent ? count : parent) + 2]++;
+            }
+            for (size_t i = 2; i < firstChild.size(); i++)
+            {
+                firstChild[i] += firstChild[i - 1];
+            }
+            std::vector<NodeId> children(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                NodeId parent = parents[i];
+                children[firstChild[(parent == NoParent ? count : parent) + 1]++] = static_cast<NodeId>(i);
+            }
+
+            // Pre-order numbering, subtree sizes from the input parents in reverse
+            std::vector<NodeId> sizes(count, 1);
+            for (size_t i = count; i-- > 0; )
+            {
+                if (parents[i] != NoParent)
+                {
+                    sizes[parents[i]] += sizes[i];
+                }
+            }
+
+            std::vector<NodeId> position(count);
+            NodeId next = 0;
+            for (NodeId c = firstChild[count]; c < firstChild[count + 1]; c++)
+            {
+                position[children[c]] = next;
+                next += sizes[children[c]];
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                // Every node is placed before its children are visited, parents precede them
+                NodeId child = position[i] + 1;
+                for (NodeId c = firstChild[i]; c < firstChild[i + 1]; c++)
+                {
+                    position[children[c]] = child;
+                    child += sizes[children[c]];
+                }
+            }
+
+            FlatComposite tree;
+            tree.m_values.resize(count);
+            tree.m_sizes.resize(count);
+            tree.m_parents.resize(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                NodeId at = position[i];
+                tree.m_values[at] = std::move(values[i]);
+                tree.m_sizes[at] = sizes[i];
+                tree.m_parents[at] = parents[i] == NoParent ? NoParent : position[parents[i]];
+            }
+            if (order != nullptr)
+            {
+                *order = std::move(position);
+            }
+            return tree;
+        }
+
+        size_t Size() const
+        {
+            return m_values.size();
+        }
+
+        bool Empty() const
+        {
+            return m_values.empty();
+        }
+
+        void Reserve(size_t count)
+        {
+            m_values.reserve(count);
+            m_sizes.reserve(count);
+            m_parents.reserve(count);
+        }
+
+        /**
+         * Start a new tree after the last one.
+         */
+        NodeId AddRoot(T value)
+        {
+            CheckCapacity(Size() + 1);
+            NodeId node = static_cast<NodeId>(Size());
+            m_values.push_back(std::move(value));
+            m_sizes.push_back(1);
+            m_parents.push_back(NoParent);
+            return node;
+        }
+
+        /**
+         * Append a child after the existing children of the parent.
+         */
+        NodeId AddChild(NodeId parent, T value)
+        {
+            CheckNode(parent);
+            CheckCapacity(Size() + 1);
+
+            const NodeId at = parent + m_sizes[parent];
+            Open(at, parent, 1);
+            m_values.insert(m_values.begin() + at, std::move(value));
+            m_sizes.insert(m_sizes.begin() + at, 1);
+            m_parents.insert(m_parents.begin() + at, parent);
+            return at;
+        }
+
+        /**
+         * Copy every tree of the other composite in as children of the
+         * parent, returns the id of the first copied node.
+         */
+        NodeId Graft(NodeId parent, const FlatComposite& other)
+        {
+            CheckNode(parent);
+            CheckCapacity(Size() + other.Size());
+
+            const NodeId at = parent + m_sizes[parent];
+            const NodeId count = static_cast<NodeId>(other.Size());
+            Open(at, parent, count);
+            m_values.insert(m_values.begin() + at, other.m_values.begin(), other.m_values.end());
+            m_sizes.insert(m_sizes.begin() + at, other.m_sizes.begin(), other.m_sizes.end());
+            m_parents.insert(m_parents.begin() + at, other.m_parents.begin(), other.m_parents.end());
+            for (NodeId i = at; i < at + count; i++)
+            {
+                m_parents[i] = m_parents[i] == NoParent ? parent : m_parents[i] + at;
+            }
+            return at;
+        }
+
+        /**
+         * Remove the node and its subtree.
+         */
+        void Erase(NodeId node)
+        {
+            CheckNode(node);
+
+            const NodeId count = m_sizes[node];
+            const NodeId end = node + count;
+            for (NodeId ancestor = m_parents[node]; ancestor != NoParent; ancestor = m_parents[ancestor])
+            {
+                m_sizes[ancestor] -= count;
+            }
+            m_values.erase(m_values.begin() + node, m_values.begin() + end);
+            m_sizes.erase(m_sizes.begin() + node, m_sizes.begin() + end);
+            m_parents.erase(m_parents.begin() + node, m_parents.begin() + end);
+            for (NodeId i = node; i < Size(); i++)
+            {
+                if (m_parents[i] != NoParent && m_parents[i] >= end)
+                {
+                    m_parents[i] -= count;
+                }
+            }
+        }
+
+        T& Value(NodeId node)
+        {
+            return m_values[node];
+        }
+
+        const T& Value(NodeId node) const
+        {
+            return m_values[node];
+        }
+
+        NodeId Parent(NodeId node) const
+        {
+            return m_parents[node];
+        }
+
+        // Nodes in the subtree, the node included
+        NodeId SubtreeSize(NodeId node) const
+        {
+            return m_sizes[node];
+        }
+
+        bool IsLeaf(NodeId node) const
+        {
+            return m_sizes[node] == 1;
+        }
+
+        ChildRange Children(NodeId node) const
+        {
+            return ChildRange(&m_sizes, node + 1, node + m_sizes[node]);
+        }
+
+        // Roots of the forest
+        ChildRange Roots() const
+        {
+            return ChildRange(&m_sizes, 0, static_cast<NodeId>(Size()));
+        }
+
+        /**
+         * Values of the node and its descendants in pre-order.
+         */
+        std::span<T> Subtree(NodeId node)
+        {
+            return std::span<T>(m_values).subspan(node, m_sizes[node]);
+        }
+
+        std::span<const T> Subtree(NodeId node) const
+        {
+            return std::span<const T>(m_values).subspan(node, m_sizes[node]);
+        }
+
+        // Every value in pre-order
+        std::span<T> Values()
+        {
+            return m_values;
+        }
+
+        std::span<const T> Values() const
+        {
+            return m_values;
+        }
+
+        std::span<const NodeId> Parents() const
+        {
+            return m_parents;
+        }
+
+        /**
+         * Value of every subtree, project(value) combined with the results of
+         * the children by combine(result, child result), in one backwards
+         * scan.
+         */
+        template <class Result, class Project, class Combine>
+        std::vector<Result> ReduceSubtrees(Project&& project, Combine&& combine) const
+        {
+            std::vector<Result> results;
+            results.reserve(Size());
+            for (const T& value : m_values)
+            {
+                results.push_back(project(value));
+            }
+            for (size_t i = Size(); i-- > 0; )
+            {
+                if (m_parents[i] != NoParent)
+                {
+                    results[m_parents[i]] = combine(std::move(results[m_parents[i]]), results[i]);
+                }
+            }
+            return results;
+        }
+
+    private:
+
+        static void CheckCapacity(size_t count)
+        {
+            if (count >= NoParent)
+            {
+                throw std::length_error("FlatComposite holds at most 2^32 - 1 nodes");
+            }
+        }
+
+        void CheckNode(NodeId node) const
+        {
+            if (node >= Size())
+            {
+                throw std::out_of_range("Node id out of range");
+            }
+        }
+
+        /**
+         * Make room for count nodes at the position under the parent, grow
+         * the ancestors and renumber the parents of the nodes after it.
+         */
+        void Open(NodeId at, NodeId parent, NodeId count)
+        {
+            for (NodeId ancestor = parent; ancestor != NoParent; ancestor = m_parents[ancestor])
+            {
+                m_sizes[ancestor] += count;
+            }
+            for (NodeId i = at; i < Size(); i++)
+            {
+                if (m_parents[i] != NoParent && m_parents[i] >= at)
+                {
+                    m_parents[i] += count;
+                }
+            }
+        }
+
+        std::vector<T> m_values;
+        std::vector<NodeId> m_sizes;
+        std::vector<NodeId> m_parents;
+};
+
+
+#endif // __FLAT_COMPOSITE_H_
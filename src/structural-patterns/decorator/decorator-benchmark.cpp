@@ -0,0 +1,189 @@
+/**
+* @file decorator-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Decorator benchmark
+*
+* Wraps a cheap component, a checksum step, in three decorators, logging
+* with no logger set, retry and a bounds check, and calls it in a loop.
+* Compares the classic decorators holding their inner component through a
+* pointer to the interface, DecoratorChain composing std::function layers
+* at run time, and the layers fused at compile time by Decorate().
+*
+* Build:
+* g++ -std=c++20 -O2 decorator-benchmark.cpp -o decorator-benchmark
+* ./decorator-benchmark [calls]
+*
+*/
+
+#include "decorator.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+uint64_t Mix(uint64_t value)
+{
+    value ^= value >> 31;
+    value *= 0x9E3779B97F4A7C15ULL;
+    return value ^ (value >> 29);
+}
+
+
+/**
+ * Classic decorators, every layer a heap object behind the interface.
+ */
+class Step
+{
+    public:
+        virtual uint64_t operator()(uint64_t value) = 0;
+        virtual ~Step() = default;
+};
+
+class MixStep : public Step
+{
+    public:
+        uint64_t operator()(uint64_t value) override
+        {
+            return Mix(value);
+        }
+};
+
+class StepDecorator : public Step
+{
+    public:
+        explicit StepDecorator(std::unique_ptr<Step> inner) :
+            m_inner(std::move(inner)) {}
+
+    protected:
+        std::unique_ptr<Step> m_inner;
+};
+
+class LoggingStep : public StepDecorator
+{
+    public:
+        using StepDecorator::StepDecorator;
+
+        uint64_t operator()(uint64_t value) override
+        {
+            if (m_logger)
+            {
+                m_logger("step", "call");
+            }
+            return (*m_inner)(value);
+        }
+
+    private:
+        std::function<void(std::string_view, std::string_view)> m_logger;
+};
+
+class RetryStep : public StepDecorator
+{
+    public:
+        using StepDecorator::StepDecorator;
+
+        uint64_t operator()(uint64_t value) override
+        {
+            for (size_t attempt = 1; ; attempt++)
+            {
+                try
+                {
+                    return (*m_inner)(value);
+                }
+                catch (const std::exception&)
+                {
+                    if (attempt >= 3)
+                    {
+                        throw;
+                    }
+                }
+            }
+        }
+};
+
+class BoundsStep : public StepDecorator
+{
+    public:
+        using StepDecorator::StepDecorator;
+
+        uint64_t operator()(uint64_t value) override
+        {
+            if (value == UINT64_MAX)
+            {
+                throw std::out_of_range("Value out of range");
+            }
+            return (*m_inner)(value);
+        }
+};
+
+
+/**
+ * The bounds check as a mixin layer.
+ */
+template <class Inner>
+class BoundsLayer : public Inner
+{
+    public:
+        using Inner::Inner;
+
+        uint64_t operator()(uint64_t value)
+        {
+            if (value == UINT64_MAX)
+            {
+                throw std::out_of_range("Value out of range");
+            }
+            return Inner::operator()(value);
+        }
+};
+
+
+template <class F>
+void Measure(const std::string& name, size_t calls, F&& function)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t value = 1;
+    for (size_t i = 0; i < calls; i++)
+    {
+        value = function(value + i);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << name << ": " << (seconds * 1e9 / calls) << " ns/call (checksum " << value << ")\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t calls = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000000;
+    std::cout << "Calls: " << calls << "\n";
+
+    Measure("  undecorated     ", calls, Mix);
+
+    std::unique_ptr<Step> classic = std::make_unique<LoggingStep>(
+        std::make_unique<RetryStep>(std::make_unique<BoundsStep>(std::make_unique<MixStep>())));
+    Measure("  classic virtual ", calls, [&](uint64_t value) { return (*classic)(value); });
+
+    using Chain = DecoratorChain<uint64_t(uint64_t)>;
+    Chain chain;
+    chain.Register("logging", Chain::FromLayer<LoggingLayer>());
+    chain.Register("retry", Chain::FromLayer<RetryLayer>());
+    chain.Register("bounds", Chain::FromLayer<BoundsLayer>());
+    std::vector<std::string> configured = {"logging", "retry", "bounds"};
+    Chain::Function runtime = chain.Build(Mix, configured);
+    Measure("  runtime chain   ", calls, runtime);
+
+    auto fused = Decorate<LoggingLayer, RetryLayer, BoundsLayer>([](uint64_t value) { return Mix(value); });
+    Measure("  fused layers    ", calls, [&](uint64_t value) { return fused(value); });
+
+    return 0;
+}
@@ -0,0 +1,393 @@
+/**
+* @file decorator.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Decorator structural pattern, layers fused at compile time
+*
+* The Problem:
+*
+* Decorators wrap a component behind the component's own interface and
+* add behaviour around each call, logging, timing, retries, caching. The
+* classic decorator holds its inner component through a pointer to the
+* interface, a stack of decorators is a linked list of heap objects and
+* every call walks it with one virtual call per layer, none of which the
+* compiler can inline.
+*
+* Solution:
+*
+* Layers are class templates deriving from the layer below them, mixins.
+* Decorate<Layers...>(component) stacks them at compile time around the
+* component, the first layer outermost. The stack is a single object
+* without allocation, every layer calls the next as a direct call on its
+* base class and the compiler inlines the whole stack into one function.
+* The settings and counters of every layer are members of that object.
+*
+* A layer is written as:
+*
+* template <class Inner>
+* class Layer : public Inner
+* {
+*     public:
+*         using Inner::Inner;
+*
+*         template <class... Args>
+*         decltype(auto) operator()(Args&&... args)
+*         {
+*             // before
+*             return Inner::operator()(std::forward<Args>(args)...);
+*         }
+* };
+*
+* Stacks chosen at run time, e.g. from configuration, use DecoratorChain.
+* It keeps named layers, each wrapping a std::function into another, and
+* builds the stack named by a list. The same mixins can be registered as
+* runtime layers, every layer then costs one indirect call again.
+*
+* Usage:
+*
+* auto load = Decorate<LoggingLayer, RetryLayer, TimingLayer>([](int key) { return Load(key); });
+* load.SetLogger([](std::string_view name, std::string_view event) { std::clog << name << ' ' << event << '\n'; });
+* load.SetAttempts(3);
+* load(42);
+* load.Nanoseconds();
+*
+* DecoratorChain<int(int)> chain;
+* chain.Register("retry", DecoratorChain<int(int)>::FromLayer<RetryLayer>());
+* std::function<int(int)> configured = chain.Build(Load, {"retry"});
+*
+* Notes:
+*
+* Layers are found by name lookup, two layers in one stack must not use the
+* same member names. Layers which keep statistics in a runtime chain keep
+* them inside the std::function, out of reach, such layers are better
+* registered as lambdas capturing their counters.
+*
+* References:
+* https://en.wikipedia.org/wiki/Decorator_pattern
+* https://en.wikipedia.org/wiki/Mixin
+*
+*/
+
+#ifndef __DECORATOR_H_
+#define __DECORATOR_H_
+
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+
+/**
+ * Bottom of every stack, holds the decorated component.
+ */
+template <class Component>
+class DecoratorBase
+{
+    public:
+        explicit DecoratorBase(Component component) :
+            m_component(std::move(component)) {}
+
+        template <class... Args>
+        decltype(auto) operator()(Args&&... args)
+        {
+            return std::invoke(m_component, std::forward<Args>(args)...);
+        }
+
+        Component& GetComponent()
+        {
+            return m_component;
+        }
+
+    private:
+        Component m_component;
+};
+
+template <class Component, template <class> class... Layers>
+struct DecoratedStack
+{
+    using Type = DecoratorBase<Component>;
+};
+
+template <class Component, template <class> class Outer, template <class> class... Layers>
+struct DecoratedStack<Component, Outer, Layers...>
+{
+    using Type = Outer<typename DecoratedStack<Component, Layers...>::Type>;
+};
+
+/**
+ * The component wrapped in the layers, the first layer outermost.
+ */
+template <class Component, template <class> class... Layers>
+using Decorated = typename DecoratedStack<Component, Layers...>::Type;
+
+template <template <class> class... Layers, class Component>
+Decorated<Component, Layers...> Decorate(Component component)
+{
+    return Decorated<Component, Layers...>(std::move(component));
+}
+
+
+/**
+ * Reports every call and its outcome to a logger, costs one branch while
+ * no logger is set.
+ */
+template <class Inner>
+class LoggingLayer : public Inner
+{
+    public:
+        using Logger = std::function<void(std::string_view name, std::string_view event)>;
+        using Inner::Inner;
+
+        template <class... Args>
+        decltype(auto) operator()(Args&&... args)
+        {
+            if (!m_logger)
+            {
+                return Inner::operator()(std::forward<Args>(args)...);
+            }
+
+            m_logger(m_name, "call");
+            try
+            {
+                if constexpr (std::is_void_v<decltype(Inner::operator()(std::forward<Args>(args)...))>)
+                {
+                    Inner::operator()(std::forward<Args>(args)...);
+                    m_logger(m_name, "done");
+                }
+                else
+                {
+                    decltype(auto) result = Inner::operator()(std::forward<Args>(args)...);
+                    m_logger(m_name, "done");
+                    return static_cast<decltype(result)>(result);
+                }
+            }
+            catch (...)
+            {
+                m_logger(m_name, "failed");
+                throw;
+            }
+        }
+
+        void SetLogger(Logger logger, std::string name = "component")
+        {
+            m_logger = std::move(logger);
+            m_name = std::move(name);
+        }
+
+    private:
+        Logger m_logger;
+        std::string m_name;
+};
+
+/**
+ * Counts the calls and the time spent below the layer.
+ */
+template <class Inner>
+class TimingLayer : public Inner
+{
+    public:
+        using Inner::Inner;
+
+        template <class... Args>
+        decltype(auto) operator()(Args&&... args)
+        {
+            struct Stopwatch
+            {
+                ~Stopwatch()
+                {
+                    m_layer.m_calls++;
+                    m_layer.m_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+                }
+
+                TimingLayer& m_layer;
+                std::chrono::steady_clock::time_point m_start;
+            };
+
+            Stopwatch stopwatch{*this, std::chrono::steady_clock::now()};
+            return Inner::operator()(std::forward<Args>(args)...);
+        }
+
+        uint64_t Calls() const
+        {
+            return m_calls;
+        }
+
+        uint64_t Nanoseconds() const
+        {
+            return m_nanoseconds;
+        }
+
+    private:
+        uint64_t m_calls = 0;
+        uint64_t m_nanoseconds = 0;
+};
+
+/**
+ * Calls again when the layers below throw, the last exception propagates.
+ * Arguments are forwarded as lvalues so every attempt sees them intact.
+ */
+template <class Inner>
+class RetryLayer : public Inner
+{
+    public:
+        using Inner::Inner;
+
+        template <class... Args>
+        decltype(auto) operator()(Args&&... args)
+        {
+            for (size_t attempt = 1; ; attempt++)
+            {
+                try
+                {
+                    return Inner::operator()(args...);
+                }
+                catch (const std::exception&)
+                {
+                    if (attempt >= m_attempts)
+                    {
+                        throw;
+                    }
+                    m_retries++;
+                }
+            }
+        }
+
+        void SetAttempts(size_t attempts)
+        {
+            if (attempts == 0)
+            {
+                throw std::invalid_argument("Attempts must be greater than zero");
+            }
+            m_attempts = attempts;
+        }
+
+        uint64_t Retries() const
+        {
+            return m_retries;
+        }
+
+    private:
+        size_t m_attempts = 3;
+        uint64_t m_retries = 0;
+};
+
+/**
+ * Remembers the results by the single argument, for components which are
+ * pure functions of it. Caching<Key, Value>::Layer is the layer.
+ */
+template <class Key, class Value, class Hash = std::hash<Key> >
+struct Caching
+{
+    template <class Inner>
+    class Layer : public Inner
+    {
+        public:
+            using Inner::Inner;
+
+            const Value& operator()(const Key& key)
+            {
+                auto found = m_cache.find(key);
+                if (found == m_cache.end())
+                {
+                    found = m_cache.emplace(key, Inner::operator()(key)).first;
+                }
+                return found->second;
+            }
+
+            void Invalidate()
+            {
+                m_cache.clear();
+            }
+
+        private:
+            std::unordered_map<Key, Value, Hash> m_cache;
+    };
+};
+
+
+/**
+ * Stack of named layers composed at run time.
+ */
+template <class Signature>
+class DecoratorChain;
+
+template <class Result, class... Args>
+class DecoratorChain<Result(Args...)>
+{
+    public:
+        using Function = std::function<Result(Args...)>;
+        using Layer = std::function<Function(Function inner)>;
+
+        /**
+         * Runtime layer made of a mixin, over a std::function component.
+         */
+        template <template <class> class Mixin>
+        static Layer FromLayer()
+        {
+            return [](Function inner) -> Function
+            {
+                return Mixin<DecoratorBase<Function> >(std::move(inner));
+            };
+        }
+
+        void Register(const std::string& name, Layer layer)
+        {
+            if (!layer)
+            {
+                throw std::invalid_argument("Layer must not be empty");
+            }
+            m_layers[name] = std::move(layer);
+        }
+
+        /**
+         * Wrap the component in the named layers, the first outermost.
+         */
+        Function Build(Function component, std::initializer_list<std::string_view> names) const
+        {
+            return Build(std::move(component), names.begin(), names.end());
+        }
+
+        template <class Names>
+        Function Build(Function component, const Names& names) const
+        {
+            return Build(std::move(component), std::begin(names), std::end(names));
+        }
+
+    private:
+        template <class Iterator>
+        Function Build(Function component, Iterator begin, Iterator end) const
+        {
+            if (!component)
+            {
+                throw std::invalid_argument("Component must not be empty");
+            }
+
+            Function function = std::move(component);
+            while (end != begin)
+            {
+                --end;
+                auto found = m_layers.find(std::string_view(*end));
+                if (found == m_layers.end())
+                {
+                    throw std::invalid_argument("Unknown decorator layer: " + std::string(*end));
+                }
+                function = found->second(std::move(function));
+            }
+            return function;
+        }
+
+        std::map<std::string, Layer, std::less<> > m_layers;
+};
+
+
+#endif // __DECORATOR_H_
@@ -0,0 +1,171 @@
+/**
+* @file runtime-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Runtime facade benchmark
+*
+* Workers encode messages into 4 KB buffers, once allocating a buffer for
+* every message and once taking it from the pool of the runtime, while a
+* monitoring thread takes snapshots as fast as it can. Then the cost of the
+* pool, a snapshot and the Prometheus dump on their own, and the metrics
+* the run left behind.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread runtime-benchmark.cpp -o runtime-benchmark
+* ./runtime-benchmark [threads] [tasks] [path]
+*
+*/
+
+#include "runtime.h"
+#include "../../benchmark.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+
+struct Buffer
+{
+    std::byte m_bytes[4096];
+};
+
+/**
+ * Service provided to the runtime, the pool injected into it.
+ */
+class Encoder
+{
+    public:
+        explicit Encoder(RuntimePool<Buffer>& buffers) :
+            m_buffers(buffers) {}
+
+        uint64_t EncodePooled(uint64_t message)
+        {
+            RuntimePool<Buffer>::Handle buffer = m_buffers.Acquire();
+            return Encode(*buffer, message);
+        }
+
+        uint64_t EncodeAllocated(uint64_t message)
+        {
+            std::unique_ptr<Buffer> buffer = std::make_unique_for_overwrite<Buffer>();
+            return Encode(*buffer, message);
+        }
+
+    private:
+        static uint64_t Encode(Buffer& buffer, uint64_t message)
+        {
+            uint64_t checksum = 0;
+            for (size_t i = 0; i < sizeof(buffer.m_bytes); i += 64)
+            {
+                buffer.m_bytes[i] = static_cast<std::byte>(message + i);
+                checksum += static_cast<uint64_t>(buffer.m_bytes[i]);
+            }
+            return checksum;
+        }
+
+        RuntimePool<Buffer>& m_buffers;
+};
+
+
+int main(int argc, char* argv[])
+{
+    const size_t threads = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+    const size_t tasks = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+    const std::string path = argc > 3 ? argv[3] : "/tmp/runtime-benchmark.prom";
+    std::cout << "Threads: " << threads << ", tasks: " << tasks << "\n";
+
+    Runtime runtime(threads);
+    RuntimePool<Buffer>& buffers = runtime.AddPool<Buffer>("buffers", []() { return std::make_unique_for_overwrite<Buffer>(); }, threads, 4 * threads);
+    runtime.Provide<Encoder>(std::make_shared<Encoder>(buffers));
+    runtime.Start();
+
+    std::atomic<uint64_t> checksum{0};
+    std::atomic<bool> monitoring{true};
+    std::atomic<uint64_t> snapshots{0};
+    std::thread monitor([&]()
+    {
+        while (monitoring.load(std::memory_order_relaxed))
+        {
+            RuntimeMetrics metrics = runtime.Metrics();
+            snapshots.fetch_add(metrics.m_pools.size(), std::memory_order_relaxed);
+        }
+    });
+
+    Encoder& encoder = runtime.Require<Encoder>();
+    Measure("  tasks, allocated buffer ", tasks, [&]()
+    {
+        for (size_t i = 0; i < tasks; i++)
+        {
+            runtime.Submit([&, i]() { checksum.fetch_add(encoder.EncodeAllocated(i), std::memory_order_relaxed); });
+        }
+        runtime.Wait();
+        return checksum.exchange(0);
+    });
+    Measure("  tasks, pooled buffer    ", tasks, [&]()
+    {
+        for (size_t i = 0; i < tasks; i++)
+        {
+            runtime.Submit([&, i]() { checksum.fetch_add(encoder.EncodePooled(i), std::memory_order_relaxed); });
+        }
+        runtime.Wait();
+        return checksum.exchange(0);
+    });
+    monitoring.store(false, std::memory_order_relaxed);
+    monitor.join();
+    std::cout << "  snapshots taken meanwhile: " << snapshots.load() << "\n";
+
+    // Single thread costs
+    Measure("  allocate and free       ", tasks, [&]()
+    {
+        uint64_t total = 0;
+        for (size_t i = 0; i < tasks; i++)
+        {
+            total += encoder.EncodeAllocated(i);
+        }
+        return total;
+    });
+    Measure("  acquire and release     ", tasks, [&]()
+    {
+        uint64_t total = 0;
+        for (size_t i = 0; i < tasks; i++)
+        {
+            total += encoder.EncodePooled(i);
+        }
+        return total;
+    });
+    Measure("  snapshot                ", tasks / 10, [&]()
+    {
+        uint64_t total = 0;
+        for (size_t i = 0; i < tasks / 10; i++)
+        {
+            total += runtime.Metrics().m_threads.m_completed;
+        }
+        return total;
+    });
+    Measure("  Prometheus dump         ", 1000, [&]()
+    {
+        for (size_t i = 0; i < 1000; i++)
+        {
+            runtime.DumpPrometheus(path);
+        }
+        return runtime.PrometheusText().size();
+    });
+
+    RuntimeMetrics metrics = runtime.Metrics();
+    const PoolMetrics& pool = metrics.m_pools.front();
+    std::cout << "  pool capacity " << pool.m_capacity << ", in use " << pool.m_inUse << ", acquires " << pool.m_acquires
+              << ", allocations " << pool.m_allocations << ", exhausted " << pool.m_exhausted << "\n"
+              << "  tasks " << metrics.m_threads.m_completed << ", utilisation " << metrics.m_threads.Utilisation()
+              << ", allocations/s " << metrics.AllocationRate() << "\n";
+
+    runtime.Stop();
+    std::remove(path.c_str());
+    return 0;
+}
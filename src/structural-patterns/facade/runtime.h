@@ -0,0 +1,765 @@
+/**
+* @file runtime.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Facade structural pattern, one runtime for the services
+*
+* The Problem:
+*
+* A service is assembled from object pools, factories creating the pooled
+* products, worker threads and injected dependencies, and every service
+* configures each of them on its own. Two services in a process end up with
+* two thread pools and two pools of the same buffers, and none of the parts
+* reports how it is doing, so nobody can tell whether a pool is too small or
+* the threads are saturated.
+*
+* Solution:
+*
+* Runtime is a facade over those subsystems. It owns the pools, each one a
+* SharedPool refilled by the factory method of its product, one set of
+* worker threads built on ThreadObject and the services provided to it, and
+* hands the same instances to everything built on top of it.
+*
+* Every subsystem counts what it does in relaxed atomics, Metrics() reads
+* them without taking a lock, so it can be called as often as a monitoring
+* loop likes without slowing the pools or the workers down. PrometheusText()
+* formats the same snapshot in the Prometheus text exposition format and
+* DumpPrometheus() writes it to a file, for the node exporter textfile
+* collector or anything else scraping files.
+*
+* Snapshot:
+*
+*   pools       capacity, objects in use, occupancy, acquires, allocations
+*               made by the factory and acquires refused at the limit
+*   threads     workers, tasks submitted, completed, failed and queued,
+*               busy time and utilisation since Start()
+*   allocations total allocations and allocations per second
+*
+* Usage:
+*
+* Runtime runtime(4);
+* RuntimePool<Buffer>& buffers = runtime.AddPool<Buffer>("buffers", []() { return std::make_unique<Buffer>(); }, 64, 1024);
+* runtime.Provide<Codec>(std::make_shared<Codec>(buffers));
+* runtime.Start();
+*
+* runtime.Submit([&]() { auto buffer = buffers.Acquire(); runtime.Require<Codec>().Encode(*buffer); });
+* RuntimeMetrics metrics = runtime.Metrics();
+* runtime.DumpPrometheus("/var/lib/node_exporter/runtime.prom");
+*
+* Notes:
+*
+* Pools and services are added before Start(), from one thread, afterwards
+* they are fixed and every lookup and snapshot runs without a lock. Each
+* counter is read on its own, a snapshot taken while the runtime is busy is
+* not one instant. Handles from a pool must be released before the runtime
+* is destroyed. Stop() runs the queued tasks before joining the workers.
+*
+* References:
+* https://en.wikipedia.org/wiki/Facade_pattern
+* https://prometheus.io/docs/instrumenting/exposition_formats/
+*
+*/
+
+#ifndef __RUNTIME_H_
+#define __RUNTIME_H_
+
+
+#include "../../concurrency-patterns/thread-object.h"
+#include "../../creational-patterns/object-pool/object-pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+inline uint64_t RuntimeClock()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+struct PoolMetrics
+{
+    std::string m_name;
+    uint64_t m_capacity = 0;
+    uint64_t m_inUse = 0;
+    uint64_t m_acquires = 0;
+    uint64_t m_allocations = 0;
+    uint64_t m_exhausted = 0;
+
+    uint64_t Available() const
+    {
+        return m_capacity - m_inUse;
+    }
+
+    double Occupancy() const
+    {
+        return m_capacity == 0 ? 0.0 : static_cast<double>(m_inUse) / m_capacity;
+    }
+};
+
+struct ThreadMetrics
+{
+    uint64_t m_threads = 0;
+    uint64_t m_submitted = 0;
+    uint64_t m_completed = 0;
+    uint64_t m_failed = 0;
+    uint64_t m_queued = 0;
+    uint64_t m_busyNanoseconds = 0;
+    uint64_t m_runningNanoseconds = 0;
+
+    /**
+     * Share of the worker time since Start() spent running tasks.
+     */
+    double Utilisation() const
+    {
+        const double available = static_cast<double>(m_threads) * m_runningNanoseconds;
+        return available == 0 ? 0.0 : std::min(1.0, m_busyNanoseconds / available);
+    }
+};
+
+struct RuntimeMetrics
+{
+    uint64_t m_uptimeNanoseconds = 0;
+    std::vector<PoolMetrics> m_pools;
+    ThreadMetrics m_threads;
+
+    uint64_t Allocations() const
+    {
+        uint64_t total = 0;
+        for (const PoolMetrics& pool : m_pools)
+        {
+            total += pool.m_allocations;
+        }
+        return total;
+    }
+
+    /**
+     * Allocations per second since the runtime was created.
+     */
+    double AllocationRate() const
+    {
+        return m_uptimeNanoseconds == 0 ? 0.0 : Allocations() * 1e9 / m_uptimeNanoseconds;
+    }
+};
+
+
+/**
+ * The counters and name shared by pools of every product type.
+ */
+class RuntimePoolBase
+{
+    public:
+        explicit RuntimePoolBase(std::string name) :
+            m_name(std::move(name)) {}
+
+        virtual ~RuntimePoolBase() = default;
+
+        // Delete copy constructor and copy-assignment
+        RuntimePoolBase(RuntimePoolBase const&) = delete;
+        RuntimePoolBase& operator=(RuntimePoolBase const&) = delete;
+
+        const std::string& Name() const
+        {
+            return m_name;
+        }
+
+        PoolMetrics Metrics() const
+        {
+            PoolMetrics metrics;
+            metrics.m_name = m_name;
+            metrics.m_inUse = m_inUse.load(std::memory_order_relaxed);
+            // Read after the objects in use so it is never the smaller
+            metrics.m_capacity = std::max(m_capacity.load(std::memory_order_relaxed), metrics.m_inUse);
+            metrics.m_acquires = m_acquires.load(std::memory_order_relaxed);
+            metrics.m_allocations = m_allocations.load(std::memory_order_relaxed);
+            metrics.m_exhausted = m_exhausted.load(std::memory_order_relaxed);
+            return metrics;
+        }
+
+    protected:
+        std::string m_name;
+        std::atomic<uint64_t> m_capacity{0};
+        std::atomic<uint64_t> m_inUse{0};
+        std::atomic<uint64_t> m_acquires{0};
+        std::atomic<uint64_t> m_allocations{0};
+        std::atomic<uint64_t> m_exhausted{0};
+};
+
+
+/**
+ * A SharedPool shared between threads, refilled by the factory of its
+ * product up to a limit.
+ */
+template <class T>
+class RuntimePool : public RuntimePoolBase
+{
+    public:
+        using Factory = std::function<std::unique_ptr<T>()>;
+        using Handle = typename SharedPool<T>::ptrType;
+
+        /**
+         * Constructor
+         * Creates the initial objects, a limit of zero lets the pool grow
+         * without bound.
+         */
+        RuntimePool(std::string name, Factory factory, size_t initial, size_t limit) :
+            RuntimePoolBase(std::move(name)),
+            m_factory(std::move(factory)),
+            m_limit(limit)
+        {
+            if (!m_factory)
+            {
+                throw std::invalid_argument("Factory must not be empty");
+            }
+            if (limit != 0 && initial > limit)
+            {
+                throw std::invalid_argument("Initial size of pool " + m_name + " exceeds its limit");
+            }
+            for (size_t i = 0; i < initial; i++)
+            {
+                m_pool.Add(Allocate());
+                m_capacity.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         * Take an object, the factory makes a new one when the pool is empty
+         * and below its limit. Returns an empty handle at the limit, the
+         * object returns to the pool when the handle is destroyed.
+         */
+        Handle Acquire()
+        {
+            m_acquires.fetch_add(1, std::memory_order_relaxed);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_pool.Empty())
+                {
+                    m_inUse.fetch_add(1, std::memory_order_relaxed);
+                    return Wrap(m_pool.Acquire().release());
+                }
+                if (m_limit != 0 && m_capacity.load(std::memory_order_relaxed) >= m_limit)
+                {
+                    m_exhausted.fetch_add(1, std::memory_order_relaxed);
+                    return Handle(nullptr, [](T*) {});
+                }
+                // Reserve the slot, the factory runs without the lock
+                m_capacity.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            std::unique_ptr<T> object;
+            try
+            {
+                object = Allocate();
+            }
+            catch (...)
+            {
+                m_capacity.fetch_sub(1, std::memory_order_relaxed);
+                throw;
+            }
+            m_inUse.fetch_add(1, std::memory_order_relaxed);
+            return Wrap(object.release());
+        }
+
+        /**
+         * Make an object the pool does not own with the same factory.
+         */
+        std::unique_ptr<T> Create()
+        {
+            return Allocate();
+        }
+
+        size_t Limit() const
+        {
+            return m_limit;
+        }
+
+    private:
+        std::unique_ptr<T> Allocate()
+        {
+            std::unique_ptr<T> object = m_factory();
+            if (object == nullptr)
+            {
+                throw std::logic_error("Factory of pool " + m_name + " returned null");
+            }
+            m_allocations.fetch_add(1, std::memory_order_relaxed);
+            return object;
+        }
+
+        Handle Wrap(T* object)
+        {
+            return Handle(object, [this](T* released)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_pool.Add(std::unique_ptr<T>(released));
+                m_inUse.fetch_sub(1, std::memory_order_relaxed);
+            });
+        }
+
+        std::mutex m_mutex;
+        SharedPool<T> m_pool;
+        Factory m_factory;
+        size_t m_limit;
+};
+
+
+class Runtime;
+
+/**
+ * Worker thread of the runtime, times the tasks it runs.
+ */
+class RuntimeWorker : public ThreadObject
+{
+    public:
+        explicit RuntimeWorker(Runtime& runtime) :
+            m_runtime(runtime) {}
+
+        /**
+         * Time spent in tasks, including the one running now.
+         */
+        uint64_t BusyNanoseconds(uint64_t now) const
+        {
+            const uint64_t since = m_taskStarted.load(std::memory_order_relaxed);
+            const uint64_t busy = m_busyNanoseconds.load(std::memory_order_relaxed);
+            return since != 0 && now > since ? busy + (now - since) : busy;
+        }
+
+    protected:
+        void Run() override;
+
+    private:
+        friend class Runtime;
+
+        Runtime& m_runtime;
+        std::atomic<uint64_t> m_busyNanoseconds{0};
+        // Zero while idle
+        std::atomic<uint64_t> m_taskStarted{0};
+};
+
+
+class Runtime
+{
+    public:
+        /**
+         * Constructor
+         * Creates the workers, they start with Start().
+         */
+        explicit Runtime(size_t threads = std::max(1u, std::thread::hardware_concurrency())) :
+            m_created(RuntimeClock())
+        {
+            if (threads == 0)
+            {
+                throw std::invalid_argument("Runtime needs at least one thread");
+            }
+            for (size_t i = 0; i < threads; i++)
+            {
+                m_workers.push_back(std::make_unique<RuntimeWorker>(*this));
+            }
+        }
+
+        ~Runtime()
+        {
+            Stop();
+        }
+
+        // Delete copy constructor and copy-assignment
+        Runtime(Runtime const&) = delete;
+        Runtime& operator=(Runtime const&) = delete;
+
+        /**
+         * Add a pool of objects made by the factory.
+         */
+        template <class T>
+        RuntimePool<T>& AddPool(const std::string& name, typename RuntimePool<T>::Factory factory, size_t initial = 0, size_t limit = 0)
+        {
+            CheckConfiguring("Pools");
+            if (FindPool(name) != nullptr)
+            {
+                throw std::invalid_argument("Pool " + name + " already exists");
+            }
+            auto pool = std::make_unique<RuntimePool<T> >(name, std::move(factory), initial, limit);
+            RuntimePool<T>& added = *pool;
+            m_pools.push_back(std::move(pool));
+            return added;
+        }
+
+        template <class T>
+        RuntimePool<T>& Pool(const std::string& name) const
+        {
+            RuntimePoolBase* pool = FindPool(name);
+            if (pool == nullptr)
+            {
+                throw std::invalid_argument("No pool named " + name);
+            }
+            auto* typed = dynamic_cast<RuntimePool<T>*>(pool);
+            if (typed == nullptr)
+            {
+                throw std::invalid_argument("Pool " + name + " holds another type");
+            }
+            return *typed;
+        }
+
+        /**
+         * Provide the service injected into everything requiring its type.
+         */
+        template <class T>
+        void Provide(std::shared_ptr<T> service)
+        {
+            CheckConfiguring("Services");
+            if (service == nullptr)
+            {
+                throw std::invalid_argument("Service must not be null");
+            }
+            m_services[std::type_index(typeid(T))] = std::move(service);
+        }
+
+        template <class T>
+        T& Require() const
+        {
+            auto found = m_services.find(std::type_index(typeid(T)));
+            if (found == m_services.end())
+            {
+                throw std::logic_error(std::string("No service provided for ") + typeid(T).name());
+            }
+            return *static_cast<T*>(found->second.get());
+        }
+
+        template <class T>
+        bool Has() const
+        {
+            return m_services.count(std::type_index(typeid(T))) != 0;
+        }
+
+        size_t Threads() const
+        {
+            return m_workers.size();
+        }
+
+        /**
+         * Start the workers, tasks submitted earlier run now.
+         */
+        void Start()
+        {
+            CheckConfiguring("Start");
+            m_started.store(RuntimeClock(), std::memory_order_relaxed);
+            m_state.store(Running, std::memory_order_release);
+            for (std::unique_ptr<RuntimeWorker>& worker : m_workers)
+            {
+                worker->Start();
+            }
+        }
+
+        /**
+         * Run the queued tasks and join the workers, tasks never started are
+         * dropped.
+         */
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_queueMutex);
+                if (m_stopping)
+                {
+                    return;
+                }
+                m_stopping = true;
+            }
+            m_ready.notify_all();
+
+            if (m_state.load(std::memory_order_acquire) == Running)
+            {
+                for (std::unique_ptr<RuntimeWorker>& worker : m_workers)
+                {
+                    worker->Join();
+                }
+                m_stopped.store(RuntimeClock(), std::memory_order_relaxed);
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(m_queueMutex);
+                m_queued.fetch_sub(m_tasks.size(), std::memory_order_relaxed);
+                m_tasks.clear();
+                m_pending = 0;
+            }
+            m_state.store(Stopped, std::memory_order_release);
+        }
+
+        template <class F>
+        void Submit(F&& task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_queueMutex);
+                if (m_stopping)
+                {
+                    throw std::logic_error("Runtime is stopped");
+                }
+                m_tasks.emplace_back(std::forward<F>(task));
+                m_pending++;
+                m_submitted.fetch_add(1, std::memory_order_relaxed);
+                m_queued.fetch_add(1, std::memory_order_relaxed);
+            }
+            m_ready.notify_one();
+        }
+
+        /**
+         * Wait until every submitted task has finished.
+         */
+        void Wait()
+        {
+            if (m_state.load(std::memory_order_acquire) != Running)
+            {
+                throw std::logic_error("Runtime is not running");
+            }
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_idle.wait(lock, [&]() { return m_pending == 0; });
+        }
+
+        /**
+         * Snapshot of every subsystem, read without a lock.
+         */
+        RuntimeMetrics Metrics() const
+        {
+            const uint64_t now = RuntimeClock();
+            RuntimeMetrics metrics;
+            metrics.m_uptimeNanoseconds = now - m_created;
+
+            metrics.m_pools.reserve(m_pools.size());
+            for (const std::unique_ptr<RuntimePoolBase>& pool : m_pools)
+            {
+                metrics.m_pools.push_back(pool->Metrics());
+            }
+
+            ThreadMetrics& threads = metrics.m_threads;
+            threads.m_threads = m_workers.size();
+            threads.m_submitted = m_submitted.load(std::memory_order_relaxed);
+            threads.m_completed = m_completed.load(std::memory_order_relaxed);
+            threads.m_failed = m_failed.load(std::memory_order_relaxed);
+            threads.m_queued = m_queued.load(std::memory_order_relaxed);
+            for (const std::unique_ptr<RuntimeWorker>& worker : m_workers)
+            {
+                threads.m_busyNanoseconds += worker->BusyNanoseconds(now);
+            }
+
+            const uint64_t started = m_started.load(std::memory_order_relaxed);
+            const uint64_t stopped = m_stopped.load(std::memory_order_relaxed);
+            if (started != 0)
+            {
+                threads.m_runningNanoseconds = (stopped != 0 ? stopped : now) - started;
+            }
+            return metrics;
+        }
+
+        /**
+         * The snapshot in the Prometheus text exposition format.
+         */
+        std::string PrometheusText() const
+        {
+            const RuntimeMetrics metrics = Metrics();
+            std::ostringstream out;
+            out << std::setprecision(12);
+
+            auto family = [&](const char* name, const char* type, const char* help)
+            {
+                out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+            };
+            auto pools = [&](const char* name, const char* type, const char* help, auto value)
+            {
+                family(name, type, help);
+                for (const PoolMetrics& pool : metrics.m_pools)
+                {
+                    out << name << "{pool=\"" << PrometheusLabel(pool.m_name) << "\"} " << value(pool) << '\n';
+                }
+            };
+            auto single = [&](const char* name, const char* type, const char* help, auto value)
+            {
+                family(name, type, help);
+                out << name << ' ' << value << '\n';
+            };
+
+            const ThreadMetrics& threads = metrics.m_threads;
+            single("runtime_uptime_seconds", "gauge", "Seconds since the runtime was created.", metrics.m_uptimeNanoseconds / 1e9);
+
+            pools("runtime_pool_capacity", "gauge", "Objects owned by the pool.", [](const PoolMetrics& pool) { return pool.m_capacity; });
+            pools("runtime_pool_in_use", "gauge", "Objects acquired and not yet released.", [](const PoolMetrics& pool) { return pool.m_inUse; });
+            pools("runtime_pool_occupancy_ratio", "gauge", "Objects in use over capacity.", [](const PoolMetrics& pool) { return pool.Occupancy(); });
+            pools("runtime_pool_acquires_total", "counter", "Acquires from the pool.", [](const PoolMetrics& pool) { return pool.m_acquires; });
+            pools("runtime_pool_allocations_total", "counter", "Objects made by the factory of the pool.", [](const PoolMetrics& pool) { return pool.m_allocations; });
+            pools("runtime_pool_exhausted_total", "counter", "Acquires refused at the pool limit.", [](const PoolMetrics& pool) { return pool.m_exhausted; });
+
+            single("runtime_allocations_total", "counter", "Objects made by every factory.", metrics.Allocations());
+            single("runtime_allocations_per_second", "gauge", "Allocations per second since the runtime was created.", metrics.AllocationRate());
+
+            single("runtime_threads", "gauge", "Worker threads.", threads.m_threads);
+            single("runtime_thread_busy_seconds_total", "counter", "Seconds the workers spent running tasks.", threads.m_busyNanoseconds / 1e9);
+            single("runtime_thread_utilisation_ratio", "gauge", "Share of worker time since start spent running tasks.", threads.Utilisation());
+            single("runtime_tasks_submitted_total", "counter", "Tasks submitted.", threads.m_submitted);
+            single("runtime_tasks_completed_total", "counter", "Tasks finished, including failed ones.", threads.m_completed);
+            single("runtime_tasks_failed_total", "counter", "Tasks which threw an exception.", threads.m_failed);
+            single("runtime_tasks_queued", "gauge", "Tasks waiting for a worker.", threads.m_queued);
+            return out.str();
+        }
+
+        /**
+         * Write the Prometheus text to the file, replaced in one rename so a
+         * scraper never reads half of it.
+         */
+        void DumpPrometheus(const std::string& path) const
+        {
+            const std::string text = PrometheusText();
+            const std::string temporary = path + ".tmp";
+
+            std::FILE* file = std::fopen(temporary.c_str(), "w");
+            if (file == nullptr)
+            {
+                throw std::system_error(errno, std::generic_category(), "Cannot open " + temporary);
+            }
+            const bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+            const int error = errno;
+            if (std::fclose(file) != 0 || !written)
+            {
+                std::remove(temporary.c_str());
+                throw std::system_error(written ? errno : error, std::generic_category(), "Cannot write " + temporary);
+            }
+            if (std::rename(temporary.c_str(), path.c_str()) != 0)
+            {
+                const int renameError = errno;
+                std::remove(temporary.c_str());
+                throw std::system_error(renameError, std::generic_category(), "Cannot replace " + path);
+            }
+        }
+
+    private:
+        friend class RuntimeWorker;
+
+        enum State
+        {
+            Configuring,
+            Running,
+            Stopped
+        };
+
+        static std::string PrometheusLabel(const std::string& value)
+        {
+            std::string escaped;
+            for (char c : value)
+            {
+                switch (c)
+                {
+                    case '\\': escaped += "\\\\"; break;
+                    case '"': escaped += "\\\""; break;
+                    case '\n': escaped += "\\n"; break;
+                    default: escaped += c;
+                }
+            }
+            return escaped;
+        }
+
+        void CheckConfiguring(const char* what) const
+        {
+            if (m_state.load(std::memory_order_acquire) != Configuring)
+            {
+                throw std::logic_error(std::string(what) + " must be set up before the runtime starts");
+            }
+        }
+
+        RuntimePoolBase* FindPool(const std::string& name) const
+        {
+            for (const std::unique_ptr<RuntimePoolBase>& pool : m_pools)
+            {
+                if (pool->Name() == name)
+                {
+                    return pool.get();
+                }
+            }
+            return nullptr;
+        }
+
+        void Work(RuntimeWorker& worker)
+        {
+            while (true)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(m_queueMutex);
+                    m_ready.wait(lock, [&]() { return m_stopping || !m_tasks.empty(); });
+                    if (m_tasks.empty())
+                    {
+                        return;
+                    }
+                    task = std::move(m_tasks.front());
+                    m_tasks.pop_front();
+                    m_queued.fetch_sub(1, std::memory_order_relaxed);
+                }
+
+                const uint64_t start = RuntimeClock();
+                worker.m_taskStarted.store(start, std::memory_order_relaxed);
+                try
+                {
+                    task();
+                }
+                catch (...)
+                {
+                    m_failed.fetch_add(1, std::memory_order_relaxed);
+                }
+                // Cleared first, a snapshot in between misses the task rather than counting it twice
+                worker.m_taskStarted.store(0, std::memory_order_relaxed);
+                worker.m_busyNanoseconds.fetch_add(RuntimeClock() - start, std::memory_order_relaxed);
+                m_completed.fetch_add(1, std::memory_order_relaxed);
+
+                std::lock_guard<std::mutex> lock(m_queueMutex);
+                if (--m_pending == 0)
+                {
+                    m_idle.notify_all();
+                }
+            }
+        }
+
+        const uint64_t m_created;
+        std::atomic<State> m_state{Configuring};
+        std::atomic<uint64_t> m_started{0};
+        std::atomic<uint64_t> m_stopped{0};
+
+        // Fixed once the runtime starts
+        std::vector<std::unique_ptr<RuntimePoolBase> > m_pools;
+        std::unordered_map<std::type_index, std::shared_ptr<void> > m_services;
+        std::vector<std::unique_ptr<RuntimeWorker> > m_workers;
+
+        std::mutex m_queueMutex;
+        std::condition_variable m_ready;
+        std::condition_variable m_idle;
+        std::deque<std::function<void()> > m_tasks;
+        size_t m_pending = 0;
+        bool m_stopping = false;
+
+        std::atomic<uint64_t> m_submitted{0};
+        std::atomic<uint64_t> m_completed{0};
+        std::atomic<uint64_t> m_failed{0};
+        std::atomic<uint64_t> m_queued{0};
+};
+
+
+inline void RuntimeWorker::Run()
+{
+    m_runtime.Work(*this);
+}
+
+
+#endif // __RUNTIME_H_
@@ -0,0 +1,188 @@
+/**
+* @file flyweight-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Flyweight benchmark
+*
+* Many objects naming one of a few thousand distinct parts. Keeps a private
+* std::string copy per object, interns through the classic factory, an
+* unordered_set behind a mutex, and through FlyweightFactory, then has
+* several threads intern the same names concurrently. Reports the time per
+* object and the memory the interned names save.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread flyweight-benchmark.cpp -o flyweight-benchmark
+* ./flyweight-benchmark [objects] [distinct] [threads]
+*
+*/
+
+#include "flyweight.h"
+#include "../../benchmark.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+
+/**
+ * Classic factory, every lookup takes the lock.
+ */
+class LockedFactory
+{
+    public:
+        const std::string* Intern(const std::string& value)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return &*m_values.insert(value).first;
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::unordered_set<std::string> m_values;
+};
+
+
+template <class F>
+void Concurrently(size_t threads, F&& function)
+{
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back(function, t);
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 20;
+    const size_t distinct = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10000;
+    const size_t threads = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 4;
+
+    std::cout << "Objects: " << count << ", distinct: " << distinct << ", threads: " << threads
+              << ", cores: " << std::thread::hardware_concurrency() << "\n";
+
+    std::vector<std::string> parts(distinct);
+    for (size_t i = 0; i < distinct; i++)
+    {
+        parts[i] = "ConcreteProduct/Assembly/Part-" + std::to_string(i * 7919);
+    }
+
+    std::vector<uint32_t> names(count);
+    uint64_t state = 42;
+    for (uint32_t& name : names)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        name = static_cast<uint32_t>((state >> 33) % distinct);
+    }
+
+    std::vector<std::string> copies;
+    copies.reserve(count);
+    Measure("  private copies   ", count, [&]()
+    {
+        uint64_t checksum = 0;
+        for (uint32_t name : names)
+        {
+            copies.push_back(parts[name]);
+            checksum += copies.back().size();
+        }
+        return checksum;
+    }, "object");
+
+    LockedFactory locked;
+    std::vector<const std::string*> pointers;
+    pointers.reserve(count);
+    Measure("  locked factory   ", count, [&]()
+    {
+        uint64_t checksum = 0;
+        for (uint32_t name : names)
+        {
+            pointers.push_back(locked.Intern(parts[name]));
+            checksum += pointers.back()->size();
+        }
+        return checksum;
+    }, "object");
+
+    FlyweightFactory<std::string> factory;
+    std::vector<FlyweightFactory<std::string>::Handle> handles;
+    handles.reserve(count);
+    Measure("  flyweight        ", count, [&]()
+    {
+        uint64_t checksum = 0;
+        for (uint32_t name : names)
+        {
+            handles.push_back(factory.Intern(parts[name]));
+            checksum += handles.back()->size();
+        }
+        return checksum;
+    }, "object");
+
+    FlyweightStats stats = factory.Stats();
+    std::cout << "  " << stats.m_entries << " entries for " << stats.m_handles << " objects, stored "
+              << stats.m_storedBytes + stats.m_tableBytes << " bytes instead of " << stats.m_requestedBytes
+              << ", saved " << stats.SavedBytes() << " bytes\n";
+
+    {
+        FlyweightFactory<std::string, FlyweightReclaim::RefCounted> counted;
+        std::vector<FlyweightFactory<std::string, FlyweightReclaim::RefCounted>::Handle> owned;
+        owned.reserve(count);
+        Measure("  flyweight counted", count, [&]()
+        {
+            uint64_t checksum = 0;
+            for (uint32_t name : names)
+            {
+                owned.push_back(counted.Intern(parts[name]));
+                checksum += owned.back()->size();
+            }
+            return checksum;
+        }, "object");
+        owned.clear();
+        std::cout << "  " << counted.Size() << " entries left after releasing every handle\n";
+    }
+
+    const size_t operations = count / threads * threads;
+    LockedFactory sharedLocked;
+    Measure("  locked threads   ", operations, [&]()
+    {
+        std::atomic<uint64_t> checksum{0};
+        Concurrently(threads, [&](size_t t)
+        {
+            uint64_t sum = 0;
+            for (size_t i = t; i < operations; i += threads)
+            {
+                sum += sharedLocked.Intern(parts[names[i]])->size();
+            }
+            checksum += sum;
+        });
+        return checksum.load();
+    }, "object");
+
+    FlyweightFactory<std::string> shared;
+    Measure("  flyweight threads", operations, [&]()
+    {
+        std::atomic<uint64_t> checksum{0};
+        Concurrently(threads, [&](size_t t)
+        {
+            uint64_t sum = 0;
+            for (size_t i = t; i < operations; i += threads)
+            {
+                sum += shared.Intern(parts[names[i]])->size();
+            }
+            checksum += sum;
+        });
+        return checksum.load();
+    }, "object");
+
+    return 0;
+}
@@ -0,0 +1,547 @@
+/**
+* @file flyweight.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Flyweight structural pattern with a concurrent interning table
+*
+* The Problem:
+*
+* Many objects carry the same immutable values, names, keys, settings,
+* each holding its own copy. The memory grows with the number of objects
+* rather than with the number of distinct values, and comparing two values
+* compares their contents.
+*
+* Solution:
+*
+* The factory interns values, every distinct value is stored once and
+* handed out as a Handle, a pointer sized reference which stays valid and
+* keeps pointing to the same address for as long as the value is interned.
+* Equal values yield equal handles, comparing handles compares pointers.
+*
+* The values are found through an open addressing hash table shared by all
+* threads:
+*
+*   * Lookups take no lock. A reader pins the epoch with an EpochGuard,
+*     probes the table and compares the stored values.
+*
+*   * Inserts and removals take the writer lock, probe again and publish a
+*     slot with a single atomic store. When the table grows a new one is
+*     built and published, the old table is retired through the epoch
+*     domain once no reader can still be probing it.
+*
+* Entries are kept forever with FlyweightReclaim::Never, handles are then
+* plain pointers. With FlyweightReclaim::RefCounted every handle holds a
+* reference and the entry is removed and retired when the last one goes.
+*
+* Stats() reports the bytes the handles would take as private copies
+* against the bytes actually stored, per FlyweightFootprint<T>, which can
+* be specialised for types owning heap memory.
+*
+* Usage:
+*
+* FlyweightFactory<std::string> names;
+* FlyweightFactory<std::string>::Handle a = names.Intern("SpecializedProductA1");
+* FlyweightFactory<std::string>::Handle b = names.Intern(std::string("SpecializedProductA1"));
+* a == b;       // true, same entry
+* a->size();    // access the shared value
+* names.Stats().SavedBytes();
+*
+* Notes:
+*
+* Interned values are immutable. The factory must outlive its handles and
+* its epoch domain must outlive the factory. Hash values are stored with the
+* entries, the hash function is called once per Intern().
+*
+* References:
+* https://en.wikipedia.org/wiki/Flyweight_pattern
+* https://en.wikipedia.org/wiki/String_interning
+*
+*/
+
+#ifndef __FLYWEIGHT_H_
+#define __FLYWEIGHT_H_
+
+
+#include "../../concurrency-patterns/epoch-reclamation.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+enum class FlyweightReclaim
+{
+    Never,
+    RefCounted
+};
+
+/**
+ * Bytes a value takes, including memory it owns.
+ */
+template <class T>
+struct FlyweightFootprint
+{
+    size_t operator()(const T&) const
+    {
+        return sizeof(T);
+    }
+};
+
+template <class C, class Traits, class Allocator>
+struct FlyweightFootprint<std::basic_string<C, Traits, Allocator> >
+{
+    size_t operator()(const std::basic_string<C, Traits, Allocator>& value) const
+    {
+        // Short strings live inside the object
+        const char* data = reinterpret_cast<const char*>(value.data());
+        const char* object = reinterpret_cast<const char*>(&value);
+        bool inlined = data >= object && data < object + sizeof(value);
+        return sizeof(value) + (inlined ? 0 : (value.capacity() + 1) * sizeof(C));
+    }
+};
+
+template <class T, class Allocator>
+struct FlyweightFootprint<std::vector<T, Allocator> >
+{
+    size_t operator()(const std::vector<T, Allocator>& value) const
+    {
+        return sizeof(value) + value.capacity() * sizeof(T);
+    }
+};
+
+/**
+ * Snapshot of the memory use of a factory
+ */
+struct FlyweightStats
+{
+    // Distinct values stored
+    uint64_t m_entries = 0;
+
+    // Values requested, Intern() calls or live handles when reference counted
+    uint64_t m_handles = 0;
+
+    // Footprint of the stored values and their entries
+    uint64_t m_storedBytes = 0;
+
+    // Footprint of the requested values had each been a private copy
+    uint64_t m_requestedBytes = 0;
+
+    // Size of the hash table
+    uint64_t m_tableBytes = 0;
+
+    int64_t SavedBytes() const
+    {
+        return static_cast<int64_t>(m_requestedBytes) - static_cast<int64_t>(m_storedBytes + m_tableBytes);
+    }
+};
+
+
+template <class T,
+          FlyweightReclaim Reclaim = FlyweightReclaim::Never,
+          class Hash = std::hash<T>,
+          class Equal = std::equal_to<T> >
+class FlyweightFactory
+{
+    private:
+        struct Entry;
+
+    public:
+
+        /**
+         * Reference to an interned value, equal values have equal handles.
+         */
+        class Handle
+        {
+            public:
+                Handle() = default;
+
+                Handle(const Handle& other) :
+                    m_entry(other.m_entry)
+                {
+                    if constexpr (Reclaim == FlyweightReclaim::RefCounted)
+                    {
+                        if (m_entry != nullptr)
+                        {
+                            m_entry->m_refs.fetch_add(1, std::memory_order_relaxed);
+                            m_entry->m_factory->Count(1, m_entry->m_footprint);
+                        }
+                    }
+                }
+
+                Handle(Handle&& other) noexcept :
+                    m_entry(std::exchange(other.m_entry, nullptr)) {}
+
+                Handle& operator=(Handle other) noexcept
+                {
+                    std::swap(m_entry, other.m_entry);
+                    return *this;
+                }
+
+                ~Handle()
+                {
+                    if constexpr (Reclaim == FlyweightReclaim::RefCounted)
+                    {
+                        if (m_entry != nullptr)
+                        {
+                            m_entry->m_factory->Release(m_entry);
+                        }
+                    }
+                }
+
+                const T& operator*() const
+                {
+                    return m_entry->m_value;
+                }
+
+                const T* operator->() const
+                {
+                    return &m_entry->m_value;
+                }
+
+                const T& Get() const
+                {
+                    return m_entry->m_value;
+                }
+
+                explicit operator bool() const
+                {
+                    return m_entry != nullptr;
+                }
+
+                bool operator==(const Handle& other) const
+                {
+                    return m_entry == other.m_entry;
+                }
+
+                // Precomputed hash of the value, for hashing handles
+                size_t HashValue() const
+                {
+                    return m_entry != nullptr ? m_entry->m_hash : 0;
+                }
+
+            private:
+                friend class FlyweightFactory;
+
+                // Takes over a reference already counted
+                explicit Handle(Entry* entry) :
+                    m_entry(entry) {}
+
+                Entry* m_entry = nullptr;
+        };
+
+        explicit FlyweightFactory(size_t capacity = 64, EpochDomain& domain = EpochDomain::Global()) :
+            m_domain(domain)
+        {
+            size_t slots = 16;
+            while (slots * MaxLoad < capacity * 100)
+            {
+                slots *= 2;
+            }
+            m_table.store(new Table(slots), std::memory_order_relaxed);
+        }
+
+        /**
+         * Destructor
+         * No handle may outlive the factory and no thread may still be
+         * interning.
+         */
+        ~FlyweightFactory()
+        {
+            Table* table = m_table.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < table->m_size; i++)
+            {
+                Entry* entry = table->m_slots[i].load(std::memory_order_relaxed);
+                if (entry != nullptr && entry != Tombstone())
+                {
+                    delete entry;
+                }
+            }
+            delete table;
+        }
+
+        // Delete copy constructor and copy-assignment
+        FlyweightFactory(FlyweightFactory const&) = delete;
+        FlyweightFactory& operator=(FlyweightFactory const&) = delete;
+
+        Handle Intern(const T& value)
+        {
+            return InternValue(value);
+        }
+
+        Handle Intern(T&& value)
+        {
+            return InternValue(std::move(value));
+        }
+
+        // Number of distinct values stored
+        size_t Size() const
+        {
+            std::lock_guard<std::mutex> lock(m_writeMutex);
+            return m_live;
+        }
+
+        FlyweightStats Stats() const
+        {
+            FlyweightStats stats;
+            for (const Stripe& stripe : m_stripes)
+            {
+                stats.m_handles += stripe.m_handles.load(std::memory_order_relaxed);
+                stats.m_requestedBytes += stripe.m_bytes.load(std::memory_order_relaxed);
+            }
+
+            std::lock_guard<std::mutex> lock(m_writeMutex);
+            stats.m_entries = m_live;
+            stats.m_storedBytes = m_storedBytes;
+            stats.m_tableBytes = m_table.load(std::memory_order_relaxed)->m_size * sizeof(std::atomic<Entry*>);
+            return stats;
+        }
+
+    private:
+
+        // Maximum percentage of used slots, tombstones included
+        static constexpr size_t MaxLoad = 70;
+
+        // Counter stripes, threads update their own to avoid sharing a line
+        static constexpr size_t StripeCount = 16;
+
+        struct Entry
+        {
+            template <class V>
+            Entry(V&& value, size_t hash, FlyweightFactory* factory) :
+                m_value(std::forward<V>(value)),
+                m_hash(hash),
+                m_footprint(FlyweightFootprint<T>()(m_value)),
+                m_factory(factory) {}
+
+            const T m_value;
+            const size_t m_hash;
+            const size_t m_footprint;
+            FlyweightFactory* const m_factory;
+
+            // Live handles, only used when reference counted, zero is final
+            std::atomic<uint32_t> m_refs{1};
+        };
+
+        struct Table
+        {
+            explicit Table(size_t size) :
+                m_size(size), m_slots(new std::atomic<Entry*>[size])
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    m_slots[i].store(nullptr, std::memory_order_relaxed);
+                }
+            }
+
+            const size_t m_size;
+            std::unique_ptr<std::atomic<Entry*>[]> m_slots;
+        };
+
+        struct alignas(64) Stripe
+        {
+            std::atomic<int64_t> m_handles{0};
+            std::atomic<int64_t> m_bytes{0};
+        };
+
+        // Marks a slot whose entry was removed, probing continues past it
+        static Entry* Tombstone()
+        {
+            static Entry* const tombstone = reinterpret_cast<Entry*>(alignof(Entry));
+            return tombstone;
+        }
+
+        void Count(int64_t handles, size_t footprint)
+        {
+            static std::atomic<size_t> s_nextThread{0};
+            static thread_local size_t t_stripe = s_nextThread.fetch_add(1, std::memory_order_relaxed) % StripeCount;
+
+            Stripe& stripe = m_stripes[t_stripe];
+            stripe.m_handles.fetch_add(handles, std::memory_order_relaxed);
+            stripe.m_bytes.fetch_add(handles * static_cast<int64_t>(footprint), std::memory_order_relaxed);
+        }
+
+        // Entry holding the value, or nullptr, the caller must be pinned or hold the writer lock
+        Entry* Find(const Table& table, const T& value, size_t hash) const
+        {
+            const size_t mask = table.m_size - 1;
+            for (size_t i = 0, slot = hash & mask; i < table.m_size; i++, slot = (slot + 1) & mask)
+            {
+                Entry* entry = table.m_slots[slot].load(std::memory_order_acquire);
+                if (entry == nullptr)
+                {
+                    return nullptr;
+                }
+                if (entry != Tombstone() && entry->m_hash == hash && m_equal(entry->m_value, value))
+                {
+                    // A dying entry is not found, it is about to be removed
+                    if (Reclaim == FlyweightReclaim::Never || entry->m_refs.load(std::memory_order_relaxed) != 0)
+                    {
+                        return entry;
+                    }
+                }
+            }
+            return nullptr;
+        }
+
+        // Take a reference unless the last one is already gone
+        static bool Acquire(Entry* entry)
+        {
+            if constexpr (Reclaim == FlyweightReclaim::RefCounted)
+            {
+                uint32_t refs = entry->m_refs.load(std::memory_order_relaxed);
+                while (refs != 0)
+                {
+                    if (entry->m_refs.compare_exchange_weak(refs, refs + 1, std::memory_order_relaxed))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            return true;
+        }
+
+        template <class V>
+        Handle InternValue(V&& value)
+        {
+            const size_t hash = m_hash(value);
+
+            // Lock free path, the value is already interned
+            {
+                EpochGuard guard(m_domain);
+                Entry* entry = Find(*m_table.load(std::memory_order_acquire), value, hash);
+                if (entry != nullptr && Acquire(entry))
+                {
+                    Count(1, entry->m_footprint);
+                    return Handle(entry);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(m_writeMutex);
+            Table* table = m_table.load(std::memory_order_relaxed);
+            Entry* entry = Find(*table, value, hash);
+            if (entry != nullptr && Acquire(entry))
+            {
+                Count(1, entry->m_footprint);
+                return Handle(entry);
+            }
+
+            if ((m_used + 1) * 100 > table->m_size * MaxLoad)
+            {
+                table = Rebuild();
+            }
+
+            entry = new Entry(std::forward<V>(value), hash, this);
+            const size_t mask = table->m_size - 1;
+            size_t slot = hash & mask;
+            for (;;)
+            {
+                Entry* current = table->m_slots[slot].load(std::memory_order_relaxed);
+                if (current == nullptr || current == Tombstone())
+                {
+                    m_used += current == nullptr ? 1 : 0;
+                    break;
+                }
+                slot = (slot + 1) & mask;
+            }
+            table->m_slots[slot].store(entry, std::memory_order_release);
+
+            m_live++;
+            m_storedBytes += sizeof(Entry) - sizeof(T) + entry->m_footprint;
+            Count(1, entry->m_footprint);
+            return Handle(entry);
+        }
+
+        /**
+         * Copy the live entries into a table sized for twice their number
+         * and publish it, dropping the tombstones. Writer lock held.
+         */
+        Table* Rebuild()
+        {
+            Table* old = m_table.load(std::memory_order_relaxed);
+            size_t size = 16;
+            while (size * MaxLoad < (m_live + 1) * 2 * 100)
+            {
+                size *= 2;
+            }
+
+            Table* table = new Table(size);
+            const size_t mask = size - 1;
+            for (size_t i = 0; i < old->m_size; i++)
+            {
+                Entry* entry = old->m_slots[i].load(std::memory_order_relaxed);
+                if (entry == nullptr || entry == Tombstone())
+                {
+                    continue;
+                }
+                size_t slot = entry->m_hash & mask;
+                while (table->m_slots[slot].load(std::memory_order_relaxed) != nullptr)
+                {
+                    slot = (slot + 1) & mask;
+                }
+                table->m_slots[slot].store(entry, std::memory_order_relaxed);
+            }
+
+            m_used = 0;
+            for (size_t i = 0; i < size; i++)
+            {
+                m_used += table->m_slots[i].load(std::memory_order_relaxed) != nullptr ? 1 : 0;
+            }
+
+            m_table.store(table, std::memory_order_release);
+            m_domain.Retire(old);
+            return table;
+        }
+
+        /**
+         * Drop a reference, the last one removes the entry from the table.
+         */
+        void Release(Entry* entry)
+        {
+            Count(-1, entry->m_footprint);
+            if (entry->m_refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            {
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(m_writeMutex);
+            Table* table = m_table.load(std::memory_order_relaxed);
+            const size_t mask = table->m_size - 1;
+            for (size_t slot = entry->m_hash & mask; ; slot = (slot + 1) & mask)
+            {
+                if (table->m_slots[slot].load(std::memory_order_relaxed) == entry)
+                {
+                    table->m_slots[slot].store(Tombstone(), std::memory_order_release);
+                    break;
+                }
+            }
+
+            m_live--;
+            m_storedBytes -= sizeof(Entry) - sizeof(T) + entry->m_footprint;
+            m_domain.Retire(entry);
+        }
+
+        EpochDomain& m_domain;
+        std::atomic<Table*> m_table;
+        Hash m_hash;
+        Equal m_equal;
+
+        // Guards inserts, removals and the counters below
+        mutable std::mutex m_writeMutex;
+        size_t m_used = 0;
+        size_t m_live = 0;
+        size_t m_storedBytes = 0;
+
+        std::array<Stripe, StripeCount> m_stripes;
+};
+
+
+#endif // __FLYWEIGHT_H_
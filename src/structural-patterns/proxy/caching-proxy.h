@@ -0,0 +1,623 @@
+/**
+* @file caching-proxy.h
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Proxy structural pattern, caching
+*
+* The Problem:
+*
+* A service is slow or expensive to call, a remote store, a computation, a
+* dependency injected into its clients. Clients ask for the same keys over
+* and over, and when a popular key is missing every client asking for it
+* at that moment calls the service, a stampede exactly when it is least
+* able to cope.
+*
+* Solution:
+*
+* The proxy implements the same CacheBackend interface as the service and
+* stands in front of it, clients receive the proxy in place of the service
+* and cannot tell the difference except for the latency.
+*
+*   * The cache is split into shards by key hash, each with its own lock,
+*     index and eviction lists, threads only contend on the same shard.
+*
+*   * Entries expire after a time to live and are evicted by least recently
+*     used or by ARC, the adaptive replacement cache, which keeps recently
+*     and frequently used entries on separate lists and remembers evicted
+*     keys to balance the two, so a scan does not flush the hot entries.
+*
+*   * Concurrent misses for one key are coalesced into a single flight,
+*     the first caller loads the value from the service while the others
+*     wait for its result, the service is called once per key and miss.
+*
+* Usage:
+*
+* LocalBackend<int, std::string> backend([](const int& key) { return Render(key); });
+* CachingProxy<int, std::string> proxy(backend, {.m_capacity = 4096, .m_ttl = std::chrono::seconds(30)});
+* Client client(proxy);         // client only knows CacheBackend<int, std::string>
+* proxy.Stats().HitRate();
+*
+* Notes:
+*
+* Values are returned by copy, expensive values are better cached as
+* std::shared_ptr<const Value>. A failed load is not cached, its exception
+* is rethrown to every caller waiting on the flight. Invalidate() drops the
+* key and detaches a flight in progress so its result is not cached. The
+* capacity is divided evenly among the shards. The service must outlive
+* the proxy.
+*
+* References:
+* https://en.wikipedia.org/wiki/Proxy_pattern
+* https://en.wikipedia.org/wiki/Adaptive_replacement_cache
+* https://pkg.go.dev/golang.org/x/sync/singleflight
+*
+*/
+
+#ifndef __CACHING_PROXY_H_
+#define __CACHING_PROXY_H_
+
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Service interface shared by the real service and its proxy
+ */
+template <class Key, class Value>
+class CacheBackend
+{
+    public:
+        virtual Value Fetch(const Key& key) = 0;
+        virtual ~CacheBackend() = default;
+};
+
+/**
+ * In process stand-in for a remote service, computes values with a
+ * function after an optional delay and counts the calls.
+ */
+template <class Key, class Value>
+class LocalBackend : public CacheBackend<Key, Value>
+{
+    public:
+        explicit LocalBackend(std::function<Value(const Key&)> load, std::chrono::nanoseconds latency = {}) :
+            m_load(std::move(load)), m_latency(latency)
+        {
+            if (!m_load)
+            {
+                throw std::invalid_argument("Load function must not be empty");
+            }
+        }
+
+        Value Fetch(const Key& key) override
+        {
+            m_calls.fetch_add(1, std::memory_order_relaxed);
+            if (m_latency.count() > 0)
+            {
+                std::this_thread::sleep_for(m_latency);
+            }
+            return m_load(key);
+        }
+
+        uint64_t Calls() const
+        {
+            return m_calls.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::function<Value(const Key&)> m_load;
+        std::chrono::nanoseconds m_latency;
+        std::atomic<uint64_t> m_calls{0};
+};
+
+
+enum class CacheEviction
+{
+    LRU,
+    ARC
+};
+
+struct CacheOptions
+{
+    // Entries over all shards
+    size_t m_capacity = 1024;
+
+    size_t m_shards = 16;
+
+    // Time to live of an entry, zero never expires
+    std::chrono::nanoseconds m_ttl{0};
+
+    CacheEviction m_eviction = CacheEviction::LRU;
+};
+
+struct CacheStats
+{
+    // Fetches answered from the cache
+    uint64_t m_hits = 0;
+
+    // Fetches not answered from the cache, coalesced ones included
+    uint64_t m_misses = 0;
+
+    // Misses which waited for another caller's load
+    uint64_t m_coalesced = 0;
+
+    // Calls to the service and the failed ones among them
+    uint64_t m_loads = 0;
+    uint64_t m_failures = 0;
+
+    // Entries dropped to make room and entries found expired
+    uint64_t m_evictions = 0;
+    uint64_t m_expirations = 0;
+
+    // Time spent in the service
+    uint64_t m_loadNanoseconds = 0;
+    uint64_t m_maxLoadNanoseconds = 0;
+
+    uint64_t m_entries = 0;
+
+    double HitRate() const
+    {
+        uint64_t fetches = m_hits + m_misses;
+        return fetches != 0 ? static_cast<double>(m_hits) / fetches : 0;
+    }
+
+    double MeanLoadNanoseconds() const
+    {
+        return m_loads != 0 ? static_cast<double>(m_loadNanoseconds) / m_loads : 0;
+    }
+};
+
+
+template <class Key, class Value, class Hash = std::hash<Key>, class Equal = std::equal_to<Key> >
+class CachingProxy : public CacheBackend<Key, Value>
+{
+    public:
+
+        /**
+         * Constructor
+         * The service is not owned.
+         */
+        explicit CachingProxy(CacheBackend<Key, Value>& backend, const CacheOptions& options = {}) :
+            m_backend(backend),
+            m_ttl(options.m_ttl),
+            m_eviction(options.m_eviction),
+            m_shards(options.m_shards)
+        {
+            if (options.m_capacity == 0 || options.m_shards == 0)
+            {
+                throw std::invalid_argument("Capacity and shard count must be greater than zero");
+            }
+            if (&backend == this)
+            {
+                throw std::invalid_argument("Proxy must not front itself");
+            }
+
+            m_shardCapacity = (options.m_capacity + options.m_shards - 1) / options.m_shards;
+        }
+
+        // Delete copy constructor and copy-assignment
+        CachingProxy(CachingProxy const&) = delete;
+        CachingProxy& operator=(CachingProxy const&) = delete;
+
+        /**
+         * Value of the key, from the cache, from a load in progress or from
+         * the service.
+         */
+        Value Fetch(const Key& key) override
+        {
+            Shard& shard = ShardOf(key);
+            std::shared_ptr<Flight> flight;
+            {
+                std::unique_lock<std::mutex> lock(shard.m_mutex);
+                if (const Value* value = Lookup(shard, key))
+                {
+                    shard.m_stats.m_hits++;
+                    return *value;
+                }
+                shard.m_stats.m_misses++;
+
+                auto found = shard.m_flights.find(key);
+                if (found != shard.m_flights.end())
+                {
+                    shard.m_stats.m_coalesced++;
+                    std::shared_ptr<Flight> loading = found->second;
+                    loading->m_done.wait(lock, [&loading]() { return loading->m_ready; });
+                    if (loading->m_error)
+                    {
+                        std::rethrow_exception(loading->m_error);
+                    }
+                    return *loading->m_value;
+                }
+
+                flight = std::make_shared<Flight>();
+                shard.m_flights.emplace(key, flight);
+            }
+            return Load(shard, key, flight);
+        }
+
+        /**
+         * Drop the key, a load in progress completes for its callers but is
+         * not cached. Returns whether an entry was dropped.
+         */
+        bool Invalidate(const Key& key)
+        {
+            Shard& shard = ShardOf(key);
+            std::lock_guard<std::mutex> lock(shard.m_mutex);
+            Detach(shard, key);
+
+            auto found = shard.m_index.find(key);
+            if (found == shard.m_index.end())
+            {
+                return false;
+            }
+            bool resident = IsResident(found->second.m_list);
+            Erase(shard, found);
+            return resident;
+        }
+
+        void Clear()
+        {
+            for (Shard& shard : m_shards)
+            {
+                std::lock_guard<std::mutex> lock(shard.m_mutex);
+                for (std::pair<const Key, std::shared_ptr<Flight> >& flight : shard.m_flights)
+                {
+                    flight.second->m_detached = true;
+                }
+                shard.m_flights.clear();
+                shard.m_index.clear();
+                for (std::list<Node>& list : shard.m_lists)
+                {
+                    list.clear();
+                }
+                shard.m_target = 0;
+            }
+        }
+
+        // Cached entries
+        size_t Size() const
+        {
+            size_t size = 0;
+            for (const Shard& shard : m_shards)
+            {
+                std::lock_guard<std::mutex> lock(shard.m_mutex);
+                size += shard.m_lists[Recent].size() + shard.m_lists[Frequent].size();
+            }
+            return size;
+        }
+
+        CacheStats Stats() const
+        {
+            CacheStats stats;
+            for (const Shard& shard : m_shards)
+            {
+                std::lock_guard<std::mutex> lock(shard.m_mutex);
+                const CacheStats& local = shard.m_stats;
+                stats.m_hits += local.m_hits;
+                stats.m_misses += local.m_misses;
+                stats.m_coalesced += local.m_coalesced;
+                stats.m_loads += local.m_loads;
+                stats.m_failures += local.m_failures;
+                stats.m_evictions += local.m_evictions;
+                stats.m_expirations += local.m_expirations;
+                stats.m_loadNanoseconds += local.m_loadNanoseconds;
+                stats.m_maxLoadNanoseconds = std::max(stats.m_maxLoadNanoseconds, local.m_maxLoadNanoseconds);
+                stats.m_entries += shard.m_lists[Recent].size() + shard.m_lists[Frequent].size();
+            }
+            return stats;
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        /**
+         * Lists of a shard. LRU keeps every entry on Recent. ARC keeps
+         * entries seen once on Recent and entries seen again on Frequent,
+         * the ghost lists keep the keys recently evicted from each.
+         */
+        enum List : uint8_t
+        {
+            Recent,
+            Frequent,
+            RecentGhost,
+            FrequentGhost
+        };
+
+        struct Node
+        {
+            Key m_key;
+
+            // Empty on the ghost lists
+            std::optional<Value> m_value;
+            Clock::time_point m_expires;
+        };
+
+        struct Slot
+        {
+            List m_list;
+            typename std::list<Node>::iterator m_node;
+        };
+
+        struct Flight
+        {
+            std::condition_variable m_done;
+            bool m_ready = false;
+            bool m_detached = false;
+            std::optional<Value> m_value;
+            std::exception_ptr m_error;
+        };
+
+        struct alignas(64) Shard
+        {
+            mutable std::mutex m_mutex;
+            std::unordered_map<Key, Slot, Hash, Equal> m_index;
+            std::array<std::list<Node>, 4> m_lists;
+
+            // ARC target size of Recent
+            size_t m_target = 0;
+
+            std::unordered_map<Key, std::shared_ptr<Flight>, Hash, Equal> m_flights;
+            CacheStats m_stats;
+        };
+
+        using Index = typename std::unordered_map<Key, Slot, Hash, Equal>::iterator;
+
+        static bool IsResident(List list)
+        {
+            return list == Recent || list == Frequent;
+        }
+
+        Shard& ShardOf(const Key& key)
+        {
+            // Mix the hash so the shard does not pick the same bits as the index
+            uint64_t hash = static_cast<uint64_t>(m_hash(key)) * 0x9E3779B97F4A7C15ULL;
+            return m_shards[(hash >> 32) % m_shards.size()];
+        }
+
+        /**
+         * Call the service and publish the result to the cache and to the
+         * callers waiting on the flight.
+         */
+        Value Load(Shard& shard, const Key& key, const std::shared_ptr<Flight>& flight)
+        {
+            Clock::time_point start = Clock::now();
+            std::optional<Value> value;
+            std::exception_ptr error;
+            try
+            {
+                value.emplace(m_backend.Fetch(key));
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            Clock::time_point end = Clock::now();
+            uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+            {
+                std::lock_guard<std::mutex> lock(shard.m_mutex);
+                shard.m_stats.m_loads++;
+                shard.m_stats.m_loadNanoseconds += nanoseconds;
+                shard.m_stats.m_maxLoadNanoseconds = std::max(shard.m_stats.m_maxLoadNanoseconds, nanoseconds);
+
+                if (!flight->m_detached)
+                {
+                    shard.m_flights.erase(key);
+                    if (error)
+                    {
+                        shard.m_stats.m_failures++;
+                    }
+                    else
+                    {
+                        Insert(shard, key, *value, end + m_ttl);
+                    }
+                }
+                else if (error)
+                {
+                    shard.m_stats.m_failures++;
+                }
+
+                // Waiters hold the only other references, copy the value for them
+                if (flight.use_count() > 1)
+                {
+                    flight->m_value = value;
+                    flight->m_error = error;
+                }
+                flight->m_ready = true;
+                flight->m_done.notify_all();
+            }
+
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+            return std::move(*value);
+        }
+
+        void Detach(Shard& shard, const Key& key)
+        {
+            auto found = shard.m_flights.find(key);
+            if (found != shard.m_flights.end())
+            {
+                found->second->m_detached = true;
+                shard.m_flights.erase(found);
+            }
+        }
+
+        /**
+         * Cached value of the key or nullptr, counts the hit for eviction.
+         */
+        const Value* Lookup(Shard& shard, const Key& key)
+        {
+            auto found = shard.m_index.find(key);
+            if (found == shard.m_index.end() || !IsResident(found->second.m_list))
+            {
+                return nullptr;
+            }
+
+            Slot& slot = found->second;
+            if (m_ttl.count() > 0 && slot.m_node->m_expires <= Clock::now())
+            {
+                shard.m_stats.m_expirations++;
+                Erase(shard, found);
+                return nullptr;
+            }
+
+            List target = m_eviction == CacheEviction::ARC ? Frequent : Recent;
+            Move(shard, slot, target);
+            return &*slot.m_node->m_value;
+        }
+
+        void Insert(Shard& shard, const Key& key, const Value& value, Clock::time_point expires)
+        {
+            auto found = shard.m_index.find(key);
+            if (found != shard.m_index.end() && IsResident(found->second.m_list))
+            {
+                // Stored by a detached flight meanwhile, keep the newer value
+                Slot& slot = found->second;
+                slot.m_node->m_value = value;
+                slot.m_node->m_expires = expires;
+                Move(shard, slot, slot.m_list);
+                return;
+            }
+
+            if (m_eviction == CacheEviction::LRU)
+            {
+                std::list<Node>& recent = shard.m_lists[Recent];
+                if (recent.size() >= m_shardCapacity)
+                {
+                    shard.m_stats.m_evictions++;
+                    DropBack(shard, Recent);
+                }
+                recent.push_front(Node{key, value, expires});
+                shard.m_index.emplace(key, Slot{Recent, recent.begin()});
+                return;
+            }
+
+            const size_t capacity = m_shardCapacity;
+            std::array<std::list<Node>, 4>& lists = shard.m_lists;
+            if (found != shard.m_index.end())
+            {
+                // Evicted not long ago, grow the list it was evicted from
+                Slot& slot = found->second;
+                bool frequent = slot.m_list == FrequentGhost;
+                if (!frequent)
+                {
+                    size_t delta = std::max<size_t>(lists[FrequentGhost].size() / lists[RecentGhost].size(), 1);
+                    shard.m_target = std::min(capacity, shard.m_target + delta);
+                }
+                else
+                {
+                    size_t delta = std::max<size_t>(lists[RecentGhost].size() / lists[FrequentGhost].size(), 1);
+                    shard.m_target = shard.m_target > delta ? shard.m_target - delta : 0;
+                }
+                Replace(shard, frequent);
+
+                slot.m_node->m_value = value;
+                slot.m_node->m_expires = expires;
+                Move(shard, slot, Frequent);
+                return;
+            }
+
+            if (lists[Recent].size() + lists[RecentGhost].size() >= capacity)
+            {
+                if (lists[Recent].size() < capacity)
+                {
+                    DropBack(shard, RecentGhost);
+                    Replace(shard, false);
+                }
+                else
+                {
+                    shard.m_stats.m_evictions++;
+                    DropBack(shard, Recent);
+                }
+            }
+            else
+            {
+                size_t total = lists[Recent].size() + lists[Frequent].size() + lists[RecentGhost].size() + lists[FrequentGhost].size();
+                if (total >= capacity)
+                {
+                    if (total >= 2 * capacity && !lists[FrequentGhost].empty())
+                    {
+                        DropBack(shard, FrequentGhost);
+                    }
+                    Replace(shard, false);
+                }
+            }
+
+            lists[Recent].push_front(Node{key, value, expires});
+            shard.m_index.emplace(key, Slot{Recent, lists[Recent].begin()});
+        }
+
+        /**
+         * ARC replacement, when the cache is full move the least recently
+         * used entry of Recent or Frequent, whichever is over its target, to
+         * its ghost list.
+         */
+        void Replace(Shard& shard, bool frequentGhostHit)
+        {
+            std::array<std::list<Node>, 4>& lists = shard.m_lists;
+            if (lists[Recent].size() + lists[Frequent].size() < m_shardCapacity)
+            {
+                return;
+            }
+
+            size_t recent = lists[Recent].size();
+            List from = recent > 0 && (recent > shard.m_target || (frequentGhostHit && recent == shard.m_target)) ? Recent : Frequent;
+            if (lists[from].empty())
+            {
+                from = from == Recent ? Frequent : Recent;
+            }
+
+            Slot& slot = shard.m_index.find(lists[from].back().m_key)->second;
+            slot.m_node->m_value.reset();
+            Move(shard, slot, from == Recent ? RecentGhost : FrequentGhost);
+            shard.m_stats.m_evictions++;
+        }
+
+        // Move to the most recently used end of the list
+        static void Move(Shard& shard, Slot& slot, List list)
+        {
+            shard.m_lists[list].splice(shard.m_lists[list].begin(), shard.m_lists[slot.m_list], slot.m_node);
+            slot.m_list = list;
+        }
+
+        static void DropBack(Shard& shard, List list)
+        {
+            shard.m_index.erase(shard.m_lists[list].back().m_key);
+            shard.m_lists[list].pop_back();
+        }
+
+        static void Erase(Shard& shard, Index found)
+        {
+            shard.m_lists[found->second.m_list].erase(found->second.m_node);
+            shard.m_index.erase(found);
+        }
+
+        CacheBackend<Key, Value>& m_backend;
+        const std::chrono::nanoseconds m_ttl;
+        const CacheEviction m_eviction;
+        std::vector<Shard> m_shards;
+        size_t m_shardCapacity = 0;
+        Hash m_hash;
+};
+
+
+#endif // __CACHING_PROXY_H_
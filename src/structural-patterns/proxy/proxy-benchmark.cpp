@@ -0,0 +1,170 @@
+/**
+* @file proxy-benchmark.cpp
+* MIT License
+* Copyright (c) 2022-Today Kamil Rog
+*
+* Caching Proxy benchmark
+*
+* Several threads fetch keys with a skewed popularity from a LocalBackend
+* taking tens of microseconds per call, directly and through CachingProxy
+* with LRU and ARC eviction, reporting the time per fetch, the hit rate and
+* the calls reaching the service. Then a hot working set interleaved with
+* scans of keys used once shows the hit rate of both policies, and threads
+* missing the same key at once show the coalescing.
+*
+* Build:
+* g++ -std=c++20 -O2 -pthread proxy-benchmark.cpp -o proxy-benchmark
+* ./proxy-benchmark [fetches] [threads]
+*
+*/
+
+#include "caching-proxy.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using Backend = LocalBackend<uint64_t, uint64_t>;
+using Proxy = CachingProxy<uint64_t, uint64_t>;
+
+uint64_t Compute(const uint64_t& key)
+{
+    return key * 2654435761ULL;
+}
+
+/**
+ * Keys with popularity falling off as 1 / rank, rank 0 the most popular.
+ */
+std::vector<uint64_t> SkewedKeys(size_t count, size_t distinct, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::vector<uint64_t> keys(count);
+    for (uint64_t& key : keys)
+    {
+        key = static_cast<uint64_t>(std::pow(static_cast<double>(distinct), uniform(random))) - 1;
+    }
+    return keys;
+}
+
+template <class F>
+double Seconds(size_t threads, F&& function)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back(function, t);
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+void Report(const std::string& name, double seconds, size_t fetches, const Backend& backend, const CacheStats& stats)
+{
+    std::cout << name << ": " << (seconds * 1e9 / fetches) << " ns/fetch, hit rate " << stats.HitRate()
+              << ", service calls " << backend.Calls() << ", coalesced " << stats.m_coalesced
+              << ", mean load " << (stats.MeanLoadNanoseconds() / 1e3) << " us, max load "
+              << (stats.m_maxLoadNanoseconds / 1e3) << " us\n";
+}
+
+void Skewed(const std::string& name, size_t threads, const std::vector<std::vector<uint64_t> >& keys, const CacheOptions& options)
+{
+    Backend backend(Compute, std::chrono::microseconds(20));
+    Proxy proxy(backend, options);
+    std::atomic<uint64_t> checksum{0};
+    double seconds = Seconds(threads, [&](size_t t)
+    {
+        uint64_t sum = 0;
+        for (uint64_t key : keys[t])
+        {
+            sum += proxy.Fetch(key);
+        }
+        checksum += sum;
+    });
+    Report(name, seconds, threads * keys[0].size(), backend, proxy.Stats());
+}
+
+/**
+ * Hot keys fetched over and over while keys never seen again stream past.
+ */
+void Scan(const std::string& name, CacheEviction eviction)
+{
+    Backend backend(Compute);
+    Proxy proxy(backend, {.m_capacity = 1024, .m_shards = 4, .m_eviction = eviction});
+    std::mt19937 random(7);
+    uint64_t cold = 1 << 20;
+    for (size_t round = 0; round < 200; round++)
+    {
+        for (size_t i = 0; i < 2000; i++)
+        {
+            proxy.Fetch(random() % 768);
+        }
+        for (size_t i = 0; i < 1000; i++)
+        {
+            proxy.Fetch(cold++);
+        }
+    }
+    std::cout << name << ": hit rate " << proxy.Stats().HitRate() << ", service calls " << backend.Calls() << "\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    const size_t fetches = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    const size_t threads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4;
+    const size_t distinct = 100000;
+
+    std::cout << "Fetches: " << fetches << ", threads: " << threads << ", cores: " << std::thread::hardware_concurrency() << "\n";
+
+    std::vector<std::vector<uint64_t> > keys;
+    for (size_t t = 0; t < threads; t++)
+    {
+        keys.push_back(SkewedKeys(fetches / threads, distinct, static_cast<uint32_t>(t)));
+    }
+
+    // The service alone, on a fraction of the fetches
+    {
+        Backend backend(Compute, std::chrono::microseconds(20));
+        std::vector<std::vector<uint64_t> > few;
+        for (const std::vector<uint64_t>& thread : keys)
+        {
+            few.emplace_back(thread.begin(), thread.begin() + thread.size() / 20);
+        }
+        double seconds = Seconds(threads, [&](size_t t)
+        {
+            for (uint64_t key : few[t])
+            {
+                backend.Fetch(key);
+            }
+        });
+        std::cout << "  service  : " << (seconds * 1e9 / (threads * few[0].size())) << " ns/fetch, service calls " << backend.Calls() << "\n";
+    }
+
+    Skewed("  proxy LRU", threads, keys, {.m_capacity = distinct / 10, .m_eviction = CacheEviction::LRU});
+    Skewed("  proxy ARC", threads, keys, {.m_capacity = distinct / 10, .m_eviction = CacheEviction::ARC});
+
+    Scan("  scan LRU ", CacheEviction::LRU);
+    Scan("  scan ARC ", CacheEviction::ARC);
+
+    // Every thread misses the same key at once
+    {
+        Backend backend(Compute, std::chrono::milliseconds(50));
+        Proxy proxy(backend);
+        Seconds(threads * 4, [&](size_t) { proxy.Fetch(42); });
+        std::cout << "  stampede : " << threads * 4 << " concurrent misses, service calls " << backend.Calls() << "\n";
+    }
+    return 0;
+}